@@ -0,0 +1,603 @@
+/* The MIT License (MIT)
+ * Copyright (c) 2016 Peter Goldsborough
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* x86 builds carry AVX2/POPCNT kernels that are picked at runtime */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BIT_VECTOR_X86
+#include <immintrin.h>
+#endif
+
+#include "bit_vector.h"
+
+/***** PRIVATE *****/
+
+typedef enum {
+	_BIT_VECTOR_AND,
+	_BIT_VECTOR_OR,
+	_BIT_VECTOR_XOR,
+	_BIT_VECTOR_ANDNOT
+} _BitVectorOp;
+
+size_t _bit_vector_words_for(size_t bits)
+{
+	return (bits + BIT_VECTOR_WORD_BITS - 1) / BIT_VECTOR_WORD_BITS;
+}
+
+/* The lowest `bits` bits set, for bits < 64 */
+uint64_t _bit_vector_low_mask(size_t bits)
+{
+	return ((uint64_t)1 << bits) - 1;
+}
+
+int _bit_vector_popcount(uint64_t word)
+{
+#ifdef __GNUC__
+	return __builtin_popcountll(word);
+#else
+	word = word - ((word >> 1) & 0x5555555555555555ULL);
+	word = (word & 0x3333333333333333ULL) + ((word >> 2) & 0x3333333333333333ULL);
+	word = (word + (word >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+	return (int)((word * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+/* Index of the lowest set bit of a non-zero word */
+size_t _bit_vector_lowest(uint64_t word)
+{
+	assert(word != 0);
+#ifdef __GNUC__
+	return (size_t)__builtin_ctzll(word);
+#else
+	size_t index = 0;
+	while ((word & 1) == 0) word >>= 1, ++index;
+	return index;
+#endif
+}
+
+/* Keeps the bits past `size` in the last word at zero */
+void _bit_vector_clear_tail(BitVector *v)
+{
+	if (v->size % BIT_VECTOR_WORD_BITS != 0) {
+		v->words[v->size / BIT_VECTOR_WORD_BITS] &=
+      _bit_vector_low_mask(v->size % BIT_VECTOR_WORD_BITS);
+	}
+}
+
+int _bit_vector_reallocate(BitVector *v, size_t new_capacity)
+{
+	size_t words = MAX(1, _bit_vector_words_for(new_capacity));
+	uint64_t *data;
+
+	data = realloc(v->words, words * sizeof(uint64_t));
+	if (data == NULL) return VECTOR_ERROR;
+
+	v->words = data;
+	v->capacity = words * BIT_VECTOR_WORD_BITS;
+
+	return VECTOR_SUCCESS;
+}
+
+int _bit_vector_grow(BitVector *v)
+{
+	if (v->size < v->capacity) return VECTOR_SUCCESS;
+
+	return _bit_vector_reallocate(v,
+      MAX(BIT_VECTOR_WORD_BITS, v->capacity * VECTOR_GROWTH_FACTOR));
+}
+
+/* Kernels */
+
+size_t _bit_vector_count_generic(const uint64_t *words, size_t count)
+{
+	size_t i, total = 0;
+
+	for (i = 0; i < count; ++i) total += _bit_vector_popcount(words[i]);
+
+	return total;
+}
+
+size_t _bit_vector_next_nonzero_generic(const uint64_t *words,
+                                        size_t first,
+                                        size_t count)
+{
+	while (first < count && words[first] == 0) ++first;
+	return first;
+}
+
+void _bit_vector_apply_generic(uint64_t *dest,
+                               const uint64_t *src,
+                               size_t count,
+                               _BitVectorOp op)
+{
+	size_t i;
+
+	switch (op) {
+		case _BIT_VECTOR_AND:
+			for (i = 0; i < count; ++i) dest[i] &= src[i];
+			break;
+		case _BIT_VECTOR_OR:
+			for (i = 0; i < count; ++i) dest[i] |= src[i];
+			break;
+		case _BIT_VECTOR_XOR:
+			for (i = 0; i < count; ++i) dest[i] ^= src[i];
+			break;
+		case _BIT_VECTOR_ANDNOT:
+			for (i = 0; i < count; ++i) dest[i] &= ~src[i];
+			break;
+	}
+}
+
+#ifdef BIT_VECTOR_X86
+
+__attribute__((target("popcnt")))
+size_t _bit_vector_count_popcnt(const uint64_t *words, size_t count)
+{
+	size_t i, total = 0;
+
+	for (i = 0; i < count; ++i) total += (size_t)__builtin_popcountll(words[i]);
+
+	return total;
+}
+
+/* Nibble lookup popcount (Mula) over 256-bit blocks */
+__attribute__((target("avx2,popcnt")))
+size_t _bit_vector_count_avx2(const uint64_t *words, size_t count)
+{
+	const __m256i lookup = _mm256_setr_epi8(
+      0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+      0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	const __m256i low_mask = _mm256_set1_epi8(0x0f);
+	__m256i block, low, high, bytes, sums = _mm256_setzero_si256();
+	uint64_t lanes[4];
+	size_t i, total;
+
+	for (i = 0; i + 4 <= count; i += 4) {
+		block = _mm256_loadu_si256((const __m256i*)(words + i));
+		low = _mm256_and_si256(block, low_mask);
+		high = _mm256_and_si256(_mm256_srli_epi16(block, 4), low_mask);
+		bytes = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, low),
+														_mm256_shuffle_epi8(lookup, high));
+		sums = _mm256_add_epi64(sums,
+														_mm256_sad_epu8(bytes, _mm256_setzero_si256()));
+	}
+
+	_mm256_storeu_si256((__m256i*)lanes, sums);
+	total = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+
+	for (; i < count; ++i) total += (size_t)__builtin_popcountll(words[i]);
+
+	return total;
+}
+
+__attribute__((target("avx2")))
+size_t _bit_vector_next_nonzero_avx2(const uint64_t *words,
+                                     size_t first,
+                                     size_t count)
+{
+	__m256i block;
+
+	/* Skip empty stretches four words at a time */
+	for (; first + 4 <= count; first += 4) {
+		block = _mm256_loadu_si256((const __m256i*)(words + first));
+		if (!_mm256_testz_si256(block, block)) break;
+	}
+
+	while (first < count && words[first] == 0) ++first;
+
+	return first;
+}
+
+__attribute__((target("avx2")))
+void _bit_vector_apply_avx2(uint64_t *dest,
+                            const uint64_t *src,
+                            size_t count,
+                            _BitVectorOp op)
+{
+	__m256i a, b;
+	size_t i = 0;
+
+#define BIT_VECTOR_AVX2_LOOP(result)                          \
+	for (; i + 4 <= count; i += 4) {                            \
+		a = _mm256_loadu_si256((const __m256i*)(dest + i));       \
+		b = _mm256_loadu_si256((const __m256i*)(src + i));        \
+		_mm256_storeu_si256((__m256i*)(dest + i), (result));      \
+	}
+
+	switch (op) {
+		case _BIT_VECTOR_AND:
+			BIT_VECTOR_AVX2_LOOP(_mm256_and_si256(a, b));
+			break;
+		case _BIT_VECTOR_OR:
+			BIT_VECTOR_AVX2_LOOP(_mm256_or_si256(a, b));
+			break;
+		case _BIT_VECTOR_XOR:
+			BIT_VECTOR_AVX2_LOOP(_mm256_xor_si256(a, b));
+			break;
+		case _BIT_VECTOR_ANDNOT:
+			/* _mm256_andnot_si256 negates its first operand */
+			BIT_VECTOR_AVX2_LOOP(_mm256_andnot_si256(b, a));
+			break;
+	}
+
+#undef BIT_VECTOR_AVX2_LOOP
+
+	_bit_vector_apply_generic(dest + i, src + i, count - i, op);
+}
+
+#endif /* BIT_VECTOR_X86 */
+
+size_t _bit_vector_count_words(const uint64_t *words, size_t count)
+{
+#ifdef BIT_VECTOR_X86
+	if (__builtin_cpu_supports("avx2")) {
+		return _bit_vector_count_avx2(words, count);
+	}
+	if (__builtin_cpu_supports("popcnt")) {
+		return _bit_vector_count_popcnt(words, count);
+	}
+#endif
+	return _bit_vector_count_generic(words, count);
+}
+
+size_t _bit_vector_next_nonzero(const uint64_t *words,
+                                size_t first,
+                                size_t count)
+{
+#ifdef BIT_VECTOR_X86
+	if (__builtin_cpu_supports("avx2")) {
+		return _bit_vector_next_nonzero_avx2(words, first, count);
+	}
+#endif
+	return _bit_vector_next_nonzero_generic(words, first, count);
+}
+
+int _bit_vector_apply(BitVector *dest, const BitVector *src, _BitVectorOp op)
+{
+	assert(dest != NULL);
+	assert(src != NULL);
+	assert(dest->size == src->size);
+
+	if (dest == NULL) return VECTOR_ERROR;
+	if (src == NULL) return VECTOR_ERROR;
+	if (dest->size != src->size) return VECTOR_ERROR;
+
+#ifdef BIT_VECTOR_X86
+	if (__builtin_cpu_supports("avx2")) {
+		_bit_vector_apply_avx2(dest->words,
+													 src->words,
+													 _bit_vector_words_for(dest->size),
+													 op);
+		return VECTOR_SUCCESS;
+	}
+#endif
+
+	_bit_vector_apply_generic(dest->words,
+														src->words,
+														_bit_vector_words_for(dest->size),
+														op);
+
+	return VECTOR_SUCCESS;
+}
+
+/* First set bit at or after `first` */
+size_t _bit_vector_find_from(const BitVector *v, size_t first)
+{
+	size_t word_index, words = _bit_vector_words_for(v->size);
+	uint64_t word;
+
+	if (first >= v->size) return BIT_VECTOR_NOT_FOUND;
+
+	word_index = first / BIT_VECTOR_WORD_BITS;
+	word = v->words[word_index] &
+    ~_bit_vector_low_mask(first % BIT_VECTOR_WORD_BITS);
+
+	if (word == 0) {
+		word_index = _bit_vector_next_nonzero(v->words, word_index + 1, words);
+		if (word_index == words) return BIT_VECTOR_NOT_FOUND;
+		word = v->words[word_index];
+	}
+
+	/* The tail past `size` is zero, so this is always in range */
+	return word_index * BIT_VECTOR_WORD_BITS + _bit_vector_lowest(word);
+}
+
+
+/***** METHODS *****/
+
+int bit_vector_setup(BitVector* v, size_t capacity)
+{
+	assert(v != NULL);
+
+	if (v == NULL) return VECTOR_ERROR;
+
+	v->words = NULL;
+	v->size = 0;
+	v->capacity = 0;
+
+	return _bit_vector_reallocate(v, MAX(BIT_VECTOR_WORD_BITS, capacity));
+}
+
+int bit_vector_destroy(BitVector* v)
+{
+	assert(v != NULL);
+
+	if (v == NULL) return VECTOR_ERROR;
+
+	free(v->words);
+	v->words = NULL;
+	v->size = 0;
+	v->capacity = 0;
+
+	return VECTOR_SUCCESS;
+}
+
+/* Insertion */
+
+int bit_vector_push_back(BitVector* v, bool value)
+{
+	assert(v != NULL);
+	assert(v->words != NULL);
+
+	if (_bit_vector_grow(v) == VECTOR_ERROR) return VECTOR_ERROR;
+
+	/* Start a fresh word */
+	if (v->size % BIT_VECTOR_WORD_BITS == 0) {
+		v->words[v->size / BIT_VECTOR_WORD_BITS] = 0;
+	}
+
+	v->words[v->size / BIT_VECTOR_WORD_BITS] |=
+    (uint64_t)value << (v->size % BIT_VECTOR_WORD_BITS);
+	++v->size;
+
+	return VECTOR_SUCCESS;
+}
+
+int bit_vector_insert(BitVector* v, size_t index, bool value)
+{
+	size_t word_index, bit, last, k;
+	uint64_t word, mask;
+
+	assert(v != NULL);
+	assert(v->words != NULL);
+	assert(index <= v->size);
+
+	if (v == NULL) return VECTOR_ERROR;
+	if (v->words == NULL) return VECTOR_ERROR;
+	if (index > v->size) return VECTOR_ERROR;
+
+	if (_bit_vector_grow(v) == VECTOR_ERROR) return VECTOR_ERROR;
+
+	if (v->size % BIT_VECTOR_WORD_BITS == 0) {
+		v->words[v->size / BIT_VECTOR_WORD_BITS] = 0;
+	}
+
+	word_index = index / BIT_VECTOR_WORD_BITS;
+	bit = index % BIT_VECTOR_WORD_BITS;
+	last = v->size / BIT_VECTOR_WORD_BITS;
+
+	/* Shift whole words right by one bit, carrying the top bit across */
+	for (k = last; k > word_index; --k) {
+		v->words[k] = (v->words[k] << 1) | (v->words[k - 1] >> 63);
+	}
+
+	word = v->words[word_index];
+	mask = _bit_vector_low_mask(bit);
+	v->words[word_index] = (word & mask) | ((word & ~mask) << 1) |
+    ((uint64_t)value << bit);
+
+	++v->size;
+
+	return VECTOR_SUCCESS;
+}
+
+int bit_vector_set(BitVector* v, size_t index, bool value)
+{
+	uint64_t *word, bit;
+
+	assert(v != NULL);
+	assert(index < v->size);
+
+	if (v == NULL) return VECTOR_ERROR;
+	if (index >= v->size) return VECTOR_ERROR;
+
+	word = &v->words[index / BIT_VECTOR_WORD_BITS];
+	bit = (uint64_t)1 << (index % BIT_VECTOR_WORD_BITS);
+	*word = value ? (*word | bit) : (*word & ~bit);
+
+	return VECTOR_SUCCESS;
+}
+
+/* Deletion */
+
+int bit_vector_pop_back(BitVector* v)
+{
+	assert(v != NULL);
+	assert(v->size > 0);
+
+	if (v == NULL) return VECTOR_ERROR;
+	if (v->size == 0) return VECTOR_ERROR;
+
+	--v->size;
+	_bit_vector_clear_tail(v);
+
+	return VECTOR_SUCCESS;
+}
+
+int bit_vector_erase(BitVector* v, size_t index)
+{
+	size_t word_index, bit, last, k;
+	uint64_t word, mask;
+
+	assert(v != NULL);
+	assert(index < v->size);
+
+	if (v == NULL) return VECTOR_ERROR;
+	if (index >= v->size) return VECTOR_ERROR;
+
+	word_index = index / BIT_VECTOR_WORD_BITS;
+	bit = index % BIT_VECTOR_WORD_BITS;
+	last = (v->size - 1) / BIT_VECTOR_WORD_BITS;
+
+	word = v->words[word_index];
+	mask = _bit_vector_low_mask(bit);
+	v->words[word_index] = (word & mask) | ((word >> 1) & ~mask);
+
+	/* Shift the following words left by one bit, carrying the low bit back */
+	for (k = word_index; k < last; ++k) {
+		v->words[k] |= v->words[k + 1] << 63;
+		v->words[k + 1] >>= 1;
+	}
+
+	--v->size;
+	_bit_vector_clear_tail(v);
+
+	return VECTOR_SUCCESS;
+}
+
+int bit_vector_clear(BitVector* v)
+{
+	return bit_vector_resize(v, 0);
+}
+
+/* Lookup */
+
+bool bit_vector_get(const BitVector* v, size_t index)
+{
+	assert(v != NULL);
+	assert(index < v->size);
+
+	if (v == NULL) return false;
+	if (index >= v->size) return false;
+
+	return (v->words[index / BIT_VECTOR_WORD_BITS] >>
+          (index % BIT_VECTOR_WORD_BITS)) & 1;
+}
+
+/* Information */
+
+size_t bit_vector_size(const BitVector* v)
+{
+	assert(v != NULL);
+	return v->size;
+}
+
+size_t bit_vector_capacity(const BitVector* v)
+{
+	assert(v != NULL);
+	return v->capacity;
+}
+
+size_t bit_vector_word_count(const BitVector* v)
+{
+	assert(v != NULL);
+	return _bit_vector_words_for(v->size);
+}
+
+/* Memory management */
+
+int bit_vector_resize(BitVector* v, size_t new_size)
+{
+	size_t old_words, new_words;
+
+	assert(v != NULL);
+
+	if (v == NULL) return VECTOR_ERROR;
+
+	if (new_size > v->capacity) {
+		if (_bit_vector_reallocate(v, new_size) == VECTOR_ERROR) {
+			return VECTOR_ERROR;
+		}
+	}
+
+	old_words = _bit_vector_words_for(v->size);
+	new_words = _bit_vector_words_for(new_size);
+
+	/* The tail of the old last word is already clear */
+	if (new_words > old_words) {
+		memset(v->words + old_words, 0, (new_words - old_words) * sizeof(uint64_t));
+	}
+
+	v->size = new_size;
+	_bit_vector_clear_tail(v);
+
+	return VECTOR_SUCCESS;
+}
+
+int bit_vector_reserve(BitVector* v, size_t minimum_capacity)
+{
+	assert(v != NULL);
+
+	if (v == NULL) return VECTOR_ERROR;
+
+	if (minimum_capacity > v->capacity) {
+		return _bit_vector_reallocate(v, minimum_capacity);
+	}
+
+	return VECTOR_SUCCESS;
+}
+
+/* Search */
+
+size_t bit_vector_count(const BitVector* v)
+{
+	assert(v != NULL);
+	return _bit_vector_count_words(v->words, _bit_vector_words_for(v->size));
+}
+
+size_t bit_vector_find_first(const BitVector* v)
+{
+	assert(v != NULL);
+	return _bit_vector_find_from(v, 0);
+}
+
+size_t bit_vector_find_next(const BitVector* v, size_t index)
+{
+	assert(v != NULL);
+
+	if (index >= v->size) return BIT_VECTOR_NOT_FOUND;
+
+	return _bit_vector_find_from(v, index + 1);
+}
+
+/* Bulk operations */
+
+int bit_vector_and(BitVector* destination, const BitVector* source)
+{
+	return _bit_vector_apply(destination, source, _BIT_VECTOR_AND);
+}
+
+int bit_vector_or(BitVector* destination, const BitVector* source)
+{
+	return _bit_vector_apply(destination, source, _BIT_VECTOR_OR);
+}
+
+int bit_vector_xor(BitVector* destination, const BitVector* source)
+{
+	return _bit_vector_apply(destination, source, _BIT_VECTOR_XOR);
+}
+
+int bit_vector_andnot(BitVector* destination, const BitVector* source)
+{
+	return _bit_vector_apply(destination, source, _BIT_VECTOR_ANDNOT);
+}
@@ -0,0 +1,96 @@
+/* The MIT License (MIT)
+ * Copyright (c) 2016 Peter Goldsborough
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#ifndef BIT_VECTOR_H
+#define BIT_VECTOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vector.h"
+
+/***** DEFINITIONS *****/
+
+#define BIT_VECTOR_WORD_BITS 64
+
+/* Returned by the find methods when there is no further set bit */
+#define BIT_VECTOR_NOT_FOUND ((size_t)-1)
+
+#define BIT_VECTOR_INITIALIZER { NULL, 0, 0 }
+
+
+/***** STRUCTURES *****/
+
+/* Bits packed into 64-bit words, least significant bit first. Bits past
+ * `size` in the last word are always zero. */
+typedef struct
+{
+  uint64_t *words;
+  size_t size;
+  size_t capacity;
+} BitVector;
+
+
+/***** METHODS *****/
+
+/* Constructor */
+int bit_vector_setup(BitVector* vector, size_t capacity);
+
+/* Destructor */
+int bit_vector_destroy(BitVector* vector);
+
+/* Insertion */
+int bit_vector_push_back(BitVector* vector, bool value);
+int bit_vector_insert(BitVector* vector, size_t index, bool value);
+int bit_vector_set(BitVector* vector, size_t index, bool value);
+
+/* Deletion */
+int bit_vector_pop_back(BitVector* vector);
+int bit_vector_erase(BitVector* vector, size_t index);
+int bit_vector_clear(BitVector* vector);
+
+/* Lookup */
+bool bit_vector_get(const BitVector* vector, size_t index);
+
+/* Information */
+size_t bit_vector_size(const BitVector* vector);
+size_t bit_vector_capacity(const BitVector* vector);
+size_t bit_vector_word_count(const BitVector* vector);
+
+/* Memory management
+ * Bits added by resizing are cleared. */
+int bit_vector_resize(BitVector* vector, size_t new_size);
+int bit_vector_reserve(BitVector* vector, size_t minimum_capacity);
+
+/* Search */
+size_t bit_vector_count(const BitVector* vector);
+size_t bit_vector_find_first(const BitVector* vector);
+size_t bit_vector_find_next(const BitVector* vector, size_t index);
+
+/* Bulk operations
+ * Combine `source` into `destination` word by word; both must have the same
+ * size. */
+int bit_vector_and(BitVector* destination, const BitVector* source);
+int bit_vector_or(BitVector* destination, const BitVector* source);
+int bit_vector_xor(BitVector* destination, const BitVector* source);
+int bit_vector_andnot(BitVector* destination, const BitVector* source);
+
+#endif /* BIT_VECTOR_H */
@@ -0,0 +1,515 @@
+/* The MIT License (MIT)
+ * Copyright (c) 2016 Peter Goldsborough
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "compressed_vector.h"
+
+/***** DEFINITIONS *****/
+
+/* Zeroed slack after every encoded block, so the reader can always load a
+ * whole word without checking for the end of the buffer */
+#define COMPRESSED_VECTOR_PADDING 16
+
+#define COMPRESSED_VECTOR_NOT_CACHED ((size_t)-1)
+
+
+/***** PRIVATE *****/
+
+/* Bit streams, least significant bit first */
+
+typedef struct {
+	unsigned char *data;
+	size_t bytes;
+	uint64_t accumulator;
+	unsigned filled;
+} _CvWriter;
+
+typedef struct {
+	const unsigned char *data;
+	size_t position;
+} _CvReader;
+
+static inline unsigned _cv_leading_zeros(uint64_t x)
+{
+	assert(x != 0);
+#ifdef __GNUC__
+	return (unsigned)__builtin_clzll(x);
+#else
+	unsigned count = 0;
+	while (!(x & ((uint64_t)1 << 63))) x <<= 1, ++count;
+	return count;
+#endif
+}
+
+static inline unsigned _cv_trailing_zeros(uint64_t x)
+{
+	assert(x != 0);
+#ifdef __GNUC__
+	return (unsigned)__builtin_ctzll(x);
+#else
+	unsigned count = 0;
+	while (!(x & 1)) x >>= 1, ++count;
+	return count;
+#endif
+}
+
+static inline void _cv_write(_CvWriter *w, uint64_t value, unsigned bits)
+{
+	if (bits == 0) return;
+	if (bits < 64) value &= ((uint64_t)1 << bits) - 1;
+
+	w->accumulator |= value << w->filled;
+
+	if (w->filled + bits >= 64) {
+		memcpy(w->data + w->bytes, &w->accumulator, sizeof(uint64_t));
+		w->bytes += sizeof(uint64_t);
+		/* The bits that did not fit */
+		w->accumulator = w->filled == 0 ? 0 : value >> (64 - w->filled);
+		w->filled = w->filled + bits - 64;
+	} else {
+		w->filled += bits;
+	}
+}
+
+size_t _cv_flush(_CvWriter *w)
+{
+	memcpy(w->data + w->bytes, &w->accumulator, sizeof(uint64_t));
+	w->bytes += (w->filled + 7) / 8;
+	w->accumulator = 0;
+	w->filled = 0;
+
+	return w->bytes;
+}
+
+static inline uint64_t _cv_read(_CvReader *r, unsigned bits)
+{
+	size_t byte = r->position / 8;
+	unsigned offset = r->position % 8;
+	uint64_t word, value;
+
+	memcpy(&word, r->data + byte, sizeof(uint64_t));
+	value = word >> offset;
+
+	/* A single load holds at least 57 bits past the offset */
+	if (bits + offset > 64) {
+		value |= (uint64_t)r->data[byte + 8] << (64 - offset);
+	}
+
+	if (bits < 64) value &= ((uint64_t)1 << bits) - 1;
+	r->position += bits;
+
+	return value;
+}
+
+/* Gorilla XOR encoding */
+
+size_t _cv_encode_doubles(const uint64_t *values,
+                          size_t count,
+                          unsigned char *out)
+{
+	_CvWriter w = { out, 0, 0, 0 };
+	unsigned leading, trailing, length;
+	unsigned window_leading = 64, window_trailing = 0;
+	uint64_t x;
+	size_t i;
+
+	_cv_write(&w, values[0], 64);
+
+	for (i = 1; i < count; ++i) {
+		x = values[i] ^ values[i - 1];
+		if (x == 0) {
+			_cv_write(&w, 0, 1);
+			continue;
+		}
+
+		_cv_write(&w, 1, 1);
+		leading = _cv_leading_zeros(x);
+		trailing = _cv_trailing_zeros(x);
+
+		if (window_leading != 64 &&
+				leading >= window_leading &&
+				trailing >= window_trailing) {
+			/* The meaningful bits fit the previous window */
+			_cv_write(&w, 0, 1);
+			_cv_write(&w,
+								x >> window_trailing,
+								64 - window_leading - window_trailing);
+		} else {
+			length = 64 - leading - trailing;
+			_cv_write(&w, 1, 1);
+			_cv_write(&w, leading, 6);
+			_cv_write(&w, length - 1, 6);
+			_cv_write(&w, x >> trailing, length);
+			window_leading = leading;
+			window_trailing = trailing;
+		}
+	}
+
+	return _cv_flush(&w);
+}
+
+void _cv_decode_doubles(const unsigned char *in, size_t count, uint64_t *out)
+{
+	_CvReader r = { in, 0 };
+	unsigned leading = 0, trailing = 0, length = 0;
+	uint64_t previous;
+	size_t i;
+
+	previous = _cv_read(&r, 64);
+	out[0] = previous;
+
+	for (i = 1; i < count; ++i) {
+		if (_cv_read(&r, 1) != 0) {
+			if (_cv_read(&r, 1) != 0) {
+				leading = (unsigned)_cv_read(&r, 6);
+				length = (unsigned)_cv_read(&r, 6) + 1;
+				trailing = 64 - leading - length;
+			}
+			previous ^= _cv_read(&r, length) << trailing;
+		}
+		out[i] = previous;
+	}
+}
+
+/* Delta + zigzag + bit-packing */
+
+static inline uint64_t _cv_zigzag(uint64_t delta)
+{
+	return (delta << 1) ^ (uint64_t)((int64_t)delta >> 63);
+}
+
+static inline uint64_t _cv_unzigzag(uint64_t value)
+{
+	return (value >> 1) ^ (~(value & 1) + 1);
+}
+
+size_t _cv_encode_int64s(const uint64_t *values,
+                         size_t count,
+                         unsigned char *out)
+{
+	_CvWriter w = { out, 0, 0, 0 };
+	uint64_t all = 0;
+	unsigned width;
+	size_t i;
+
+	for (i = 1; i < count; ++i) {
+		all |= _cv_zigzag(values[i] - values[i - 1]);
+	}
+	width = all == 0 ? 0 : 64 - _cv_leading_zeros(all);
+
+	_cv_write(&w, values[0], 64);
+	_cv_write(&w, width, 7);
+
+	for (i = 1; i < count; ++i) {
+		_cv_write(&w, _cv_zigzag(values[i] - values[i - 1]), width);
+	}
+
+	return _cv_flush(&w);
+}
+
+void _cv_decode_int64s(const unsigned char *in, size_t count, uint64_t *out)
+{
+	_CvReader r = { in, 0 };
+	uint64_t previous;
+	unsigned width;
+	size_t i;
+
+	previous = _cv_read(&r, 64);
+	width = (unsigned)_cv_read(&r, 7);
+	out[0] = previous;
+
+	for (i = 1; i < count; ++i) {
+		previous += _cv_unzigzag(_cv_read(&r, width));
+		out[i] = previous;
+	}
+}
+
+/* Blocks */
+
+size_t _cv_tail_size(const CompressedVector *cv)
+{
+	return cv->size - cv->block_count * COMPRESSED_VECTOR_BLOCK_SIZE;
+}
+
+void _cv_decode_block(const CompressedVector *cv, size_t block, uint64_t *out)
+{
+	assert(block < cv->block_count);
+
+	if (cv->kind == COMPRESSED_DOUBLE) {
+		_cv_decode_doubles(cv->blocks[block].data,
+											 COMPRESSED_VECTOR_BLOCK_SIZE,
+											 out);
+	} else {
+		_cv_decode_int64s(cv->blocks[block].data,
+											COMPRESSED_VECTOR_BLOCK_SIZE,
+											out);
+	}
+}
+
+/* Compresses the full tail into a new block */
+int _cv_seal(CompressedVector *cv)
+{
+	CompressedBlock *blocks;
+	unsigned char *data, *shrunk;
+	size_t capacity, bytes;
+
+	assert(_cv_tail_size(cv) == COMPRESSED_VECTOR_BLOCK_SIZE);
+
+	if (cv->block_count == cv->block_capacity) {
+		capacity = MAX(VECTOR_MINIMUM_CAPACITY,
+									 cv->block_capacity * VECTOR_GROWTH_FACTOR);
+		blocks = realloc(cv->blocks, capacity * sizeof(CompressedBlock));
+		if (blocks == NULL) return VECTOR_ERROR;
+		cv->blocks = blocks;
+		cv->block_capacity = capacity;
+	}
+
+	/* Worst case is 2 + 12 + 64 bits per XOR encoded double */
+	data = malloc(COMPRESSED_VECTOR_BLOCK_SIZE * 10 + COMPRESSED_VECTOR_PADDING);
+	if (data == NULL) return VECTOR_ERROR;
+
+	if (cv->kind == COMPRESSED_DOUBLE) {
+		bytes = _cv_encode_doubles(cv->tail, COMPRESSED_VECTOR_BLOCK_SIZE, data);
+	} else {
+		bytes = _cv_encode_int64s(cv->tail, COMPRESSED_VECTOR_BLOCK_SIZE, data);
+	}
+
+	memset(data + bytes, 0, COMPRESSED_VECTOR_PADDING);
+	shrunk = realloc(data, bytes + COMPRESSED_VECTOR_PADDING);
+	if (shrunk != NULL) data = shrunk;
+
+	cv->blocks[cv->block_count].data = data;
+	cv->blocks[cv->block_count].bytes = bytes;
+	++cv->block_count;
+
+	return VECTOR_SUCCESS;
+}
+
+
+/***** METHODS *****/
+
+int compressed_vector_setup(CompressedVector* cv, CompressedKind kind)
+{
+	assert(cv != NULL);
+
+	if (cv == NULL) return VECTOR_ERROR;
+
+	cv->kind = kind;
+	cv->size = 0;
+	cv->blocks = NULL;
+	cv->block_count = 0;
+	cv->block_capacity = 0;
+	cv->cache = NULL;
+	cv->cached_block = COMPRESSED_VECTOR_NOT_CACHED;
+
+	cv->tail = malloc(COMPRESSED_VECTOR_BLOCK_SIZE * sizeof(uint64_t));
+
+	return cv->tail == NULL ? VECTOR_ERROR : VECTOR_SUCCESS;
+}
+
+int compressed_vector_destroy(CompressedVector* cv)
+{
+	size_t i;
+
+	assert(cv != NULL);
+
+	if (cv == NULL) return VECTOR_ERROR;
+
+	for (i = 0; i < cv->block_count; ++i) free(cv->blocks[i].data);
+	free(cv->blocks);
+	free(cv->tail);
+	free(cv->cache);
+
+	cv->blocks = NULL;
+	cv->tail = NULL;
+	cv->cache = NULL;
+	cv->size = 0;
+	cv->block_count = 0;
+	cv->block_capacity = 0;
+
+	return VECTOR_SUCCESS;
+}
+
+/* Insertion */
+
+int compressed_vector_push_back(CompressedVector* cv, const void* element)
+{
+	assert(cv != NULL);
+	assert(cv->tail != NULL);
+	assert(element != NULL);
+
+	if (cv == NULL) return VECTOR_ERROR;
+	if (cv->tail == NULL) return VECTOR_ERROR;
+	if (element == NULL) return VECTOR_ERROR;
+
+	if (_cv_tail_size(cv) == COMPRESSED_VECTOR_BLOCK_SIZE) {
+		if (_cv_seal(cv) == VECTOR_ERROR) return VECTOR_ERROR;
+	}
+
+	memcpy(&cv->tail[_cv_tail_size(cv)], element, sizeof(uint64_t));
+	++cv->size;
+
+	return VECTOR_SUCCESS;
+}
+
+int compressed_vector_append(CompressedVector* cv, const Vector* source)
+{
+	const uint64_t *data;
+	size_t i, size;
+
+	assert(cv != NULL);
+	assert(source != NULL);
+	assert(source->tc->_vec_elem_size() == sizeof(uint64_t));
+
+	if (cv == NULL) return VECTOR_ERROR;
+	if (source == NULL) return VECTOR_ERROR;
+	if (source->tc->_vec_elem_size() != sizeof(uint64_t)) return VECTOR_ERROR;
+
+	data = vector_const_data(source);
+	size = vector_size(source);
+
+	for (i = 0; i < size; ++i) {
+		if (compressed_vector_push_back(cv, &data[i]) == VECTOR_ERROR) {
+			return VECTOR_ERROR;
+		}
+	}
+
+	return VECTOR_SUCCESS;
+}
+
+/* Lookup */
+
+int compressed_vector_get(CompressedVector* cv, size_t index, void* element)
+{
+	size_t block;
+
+	assert(cv != NULL);
+	assert(element != NULL);
+	assert(index < cv->size);
+
+	if (cv == NULL) return VECTOR_ERROR;
+	if (element == NULL) return VECTOR_ERROR;
+	if (index >= cv->size) return VECTOR_ERROR;
+
+	block = index / COMPRESSED_VECTOR_BLOCK_SIZE;
+
+	if (block == cv->block_count) {
+		memcpy(element,
+					 &cv->tail[index % COMPRESSED_VECTOR_BLOCK_SIZE],
+					 sizeof(uint64_t));
+		return VECTOR_SUCCESS;
+	}
+
+	if (cv->cached_block != block) {
+		if (cv->cache == NULL) {
+			cv->cache = malloc(COMPRESSED_VECTOR_BLOCK_SIZE * sizeof(uint64_t));
+			if (cv->cache == NULL) return VECTOR_ERROR;
+		}
+		_cv_decode_block(cv, block, cv->cache);
+		cv->cached_block = block;
+	}
+
+	memcpy(element,
+				 &cv->cache[index % COMPRESSED_VECTOR_BLOCK_SIZE],
+				 sizeof(uint64_t));
+
+	return VECTOR_SUCCESS;
+}
+
+/* Information */
+
+size_t compressed_vector_size(const CompressedVector* cv)
+{
+	assert(cv != NULL);
+	return cv->size;
+}
+
+size_t compressed_vector_byte_size(const CompressedVector* cv)
+{
+	size_t i, bytes;
+
+	assert(cv != NULL);
+
+	bytes = cv->block_capacity * sizeof(CompressedBlock) +
+    COMPRESSED_VECTOR_BLOCK_SIZE * sizeof(uint64_t);
+	if (cv->cache != NULL) {
+		bytes += COMPRESSED_VECTOR_BLOCK_SIZE * sizeof(uint64_t);
+	}
+
+	for (i = 0; i < cv->block_count; ++i) {
+		bytes += cv->blocks[i].bytes + COMPRESSED_VECTOR_PADDING;
+	}
+
+	return bytes;
+}
+
+/* Iterators */
+
+int compressed_iterator_begin(CompressedIterator* iterator,
+                              const CompressedVector* cv)
+{
+	assert(iterator != NULL);
+	assert(cv != NULL);
+
+	if (iterator == NULL) return VECTOR_ERROR;
+	if (cv == NULL) return VECTOR_ERROR;
+
+	iterator->vector = cv;
+	iterator->block = 0;
+	iterator->buffer = malloc(COMPRESSED_VECTOR_BLOCK_SIZE * sizeof(uint64_t));
+
+	return iterator->buffer == NULL ? VECTOR_ERROR : VECTOR_SUCCESS;
+}
+
+size_t compressed_iterator_next(CompressedIterator* iterator,
+                                const void** elements)
+{
+	const CompressedVector *cv;
+
+	assert(iterator != NULL);
+	assert(elements != NULL);
+
+	cv = iterator->vector;
+
+	if (iterator->block < cv->block_count) {
+		_cv_decode_block(cv, iterator->block++, iterator->buffer);
+		*elements = iterator->buffer;
+		return COMPRESSED_VECTOR_BLOCK_SIZE;
+	}
+
+	if (iterator->block == cv->block_count && _cv_tail_size(cv) > 0) {
+		++iterator->block;
+		*elements = cv->tail;
+		return _cv_tail_size(cv);
+	}
+
+	return 0;
+}
+
+void compressed_iterator_destroy(CompressedIterator* iterator)
+{
+	assert(iterator != NULL);
+
+	free(iterator->buffer);
+	iterator->buffer = NULL;
+}
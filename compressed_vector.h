@@ -0,0 +1,110 @@
+/* The MIT License (MIT)
+ * Copyright (c) 2016 Peter Goldsborough
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#ifndef COMPRESSED_VECTOR_H
+#define COMPRESSED_VECTOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vector.h"
+
+/***** DEFINITIONS *****/
+
+/* Elements per compressed block */
+#define COMPRESSED_VECTOR_BLOCK_SIZE 1024
+
+
+/***** STRUCTURES *****/
+
+/* Doubles are XOR encoded against their predecessor (Gorilla), integers are
+ * delta encoded, zigzagged and bit-packed to the widest delta of the block */
+typedef enum {
+  COMPRESSED_DOUBLE,
+  COMPRESSED_INT64
+} CompressedKind;
+
+typedef struct
+{
+  unsigned char *data;
+  size_t bytes;
+} CompressedBlock;
+
+/* An append-only vector of 8-byte elements. Full blocks of
+ * COMPRESSED_VECTOR_BLOCK_SIZE elements are sealed and compressed; the
+ * newest elements stay in an uncompressed tail. Element i lives in block
+ * i / COMPRESSED_VECTOR_BLOCK_SIZE, so random access decodes one block. */
+typedef struct
+{
+  CompressedKind kind;
+  size_t size;
+
+  CompressedBlock *blocks;
+  size_t block_count;
+  size_t block_capacity;
+
+  uint64_t *tail;
+
+  /* The most recently decoded block, for random access */
+  uint64_t *cache;
+  size_t cached_block;
+} CompressedVector;
+
+/* Decodes one block at a time for sequential scans */
+typedef struct
+{
+  const CompressedVector *vector;
+  size_t block;
+  uint64_t *buffer;
+} CompressedIterator;
+
+
+/***** METHODS *****/
+
+/* Constructor */
+int compressed_vector_setup(CompressedVector* vector, CompressedKind kind);
+
+/* Destructor */
+int compressed_vector_destroy(CompressedVector* vector);
+
+/* Insertion
+ * Elements are a double or an int64_t, depending on the kind. */
+int compressed_vector_push_back(CompressedVector* vector, const void* element);
+int compressed_vector_append(CompressedVector* vector, const Vector* source);
+
+/* Lookup */
+int compressed_vector_get(CompressedVector* vector,
+                          size_t index,
+                          void* element);
+
+/* Information */
+size_t compressed_vector_size(const CompressedVector* vector);
+size_t compressed_vector_byte_size(const CompressedVector* vector);
+
+/* Iterators
+ * compressed_iterator_next points `elements` at the next run of decoded
+ * elements and returns its length, or 0 once the vector is exhausted. */
+int compressed_iterator_begin(CompressedIterator* iterator,
+                              const CompressedVector* vector);
+size_t compressed_iterator_next(CompressedIterator* iterator,
+                                const void** elements);
+void compressed_iterator_destroy(CompressedIterator* iterator);
+
+#endif /* COMPRESSED_VECTOR_H */
@@ -0,0 +1,468 @@
+/* The MIT License (MIT)
+ * Copyright (c) 2016 Peter Goldsborough
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "flat_map.h"
+#include "vector_private.h"
+
+/***** PRIVATE *****/
+
+bool _flat_map_is_set(const FlatMap *map)
+{
+	return map->values.self == NULL;
+}
+
+size_t _flat_map_key_size(const FlatMap *map)
+{
+	return map->keys.tc->_vec_elem_size();
+}
+
+size_t _flat_map_value_size(const FlatMap *map)
+{
+	return _flat_map_is_set(map) ? 0 : map->values.tc->_vec_elem_size();
+}
+
+/* Index of the first key not less than `key` */
+size_t _flat_map_lower_bound(const FlatMap *map, const void *key)
+{
+	const char *keys = vector_const_data(&map->keys);
+	size_t key_size = _flat_map_key_size(map);
+	size_t first = 0, count = vector_size(&map->keys), step;
+
+	while (count > 0) {
+		step = count / 2;
+		if (map->compare(keys + (first + step) * key_size, key) < 0) {
+			first += step + 1;
+			count -= step + 1;
+		} else {
+			count = step;
+		}
+	}
+
+	return first;
+}
+
+bool _flat_map_find(const FlatMap *map, const void *key, size_t *index)
+{
+	const char *keys = vector_const_data(&map->keys);
+
+	*index = _flat_map_lower_bound(map, key);
+
+	return *index < vector_size(&map->keys) &&
+    map->compare(keys + *index * _flat_map_key_size(map), key) == 0;
+}
+
+/* Stable bottom-up merge sort of the indices of `keys`, so that equal keys
+ * keep their insertion order. `scratch` holds `count` indices. */
+void _flat_map_sort(size_t *order,
+                    size_t *scratch,
+                    size_t count,
+                    const char *keys,
+                    size_t key_size,
+                    VectorCompare compare)
+{
+	size_t *from = order, *to = scratch, *tmp;
+	size_t width, first, middle, last, i, j, k;
+	bool sorted = true;
+
+	for (i = 0; i < count; ++i) {
+		order[i] = i;
+		if (i > 0 && compare(keys + (i - 1) * key_size, keys + i * key_size) > 0) {
+			sorted = false;
+		}
+	}
+
+	/* Batches often arrive sorted already */
+	if (sorted) return;
+
+	for (width = 1; width < count; width *= 2) {
+		for (first = 0; first < count; first += 2 * width) {
+			middle = MIN(first + width, count);
+			last = MIN(first + 2 * width, count);
+
+			i = first, j = middle, k = first;
+			while (i < middle && j < last) {
+				if (compare(keys + from[j] * key_size, keys + from[i] * key_size) < 0) {
+					to[k++] = from[j++];
+				} else {
+					to[k++] = from[i++];
+				}
+			}
+			while (i < middle) to[k++] = from[i++];
+			while (j < last) to[k++] = from[j++];
+		}
+
+		tmp = from, from = to, to = tmp;
+	}
+
+	if (from != order) memcpy(order, from, count * sizeof(size_t));
+}
+
+int _flat_map_buffer(FlatMap *map, const void *key, const void *value)
+{
+	size_t key_size = _flat_map_key_size(map);
+	size_t value_size = _flat_map_value_size(map);
+	size_t capacity;
+	void *keys, *values;
+
+	if (map->pending_size == map->pending_capacity) {
+		capacity = MAX(VECTOR_MINIMUM_CAPACITY,
+									 map->pending_capacity * VECTOR_GROWTH_FACTOR);
+
+		keys = realloc(map->pending_keys, capacity * key_size);
+		if (keys == NULL) return VECTOR_ERROR;
+		map->pending_keys = keys;
+
+		if (!_flat_map_is_set(map)) {
+			values = realloc(map->pending_values, capacity * value_size);
+			if (values == NULL) return VECTOR_ERROR;
+			map->pending_values = values;
+		}
+
+		map->pending_capacity = capacity;
+	}
+
+	memcpy((char*)map->pending_keys + map->pending_size * key_size,
+				 key,
+				 key_size);
+	if (!_flat_map_is_set(map)) {
+		memcpy((char*)map->pending_values + map->pending_size * value_size,
+					 value,
+					 value_size);
+	}
+
+	++map->pending_size;
+
+	return VECTOR_SUCCESS;
+}
+
+
+/***** METHODS *****/
+
+int flat_map_setup(FlatMap* map,
+                   Vector* keys,
+                   Vector* values,
+                   VectorCompare compare)
+{
+	assert(map != NULL);
+	assert(keys != NULL);
+	assert(compare != NULL);
+	assert(vector_is_initialized(keys));
+	assert(vector_is_empty(keys));
+	assert(values == NULL || vector_is_initialized(values));
+	assert(values == NULL || vector_is_empty(values));
+
+	if (map == NULL) return VECTOR_ERROR;
+	if (keys == NULL) return VECTOR_ERROR;
+	if (compare == NULL) return VECTOR_ERROR;
+	if (!vector_is_initialized(keys)) return VECTOR_ERROR;
+	if (!vector_is_empty(keys)) return VECTOR_ERROR;
+	if (values != NULL) {
+		if (!vector_is_initialized(values)) return VECTOR_ERROR;
+		if (!vector_is_empty(values)) return VECTOR_ERROR;
+	}
+
+	/* Keys and values are merged and overwritten as bytes */
+	if (_vec_has_lifecycle(keys)) return VECTOR_ERROR;
+	if (values != NULL && _vec_has_lifecycle(values)) return VECTOR_ERROR;
+
+	map->keys = *keys;
+	if (values != NULL) {
+		map->values = *values;
+	} else {
+		map->values.self = NULL;
+		map->values.tc = NULL;
+	}
+	map->compare = compare;
+
+	map->buffered = false;
+	map->pending_keys = NULL;
+	map->pending_values = NULL;
+	map->pending_size = 0;
+	map->pending_capacity = 0;
+
+	return VECTOR_SUCCESS;
+}
+
+int flat_map_destroy(FlatMap* map)
+{
+	assert(map != NULL);
+
+	if (map == NULL) return VECTOR_ERROR;
+
+	free(map->pending_keys);
+	free(map->pending_values);
+	map->pending_keys = NULL;
+	map->pending_values = NULL;
+	map->pending_size = 0;
+	map->pending_capacity = 0;
+
+	if (!_flat_map_is_set(map)) {
+		if (vector_destroy(&map->values) == VECTOR_ERROR) return VECTOR_ERROR;
+	}
+
+	return vector_destroy(&map->keys);
+}
+
+/* Buffered mode */
+
+int flat_map_set_buffered(FlatMap* map, bool buffered)
+{
+	assert(map != NULL);
+
+	if (map == NULL) return VECTOR_ERROR;
+
+	if (!buffered && flat_map_flush(map) == VECTOR_ERROR) {
+		return VECTOR_ERROR;
+	}
+
+	map->buffered = buffered;
+
+	return VECTOR_SUCCESS;
+}
+
+int flat_map_flush(FlatMap* map)
+{
+	assert(map != NULL);
+
+	if (map == NULL) return VECTOR_ERROR;
+	if (map->pending_size == 0) return VECTOR_SUCCESS;
+
+	if (flat_map_insert_many(map,
+													 map->pending_keys,
+													 map->pending_values,
+													 map->pending_size) == VECTOR_ERROR) {
+		return VECTOR_ERROR;
+	}
+
+	map->pending_size = 0;
+
+	return VECTOR_SUCCESS;
+}
+
+/* Insertion */
+
+int flat_map_insert(FlatMap* map, const void* key, const void* value)
+{
+	size_t index;
+
+	assert(map != NULL);
+	assert(key != NULL);
+	assert(_flat_map_is_set(map) || value != NULL);
+
+	if (map == NULL) return VECTOR_ERROR;
+	if (key == NULL) return VECTOR_ERROR;
+	if (!_flat_map_is_set(map) && value == NULL) return VECTOR_ERROR;
+
+	if (map->buffered) return _flat_map_buffer(map, key, value);
+
+	if (_flat_map_find(map, key, &index)) {
+		if (_flat_map_is_set(map)) return VECTOR_SUCCESS;
+		return vector_assign(&map->values, index, (void*)value);
+	}
+
+	if (vector_insert(&map->keys, index, (void*)key) == VECTOR_ERROR) {
+		return VECTOR_ERROR;
+	}
+
+	if (!_flat_map_is_set(map)) {
+		if (vector_insert(&map->values, index, (void*)value) == VECTOR_ERROR) {
+			vector_erase(&map->keys, index);
+			return VECTOR_ERROR;
+		}
+	}
+
+	return VECTOR_SUCCESS;
+}
+
+int flat_map_insert_many(FlatMap* map,
+                         const void* keys,
+                         const void* values,
+                         size_t count)
+{
+	const char *batch_keys = keys, *batch_values = values, *existing;
+	size_t key_size, value_size, size, unique, duplicates, total;
+	size_t i, j, w, *order;
+	char *map_keys, *map_values = NULL;
+	int comparison;
+
+	assert(map != NULL);
+	assert(keys != NULL || count == 0);
+	assert(_flat_map_is_set(map) || values != NULL || count == 0);
+
+	if (map == NULL) return VECTOR_ERROR;
+	if (count == 0) return VECTOR_SUCCESS;
+	if (keys == NULL) return VECTOR_ERROR;
+	if (!_flat_map_is_set(map) && values == NULL) return VECTOR_ERROR;
+
+	key_size = _flat_map_key_size(map);
+	value_size = _flat_map_value_size(map);
+
+	order = malloc(2 * count * sizeof(size_t));
+	if (order == NULL) return VECTOR_ERROR;
+
+	_flat_map_sort(order, order + count, count, keys, key_size, map->compare);
+
+	/* Keep only the last of each run of equal keys */
+	unique = 0;
+	for (i = 0; i < count; ++i) {
+		if (i + 1 < count && map->compare(batch_keys + order[i] * key_size,
+																			batch_keys + order[i + 1] * key_size) == 0) {
+			continue;
+		}
+		order[unique++] = order[i];
+	}
+
+	/* Count the keys that are already present to size the result exactly */
+	size = vector_size(&map->keys);
+	existing = vector_const_data(&map->keys);
+	duplicates = 0;
+	for (i = 0, j = 0; i < size && j < unique;) {
+		comparison = map->compare(existing + i * key_size,
+															batch_keys + order[j] * key_size);
+		if (comparison < 0) {
+			++i;
+		} else if (comparison > 0) {
+			++j;
+		} else {
+			++duplicates, ++i, ++j;
+		}
+	}
+
+	total = size + unique - duplicates;
+
+	if (vector_resize(&map->keys, total) == VECTOR_ERROR) {
+		free(order);
+		return VECTOR_ERROR;
+	}
+	if (!_flat_map_is_set(map)) {
+		if (vector_resize(&map->values, total) == VECTOR_ERROR) {
+			vector_resize(&map->keys, size);
+			free(order);
+			return VECTOR_ERROR;
+		}
+		map_values = vector_data(&map->values);
+	}
+	map_keys = vector_data(&map->keys);
+
+	/* Merge from the back so every element moves at most once */
+	i = size, j = unique, w = total;
+	while (j > 0) {
+		comparison = i == 0 ? -1 : map->compare(map_keys + (i - 1) * key_size,
+																						batch_keys + order[j - 1] * key_size);
+		--w;
+		if (comparison > 0) {
+			--i;
+			memmove(map_keys + w * key_size, map_keys + i * key_size, key_size);
+			if (map_values != NULL) {
+				memmove(map_values + w * value_size,
+								map_values + i * value_size,
+								value_size);
+			}
+		} else {
+			/* The batch overrides an equal existing key */
+			if (comparison == 0) --i;
+			--j;
+			memcpy(map_keys + w * key_size,
+						 batch_keys + order[j] * key_size,
+						 key_size);
+			if (map_values != NULL) {
+				memcpy(map_values + w * value_size,
+							 batch_values + order[j] * value_size,
+							 value_size);
+			}
+		}
+	}
+
+	free(order);
+
+	return VECTOR_SUCCESS;
+}
+
+/* Deletion */
+
+int flat_map_erase(FlatMap* map, const void* key)
+{
+	size_t index;
+
+	assert(map != NULL);
+	assert(key != NULL);
+
+	if (map == NULL) return VECTOR_ERROR;
+	if (key == NULL) return VECTOR_ERROR;
+
+	if (flat_map_flush(map) == VECTOR_ERROR) return VECTOR_ERROR;
+	if (!_flat_map_find(map, key, &index)) return VECTOR_ERROR;
+
+	if (!_flat_map_is_set(map)) {
+		if (vector_erase(&map->values, index) == VECTOR_ERROR) {
+			return VECTOR_ERROR;
+		}
+	}
+
+	return vector_erase(&map->keys, index);
+}
+
+/* Lookup */
+
+void* flat_map_get(FlatMap* map, const void* key)
+{
+	size_t index;
+
+	assert(map != NULL);
+	assert(key != NULL);
+
+	if (map == NULL) return NULL;
+	if (key == NULL) return NULL;
+
+	if (flat_map_flush(map) == VECTOR_ERROR) return NULL;
+	if (!_flat_map_find(map, key, &index)) return NULL;
+
+	if (_flat_map_is_set(map)) return vector_get(&map->keys, index);
+
+	return vector_get(&map->values, index);
+}
+
+bool flat_map_contains(FlatMap* map, const void* key)
+{
+	size_t index;
+
+	assert(map != NULL);
+	assert(key != NULL);
+
+	if (map == NULL) return false;
+	if (key == NULL) return false;
+
+	if (flat_map_flush(map) == VECTOR_ERROR) return false;
+
+	return _flat_map_find(map, key, &index);
+}
+
+size_t flat_map_size(FlatMap* map)
+{
+	assert(map != NULL);
+
+	flat_map_flush(map);
+
+	return vector_size(&map->keys);
+}
@@ -0,0 +1,115 @@
+/* The MIT License (MIT)
+ * Copyright (c) 2016 Peter Goldsborough
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#ifndef FLAT_MAP_H
+#define FLAT_MAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "vector.h"
+
+/***** STRUCTURES *****/
+
+/* A sorted associative container over two parallel vectors: `keys` holds
+ * the keys in ascending order without duplicates and `values` the value at
+ * the same index. A set has no values vector (values.self == NULL). */
+typedef struct
+{
+  Vector keys;
+  Vector values;
+  VectorCompare compare;
+
+  /* Unsorted inserts waiting to be merged, used in buffered mode */
+  bool buffered;
+  void *pending_keys;
+  void *pending_values;
+  size_t pending_size;
+  size_t pending_capacity;
+} FlatMap;
+
+typedef FlatMap FlatSet;
+
+
+/***** METHODS *****/
+
+/* Constructor
+ * Takes ownership of the two (empty) vectors, whose element types give the
+ * key and value sizes. Keys and values are moved and overwritten as bytes,
+ * so element types with lifecycle hooks are refused. */
+int flat_map_setup(FlatMap* map,
+                   Vector* keys,
+                   Vector* values,
+                   VectorCompare compare);
+
+/* Destructor */
+int flat_map_destroy(FlatMap* map);
+
+/* Buffered mode
+ * Single inserts are appended to an unsorted buffer and merged in one batch
+ * on the next lookup, erase or size query. */
+int flat_map_set_buffered(FlatMap* map, bool buffered);
+int flat_map_flush(FlatMap* map);
+
+/* Insertion
+ * An existing key has its value overwritten. In a batch, the last of several
+ * equal keys wins. */
+int flat_map_insert(FlatMap* map, const void* key, const void* value);
+int flat_map_insert_many(FlatMap* map,
+                         const void* keys,
+                         const void* values,
+                         size_t count);
+
+/* Deletion */
+int flat_map_erase(FlatMap* map, const void* key);
+
+/* Lookup */
+void* flat_map_get(FlatMap* map, const void* key);
+bool flat_map_contains(FlatMap* map, const void* key);
+size_t flat_map_size(FlatMap* map);
+
+/* Sets */
+
+static inline int flat_set_setup(FlatSet* set,
+                                 Vector* keys,
+                                 VectorCompare compare)
+{
+	return flat_map_setup(set, keys, NULL, compare);
+}
+
+static inline int flat_set_insert(FlatSet* set, const void* key)
+{
+	return flat_map_insert(set, key, NULL);
+}
+
+static inline int flat_set_insert_many(FlatSet* set,
+                                       const void* keys,
+                                       size_t count)
+{
+	return flat_map_insert_many(set, keys, NULL, count);
+}
+
+#define flat_set_destroy flat_map_destroy
+#define flat_set_set_buffered flat_map_set_buffered
+#define flat_set_erase flat_map_erase
+#define flat_set_contains flat_map_contains
+#define flat_set_size flat_map_size
+
+#endif /* FLAT_MAP_H */
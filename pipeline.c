@@ -0,0 +1,494 @@
+/* The MIT License (MIT)
+ * Copyright (c) 2016 Peter Goldsborough
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pipeline.h"
+#include "vector_private.h"
+
+/***** PRIVATE *****/
+
+/* One pass of the pipeline over the source slice [first, last), with its
+ * own map buffers and take counters so that passes can run concurrently */
+typedef struct _PipelineRun {
+	const Pipeline *pipeline;
+	size_t first;
+	size_t last;
+
+	unsigned char *buffers[PIPELINE_MAX_STAGES];
+	size_t remaining[PIPELINE_MAX_STAGES];
+
+	/* Receives the elements that make it through all stages */
+	void (*sink)(struct _PipelineRun *run, const void **items, size_t count);
+	void *accumulator;
+	PipelineReduce reduce;
+	void *context;
+	Vector *destination;
+
+	int result;
+} _PipelineRun;
+
+size_t _pipeline_elem_size(const Pipeline *p)
+{
+	return p->stage_count == 0 ? p->elem_size :
+    p->stages[p->stage_count - 1].elem_size;
+}
+
+bool _pipeline_has_take(const Pipeline *p)
+{
+	size_t s;
+
+	for (s = 0; s < p->stage_count; ++s) {
+		if (p->stages[s].kind == PIPELINE_TAKE) return true;
+	}
+
+	return false;
+}
+
+int _pipeline_add_stage(Pipeline *p, PipelineStage stage)
+{
+	assert(p != NULL);
+	assert(p->stage_count < PIPELINE_MAX_STAGES);
+
+	if (p == NULL) return VECTOR_ERROR;
+	if (p->stage_count == PIPELINE_MAX_STAGES) return VECTOR_ERROR;
+
+	p->stages[p->stage_count++] = stage;
+
+	return VECTOR_SUCCESS;
+}
+
+void _pipeline_run_destroy(_PipelineRun *run)
+{
+	size_t s;
+
+	for (s = 0; s < PIPELINE_MAX_STAGES; ++s) {
+		free(run->buffers[s]);
+		run->buffers[s] = NULL;
+	}
+}
+
+int _pipeline_run_setup(_PipelineRun *run,
+                        const Pipeline *p,
+                        size_t first,
+                        size_t last)
+{
+	const PipelineStage *stage;
+	size_t s;
+
+	memset(run, 0, sizeof(_PipelineRun));
+	run->pipeline = p;
+	run->first = first;
+	run->last = last;
+	run->result = VECTOR_SUCCESS;
+
+	for (s = 0; s < p->stage_count; ++s) {
+		stage = &p->stages[s];
+		if (stage->kind == PIPELINE_MAP) {
+			run->buffers[s] = malloc(PIPELINE_CHUNK_SIZE * stage->elem_size);
+			if (run->buffers[s] == NULL) {
+				_pipeline_run_destroy(run);
+				return VECTOR_ERROR;
+			}
+		} else if (stage->kind == PIPELINE_TAKE) {
+			run->remaining[s] = stage->limit;
+		}
+	}
+
+	return VECTOR_SUCCESS;
+}
+
+/* Pushes one chunk through every stage. `items` points at the elements and
+ * is narrowed in place; returns how many are left. Sets `done` once a take
+ * stage is exhausted. */
+size_t _pipeline_chunk(_PipelineRun *run,
+                       const void **items,
+                       size_t count,
+                       bool *done)
+{
+	const Pipeline *p = run->pipeline;
+	const PipelineStage *stage;
+	unsigned char *result;
+	size_t s, i, kept;
+
+	for (s = 0; s < p->stage_count && count > 0; ++s) {
+		stage = &p->stages[s];
+		switch (stage->kind) {
+			case PIPELINE_FILTER:
+				/* Always store and advance by the verdict, so random
+				 * selectivity costs no mispredicted branches */
+				for (i = 0, kept = 0; i < count; ++i) {
+					items[kept] = items[i];
+					kept += stage->predicate(items[i], stage->context);
+				}
+				count = kept;
+				break;
+			case PIPELINE_MAP:
+				result = run->buffers[s];
+				for (i = 0; i < count; ++i, result += stage->elem_size) {
+					stage->map(result, items[i], stage->context);
+					items[i] = result;
+				}
+				break;
+			case PIPELINE_TAKE:
+				if (count >= run->remaining[s]) {
+					count = run->remaining[s];
+					*done = true;
+				}
+				run->remaining[s] -= count;
+				break;
+		}
+	}
+
+	return count;
+}
+
+void _pipeline_run(_PipelineRun *run)
+{
+	const Pipeline *p = run->pipeline;
+	const void *items[PIPELINE_CHUNK_SIZE];
+	const char *element;
+	size_t index, count, survivors, i;
+	bool done = false;
+
+	for (index = run->first;
+			 index < run->last && !done && run->result == VECTOR_SUCCESS;
+			 index += count) {
+		count = MIN(PIPELINE_CHUNK_SIZE, run->last - index);
+
+		element = (const char*)p->data + index * p->elem_size;
+		for (i = 0; i < count; ++i, element += p->elem_size) {
+			items[i] = element;
+		}
+
+		survivors = _pipeline_chunk(run, items, count, &done);
+		if (survivors > 0) run->sink(run, items, survivors);
+	}
+}
+
+void* _pipeline_thread(void *run)
+{
+	_pipeline_run(run);
+	return NULL;
+}
+
+void _pipeline_sink_reduce(_PipelineRun *run,
+                           const void **items,
+                           size_t count)
+{
+	size_t i;
+
+	for (i = 0; i < count; ++i) {
+		run->reduce(run->accumulator, items[i], run->context);
+	}
+}
+
+void _pipeline_sink_collect(_PipelineRun *run,
+                            const void **items,
+                            size_t count)
+{
+	Vector *destination = run->destination;
+	size_t i;
+
+	/* One capacity check per chunk instead of one per element */
+	if (vector_free_space(destination) < count &&
+			vector_reserve(destination,
+										 MAX(vector_size(destination) + count,
+												 vector_capacity(destination) * VECTOR_GROWTH_FACTOR)) ==
+					VECTOR_ERROR) {
+		run->result = VECTOR_ERROR;
+		return;
+	}
+
+	for (i = 0; i < count; ++i) {
+		vector_push_back_unchecked(destination, (void*)items[i]);
+	}
+}
+
+/* Splits a reduction across threads; the first slice runs on the caller */
+int _pipeline_reduce_parallel(size_t threads,
+                              _PipelineRun *runs,
+                              void *accumulator,
+                              size_t accumulator_size,
+                              PipelineCombine combine)
+{
+	pthread_t *handles;
+	bool *started;
+	unsigned char *partials;
+	size_t t;
+	int result = VECTOR_SUCCESS;
+
+	handles = malloc(threads * sizeof(pthread_t));
+	started = calloc(threads, sizeof(bool));
+	partials = malloc(threads * accumulator_size);
+	if (handles == NULL || started == NULL || partials == NULL) {
+		free(handles);
+		free(started);
+		free(partials);
+		return VECTOR_ERROR;
+	}
+
+	/* Every slice starts from the initial value */
+	for (t = 1; t < threads; ++t) {
+		memcpy(partials + t * accumulator_size, accumulator, accumulator_size);
+		runs[t].accumulator = partials + t * accumulator_size;
+	}
+	runs[0].accumulator = accumulator;
+
+	for (t = 1; t < threads; ++t) {
+		started[t] = pthread_create(&handles[t],
+																NULL,
+																_pipeline_thread,
+																&runs[t]) == 0;
+	}
+
+	_pipeline_run(&runs[0]);
+
+	for (t = 1; t < threads; ++t) {
+		if (started[t]) {
+			pthread_join(handles[t], NULL);
+		} else {
+			/* No thread to spare, so do the slice here */
+			_pipeline_run(&runs[t]);
+		}
+	}
+
+	for (t = 0; t < threads; ++t) {
+		if (runs[t].result == VECTOR_ERROR) result = VECTOR_ERROR;
+		if (t > 0) combine(accumulator, runs[t].accumulator, runs[t].context);
+	}
+
+	free(handles);
+	free(started);
+	free(partials);
+
+	return result;
+}
+
+
+/***** METHODS *****/
+
+/* Constructors */
+
+int pipeline_setup(Pipeline* p, const Vector* source)
+{
+	assert(source != NULL);
+	assert(source->self != NULL);
+
+	if (source == NULL) return VECTOR_ERROR;
+	if (source->self == NULL) return VECTOR_ERROR;
+
+	return pipeline_setup_view(p,
+														 vector_const_data(source),
+														 vector_size(source),
+														 source->tc->_vec_elem_size());
+}
+
+int pipeline_setup_view(Pipeline* p,
+                        const void* data,
+                        size_t size,
+                        size_t elem_size)
+{
+	assert(p != NULL);
+	assert(data != NULL || size == 0);
+	assert(elem_size > 0);
+
+	if (p == NULL) return VECTOR_ERROR;
+	if (data == NULL && size > 0) return VECTOR_ERROR;
+	if (elem_size == 0) return VECTOR_ERROR;
+
+	p->data = data;
+	p->size = size;
+	p->elem_size = elem_size;
+	p->stage_count = 0;
+	p->threads = 1;
+
+	return VECTOR_SUCCESS;
+}
+
+/* Stages */
+
+int pipeline_filter(Pipeline* p, PipelinePredicate predicate, void* context)
+{
+	PipelineStage stage = {PIPELINE_FILTER, NULL, NULL, NULL, 0, 0};
+
+	assert(predicate != NULL);
+	if (p == NULL || predicate == NULL) return VECTOR_ERROR;
+
+	stage.predicate = predicate;
+	stage.context = context;
+	stage.elem_size = _pipeline_elem_size(p);
+
+	return _pipeline_add_stage(p, stage);
+}
+
+int pipeline_map(Pipeline* p, PipelineMap map, size_t elem_size, void* context)
+{
+	PipelineStage stage = {PIPELINE_MAP, NULL, NULL, NULL, 0, 0};
+
+	assert(map != NULL);
+	assert(elem_size > 0);
+	if (p == NULL || map == NULL || elem_size == 0) return VECTOR_ERROR;
+
+	stage.map = map;
+	stage.context = context;
+	stage.elem_size = elem_size;
+
+	return _pipeline_add_stage(p, stage);
+}
+
+int pipeline_take(Pipeline* p, size_t count)
+{
+	PipelineStage stage = {PIPELINE_TAKE, NULL, NULL, NULL, 0, 0};
+
+	if (p == NULL) return VECTOR_ERROR;
+
+	stage.elem_size = _pipeline_elem_size(p);
+	stage.limit = count;
+
+	return _pipeline_add_stage(p, stage);
+}
+
+/* Execution */
+
+int pipeline_set_threads(Pipeline* p, size_t threads)
+{
+	assert(p != NULL);
+
+	if (p == NULL) return VECTOR_ERROR;
+
+	p->threads = MAX(1, threads);
+
+	return VECTOR_SUCCESS;
+}
+
+/* Terminal stages */
+
+int pipeline_reduce(Pipeline* p,
+                    void* accumulator,
+                    size_t accumulator_size,
+                    PipelineReduce reduce,
+                    PipelineCombine combine,
+                    void* context)
+{
+	_PipelineRun single, *runs;
+	size_t threads, t;
+	int result;
+
+	assert(p != NULL);
+	assert(accumulator != NULL);
+	assert(reduce != NULL);
+
+	if (p == NULL) return VECTOR_ERROR;
+	if (accumulator == NULL) return VECTOR_ERROR;
+	if (reduce == NULL) return VECTOR_ERROR;
+
+	/* Slices of less than a chunk are not worth a thread */
+	threads = MIN(p->threads, MAX(1, p->size / PIPELINE_CHUNK_SIZE));
+	if (combine == NULL || _pipeline_has_take(p)) threads = 1;
+
+	if (threads == 1) {
+		if (_pipeline_run_setup(&single, p, 0, p->size) == VECTOR_ERROR) {
+			return VECTOR_ERROR;
+		}
+		single.sink = _pipeline_sink_reduce;
+		single.accumulator = accumulator;
+		single.reduce = reduce;
+		single.context = context;
+
+		_pipeline_run(&single);
+		_pipeline_run_destroy(&single);
+
+		return single.result;
+	}
+
+	runs = calloc(threads, sizeof(_PipelineRun));
+	if (runs == NULL) return VECTOR_ERROR;
+
+	result = VECTOR_SUCCESS;
+	for (t = 0; t < threads; ++t) {
+		if (_pipeline_run_setup(&runs[t],
+														p,
+														p->size * t / threads,
+														p->size * (t + 1) / threads) == VECTOR_ERROR) {
+			result = VECTOR_ERROR;
+			break;
+		}
+		runs[t].sink = _pipeline_sink_reduce;
+		runs[t].reduce = reduce;
+		runs[t].context = context;
+	}
+
+	if (result == VECTOR_SUCCESS) {
+		result = _pipeline_reduce_parallel(threads,
+																			 runs,
+																			 accumulator,
+																			 accumulator_size,
+																			 combine);
+	}
+
+	for (t = 0; t < threads; ++t) {
+		_pipeline_run_destroy(&runs[t]);
+	}
+	free(runs);
+
+	return result;
+}
+
+int pipeline_collect_into(Pipeline* p, Vector* destination)
+{
+	_PipelineRun run;
+	size_t old_size;
+
+	assert(p != NULL);
+	assert(destination != NULL);
+	assert(vector_is_initialized(destination));
+	assert(destination->tc->_vec_elem_size() == _pipeline_elem_size(p));
+
+	if (p == NULL) return VECTOR_ERROR;
+	if (destination == NULL) return VECTOR_ERROR;
+	if (!vector_is_initialized(destination)) return VECTOR_ERROR;
+	if (destination->tc->_vec_elem_size() != _pipeline_elem_size(p)) {
+		return VECTOR_ERROR;
+	}
+
+	/* Elements are appended as bytes, which would share what they own */
+	if (_vec_has_lifecycle(destination)) return VECTOR_ERROR;
+
+	/* The unchecked appends below do not break sharing themselves */
+	if (vector_data(destination) == NULL) return VECTOR_ERROR;
+
+	if (_pipeline_run_setup(&run, p, 0, p->size) == VECTOR_ERROR) {
+		return VECTOR_ERROR;
+	}
+	run.sink = _pipeline_sink_collect;
+	run.destination = destination;
+
+	old_size = vector_size(destination);
+	_pipeline_run(&run);
+	_pipeline_run_destroy(&run);
+
+	vector_mark_dirty(destination, old_size, vector_size(destination) - old_size);
+
+	return run.result;
+}
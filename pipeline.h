@@ -0,0 +1,128 @@
+/* The MIT License (MIT)
+ * Copyright (c) 2016 Peter Goldsborough
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "vector.h"
+
+/***** DEFINITIONS *****/
+
+#define PIPELINE_MAX_STAGES 16
+
+/* Elements carried through all stages at once */
+#define PIPELINE_CHUNK_SIZE 256
+
+
+/***** STRUCTURES *****/
+
+typedef bool (*PipelinePredicate)(const void *element, void *context);
+typedef void (*PipelineMap)(void *result, const void *element, void *context);
+
+/* Folds an element into the accumulator. With several threads, partial
+ * accumulators are folded into one another with the combine function. */
+typedef void (*PipelineReduce)(void *accumulator,
+                               const void *element,
+                               void *context);
+typedef void (*PipelineCombine)(void *accumulator,
+                                const void *partial,
+                                void *context);
+
+typedef enum {
+  PIPELINE_FILTER,
+  PIPELINE_MAP,
+  PIPELINE_TAKE
+} PipelineStageKind;
+
+typedef struct
+{
+  PipelineStageKind kind;
+  PipelinePredicate predicate;
+  PipelineMap map;
+  void *context;
+
+  /* Size of the elements this stage produces */
+  size_t elem_size;
+
+  /* Elements a take stage lets through */
+  size_t limit;
+} PipelineStage;
+
+/* A lazy chain of stages over a vector or a plain array. Nothing runs until
+ * a terminal method (reduce or collect_into) is called, which then walks the
+ * source once, PIPELINE_CHUNK_SIZE elements at a time, through every stage.
+ * Filters only drop pointers and maps write into a chunk-sized buffer, so no
+ * intermediate vector is ever built. */
+typedef struct
+{
+  const void *data;
+  size_t size;
+  size_t elem_size;
+
+  PipelineStage stages[PIPELINE_MAX_STAGES];
+  size_t stage_count;
+
+  size_t threads;
+} Pipeline;
+
+
+/***** METHODS *****/
+
+/* Constructors
+ * The source must not change while the pipeline runs. */
+int pipeline_setup(Pipeline* pipeline, const Vector* source);
+int pipeline_setup_view(Pipeline* pipeline,
+                        const void* data,
+                        size_t size,
+                        size_t elem_size);
+
+/* Stages */
+int pipeline_filter(Pipeline* pipeline,
+                    PipelinePredicate predicate,
+                    void* context);
+int pipeline_map(Pipeline* pipeline,
+                 PipelineMap map,
+                 size_t elem_size,
+                 void* context);
+int pipeline_take(Pipeline* pipeline, size_t count);
+
+/* Execution
+ * With more than one thread, reduce splits the source into one contiguous
+ * slice per thread. Each slice starts from a copy of `accumulator`, which must
+ * therefore be the identity of `combine`, and the partial results are
+ * combined in source order. Without a combine function, with a take stage,
+ * and for collect_into, the pipeline runs on the calling thread. */
+int pipeline_set_threads(Pipeline* pipeline, size_t threads);
+
+/* Terminal stages
+ * collect_into appends the results as bytes, so it refuses a destination
+ * whose element type has lifecycle hooks. */
+int pipeline_reduce(Pipeline* pipeline,
+                    void* accumulator,
+                    size_t accumulator_size,
+                    PipelineReduce reduce,
+                    PipelineCombine combine,
+                    void* context);
+int pipeline_collect_into(Pipeline* pipeline, Vector* destination);
+
+#endif /* PIPELINE_H */
@@ -0,0 +1,371 @@
+/* The MIT License (MIT)
+ * Copyright (c) 2016 Peter Goldsborough
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rcu_vector.h"
+
+/***** PRIVATE *****/
+
+RcuBuffer* _rcu_buffer_new(size_t capacity, size_t elem_size)
+{
+	RcuBuffer *buffer;
+
+	capacity = MAX(VECTOR_MINIMUM_CAPACITY, capacity);
+
+	buffer = malloc(sizeof(RcuBuffer) + capacity * elem_size);
+	if (buffer == NULL) return NULL;
+
+	buffer->capacity = capacity;
+	buffer->size = 0;
+
+	return buffer;
+}
+
+/* Publishes `next` in place of the current buffer and retires that. The
+ * stores are sequentially consistent: a reader whose slot store the writer
+ * misses when reclaiming is ordered after this one, so it sees `next`. */
+int _rcu_vector_replace(RcuVector *rv, RcuBuffer *next)
+{
+	RcuRetired *retired;
+	RcuBuffer *old = rv->buffer;
+	size_t capacity;
+
+	if (rv->retired_count == rv->retired_capacity) {
+		capacity = MAX(VECTOR_MINIMUM_CAPACITY,
+									 rv->retired_capacity * VECTOR_GROWTH_FACTOR);
+		retired = realloc(rv->retired, capacity * sizeof(RcuRetired));
+		if (retired == NULL) return VECTOR_ERROR;
+		rv->retired = retired;
+		rv->retired_capacity = capacity;
+	}
+
+	__atomic_store_n(&rv->buffer, next, __ATOMIC_SEQ_CST);
+
+	/* Readers that enter from the next epoch on cannot see `old` */
+	rv->retired[rv->retired_count].buffer = old;
+	rv->retired[rv->retired_count].epoch =
+		__atomic_fetch_add(&rv->epoch, 1, __ATOMIC_SEQ_CST);
+	++rv->retired_count;
+
+	rcu_vector_reclaim(rv);
+
+	return VECTOR_SUCCESS;
+}
+
+/* Makes room for `count` more elements */
+int _rcu_vector_reserve(RcuVector *rv, size_t count)
+{
+	RcuBuffer *buffer = rv->buffer, *next;
+
+	if (buffer->size + count <= buffer->capacity) return VECTOR_SUCCESS;
+
+	next = _rcu_buffer_new(MAX(buffer->size + count,
+														 buffer->capacity * VECTOR_GROWTH_FACTOR),
+												 rv->elem_size);
+	if (next == NULL) return VECTOR_ERROR;
+
+	memcpy(next->data, buffer->data, buffer->size * rv->elem_size);
+	next->size = buffer->size;
+
+	if (_rcu_vector_replace(rv, next) == VECTOR_ERROR) {
+		free(next);
+		return VECTOR_ERROR;
+	}
+
+	return VECTOR_SUCCESS;
+}
+
+
+/***** METHODS *****/
+
+/* Constructor */
+
+int rcu_vector_setup(RcuVector* rv, size_t capacity, size_t elem_size)
+{
+	assert(rv != NULL);
+	assert(elem_size > 0);
+
+	if (rv == NULL) return VECTOR_ERROR;
+	if (elem_size == 0) return VECTOR_ERROR;
+
+	memset(rv, 0, sizeof(RcuVector));
+	rv->elem_size = elem_size;
+
+	/* Slots hold 0 outside of a read-side section, so epochs start at 1 */
+	rv->epoch = 1;
+
+	rv->buffer = _rcu_buffer_new(capacity, elem_size);
+
+	return rv->buffer == NULL ? VECTOR_ERROR : VECTOR_SUCCESS;
+}
+
+/* Destructor */
+
+int rcu_vector_destroy(RcuVector* rv)
+{
+	size_t i;
+
+	assert(rv != NULL);
+
+	if (rv == NULL) return VECTOR_ERROR;
+
+	for (i = 0; i < RCU_VECTOR_MAX_READERS; ++i) {
+		assert(!__atomic_load_n(&rv->readers[i].claimed, __ATOMIC_ACQUIRE));
+	}
+
+	for (i = 0; i < rv->retired_count; ++i) {
+		free(rv->retired[i].buffer);
+	}
+
+	free(rv->retired);
+	free(rv->buffer);
+
+	rv->retired = NULL;
+	rv->retired_count = 0;
+	rv->retired_capacity = 0;
+	rv->buffer = NULL;
+
+	return VECTOR_SUCCESS;
+}
+
+/* Writer */
+
+int rcu_vector_push_back(RcuVector* rv, const void* element)
+{
+	RcuBuffer *buffer;
+
+	assert(rv != NULL);
+	assert(element != NULL);
+
+	if (rv == NULL) return VECTOR_ERROR;
+	if (element == NULL) return VECTOR_ERROR;
+
+	if (_rcu_vector_reserve(rv, 1) == VECTOR_ERROR) return VECTOR_ERROR;
+
+	buffer = rv->buffer;
+	memcpy(buffer->data + buffer->size * rv->elem_size, element, rv->elem_size);
+
+	/* The element is written before readers can see the size that covers it */
+	__atomic_store_n(&buffer->size, buffer->size + 1, __ATOMIC_RELEASE);
+
+	return VECTOR_SUCCESS;
+}
+
+int rcu_vector_append(RcuVector* rv, const Vector* source)
+{
+	RcuBuffer *buffer;
+	size_t size;
+
+	assert(rv != NULL);
+	assert(source != NULL);
+	assert(source->tc->_vec_elem_size() == rv->elem_size);
+
+	if (rv == NULL) return VECTOR_ERROR;
+	if (source == NULL) return VECTOR_ERROR;
+	if (source->tc->_vec_elem_size() != rv->elem_size) return VECTOR_ERROR;
+
+	size = vector_size(source);
+	if (_rcu_vector_reserve(rv, size) == VECTOR_ERROR) return VECTOR_ERROR;
+
+	buffer = rv->buffer;
+	memcpy(buffer->data + buffer->size * rv->elem_size,
+				 vector_const_data(source),
+				 size * rv->elem_size);
+
+	__atomic_store_n(&buffer->size, buffer->size + size, __ATOMIC_RELEASE);
+
+	return VECTOR_SUCCESS;
+}
+
+/* Readers may still be looking at the old elements, so clearing starts a
+ * new buffer rather than reusing the slots */
+int rcu_vector_clear(RcuVector* rv)
+{
+	RcuBuffer *next;
+
+	assert(rv != NULL);
+
+	if (rv == NULL) return VECTOR_ERROR;
+
+	next = _rcu_buffer_new(rv->buffer->capacity, rv->elem_size);
+	if (next == NULL) return VECTOR_ERROR;
+
+	if (_rcu_vector_replace(rv, next) == VECTOR_ERROR) {
+		free(next);
+		return VECTOR_ERROR;
+	}
+
+	return VECTOR_SUCCESS;
+}
+
+size_t rcu_vector_reclaim(RcuVector* rv)
+{
+	uint64_t oldest = UINT64_MAX, epoch;
+	size_t i, kept = 0;
+
+	assert(rv != NULL);
+
+	/* The oldest epoch any reader is still in */
+	for (i = 0; i < RCU_VECTOR_MAX_READERS; ++i) {
+		epoch = __atomic_load_n(&rv->readers[i].epoch, __ATOMIC_SEQ_CST);
+		if (epoch != 0 && epoch < oldest) oldest = epoch;
+	}
+
+	/* Readers that entered after a buffer was retired never saw it */
+	for (i = 0; i < rv->retired_count; ++i) {
+		if (rv->retired[i].epoch < oldest) {
+			free(rv->retired[i].buffer);
+		} else {
+			rv->retired[kept++] = rv->retired[i];
+		}
+	}
+	rv->retired_count = kept;
+
+	return kept;
+}
+
+size_t rcu_vector_size(const RcuVector* rv)
+{
+	const RcuBuffer *buffer;
+
+	assert(rv != NULL);
+
+	buffer = __atomic_load_n(&rv->buffer, __ATOMIC_ACQUIRE);
+
+	return __atomic_load_n(&buffer->size, __ATOMIC_ACQUIRE);
+}
+
+/* Readers */
+
+int rcu_vector_reader_setup(RcuReader* reader, RcuVector* rv)
+{
+	size_t i;
+	int unclaimed;
+
+	assert(reader != NULL);
+	assert(rv != NULL);
+
+	if (reader == NULL) return VECTOR_ERROR;
+	if (rv == NULL) return VECTOR_ERROR;
+
+	for (i = 0; i < RCU_VECTOR_MAX_READERS; ++i) {
+		unclaimed = 0;
+		if (__atomic_compare_exchange_n(&rv->readers[i].claimed,
+																		&unclaimed,
+																		1,
+																		false,
+																		__ATOMIC_ACQ_REL,
+																		__ATOMIC_RELAXED)) {
+			reader->vector = rv;
+			reader->slot = &rv->readers[i];
+			return VECTOR_SUCCESS;
+		}
+	}
+
+	/* Every slot is taken */
+	return VECTOR_ERROR;
+}
+
+int rcu_vector_reader_destroy(RcuReader* reader)
+{
+	assert(reader != NULL);
+	assert(reader->slot != NULL);
+	assert(reader->slot->epoch == 0);
+
+	if (reader == NULL) return VECTOR_ERROR;
+	if (reader->slot == NULL) return VECTOR_ERROR;
+
+	__atomic_store_n(&reader->slot->claimed, 0, __ATOMIC_RELEASE);
+	reader->slot = NULL;
+	reader->vector = NULL;
+
+	return VECTOR_SUCCESS;
+}
+
+RcuView rcu_vector_read_begin(RcuReader* reader)
+{
+	RcuView view;
+	RcuBuffer *buffer;
+	uint64_t epoch;
+
+	assert(reader != NULL);
+	assert(reader->slot != NULL);
+	assert(reader->slot->epoch == 0);
+
+	/* Announce the epoch before looking at the buffer, see _rcu_vector_replace */
+	epoch = __atomic_load_n(&reader->vector->epoch, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&reader->slot->epoch, epoch, __ATOMIC_SEQ_CST);
+
+	buffer = __atomic_load_n(&reader->vector->buffer, __ATOMIC_SEQ_CST);
+
+	view.data = buffer->data;
+	view.size = __atomic_load_n(&buffer->size, __ATOMIC_ACQUIRE);
+
+	return view;
+}
+
+void rcu_vector_read_end(RcuReader* reader)
+{
+	assert(reader != NULL);
+	assert(reader->slot != NULL);
+
+	__atomic_store_n(&reader->slot->epoch, 0, __ATOMIC_RELEASE);
+}
+
+int rcu_vector_read_get(RcuReader* reader, size_t index, void* element)
+{
+	RcuView view;
+	size_t elem_size;
+
+	assert(reader != NULL);
+	assert(element != NULL);
+
+	if (reader == NULL) return VECTOR_ERROR;
+	if (element == NULL) return VECTOR_ERROR;
+
+	view = rcu_vector_read_begin(reader);
+
+	if (index >= view.size) {
+		rcu_vector_read_end(reader);
+		return VECTOR_ERROR;
+	}
+
+	elem_size = reader->vector->elem_size;
+	memcpy(element, (const char *)view.data + index * elem_size, elem_size);
+
+	rcu_vector_read_end(reader);
+
+	return VECTOR_SUCCESS;
+}
+
+size_t rcu_vector_read_size(RcuReader* reader)
+{
+	size_t size;
+
+	assert(reader != NULL);
+
+	size = rcu_vector_read_begin(reader).size;
+	rcu_vector_read_end(reader);
+
+	return size;
+}
@@ -0,0 +1,138 @@
+/* The MIT License (MIT)
+ * Copyright (c) 2016 Peter Goldsborough
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#ifndef RCU_VECTOR_H
+#define RCU_VECTOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vector.h"
+
+/***** DEFINITIONS *****/
+
+/* Readers that can be registered with one vector at a time */
+#define RCU_VECTOR_MAX_READERS 64
+
+#define RCU_VECTOR_CACHE_LINE 64
+
+
+/***** STRUCTURES *****/
+
+/* A buffer with the number of elements published in it. Within a buffer the
+ * size only grows, so an element below a size a reader has seen is never
+ * written again. */
+typedef struct
+{
+  size_t capacity;
+  size_t size;
+  unsigned char data[];
+} RcuBuffer;
+
+/* A replaced buffer and the epoch it was replaced in */
+typedef struct
+{
+  RcuBuffer *buffer;
+  uint64_t epoch;
+} RcuRetired;
+
+/* The epoch a reader entered its read-side section in, or 0 outside of one.
+ * Each slot has a cache line to itself. */
+typedef struct
+{
+  uint64_t epoch;
+  int claimed;
+  char padding[RCU_VECTOR_CACHE_LINE - sizeof(uint64_t) - sizeof(int)];
+} RcuSlot;
+
+/* A vector with a single writer and any number of readers on other threads.
+ * The writer appends in place and publishes each new size with release
+ * semantics; when it has to grow (or clears), it publishes a new buffer and
+ * retires the old one. A retired buffer is freed once every reader that
+ * could still see it has left its read-side section (epoch-based
+ * reclamation), so readers never take a lock or wait. */
+typedef struct
+{
+  size_t elem_size;
+  RcuBuffer *buffer;
+  uint64_t epoch;
+
+  /* Only touched by the writer */
+  RcuRetired *retired;
+  size_t retired_count;
+  size_t retired_capacity;
+
+  RcuSlot readers[RCU_VECTOR_MAX_READERS];
+} RcuVector;
+
+typedef struct
+{
+  RcuVector *vector;
+  RcuSlot *slot;
+} RcuReader;
+
+/* The elements a reader sees, valid until it ends its read-side section */
+typedef struct
+{
+  const void *data;
+  size_t size;
+} RcuView;
+
+
+/***** METHODS *****/
+
+/* Constructor */
+int rcu_vector_setup(RcuVector* vector, size_t capacity, size_t elem_size);
+
+/* Destructor
+ * No reader may be registered any more. */
+int rcu_vector_destroy(RcuVector* vector);
+
+/* Writer
+ * Only one thread may call these at a time. */
+int rcu_vector_push_back(RcuVector* vector, const void* element);
+int rcu_vector_append(RcuVector* vector, const Vector* source);
+int rcu_vector_clear(RcuVector* vector);
+
+/* The size as the writer last published it. A reader calls
+ * rcu_vector_read_size instead: the writer may free the buffer this reads. */
+size_t rcu_vector_size(const RcuVector* vector);
+
+/* Frees the retired buffers no reader can see any more, and returns how
+ * many are still pending. The writer calls this on its own after
+ * retiring a buffer. */
+size_t rcu_vector_reclaim(RcuVector* vector);
+
+/* Readers
+ * Each reading thread registers a reader of its own. Between read_begin and
+ * read_end, the view stays valid however the writer grows the vector; both
+ * are wait-free. */
+int rcu_vector_reader_setup(RcuReader* reader, RcuVector* vector);
+int rcu_vector_reader_destroy(RcuReader* reader);
+
+RcuView rcu_vector_read_begin(RcuReader* reader);
+void rcu_vector_read_end(RcuReader* reader);
+
+/* Read-side sections around copying out a single element, and around
+ * reading the size */
+int rcu_vector_read_get(RcuReader* reader, size_t index, void* element);
+size_t rcu_vector_read_size(RcuReader* reader);
+
+#endif /* RCU_VECTOR_H */
@@ -0,0 +1,525 @@
+/* The MIT License (MIT)
+ * Copyright (c) 2016 Peter Goldsborough
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* x86 builds carry AVX2 gather kernels that are picked at runtime */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SPARSE_VECTOR_X86
+#include <immintrin.h>
+#endif
+
+#include "sparse_vector.h"
+
+/***** DEFINITIONS *****/
+
+/* The sparse-sparse dot product gallops through the longer index list once
+ * it has this many times the entries of the shorter one */
+#define SPARSE_VECTOR_GALLOP_RATIO 16
+
+
+/***** PRIVATE *****/
+
+int _sparse_vector_reallocate(SparseVector *v, size_t capacity)
+{
+	size_t *indices;
+	double *values;
+
+	assert(capacity >= v->size);
+
+	capacity = MAX(1, capacity);
+
+	/* Each buffer is kept on its own as soon as it has grown, so a failure
+	 * of the second leaves the vector as it was */
+	indices = realloc(v->indices, capacity * sizeof(size_t));
+	if (indices == NULL) return VECTOR_ERROR;
+	v->indices = indices;
+
+	values = realloc(v->values, capacity * sizeof(double));
+	if (values == NULL) return VECTOR_ERROR;
+	v->values = values;
+
+	v->capacity = capacity;
+
+	return VECTOR_SUCCESS;
+}
+
+int _sparse_vector_grow(SparseVector *v)
+{
+	if (v->size < v->capacity) return VECTOR_SUCCESS;
+
+	return _sparse_vector_reallocate(v, v->capacity * VECTOR_GROWTH_FACTOR);
+}
+
+/* First position whose index is not below `index` */
+size_t _sparse_vector_lower_bound(const SparseVector *v, size_t index)
+{
+	size_t low = 0, high = v->size, middle;
+
+	while (low < high) {
+		middle = low + (high - low) / 2;
+		if (v->indices[middle] < index) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+
+	return low;
+}
+
+bool _sparse_vector_matches(const SparseVector *v, const Vector *dense)
+{
+	return dense->tc->_vec_elem_size() == sizeof(double) &&
+    vector_size(dense) == v->dimension;
+}
+
+/* Kernels */
+
+double _sparse_vector_dot_generic(const size_t *indices,
+                                  const double *values,
+                                  size_t count,
+                                  const double *dense)
+{
+	double sums[4] = { 0, 0, 0, 0 };
+	size_t i;
+
+	/* Independent sums, so that the loads of one do not wait on another */
+	for (i = 0; i + 4 <= count; i += 4) {
+		sums[0] += values[i] * dense[indices[i]];
+		sums[1] += values[i + 1] * dense[indices[i + 1]];
+		sums[2] += values[i + 2] * dense[indices[i + 2]];
+		sums[3] += values[i + 3] * dense[indices[i + 3]];
+	}
+	for (; i < count; ++i) sums[0] += values[i] * dense[indices[i]];
+
+	return (sums[0] + sums[1]) + (sums[2] + sums[3]);
+}
+
+void _sparse_vector_axpy_generic(double alpha,
+                                 const size_t *indices,
+                                 const double *values,
+                                 size_t count,
+                                 double *dense)
+{
+	size_t i;
+
+	for (i = 0; i < count; ++i) dense[indices[i]] += alpha * values[i];
+}
+
+#ifdef SPARSE_VECTOR_X86
+
+__attribute__((target("avx2,fma")))
+double _sparse_vector_dot_avx2(const size_t *indices,
+                               const double *values,
+                               size_t count,
+                               const double *dense)
+{
+	__m256d first = _mm256_setzero_pd(), second = _mm256_setzero_pd();
+	__m256i index;
+	double lanes[4];
+	size_t i;
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		index = _mm256_loadu_si256((const __m256i*)(indices + i));
+		first = _mm256_fmadd_pd(_mm256_loadu_pd(values + i),
+														_mm256_i64gather_pd(dense, index, 8),
+														first);
+		index = _mm256_loadu_si256((const __m256i*)(indices + i + 4));
+		second = _mm256_fmadd_pd(_mm256_loadu_pd(values + i + 4),
+														 _mm256_i64gather_pd(dense, index, 8),
+														 second);
+	}
+	if (i + 4 <= count) {
+		index = _mm256_loadu_si256((const __m256i*)(indices + i));
+		first = _mm256_fmadd_pd(_mm256_loadu_pd(values + i),
+														_mm256_i64gather_pd(dense, index, 8),
+														first);
+		i += 4;
+	}
+
+	_mm256_storeu_pd(lanes, _mm256_add_pd(first, second));
+
+	return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) +
+    _sparse_vector_dot_generic(indices + i, values + i, count - i, dense);
+}
+
+#endif /* SPARSE_VECTOR_X86 */
+
+double _sparse_vector_dot_dense(const size_t *indices,
+                                const double *values,
+                                size_t count,
+                                const double *dense)
+{
+#ifdef SPARSE_VECTOR_X86
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+		return _sparse_vector_dot_avx2(indices, values, count, dense);
+	}
+#endif
+	return _sparse_vector_dot_generic(indices, values, count, dense);
+}
+
+/* First position in [from, count) whose index is not below `index` */
+size_t _sparse_vector_gallop(const size_t *indices,
+                             size_t from,
+                             size_t count,
+                             size_t index)
+{
+	size_t low = from, high = from, step = 1, middle;
+
+	while (high < count && indices[high] < index) {
+		low = high + 1;
+		high += step;
+		step <<= 1;
+	}
+	high = MIN(high, count);
+
+	while (low < high) {
+		middle = low + (high - low) / 2;
+		if (indices[middle] < index) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+
+	return low;
+}
+
+/* Dot product of two index lists, the first being the shorter */
+double _sparse_vector_dot_sparse(const SparseVector *a, const SparseVector *b)
+{
+	size_t i = 0, j = 0, ia, ib;
+	double sum = 0;
+
+	if (b->size >= a->size * SPARSE_VECTOR_GALLOP_RATIO) {
+		for (; i < a->size; ++i) {
+			j = _sparse_vector_gallop(b->indices, j, b->size, a->indices[i]);
+			if (j == b->size) break;
+			if (b->indices[j] == a->indices[i]) sum += a->values[i] * b->values[j];
+		}
+		return sum;
+	}
+
+	/* Both cursors advance without a branch on which one is behind */
+	while (i < a->size && j < b->size) {
+		ia = a->indices[i];
+		ib = b->indices[j];
+		sum += ia == ib ? a->values[i] * b->values[j] : 0.0;
+		i += ia <= ib;
+		j += ib <= ia;
+	}
+
+	return sum;
+}
+
+
+/***** METHODS *****/
+
+int sparse_vector_setup(SparseVector* v, size_t dimension, size_t capacity)
+{
+	assert(v != NULL);
+
+	if (v == NULL) return VECTOR_ERROR;
+
+	v->dimension = dimension;
+	v->size = 0;
+	v->capacity = 0;
+	v->indices = NULL;
+	v->values = NULL;
+
+	return _sparse_vector_reallocate(v, MAX(VECTOR_MINIMUM_CAPACITY, capacity));
+}
+
+int sparse_vector_destroy(SparseVector* v)
+{
+	assert(v != NULL);
+
+	if (v == NULL) return VECTOR_ERROR;
+
+	free(v->indices);
+	free(v->values);
+	v->indices = NULL;
+	v->values = NULL;
+	v->size = 0;
+	v->capacity = 0;
+
+	return VECTOR_SUCCESS;
+}
+
+/* Insertion */
+
+int sparse_vector_set(SparseVector* v, size_t index, double value)
+{
+	size_t position;
+
+	assert(v != NULL);
+
+	if (v == NULL) return VECTOR_ERROR;
+	if (index >= v->dimension) return VECTOR_ERROR;
+
+	position = _sparse_vector_lower_bound(v, index);
+
+	if (position < v->size && v->indices[position] == index) {
+		if (value != 0) {
+			v->values[position] = value;
+			return VECTOR_SUCCESS;
+		}
+
+		/* A zero is not stored */
+		memmove(v->indices + position,
+						v->indices + position + 1,
+						(v->size - position - 1) * sizeof(size_t));
+		memmove(v->values + position,
+						v->values + position + 1,
+						(v->size - position - 1) * sizeof(double));
+		--v->size;
+
+		return VECTOR_SUCCESS;
+	}
+
+	if (value == 0) return VECTOR_SUCCESS;
+
+	if (_sparse_vector_grow(v) == VECTOR_ERROR) return VECTOR_ERROR;
+
+	memmove(v->indices + position + 1,
+					v->indices + position,
+					(v->size - position) * sizeof(size_t));
+	memmove(v->values + position + 1,
+					v->values + position,
+					(v->size - position) * sizeof(double));
+	v->indices[position] = index;
+	v->values[position] = value;
+	++v->size;
+
+	return VECTOR_SUCCESS;
+}
+
+int sparse_vector_push_back(SparseVector* v, size_t index, double value)
+{
+	assert(v != NULL);
+
+	if (v == NULL) return VECTOR_ERROR;
+	if (index >= v->dimension) return VECTOR_ERROR;
+	if (v->size > 0 && v->indices[v->size - 1] >= index) return VECTOR_ERROR;
+
+	if (value == 0) return VECTOR_SUCCESS;
+
+	if (_sparse_vector_grow(v) == VECTOR_ERROR) return VECTOR_ERROR;
+
+	v->indices[v->size] = index;
+	v->values[v->size] = value;
+	++v->size;
+
+	return VECTOR_SUCCESS;
+}
+
+int sparse_vector_clear(SparseVector* v)
+{
+	assert(v != NULL);
+
+	if (v == NULL) return VECTOR_ERROR;
+
+	v->size = 0;
+
+	return VECTOR_SUCCESS;
+}
+
+/* Lookup */
+
+double sparse_vector_get(const SparseVector* v, size_t index)
+{
+	size_t position;
+
+	assert(v != NULL);
+	assert(index < v->dimension);
+
+	if (v == NULL) return 0;
+	if (index >= v->dimension) return 0;
+
+	position = _sparse_vector_lower_bound(v, index);
+	if (position < v->size && v->indices[position] == index) {
+		return v->values[position];
+	}
+
+	return 0;
+}
+
+/* Information */
+
+size_t sparse_vector_size(const SparseVector* v)
+{
+	assert(v != NULL);
+	return v->size;
+}
+
+size_t sparse_vector_dimension(const SparseVector* v)
+{
+	assert(v != NULL);
+	return v->dimension;
+}
+
+size_t sparse_vector_byte_size(const SparseVector* v)
+{
+	assert(v != NULL);
+	return v->size * (sizeof(size_t) + sizeof(double));
+}
+
+/* Conversion */
+
+int sparse_vector_from_dense(SparseVector* v,
+                             const Vector* dense,
+                             double threshold)
+{
+	const double *data;
+	size_t i, size, count = 0;
+
+	assert(v != NULL);
+	assert(dense != NULL);
+	assert(threshold >= 0);
+
+	if (v == NULL) return VECTOR_ERROR;
+	if (dense == NULL) return VECTOR_ERROR;
+	if (dense->tc->_vec_elem_size() != sizeof(double)) return VECTOR_ERROR;
+	if (!(threshold >= 0)) return VECTOR_ERROR;
+
+	data = vector_const_data(dense);
+	size = vector_size(dense);
+
+	/* The comparisons are combined without short-circuiting, so that the
+	 * count vectorizes and the fill does not branch on the data */
+	for (i = 0; i < size; ++i) {
+		count += (data[i] > threshold) | (data[i] < -threshold);
+	}
+
+	/* The fill writes one slot past the last kept entry */
+	if (count + 1 > v->capacity &&
+			_sparse_vector_reallocate(v, count + 1) == VECTOR_ERROR) {
+		return VECTOR_ERROR;
+	}
+
+	v->dimension = size;
+	for (i = 0, count = 0; i < size; ++i) {
+		v->indices[count] = i;
+		v->values[count] = data[i];
+		count += (data[i] > threshold) | (data[i] < -threshold);
+	}
+	v->size = count;
+
+	return VECTOR_SUCCESS;
+}
+
+int sparse_vector_to_dense(const SparseVector* v, Vector* dense)
+{
+	double *data;
+	size_t i;
+
+	assert(v != NULL);
+	assert(dense != NULL);
+
+	if (v == NULL) return VECTOR_ERROR;
+	if (dense == NULL) return VECTOR_ERROR;
+	if (dense->tc->_vec_elem_size() != sizeof(double)) return VECTOR_ERROR;
+
+	if (vector_resize(dense, v->dimension) == VECTOR_ERROR) return VECTOR_ERROR;
+	if (v->dimension == 0) return VECTOR_SUCCESS;
+
+	data = vector_data(dense);
+	if (data == NULL) return VECTOR_ERROR;
+
+	memset(data, 0, v->dimension * sizeof(double));
+	for (i = 0; i < v->size; ++i) data[v->indices[i]] = v->values[i];
+
+	vector_mark_dirty(dense, 0, v->dimension);
+
+	return VECTOR_SUCCESS;
+}
+
+/* Arithmetic */
+
+int sparse_vector_dot_dense(const SparseVector* v,
+                            const Vector* dense,
+                            double* result)
+{
+	assert(v != NULL);
+	assert(dense != NULL);
+	assert(result != NULL);
+
+	if (v == NULL) return VECTOR_ERROR;
+	if (dense == NULL) return VECTOR_ERROR;
+	if (result == NULL) return VECTOR_ERROR;
+	if (!_sparse_vector_matches(v, dense)) return VECTOR_ERROR;
+
+	*result = _sparse_vector_dot_dense(v->indices,
+																		 v->values,
+																		 v->size,
+																		 vector_const_data(dense));
+
+	return VECTOR_SUCCESS;
+}
+
+int sparse_vector_axpy_dense(double alpha,
+                             const SparseVector* v,
+                             Vector* dense)
+{
+	double *data;
+
+	assert(v != NULL);
+	assert(dense != NULL);
+
+	if (v == NULL) return VECTOR_ERROR;
+	if (dense == NULL) return VECTOR_ERROR;
+	if (!_sparse_vector_matches(v, dense)) return VECTOR_ERROR;
+	if (v->size == 0) return VECTOR_SUCCESS;
+
+	data = vector_data(dense);
+	if (data == NULL) return VECTOR_ERROR;
+
+	_sparse_vector_axpy_generic(alpha, v->indices, v->values, v->size, data);
+
+	vector_mark_dirty(dense,
+										v->indices[0],
+										v->indices[v->size - 1] - v->indices[0] + 1);
+
+	return VECTOR_SUCCESS;
+}
+
+int sparse_vector_dot(const SparseVector* first,
+                      const SparseVector* second,
+                      double* result)
+{
+	assert(first != NULL);
+	assert(second != NULL);
+	assert(result != NULL);
+
+	if (first == NULL) return VECTOR_ERROR;
+	if (second == NULL) return VECTOR_ERROR;
+	if (result == NULL) return VECTOR_ERROR;
+	if (first->dimension != second->dimension) return VECTOR_ERROR;
+
+	*result = first->size <= second->size
+                ? _sparse_vector_dot_sparse(first, second)
+                : _sparse_vector_dot_sparse(second, first);
+
+	return VECTOR_SUCCESS;
+}
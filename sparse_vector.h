@@ -0,0 +1,103 @@
+/* The MIT License (MIT)
+ * Copyright (c) 2016 Peter Goldsborough
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#ifndef SPARSE_VECTOR_H
+#define SPARSE_VECTOR_H
+
+#include <stddef.h>
+
+#include "vector.h"
+
+/***** DEFINITIONS *****/
+
+#define SPARSE_VECTOR_INITIALIZER { 0, 0, 0, NULL, NULL }
+
+
+/***** STRUCTURES *****/
+
+/* A vector of `dimension` doubles that stores only its non-zero entries:
+ * their indices in ascending order in one buffer and their values, in the
+ * same order, in another. Zeros are never stored. */
+typedef struct
+{
+  size_t dimension;
+  size_t size;
+  size_t capacity;
+  size_t *indices;
+  double *values;
+} SparseVector;
+
+
+/***** METHODS *****/
+
+/* Constructor
+ * `capacity` is the number of non-zero entries to make room for. */
+int sparse_vector_setup(SparseVector* vector,
+                        size_t dimension,
+                        size_t capacity);
+
+/* Destructor */
+int sparse_vector_destroy(SparseVector* vector);
+
+/* Insertion
+ * sparse_vector_set keeps the entries sorted, so it moves the entries past
+ * `index`; setting an entry to zero removes it. sparse_vector_push_back
+ * appends an entry past every stored one, which is how to build a vector in
+ * order. */
+int sparse_vector_set(SparseVector* vector, size_t index, double value);
+int sparse_vector_push_back(SparseVector* vector, size_t index, double value);
+int sparse_vector_clear(SparseVector* vector);
+
+/* Lookup
+ * A binary search of the stored indices; entries not stored are zero. */
+double sparse_vector_get(const SparseVector* vector, size_t index);
+
+/* Information
+ * sparse_vector_size is the number of stored entries. */
+size_t sparse_vector_size(const SparseVector* vector);
+size_t sparse_vector_dimension(const SparseVector* vector);
+size_t sparse_vector_byte_size(const SparseVector* vector);
+
+/* Conversion
+ * sparse_vector_from_dense stores the entries of a vector of doubles whose
+ * magnitude is above `threshold` (0 keeps every non-zero), after counting
+ * them so that the buffers are sized once. sparse_vector_to_dense resizes
+ * `dense` to the dimension and writes every entry, zeros included. */
+int sparse_vector_from_dense(SparseVector* vector,
+                             const Vector* dense,
+                             double threshold);
+int sparse_vector_to_dense(const SparseVector* vector, Vector* dense);
+
+/* Arithmetic
+ * `dense` is a vector of doubles of the same dimension. The sparse-dense
+ * dot product gathers the dense entries with AVX2 where the CPU has it, and
+ * the sparse-sparse one merges the two index lists. Sums may be
+ * accumulated in a different order than a plain loop would. */
+int sparse_vector_dot_dense(const SparseVector* vector,
+                            const Vector* dense,
+                            double* result);
+int sparse_vector_axpy_dense(double alpha,
+                             const SparseVector* vector,
+                             Vector* dense);
+int sparse_vector_dot(const SparseVector* first,
+                      const SparseVector* second,
+                      double* result);
+
+#endif /* SPARSE_VECTOR_H */
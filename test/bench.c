@@ -0,0 +1,1257 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "compressed_vector.h"
+#include "doubles.h"
+#include "pipeline.h"
+#include "rcu_vector.h"
+#include "sparse_vector.h"
+#include "texts.h"
+#include "vector.h"
+#include "vector_parse.h"
+#include "vector_stream.h"
+#include "vector_algorithm.h"
+
+#define BENCH_SIZE 10000000
+#define BENCH_ROUNDS 5
+#define BENCH_HEAP_SIZE 1000000
+#define BENCH_SORTED_SIZE 100000
+#define BENCH_PARSE_SIZE 2000000
+#define BENCH_BULK_SIZE 40000000
+#define BENCH_RCU_WRITES 2000000
+#define BENCH_RCU_READS 2000000
+#define BENCH_RCU_MAX_READERS 8
+#define BENCH_LIFECYCLE_SIZE 1000000
+#define BENCH_LIFECYCLE_GROWTHS 6
+#define BENCH_GATHER_SMALL 65536
+#define BENCH_MERGE_SIZE 4000000
+#define BENCH_MERGE_WAYS 16
+#define BENCH_SET_SIZE 1000000
+#define BENCH_SPLICE_SIZE 100000
+#define BENCH_SPLICE_RANGE 10000
+#define BENCH_SPARSE_DIMENSION 4000000
+#define BENCH_STREAM_BATCH 1024
+#define BENCH_STREAM_BATCHES 32768
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void report(const char* name, double seconds, size_t operations)
+{
+	printf("%-32s %8.2f ms %8.2f ns/op\n",
+				 name,
+				 seconds * 1e3,
+				 seconds * 1e9 / (double)operations);
+}
+
+/* Keeps the optimizer from discarding benchmark loops */
+static volatile double sink;
+
+static void bench_push_back(void)
+{
+	Vector vector = VECTOR_INITIALIZER;
+	double start, best_checked = 1e9, best_unchecked = 1e9;
+	size_t i;
+	int round;
+
+	for (round = 0; round < BENCH_ROUNDS; ++round) {
+		doubles_vector_setup(&vector, BENCH_SIZE);
+		start = now();
+		for (i = 0; i < BENCH_SIZE; ++i) {
+			double d = (double)i;
+			vector_push_back(&vector, &d);
+		}
+		best_checked = MIN(best_checked, now() - start);
+		vector_destroy(&vector);
+
+		doubles_vector_setup(&vector, BENCH_SIZE);
+		start = now();
+		for (i = 0; i < BENCH_SIZE; ++i) {
+			double d = (double)i;
+			vector_push_back_unchecked(&vector, &d);
+		}
+		best_unchecked = MIN(best_unchecked, now() - start);
+		vector_destroy(&vector);
+	}
+
+	report("vector_push_back", best_checked, BENCH_SIZE);
+	report("vector_push_back_unchecked", best_unchecked, BENCH_SIZE);
+}
+
+static void bench_get(void)
+{
+	Vector vector = VECTOR_INITIALIZER;
+	double start, sum, best_checked = 1e9, best_unchecked = 1e9;
+	size_t i, size;
+	int round;
+
+	doubles_vector_setup(&vector, BENCH_SIZE);
+	for (i = 0; i < BENCH_SIZE; ++i) {
+		double d = (double)i;
+		vector_push_back(&vector, &d);
+	}
+
+	for (round = 0; round < BENCH_ROUNDS; ++round) {
+		start = now();
+		sum = 0.0;
+		for (i = 0; i < vector_size(&vector); ++i) {
+			sum += *(double*)vector_get(&vector, i);
+		}
+		sink = sum;
+		best_checked = MIN(best_checked, now() - start);
+
+		start = now();
+		sum = 0.0;
+		size = vector_size_fast(&vector);
+		for (i = 0; i < size; ++i) {
+			sum += *(double*)vector_get_unchecked(&vector, i);
+		}
+		sink = sum;
+		best_unchecked = MIN(best_unchecked, now() - start);
+	}
+
+	report("vector_get", best_checked, BENCH_SIZE);
+	report("vector_get_unchecked", best_unchecked, BENCH_SIZE);
+
+	vector_destroy(&vector);
+}
+
+/* Compresses `source` and compares memory and scan time with the plain
+ * vector */
+static void bench_compressed_scan(const char* name,
+																	Vector* source,
+																	CompressedKind kind)
+{
+	CompressedVector compressed;
+	CompressedIterator iterator;
+	const void* chunk;
+	const double* data;
+	double start, sum, plain = 1e9, scan = 1e9;
+	size_t i, count, size = vector_size(source);
+	int round;
+
+	compressed_vector_setup(&compressed, kind);
+	compressed_vector_append(&compressed, source);
+
+	for (round = 0; round < BENCH_ROUNDS; ++round) {
+		start = now();
+		sum = 0.0;
+		data = vector_const_data(source);
+		for (i = 0; i < size; ++i) sum += data[i];
+		sink = sum;
+		plain = MIN(plain, now() - start);
+
+		start = now();
+		sum = 0.0;
+		compressed_iterator_begin(&iterator, &compressed);
+		while ((count = compressed_iterator_next(&iterator, &chunk)) > 0) {
+			for (i = 0; i < count; ++i) sum += ((const double*)chunk)[i];
+		}
+		compressed_iterator_destroy(&iterator);
+		sink = sum;
+		scan = MIN(scan, now() - start);
+	}
+
+	printf("%-32s %8.2fx smaller\n",
+				 name,
+				 (double)vector_byte_size(source) /
+						 (double)compressed_vector_byte_size(&compressed));
+	report("  plain scan", plain, size);
+	report("  compressed scan", scan, size);
+
+	compressed_vector_destroy(&compressed);
+}
+
+static void bench_compressed(void)
+{
+	Vector vector = VECTOR_INITIALIZER;
+	double d = 100.0;
+	int64_t t = 1500000000000;
+	size_t i;
+
+	/* Prices with two decimals */
+	srand(7);
+	doubles_vector_setup(&vector, BENCH_SIZE);
+	for (i = 0; i < BENCH_SIZE; ++i) {
+		d = (double)(int64_t)((d + (rand() % 21 - 10) * 0.01) * 100.0 + 0.5) / 100.0;
+		vector_push_back(&vector, &d);
+	}
+	bench_compressed_scan("doubles (price ticks)", &vector, COMPRESSED_DOUBLE);
+	vector_destroy(&vector);
+
+	/* A gauge that mostly repeats its last reading */
+	doubles_vector_setup(&vector, BENCH_SIZE);
+	for (i = 0; i < BENCH_SIZE; ++i) {
+		if (rand() % 16 == 0) d = (double)(rand() % 1000) * 0.5;
+		vector_push_back(&vector, &d);
+	}
+	bench_compressed_scan("doubles (gauge)", &vector, COMPRESSED_DOUBLE);
+	vector_destroy(&vector);
+
+	/* Millisecond timestamps with jitter, stored in a Doubles buffer as raw
+	 * 8-byte integers */
+	doubles_vector_setup(&vector, BENCH_SIZE);
+	for (i = 0; i < BENCH_SIZE; ++i) {
+		t += 1000 + rand() % 16;
+		vector_push_back(&vector, &t);
+	}
+	bench_compressed_scan("int64 (timestamps)", &vector, COMPRESSED_INT64);
+	vector_destroy(&vector);
+}
+
+/* A textbook binary heap over a plain array, as the baseline */
+static void binary_heap_push(double* heap, size_t size, double value)
+{
+	size_t index = size, parent;
+
+	while (index > 0 && value < heap[parent = (index - 1) / 2]) {
+		heap[index] = heap[parent];
+		index = parent;
+	}
+	heap[index] = value;
+}
+
+static double binary_heap_pop(double* heap, size_t size)
+{
+	double top = heap[0], value = heap[--size];
+	size_t index = 0, child;
+
+	while ((child = 2 * index + 1) < size) {
+		if (child + 1 < size && heap[child + 1] < heap[child]) ++child;
+		if (!(heap[child] < value)) break;
+		heap[index] = heap[child];
+		index = child;
+	}
+	heap[index] = value;
+
+	return top;
+}
+
+static int compare_doubles(const void* first, const void* second)
+{
+	double a = *(const double*)first, b = *(const double*)second;
+	return (a > b) - (a < b);
+}
+
+static void bench_heap_ary(const char* name, VectorCompare compare)
+{
+	Vector heap = VECTOR_INITIALIZER;
+	double start, d;
+	size_t i;
+
+	srand(3);
+	doubles_vector_setup(&heap, BENCH_HEAP_SIZE);
+	start = now();
+	for (i = 0; i < BENCH_HEAP_SIZE; ++i) {
+		d = (double)rand();
+		vector_heap_push(&heap, &d, compare);
+	}
+	for (i = 0; i < BENCH_HEAP_SIZE; ++i) {
+		vector_heap_pop(&heap, &d, compare);
+		sink += d;
+	}
+	report(name, now() - start, 2 * BENCH_HEAP_SIZE);
+
+	vector_destroy(&heap);
+}
+
+static void bench_heap(void)
+{
+	Vector sorted = VECTOR_INITIALIZER;
+	double *binary, start, d;
+	size_t i, low, high, middle;
+
+	bench_heap_ary("4-ary heap (double kernel)", vector_compare_double);
+	bench_heap_ary("4-ary heap (comparator)", compare_doubles);
+
+	srand(3);
+	binary = malloc(BENCH_HEAP_SIZE * sizeof(double));
+	start = now();
+	for (i = 0; i < BENCH_HEAP_SIZE; ++i) {
+		binary_heap_push(binary, i, (double)rand());
+	}
+	for (i = BENCH_HEAP_SIZE; i > 0; --i) {
+		sink += binary_heap_pop(binary, i);
+	}
+	report("binary heap", now() - start, 2 * BENCH_HEAP_SIZE);
+	free(binary);
+
+	/* Quadratic, so only a tenth of the elements */
+	srand(3);
+	doubles_vector_setup(&sorted, BENCH_SORTED_SIZE);
+	start = now();
+	for (i = 0; i < BENCH_SORTED_SIZE; ++i) {
+		d = (double)rand();
+		low = 0;
+		high = vector_size(&sorted);
+		while (low < high) {
+			middle = low + (high - low) / 2;
+			if (((const double*)vector_const_data(&sorted))[middle] > d) {
+				low = middle + 1;
+			} else {
+				high = middle;
+			}
+		}
+		vector_insert(&sorted, low, &d);
+	}
+	for (i = 0; i < BENCH_SORTED_SIZE; ++i) {
+		sink += VECTOR_GET_AS(double, &sorted, vector_size(&sorted) - 1);
+		vector_pop_back(&sorted);
+	}
+	report("sorted vector_insert (100k)", now() - start, 2 * BENCH_SORTED_SIZE);
+
+	vector_destroy(&sorted);
+}
+
+static bool is_positive(const void* element, void* context)
+{
+	return *(const double*)element > 0;
+}
+
+static void sum_doubles(void* accumulator, const void* element, void* context)
+{
+	*(double*)accumulator += *(const double*)element;
+}
+
+static void add_doubles(void* accumulator, const void* partial, void* context)
+{
+	*(double*)accumulator += *(const double*)partial;
+}
+
+static void bench_pipeline(void)
+{
+	Vector source = VECTOR_INITIALIZER, survivors = VECTOR_INITIALIZER;
+	Pipeline pipeline;
+	double start, d, sum;
+	size_t i, threads;
+	char name[64];
+
+	srand(5);
+	doubles_vector_setup(&source, BENCH_SIZE);
+	for (i = 0; i < BENCH_SIZE; ++i) {
+		d = (double)(rand() % 2001 - 1000);
+		vector_push_back(&source, &d);
+	}
+
+	/* Copy the survivors out, then sum them */
+	start = now();
+	doubles_vector_setup(&survivors, 0);
+	for (i = 0; i < BENCH_SIZE; ++i) {
+		d = *(const double*)vector_const_get(&source, i);
+		if (d > 0) vector_push_back(&survivors, &d);
+	}
+	sum = 0;
+	for (i = 0; i < vector_size(&survivors); ++i) {
+		sum += *(const double*)vector_const_get(&survivors, i);
+	}
+	sink += sum;
+	report("filter into vector, then sum", now() - start, BENCH_SIZE);
+	vector_destroy(&survivors);
+
+	for (threads = 1; threads <= 4; threads *= 2) {
+		pipeline_setup(&pipeline, &source);
+		pipeline_filter(&pipeline, is_positive, NULL);
+		pipeline_set_threads(&pipeline, threads);
+
+		start = now();
+		sum = 0;
+		pipeline_reduce(&pipeline, &sum, sizeof sum, sum_doubles, add_doubles, NULL);
+		sink += sum;
+		snprintf(name, sizeof name, "fused pipeline (%zu threads)", threads);
+		report(name, now() - start, BENCH_SIZE);
+	}
+
+	vector_destroy(&source);
+}
+
+static void bench_parse(void)
+{
+	Vector numbers = VECTOR_INITIALIZER;
+	char *text, *position, *end;
+	size_t length = 0, i;
+	double start, d;
+
+	/* Prices and readings, one per line */
+	text = malloc(BENCH_PARSE_SIZE * 24);
+	srand(9);
+	for (i = 0; i < BENCH_PARSE_SIZE; ++i) {
+		length += sprintf(text + length,
+											i % 2 ? "%.2f\n" : "%.9g\n",
+											(double)rand() / RAND_MAX * 1000.0);
+	}
+
+	start = now();
+	doubles_vector_setup(&numbers, 0);
+	for (position = text; position < text + length; position = end + 1) {
+		d = strtod(position, &end);
+		vector_push_back(&numbers, &d);
+	}
+	report("strtod + vector_push_back", now() - start, BENCH_PARSE_SIZE);
+	vector_destroy(&numbers);
+
+	start = now();
+	doubles_vector_setup(&numbers, 0);
+	vector_parse_doubles(&numbers, text, length, ',', NULL);
+	report("vector_parse_doubles", now() - start, BENCH_PARSE_SIZE);
+	vector_destroy(&numbers);
+
+	free(text);
+}
+
+/* A destination for vector_copy, which wants one without a buffer */
+static void release_buffer(Vector* vector)
+{
+	free(((Doubles*)vector->self)->data);
+	((Doubles*)vector->self)->data = NULL;
+}
+
+static void bench_bulk(void)
+{
+	Vector source = VECTOR_INITIALIZER, copy = VECTOR_INITIALIZER;
+	double start, d = 1.5;
+	size_t i;
+
+	doubles_vector_setup(&source, BENCH_BULK_SIZE);
+	vector_resize(&source, BENCH_BULK_SIZE);
+
+	start = now();
+	vector_fill(&source, 0, BENCH_BULK_SIZE, &d, 0);
+	report("vector_fill (first touch)", now() - start, BENCH_BULK_SIZE);
+
+	start = now();
+	for (i = 0; i < BENCH_BULK_SIZE; ++i) {
+		vector_assign(&source, i, &d);
+	}
+	report("fill by vector_assign", now() - start, BENCH_BULK_SIZE);
+
+	start = now();
+	vector_fill(&source, 0, BENCH_BULK_SIZE, &d, 0);
+	report("vector_fill", now() - start, BENCH_BULK_SIZE);
+
+	doubles_vector_setup(&copy, 0);
+	release_buffer(&copy);
+	start = now();
+	vector_copy(&copy, &source);
+	report("vector_copy", now() - start, BENCH_BULK_SIZE);
+	vector_destroy(&copy);
+
+	doubles_vector_setup(&copy, 0);
+	release_buffer(&copy);
+	start = now();
+	vector_copy_parallel(&copy, &source, 0);
+	report("vector_copy_parallel", now() - start, BENCH_BULK_SIZE);
+	vector_destroy(&copy);
+
+	vector_destroy(&source);
+}
+
+/* Resident set size in MiB */
+static double resident_mib(void)
+{
+	long pages = 0;
+	FILE* statm = fopen("/proc/self/statm", "r");
+
+	if (statm != NULL) {
+		if (fscanf(statm, "%*s %ld", &pages) != 1) pages = 0;
+		fclose(statm);
+	}
+
+	return (double)pages * (double)sysconf(_SC_PAGESIZE) / (1 << 20);
+}
+
+/* Fills the whole vector, then drops back to a third of it */
+static void burst(Vector* vector)
+{
+	double d = 1.5;
+
+	vector_resize(vector, BENCH_BULK_SIZE);
+	vector_fill(vector, 0, BENCH_BULK_SIZE, &d, 0);
+	vector_resize(vector, BENCH_BULK_SIZE / 3);
+}
+
+static void bench_release(void)
+{
+	Vector vector = VECTOR_INITIALIZER;
+	size_t released = BENCH_BULK_SIZE - BENCH_BULK_SIZE / 3;
+	double start;
+
+	doubles_vector_setup(&vector, BENCH_BULK_SIZE);
+
+	burst(&vector);
+	printf("%-32s %8.1f MiB\n", "resident after burst", resident_mib());
+	start = now();
+	vector_release_memory(&vector, 0);
+	report("vector_release_memory", now() - start, released);
+	printf("%-32s %8.1f MiB\n", "resident after release", resident_mib());
+
+	burst(&vector);
+	start = now();
+	vector_shrink_to_fit(&vector);
+	report("vector_shrink_to_fit", now() - start, released);
+	printf("%-32s %8.1f MiB\n", "resident after shrink", resident_mib());
+
+	vector_destroy(&vector);
+}
+
+/* One writer appending while readers fetch elements, either through an
+ * RcuVector or through a Vector behind a pthread rwlock */
+typedef struct {
+	bool rcu;
+	RcuVector rcu_vector;
+	Vector vector;
+	pthread_rwlock_t lock;
+} RcuBench;
+
+typedef struct {
+	RcuBench* bench;
+	double total;
+} RcuBenchReader;
+
+static void* rcu_bench_reader(void* argument)
+{
+	RcuBenchReader* self = argument;
+	RcuBench* bench = self->bench;
+	RcuReader reader;
+	RcuView view;
+	size_t reads, index = 0, size;
+	double total = 0;
+	bool rcu = bench->rcu;
+
+	self->total = 0;
+	if (rcu && rcu_vector_reader_setup(&reader, &bench->rcu_vector) == VECTOR_ERROR) {
+		return NULL;
+	}
+
+	for (reads = 0; reads < BENCH_RCU_READS; ++reads) {
+		if (rcu) {
+			view = rcu_vector_read_begin(&reader);
+			if (view.size > 0) total += ((const double*)view.data)[index % view.size];
+			rcu_vector_read_end(&reader);
+		} else {
+			pthread_rwlock_rdlock(&bench->lock);
+			size = vector_size(&bench->vector);
+			if (size > 0) total += *(const double*)vector_const_get(&bench->vector, index % size);
+			pthread_rwlock_unlock(&bench->lock);
+		}
+		index += 7919;
+	}
+
+	if (rcu) rcu_vector_reader_destroy(&reader);
+
+	self->total = total;
+
+	return NULL;
+}
+
+static void bench_rcu_run(bool rcu, size_t readers)
+{
+	RcuBench bench;
+	RcuBenchReader states[BENCH_RCU_MAX_READERS];
+	pthread_t threads[BENCH_RCU_MAX_READERS];
+	char name[64];
+	double start, writer, elapsed, d;
+	size_t i;
+
+	bench.rcu = rcu;
+	if (rcu) {
+		rcu_vector_setup(&bench.rcu_vector, 0, sizeof(double));
+	} else {
+		bench.vector = (Vector)VECTOR_INITIALIZER;
+		doubles_vector_setup(&bench.vector, 0);
+		pthread_rwlock_init(&bench.lock, NULL);
+	}
+
+	for (i = 0; i < readers; ++i) {
+		states[i].bench = &bench;
+		pthread_create(&threads[i], NULL, rcu_bench_reader, &states[i]);
+	}
+
+	start = now();
+	for (i = 0; i < BENCH_RCU_WRITES; ++i) {
+		d = (double)i;
+		if (rcu) {
+			rcu_vector_push_back(&bench.rcu_vector, &d);
+		} else {
+			pthread_rwlock_wrlock(&bench.lock);
+			vector_push_back(&bench.vector, &d);
+			pthread_rwlock_unlock(&bench.lock);
+		}
+	}
+	writer = now() - start;
+
+	for (i = 0; i < readers; ++i) {
+		pthread_join(threads[i], NULL);
+		sink += states[i].total;
+	}
+	elapsed = now() - start;
+
+	/* Reads are timed until the last reader is done */
+	snprintf(name, sizeof name, "%s writer, %zu readers", rcu ? "rcu" : "rwlock", readers);
+	report(name, writer, BENCH_RCU_WRITES);
+	snprintf(name, sizeof name, "%s reads, %zu readers", rcu ? "rcu" : "rwlock", readers);
+	report(name, elapsed, readers * BENCH_RCU_READS);
+
+	if (rcu) {
+		rcu_vector_destroy(&bench.rcu_vector);
+	} else {
+		vector_destroy(&bench.vector);
+		pthread_rwlock_destroy(&bench.lock);
+	}
+}
+
+static void bench_rcu(void)
+{
+	size_t readers;
+
+	for (readers = 1; readers <= BENCH_RCU_MAX_READERS; readers *= 2) {
+		bench_rcu_run(true, readers);
+		bench_rcu_run(false, readers);
+	}
+}
+
+static void bench_search(void)
+{
+	Vector vector = VECTOR_INITIALIZER;
+	double start, d, needle = -1;
+	size_t i, found, count = 0;
+
+	doubles_vector_setup(&vector, BENCH_SIZE);
+	for (i = 0; i < BENCH_SIZE; ++i) {
+		d = (double)(i % 1000);
+		vector_push_back(&vector, &d);
+	}
+
+	/* Absent, so every element is looked at */
+	start = now();
+	found = BENCH_SIZE;
+	VECTOR_FOR_EACH(&vector, it) {
+		if (ITERATOR_GET_AS(double, &it) == needle) {
+			found = iterator_index(&vector, &it);
+			break;
+		}
+	}
+	sink += (double)found;
+	report("VECTOR_FOR_EACH find", now() - start, BENCH_SIZE);
+
+	start = now();
+	sink += (double)vector_find(&vector, &needle);
+	report("vector_find", now() - start, BENCH_SIZE);
+
+	needle = 7;
+	start = now();
+	VECTOR_FOR_EACH(&vector, it) {
+		count += ITERATOR_GET_AS(double, &it) == needle;
+	}
+	sink += (double)count;
+	report("VECTOR_FOR_EACH count", now() - start, BENCH_SIZE);
+
+	start = now();
+	sink += (double)vector_count(&vector, &needle);
+	report("vector_count", now() - start, BENCH_SIZE);
+
+	start = now();
+	sink += (double)vector_hash(&vector);
+	report("vector_hash", now() - start, BENCH_SIZE);
+
+	vector_destroy(&vector);
+}
+
+/* Fills the vector with BENCH_LIFECYCLE_SIZE elements made by `make`, then
+ * times capacity doublings, which relocate every element */
+static void bench_relocation(const char* name,
+                             int (*setup)(Vector*, size_t),
+                             void (*make)(void*, size_t))
+{
+	Vector vector = VECTOR_INITIALIZER;
+	char element[32];
+	double start, best = 1e9;
+	size_t i;
+	int round, growth;
+
+	for (round = 0; round < BENCH_ROUNDS; ++round) {
+		setup(&vector, BENCH_LIFECYCLE_SIZE);
+		for (i = 0; i < BENCH_LIFECYCLE_SIZE; ++i) {
+			make(element, i);
+			vector_push_back(&vector, element);
+		}
+
+		start = now();
+		for (growth = 0; growth < BENCH_LIFECYCLE_GROWTHS; ++growth) {
+			vector_reserve(&vector, vector_capacity(&vector) * 2);
+		}
+		best = MIN(best, now() - start);
+
+		vector_destroy(&vector);
+	}
+
+	report(name, best, BENCH_LIFECYCLE_SIZE * BENCH_LIFECYCLE_GROWTHS);
+}
+
+static void make_double(void* element, size_t i)
+{
+	*(double*)element = (double)i;
+}
+
+static void make_name(void* element, size_t i)
+{
+	char buffer[32];
+	sprintf(buffer, "name %zu", i);
+	*(char**)element = name_new(buffer);
+}
+
+static void make_text(void* element, size_t i)
+{
+	char buffer[32];
+	sprintf(buffer, "text %zu", i);
+	text_setup(element, buffer);
+}
+
+static void bench_lifecycle(void)
+{
+	bench_relocation("growth (doubles)", doubles_vector_setup, make_double);
+	bench_relocation("growth (names, relocatable)", names_vector_setup, make_name);
+	bench_relocation("growth (texts, move hook)", texts_vector_setup, make_text);
+}
+
+/* A random permutation of 0..count-1 */
+static void shuffled_indices(Vector* indices, size_t count)
+{
+	size_t i, j, swap;
+	size_t *index;
+
+	doubles_vector_setup(indices, count);
+	vector_resize(indices, count);
+	index = vector_data(indices);
+	for (i = 0; i < count; ++i) index[i] = i;
+	for (i = count - 1; i > 0; --i) {
+		j = (size_t)rand() % (i + 1);
+		swap = index[i];
+		index[i] = index[j];
+		index[j] = swap;
+	}
+}
+
+static void bench_gather_size(const char* label, size_t count)
+{
+	Vector values = VECTOR_INITIALIZER, indices = VECTOR_INITIALIZER;
+	Vector gathered = VECTOR_INITIALIZER;
+	const size_t *index;
+	double start, best_loop = 1e9, best_gather = 1e9, best_scatter = 1e9;
+	double best_permute = 1e9, d;
+	char name[64];
+	size_t i;
+	int round;
+
+	doubles_vector_setup(&values, count);
+	for (i = 0; i < count; ++i) {
+		d = (double)i;
+		vector_push_back(&values, &d);
+	}
+	shuffled_indices(&indices, count);
+	index = vector_const_data(&indices);
+	doubles_vector_setup(&gathered, count);
+
+	for (round = 0; round < BENCH_ROUNDS; ++round) {
+		vector_clear(&gathered);
+		start = now();
+		for (i = 0; i < count; ++i) {
+			vector_push_back(&gathered, vector_get(&values, index[i]));
+		}
+		best_loop = MIN(best_loop, now() - start);
+
+		start = now();
+		vector_gather(&gathered, &values, &indices);
+		best_gather = MIN(best_gather, now() - start);
+
+		start = now();
+		vector_scatter(&values, &gathered, &indices);
+		best_scatter = MIN(best_scatter, now() - start);
+
+		start = now();
+		vector_permute_inplace(&values, &indices);
+		best_permute = MIN(best_permute, now() - start);
+	}
+
+	sprintf(name, "get + push_back (%s)", label);
+	report(name, best_loop, count);
+	sprintf(name, "vector_gather (%s)", label);
+	report(name, best_gather, count);
+	sprintf(name, "vector_scatter (%s)", label);
+	report(name, best_scatter, count);
+	sprintf(name, "vector_permute_inplace (%s)", label);
+	report(name, best_permute, count);
+
+	vector_destroy(&values);
+	vector_destroy(&indices);
+	vector_destroy(&gathered);
+}
+
+/* Cycle following, forced by a vector over caller storage */
+static void bench_permute_cycles(size_t count)
+{
+	Vector fixed = VECTOR_INITIALIZER, indices = VECTOR_INITIALIZER;
+	FixedDoubles fixed_doubles;
+	double *storage, start, best = 1e9, d;
+	size_t i;
+	int round;
+
+	storage = malloc(count * sizeof(double));
+	doubles_fixed_vector_setup(&fixed, &fixed_doubles, storage, count, false);
+	for (i = 0; i < count; ++i) {
+		d = (double)i;
+		vector_push_back(&fixed, &d);
+	}
+	shuffled_indices(&indices, count);
+
+	for (round = 0; round < BENCH_ROUNDS; ++round) {
+		start = now();
+		vector_permute_inplace(&fixed, &indices);
+		best = MIN(best, now() - start);
+	}
+	report("permute, cycles in place (large)", best, count);
+
+	vector_destroy(&fixed);
+	vector_destroy(&indices);
+	free(storage);
+}
+
+static void bench_gather(void)
+{
+	bench_gather_size("small", BENCH_GATHER_SMALL);
+	bench_gather_size("large", BENCH_SIZE);
+	bench_permute_cycles(BENCH_SIZE);
+}
+
+/* `count` sorted int64_t, drawn from [0, range) */
+static void sorted_integers(Vector* vector, size_t count, int64_t range)
+{
+	int64_t integer;
+	size_t i;
+
+	doubles_vector_setup(vector, count);
+	for (i = 0; i < count; ++i) {
+		integer = (int64_t)(((uint64_t)rand() << 31 | (uint64_t)rand()) % (uint64_t)range);
+		vector_push_back(vector, &integer);
+	}
+	qsort(vector_data(vector), count, sizeof(int64_t), vector_compare_int64);
+}
+
+static void bench_merge_k(void)
+{
+	Vector sources[BENCH_MERGE_WAYS], merged = VECTOR_INITIALIZER;
+	size_t cursor[BENCH_MERGE_WAYS], i, s, best_source;
+	const int64_t *head, *best_head;
+	double start, best_loop = 1e9, best_merge = 1e9;
+	int round;
+
+	for (s = 0; s < BENCH_MERGE_WAYS; ++s) {
+		sorted_integers(&sources[s], BENCH_MERGE_SIZE / BENCH_MERGE_WAYS, INT64_MAX);
+	}
+	doubles_vector_setup(&merged, 0);
+
+	for (round = 0; round < BENCH_ROUNDS; ++round) {
+		/* Smallest head by a scan of all sources, one push_back each */
+		vector_clear(&merged);
+		for (s = 0; s < BENCH_MERGE_WAYS; ++s) cursor[s] = 0;
+		start = now();
+		for (i = 0; i < BENCH_MERGE_SIZE; ++i) {
+			best_head = NULL;
+			best_source = 0;
+			for (s = 0; s < BENCH_MERGE_WAYS; ++s) {
+				if (cursor[s] == vector_size(&sources[s])) continue;
+				head = vector_const_get(&sources[s], cursor[s]);
+				if (best_head == NULL || *head < *best_head) {
+					best_head = head;
+					best_source = s;
+				}
+			}
+			vector_push_back(&merged, (void*)best_head);
+			++cursor[best_source];
+		}
+		best_loop = MIN(best_loop, now() - start);
+
+		start = now();
+		vector_merge_k(&merged, sources, BENCH_MERGE_WAYS, vector_compare_int64);
+		best_merge = MIN(best_merge, now() - start);
+	}
+
+	report("16-way, scan + push_back", best_loop, BENCH_MERGE_SIZE);
+	report("16-way, vector_merge_k", best_merge, BENCH_MERGE_SIZE);
+
+	for (s = 0; s < BENCH_MERGE_WAYS; ++s) vector_destroy(&sources[s]);
+	vector_destroy(&merged);
+}
+
+/* Intersects a list of BENCH_SET_SIZE / ratio with one of BENCH_SET_SIZE,
+ * both drawn from the same range */
+static void bench_set_skew(size_t ratio)
+{
+	Vector small = VECTOR_INITIALIZER, large = VECTOR_INITIALIZER;
+	Vector result = VECTOR_INITIALIZER;
+	const int64_t *a, *b;
+	double start, best_loop = 1e9, best_intersection = 1e9, best_union = 1e9;
+	size_t i, j, na, nb;
+	char name[64];
+	int round;
+
+	sorted_integers(&small, BENCH_SET_SIZE / ratio, BENCH_SET_SIZE * 4);
+	sorted_integers(&large, BENCH_SET_SIZE, BENCH_SET_SIZE * 4);
+	doubles_vector_setup(&result, 0);
+	na = vector_size(&small);
+	nb = vector_size(&large);
+
+	for (round = 0; round < BENCH_ROUNDS; ++round) {
+		vector_clear(&result);
+		start = now();
+		a = vector_const_data(&small);
+		b = vector_const_data(&large);
+		for (i = 0, j = 0; i < na && j < nb;) {
+			if (a[i] < b[j]) {
+				++i;
+			} else if (b[j] < a[i]) {
+				++j;
+			} else {
+				vector_push_back(&result, (void*)&a[i]);
+				++i;
+				++j;
+			}
+		}
+		best_loop = MIN(best_loop, now() - start);
+
+		start = now();
+		vector_set_intersection(&result, &small, &large, vector_compare_int64);
+		best_intersection = MIN(best_intersection, now() - start);
+
+		start = now();
+		vector_set_union(&result, &small, &large, vector_compare_int64);
+		best_union = MIN(best_union, now() - start);
+	}
+
+	sprintf(name, "1:%zu intersect, merge loop", ratio);
+	report(name, best_loop, na + nb);
+	sprintf(name, "1:%zu vector_set_intersection", ratio);
+	report(name, best_intersection, na + nb);
+	sprintf(name, "1:%zu vector_set_union", ratio);
+	report(name, best_union, na + nb);
+
+	vector_destroy(&small);
+	vector_destroy(&large);
+	vector_destroy(&result);
+}
+
+static void bench_merging(void)
+{
+	bench_merge_k();
+	bench_set_skew(1);
+	bench_set_skew(10);
+	bench_set_skew(100);
+	bench_set_skew(1000);
+	bench_set_skew(10000);
+}
+
+static void fill_doubles(Vector* vector, size_t count)
+{
+	double d;
+	size_t i;
+
+	doubles_vector_setup(vector, 0);
+	for (i = 0; i < count; ++i) {
+		d = (double)i;
+		vector_push_back(vector, &d);
+	}
+}
+
+static void bench_concat(void)
+{
+	Vector dest = VECTOR_INITIALIZER, src = VECTOR_INITIALIZER;
+	double start, best_push = 1e9, best_empty = 1e9, best_small = 1e9;
+	double best_push_splice = 1e9, best_splice = 1e9;
+	size_t i;
+	int round;
+
+	for (round = 0; round < BENCH_ROUNDS; ++round) {
+		/* A short vector joined with a long one, element by element */
+		fill_doubles(&dest, 100);
+		fill_doubles(&src, BENCH_SIZE);
+		start = now();
+		for (i = 0; i < BENCH_SIZE; ++i) {
+			vector_push_back(&dest, vector_get(&src, i));
+		}
+		vector_clear(&src);
+		best_push = MIN(best_push, now() - start);
+		vector_destroy(&dest);
+		vector_destroy(&src);
+
+		fill_doubles(&dest, 0);
+		fill_doubles(&src, BENCH_SIZE);
+		start = now();
+		vector_concat_move(&dest, &src);
+		best_empty = MIN(best_empty, now() - start);
+		vector_destroy(&dest);
+		vector_destroy(&src);
+
+		fill_doubles(&dest, 100);
+		fill_doubles(&src, BENCH_SIZE);
+		start = now();
+		vector_concat_move(&dest, &src);
+		best_small = MIN(best_small, now() - start);
+		vector_destroy(&dest);
+		vector_destroy(&src);
+
+		/* A range moved into the middle of another vector */
+		fill_doubles(&dest, BENCH_SPLICE_SIZE);
+		fill_doubles(&src, BENCH_SPLICE_SIZE);
+		start = now();
+		for (i = 0; i < BENCH_SPLICE_RANGE; ++i) {
+			vector_insert(&dest, BENCH_SPLICE_SIZE / 2 + i, vector_get(&src, 1000));
+			vector_erase(&src, 1000);
+		}
+		best_push_splice = MIN(best_push_splice, now() - start);
+		vector_destroy(&dest);
+		vector_destroy(&src);
+
+		fill_doubles(&dest, BENCH_SPLICE_SIZE);
+		fill_doubles(&src, BENCH_SPLICE_SIZE);
+		start = now();
+		vector_splice(&dest,
+									BENCH_SPLICE_SIZE / 2,
+									&src,
+									1000,
+									1000 + BENCH_SPLICE_RANGE);
+		best_splice = MIN(best_splice, now() - start);
+		vector_destroy(&dest);
+		vector_destroy(&src);
+	}
+
+	report("join, get + push_back", best_push, BENCH_SIZE);
+	report("vector_concat_move (empty dest)", best_empty, BENCH_SIZE);
+	report("vector_concat_move (short dest)", best_small, BENCH_SIZE);
+	report("splice, insert + erase", best_push_splice, BENCH_SPLICE_RANGE);
+	report("vector_splice", best_splice, BENCH_SPLICE_RANGE);
+}
+
+/* One density of the sparse-dense crossover; times are per dense element so
+ * that the dense loop and the sparse kernels compare directly. The dense loop
+ * keeps four sums, as the sparse kernel does. */
+static void bench_sparse_density(const Vector* dense, double density)
+{
+	SparseVector sparse = SPARSE_VECTOR_INITIALIZER;
+	Vector other = VECTOR_INITIALIZER;
+	const double *x, *y;
+	double start, sum = 0, best_dense = 1e9, best_dot = 1e9, best_axpy = 1e9;
+	double d, best_build = 1e9, sums[4] = { 0, 0, 0, 0 };
+	size_t i;
+	int round;
+
+	/* The same dimension with the entries past the density zeroed */
+	fill_doubles(&other, BENCH_SPARSE_DIMENSION);
+	x = vector_const_data(&other);
+	for (i = 0; i < BENCH_SPARSE_DIMENSION; ++i) {
+		d = (double)(rand() % 100000) / 100000.0 < density ? 1.0 + i % 7 : 0.0;
+		vector_assign(&other, i, &d);
+	}
+	y = vector_const_data(dense);
+	sparse_vector_setup(&sparse, 0, 0);
+
+	for (round = 0; round < BENCH_ROUNDS; ++round) {
+		start = now();
+		for (i = 0; i < BENCH_SPARSE_DIMENSION; i += 4) {
+			sums[0] += x[i] * y[i];
+			sums[1] += x[i + 1] * y[i + 1];
+			sums[2] += x[i + 2] * y[i + 2];
+			sums[3] += x[i + 3] * y[i + 3];
+		}
+		best_dense = MIN(best_dense, now() - start);
+		sink = sums[0] + sums[1] + sums[2] + sums[3];
+
+		start = now();
+		if (sparse_vector_from_dense(&sparse, &other, 0) == VECTOR_ERROR) break;
+		best_build = MIN(best_build, now() - start);
+
+		start = now();
+		if (sparse_vector_dot_dense(&sparse, dense, &sum) == VECTOR_ERROR) break;
+		best_dot = MIN(best_dot, now() - start);
+		sink = sum;
+
+		start = now();
+		sparse_vector_axpy_dense(1e-9, &sparse, (Vector*)dense);
+		best_axpy = MIN(best_axpy, now() - start);
+	}
+
+	if (round < BENCH_ROUNDS) {
+		printf("density %.1f%%: the sparse kernels failed\n", density * 100);
+		sparse_vector_destroy(&sparse);
+		vector_destroy(&other);
+		return;
+	}
+
+	printf("density %.1f%%: %zu entries, %zu of %zu dense bytes\n",
+				 density * 100,
+				 sparse_vector_size(&sparse),
+				 sparse_vector_byte_size(&sparse),
+				 (size_t)BENCH_SPARSE_DIMENSION * sizeof(double));
+	report("  dense dot", best_dense, BENCH_SPARSE_DIMENSION);
+	report("  sparse dot", best_dot, BENCH_SPARSE_DIMENSION);
+	report("  sparse axpy", best_axpy, BENCH_SPARSE_DIMENSION);
+	report("  from dense", best_build, BENCH_SPARSE_DIMENSION);
+
+	sparse_vector_destroy(&sparse);
+	vector_destroy(&other);
+}
+
+static void bench_sparse(void)
+{
+	Vector dense = VECTOR_INITIALIZER;
+
+	fill_doubles(&dense, BENCH_SPARSE_DIMENSION);
+	bench_sparse_density(&dense, 0.001);
+	bench_sparse_density(&dense, 0.01);
+	bench_sparse_density(&dense, 0.05);
+	bench_sparse_density(&dense, 0.1);
+	bench_sparse_density(&dense, 0.25);
+	bench_sparse_density(&dense, 0.5);
+	vector_destroy(&dense);
+}
+
+/* Appends BENCH_STREAM_BATCHES batches of doubles, one at a time, to a
+ * scratch file, either through a stream or, with `options` NULL, into a
+ * buffer of the stream's default size that is written out with a blocking
+ * write() whenever it fills. Reports the throughput and the latency of
+ * single batches. */
+static void bench_stream_run(const char* name, const VectorStreamOptions* options)
+{
+	VectorStream stream;
+	unsigned char *pending = NULL;
+	FILE *file = tmpfile();
+	double batch[BENCH_STREAM_BATCH], *latencies, start, begin, seconds;
+	size_t i, b, used = 0;
+	int fd = fileno(file);
+
+	latencies = malloc(BENCH_STREAM_BATCHES * sizeof(double));
+	for (i = 0; i < BENCH_STREAM_BATCH; ++i) batch[i] = (double)i;
+
+	if (options != NULL) {
+		if (vector_stream_setup(&stream, fd, sizeof(double), options) == VECTOR_ERROR) {
+			printf("%-32s unsupported here\n", name);
+			free(latencies);
+			fclose(file);
+			return;
+		}
+	} else {
+		pending = malloc(VECTOR_STREAM_DEFAULT_BUFFER_SIZE);
+	}
+
+	begin = now();
+	for (b = 0; b < BENCH_STREAM_BATCHES; ++b) {
+		start = now();
+		if (options != NULL) {
+			for (i = 0; i < BENCH_STREAM_BATCH; ++i) {
+				vector_stream_push_back(&stream, &batch[i]);
+			}
+		} else {
+			for (i = 0; i < BENCH_STREAM_BATCH; ++i) {
+				memcpy(pending + used, &batch[i], sizeof(double));
+				used += sizeof(double);
+				if (used == VECTOR_STREAM_DEFAULT_BUFFER_SIZE) {
+					sink = (double)write(fd, pending, used);
+					used = 0;
+				}
+			}
+		}
+		latencies[b] = now() - start;
+	}
+	if (options != NULL) {
+		vector_stream_close(&stream);
+	} else {
+		sink = (double)write(fd, pending, used);
+		free(pending);
+	}
+	seconds = now() - begin;
+
+	qsort(latencies, BENCH_STREAM_BATCHES, sizeof(double), compare_doubles);
+	report(name, seconds, BENCH_STREAM_BATCHES * BENCH_STREAM_BATCH);
+	printf("  %.0f MB/s, batch p50 %.1f us p99 %.1f us p99.9 %.1f us max %.1f us\n",
+				 (double)(BENCH_STREAM_BATCHES * sizeof batch) / seconds / 1e6,
+				 latencies[BENCH_STREAM_BATCHES / 2] * 1e6,
+				 latencies[BENCH_STREAM_BATCHES * 99 / 100] * 1e6,
+				 latencies[BENCH_STREAM_BATCHES * 999 / 1000] * 1e6,
+				 latencies[BENCH_STREAM_BATCHES - 1] * 1e6);
+	if (options != NULL) printf("  %zu stalls\n", stream.stalls);
+
+	free(latencies);
+	fclose(file);
+}
+
+static void bench_stream(void)
+{
+	VectorStreamOptions options = VECTOR_STREAM_OPTIONS_DEFAULT;
+
+	bench_stream_run("blocking write", NULL);
+	bench_stream_run("stream", &options);
+	options.buffer_count = 8;
+	bench_stream_run("stream, 8 buffers", &options);
+	options.buffer_count = VECTOR_STREAM_DEFAULT_BUFFERS;
+	options.direct = true;
+	bench_stream_run("stream, direct", &options);
+	options.buffer_size = (size_t)8 << 20;
+	bench_stream_run("stream, direct, 8 MiB", &options);
+}
+
+int main(int argc, const char* argv[]) {
+	printf("BENCHMARKING UNCHECKED ACCESS ...\n");
+	bench_push_back();
+	bench_get();
+
+	printf("BENCHMARKING COMPRESSED VECTOR ...\n");
+	bench_compressed();
+
+	printf("BENCHMARKING HEAP ...\n");
+	bench_heap();
+
+	printf("BENCHMARKING PIPELINE ...\n");
+	bench_pipeline();
+
+	printf("BENCHMARKING PARSE ...\n");
+	bench_parse();
+
+	printf("BENCHMARKING BULK ...\n");
+	bench_bulk();
+
+	printf("BENCHMARKING RELEASE ...\n");
+	bench_release();
+
+	printf("BENCHMARKING RCU ...\n");
+	bench_rcu();
+
+	printf("BENCHMARKING SEARCH ...\n");
+	bench_search();
+
+	printf("BENCHMARKING LIFECYCLE ...\n");
+	bench_lifecycle();
+
+	printf("BENCHMARKING GATHER ...\n");
+	bench_gather();
+
+	printf("BENCHMARKING MERGING ...\n");
+	bench_merging();
+
+	printf("BENCHMARKING CONCAT ...\n");
+	bench_concat();
+
+	printf("BENCHMARKING SPARSE ...\n");
+	bench_sparse();
+
+	printf("BENCHMARKING STREAM ...\n");
+	bench_stream();
+}
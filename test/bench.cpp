@@ -0,0 +1,128 @@
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <numeric>
+#include <span>
+#include <vector>
+
+#include "vector.hpp"
+
+#define BENCH_SIZE 10000000
+#define BENCH_ROUNDS 5
+#define BENCH_BOXED_SIZE 1000000
+
+static double now()
+{
+	using clock = std::chrono::steady_clock;
+	return std::chrono::duration<double>(clock::now().time_since_epoch()).count();
+}
+
+static void report(const char* name, double seconds, size_t operations)
+{
+	printf("%-32s %8.2f ms %8.2f ns/op\n",
+				 name,
+				 seconds * 1e3,
+				 seconds * 1e9 / (double)operations);
+}
+
+/* Keeps the optimizer from discarding benchmark loops */
+static volatile double sink;
+
+/* Owns its element, but may be moved with memcpy */
+struct Boxed
+{
+	std::unique_ptr<double> value;
+	explicit Boxed(double v) : value(new double(v)) {}
+};
+
+template <>
+struct vec::is_trivially_relocatable<Boxed> : std::true_type {};
+
+template <class Vector>
+static void bench_push_back(const char* name)
+{
+	double start, best = 1e9;
+
+	for (int round = 0; round < BENCH_ROUNDS; ++round) {
+		Vector vector;
+		start = now();
+		for (size_t i = 0; i < BENCH_SIZE; ++i) vector.push_back((double)i);
+		best = std::min(best, now() - start);
+		sink = sink + vector.back();
+	}
+
+	report(name, best, BENCH_SIZE);
+}
+
+template <class Vector>
+static void bench_iterate(const char* name)
+{
+	Vector vector;
+	double start, best = 1e9;
+
+	for (size_t i = 0; i < BENCH_SIZE; ++i) vector.push_back((double)i);
+
+	for (int round = 0; round < BENCH_ROUNDS; ++round) {
+		double total = 0;
+		start = now();
+		for (double d : vector) total += d;
+		best = std::min(best, now() - start);
+		sink = sink + total;
+	}
+
+	report(name, best, BENCH_SIZE);
+}
+
+template <class Vector>
+static void bench_boxed(const char* name)
+{
+	double start, best = 1e9;
+
+	for (int round = 0; round < BENCH_ROUNDS; ++round) {
+		Vector vector;
+		start = now();
+		for (size_t i = 0; i < BENCH_BOXED_SIZE; ++i) vector.emplace_back((double)i);
+		best = std::min(best, now() - start);
+		sink = sink + *vector.back().value;
+	}
+
+	report(name, best, BENCH_BOXED_SIZE);
+}
+
+static void bench_c_push_back()
+{
+	double start, best = 1e9;
+
+	for (int round = 0; round < BENCH_ROUNDS; ++round) {
+		vec::vector<double> vector;
+		Vector view = vector.c_vector();
+		start = now();
+		for (size_t i = 0; i < BENCH_SIZE; ++i) {
+			double d = (double)i;
+			vector_push_back(&view, &d);
+		}
+		best = std::min(best, now() - start);
+		sink = sink + vector.back();
+	}
+
+	report("vector_push_back via c_vector", best, BENCH_SIZE);
+}
+
+int main(int argc, const char* argv[]) {
+	printf("BENCHMARKING PUSH BACK ...\n");
+	bench_push_back<vec::vector<double>>("vec::vector push_back");
+	bench_push_back<vec::vector<double, vec::policy<vec::grow_half>>>(
+			"vec::vector push_back (1.5x)");
+	bench_push_back<std::vector<double>>("std::vector push_back");
+	bench_c_push_back();
+
+	printf("BENCHMARKING ITERATION ...\n");
+	bench_iterate<vec::vector<double>>("vec::vector range-for");
+	bench_iterate<std::vector<double>>("std::vector range-for");
+
+	printf("BENCHMARKING RELOCATION ...\n");
+	bench_boxed<vec::vector<Boxed>>("vec::vector emplace_back boxed");
+	bench_boxed<std::vector<Boxed>>("std::vector emplace_back boxed");
+}
@@ -1,4 +1,5 @@
 #include <assert.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -30,6 +31,11 @@ double *doubles_iter_prev(double *pointer)
 	return pointer - 1;
 }
 
+size_t doubles_iter_stride(void)
+{
+  return sizeof(double);
+}
+
 /* Wrapper functions */
 
 static inline int doubles_iter_type__(void)
@@ -52,6 +58,11 @@ static inline void *doubles_iter_prev__(void *self)
   return doubles_iter_prev(self);
 }
 
+static inline size_t doubles_iter_stride__(void)
+{
+  return doubles_iter_stride();
+}
+
 
 /***** VECTOR *****/
 
@@ -146,6 +157,7 @@ Iterator doubles_iterator(Doubles *doubles, size_t index) {
     ._iter_pointer = doubles_iter_pointer__,
     ._iter_next    = doubles_iter_next__,
     ._iter_prev    = doubles_iter_prev__,
+    ._iter_stride  = doubles_iter_stride__,
   };
 
   iterator.tc = &iterator_tc;
@@ -268,3 +280,232 @@ int doubles_vector_setup(Vector *vector, size_t capacity)
 
   return VECTOR_SUCCESS;
 }
+
+
+/***** BATCH *****/
+
+/* Size of a slot header, padded so the buffer after it is aligned */
+#define DOUBLES_HEADER_SIZE \
+  ((sizeof(Doubles) + sizeof(double) - 1) / sizeof(double) * sizeof(double))
+
+double *doubles_slot(const Doubles *doubles)
+{
+  return (double *)((char *)doubles + DOUBLES_HEADER_SIZE);
+}
+
+Doubles *doubles_batch_header(const DoublesBatch *batch, size_t index)
+{
+	assert(batch != NULL);
+	assert(index < batch->count);
+
+  return (Doubles *)((char *)batch->slab + index * batch->stride);
+}
+
+bool doubles_slab_owns_data(const Doubles *doubles, const double *data)
+{
+	assert(doubles != NULL);
+  return data != doubles_slot(doubles);
+}
+
+int doubles_slab_destroy(Doubles *doubles)
+{
+	assert(doubles != NULL);
+
+	if (doubles == NULL) return VECTOR_ERROR;
+
+	/* The header and the slot go back with the slab */
+	if (doubles->data != doubles_slot(doubles)) free(doubles->data);
+	doubles->data = NULL;
+
+	return VECTOR_SUCCESS;
+}
+
+/* Wrapper functions */
+
+static inline bool doubles_slab_owns_data__(const void *self, const void *data)
+{
+  return doubles_slab_owns_data(self, data);
+}
+
+static inline int doubles_slab_destroy__(void *self)
+{
+  return doubles_slab_destroy(self);
+}
+
+static VectorTC const doubles_slab_vector_tc = {
+  ._vec_elem_size    = doubles_elem_size__,
+  ._vec_type         = doubles_type__,
+  ._vec_size         = doubles_size__,
+  ._vec_cap          = doubles_capacity__,
+  ._vec_data         = doubles_data__,
+  ._vec_set_size     = doubles_set_size__,
+  ._vec_set_cap      = doubles_set_capacity__,
+  ._vec_set_data     = doubles_set_data__,
+  ._vec_offset       = doubles_offset__,
+  ._vec_const_offset = doubles_const_offset__,
+  ._vec_offset_next  = doubles_offset_next__,
+  ._vec_iterator     = doubles_iterator__,
+  ._vec_destroy      = doubles_slab_destroy__,
+  ._vec_owns_data    = doubles_slab_owns_data__,
+};
+
+/* Set up `count` vectors with a single allocation */
+
+int doubles_batch_setup(DoublesBatch *batch,
+                        Vector *vectors,
+                        size_t count,
+                        size_t capacity)
+{
+	Doubles *doubles;
+	size_t i;
+
+	assert(batch != NULL);
+	assert(vectors != NULL);
+
+	if (batch == NULL) return VECTOR_ERROR;
+	if (vectors == NULL) return VECTOR_ERROR;
+
+	capacity = MAX(VECTOR_MINIMUM_CAPACITY, capacity);
+
+	/* The slot and slab sizes must not wrap around */
+	if (capacity > (SIZE_MAX - DOUBLES_HEADER_SIZE) / sizeof(double)) {
+		return VECTOR_ERROR;
+	}
+	batch->stride = DOUBLES_HEADER_SIZE + capacity * sizeof(double);
+	if (count > SIZE_MAX / batch->stride) return VECTOR_ERROR;
+
+	batch->count = count;
+	batch->slab = malloc(MAX(1, count * batch->stride));
+	if (batch->slab == NULL) return VECTOR_ERROR;
+
+	for (i = 0; i < count; ++i) {
+		doubles = doubles_batch_header(batch, i);
+		doubles->size = 0;
+		doubles->capacity = capacity;
+		doubles->data = doubles_slot(doubles);
+
+		vectors[i].tc = &doubles_slab_vector_tc;
+		vectors[i].self = doubles;
+	}
+
+	return VECTOR_SUCCESS;
+}
+
+/* Destroys every vector of the batch, including those already spilled to the
+ * heap, and frees the slab in one go */
+
+int doubles_batch_destroy(DoublesBatch *batch)
+{
+	Vector vector;
+	size_t i;
+
+	assert(batch != NULL);
+
+	if (batch == NULL) return VECTOR_ERROR;
+
+	for (i = 0; i < batch->count; ++i) {
+		vector.tc = &doubles_slab_vector_tc;
+		vector.self = doubles_batch_header(batch, i);
+
+		/* Goes through the generic path so spilled buffers still shared with
+		 * a snapshot survive */
+		if (vector_destroy(&vector) == VECTOR_ERROR) return VECTOR_ERROR;
+	}
+
+	free(batch->slab);
+	batch->slab = NULL;
+	batch->count = 0;
+
+	return VECTOR_SUCCESS;
+}
+
+
+/***** FIXED *****/
+
+bool doubles_fixed_owns_data(const FixedDoubles *fixed, const double *data)
+{
+	assert(fixed != NULL);
+  return data != fixed->storage;
+}
+
+bool doubles_fixed_can_allocate(const FixedDoubles *fixed)
+{
+	assert(fixed != NULL);
+  return fixed->spill;
+}
+
+int doubles_fixed_destroy(FixedDoubles *fixed)
+{
+	assert(fixed != NULL);
+
+	if (fixed == NULL) return VECTOR_ERROR;
+
+	/* Both the struct and the storage belong to the caller */
+	if (fixed->doubles.data != fixed->storage) free(fixed->doubles.data);
+	fixed->doubles.data = NULL;
+
+	return VECTOR_SUCCESS;
+}
+
+/* Wrapper functions */
+
+static inline bool doubles_fixed_owns_data__(const void *self, const void *data)
+{
+  return doubles_fixed_owns_data(self, data);
+}
+
+static inline bool doubles_fixed_can_allocate__(const void *self)
+{
+  return doubles_fixed_can_allocate(self);
+}
+
+static inline int doubles_fixed_destroy__(void *self)
+{
+  return doubles_fixed_destroy(self);
+}
+
+static VectorTC const doubles_fixed_vector_tc = {
+  ._vec_elem_size    = doubles_elem_size__,
+  ._vec_type         = doubles_type__,
+  ._vec_size         = doubles_size__,
+  ._vec_cap          = doubles_capacity__,
+  ._vec_data         = doubles_data__,
+  ._vec_set_size     = doubles_set_size__,
+  ._vec_set_cap      = doubles_set_capacity__,
+  ._vec_set_data     = doubles_set_data__,
+  ._vec_offset       = doubles_offset__,
+  ._vec_const_offset = doubles_const_offset__,
+  ._vec_offset_next  = doubles_offset_next__,
+  ._vec_iterator     = doubles_iterator__,
+  ._vec_destroy      = doubles_fixed_destroy__,
+  ._vec_owns_data    = doubles_fixed_owns_data__,
+  ._vec_can_allocate = doubles_fixed_can_allocate__,
+};
+
+int doubles_fixed_vector_setup(Vector *vector,
+                               FixedDoubles *fixed,
+                               double *storage,
+                               size_t capacity,
+                               bool spill)
+{
+	assert(vector != NULL);
+	assert(fixed != NULL);
+	assert(storage != NULL);
+	assert(capacity > 0);
+
+	if (vector == NULL) return VECTOR_ERROR;
+	if (fixed == NULL) return VECTOR_ERROR;
+	if (storage == NULL) return VECTOR_ERROR;
+	if (capacity == 0) return VECTOR_ERROR;
+
+	fixed->doubles.size = 0;
+	fixed->doubles.capacity = capacity;
+	fixed->doubles.data = storage;
+	fixed->storage = storage;
+	fixed->spill = spill;
+
+	vector->tc = &doubles_fixed_vector_tc;
+	vector->self = fixed;
+
+	return VECTOR_SUCCESS;
+}
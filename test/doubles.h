@@ -13,4 +13,36 @@ typedef struct Doubles {
 
 int doubles_vector_setup(Vector *vector, size_t capacity);
 
+/* A group of vectors carved out of one slab: every slot packs a `Doubles`
+ * header with an initial buffer of `capacity` elements. A vector that
+ * outgrows its slot moves to the heap on its own. */
+typedef struct DoublesBatch {
+	void *slab;
+	size_t count;
+	size_t stride;
+} DoublesBatch;
+
+int doubles_batch_setup(DoublesBatch *batch,
+                        Vector *vectors,
+                        size_t count,
+                        size_t capacity);
+int doubles_batch_destroy(DoublesBatch *batch);
+
+/* A vector over caller storage (on the stack, in static storage or in shared
+ * memory) that never allocates: growing past `capacity` fails with
+ * VECTOR_ERROR. With `spill` it moves to the heap instead, like a batch slot.
+ * `doubles` comes first, so the struct is a `Doubles` to the shared
+ * functions. */
+typedef struct FixedDoubles {
+	Doubles doubles;
+	double *storage;
+	bool spill;
+} FixedDoubles;
+
+int doubles_fixed_vector_setup(Vector *vector,
+                               FixedDoubles *fixed,
+                               double *storage,
+                               size_t capacity,
+                               bool spill);
+
 #endif /* DOUBLES_H */
@@ -1,8 +1,220 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <assert.h>
+#include <fcntl.h>
+#include <locale.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
+#include "bit_vector.h"
+#include "compressed_vector.h"
 #include "doubles.h"
+#include "flat_map.h"
+#include "pipeline.h"
+#include "rcu_vector.h"
+#include "sparse_vector.h"
+#include "texts.h"
 #include "vector.h"
+#include "vector_algorithm.h"
+#include "vector_parse.h"
+#include "vector_stream.h"
+
+static int compare_doubles(const void* first, const void* second)
+{
+	double a = *(const double*)first, b = *(const double*)second;
+	return (a > b) - (a < b);
+}
+
+static int compare_texts(const void* first, const void* second)
+{
+	const Text *a = first, *b = second;
+
+	if (a->chars == NULL || b->chars == NULL) {
+		return (a->chars != NULL) - (b->chars != NULL);
+	}
+	return strcmp(a->chars, b->chars);
+}
+
+static int compare_names(const void* first, const void* second)
+{
+	return strcmp(*(char* const*)first, *(char* const*)second);
+}
+
+/* Orders doubles by their integer part only, so that ties can be told apart */
+static int compare_floors(const void* first, const void* second)
+{
+	int64_t a = (int64_t)*(const double*)first, b = (int64_t)*(const double*)second;
+	return (a > b) - (a < b);
+}
+
+/* Sorted values below `range`, with repeats, stored as doubles or int64_t */
+static void fill_sorted(Vector* vector, int count, int range, bool integers)
+{
+	int64_t integer;
+	double d;
+	int i;
+
+	doubles_vector_setup(vector, 0);
+	for (i = 0; i < count; ++i) {
+		integer = rand() % range;
+		d = (double)integer;
+		vector_push_back(vector, integers ? (void*)&integer : (void*)&d);
+	}
+	qsort(vector_data(vector),
+				vector_size(vector),
+				sizeof(double),
+				integers ? vector_compare_int64 : vector_compare_double);
+}
+
+static int64_t value_at(Vector* vector, size_t index, bool integers)
+{
+	return integers ? VECTOR_GET_AS(int64_t, vector, index)
+									: (int64_t)VECTOR_GET_AS(double, vector, index);
+}
+
+#define SET_TEST_RANGE 64
+
+/* Runs the three set operations and checks their multiplicities */
+static void check_set_operations(int na, int nb, bool integers, VectorCompare compare)
+{
+	Vector a = VECTOR_INITIALIZER, b = VECTOR_INITIALIZER;
+	Vector result = VECTOR_INITIALIZER;
+	int ca[SET_TEST_RANGE] = {0}, cb[SET_TEST_RANGE] = {0};
+	int cr[SET_TEST_RANGE], expected, operation, v;
+	size_t i;
+
+	fill_sorted(&a, na, SET_TEST_RANGE, integers);
+	fill_sorted(&b, nb, SET_TEST_RANGE, integers);
+	doubles_vector_setup(&result, 0);
+	for (i = 0; i < vector_size(&a); ++i) ++ca[value_at(&a, i, integers)];
+	for (i = 0; i < vector_size(&b); ++i) ++cb[value_at(&b, i, integers)];
+
+	for (operation = 0; operation < 3; ++operation) {
+		switch (operation) {
+			case 0: assert(vector_set_union(&result, &a, &b, compare) == VECTOR_SUCCESS); break;
+			case 1: assert(vector_set_intersection(&result, &a, &b, compare) == VECTOR_SUCCESS); break;
+			case 2: assert(vector_set_difference(&result, &a, &b, compare) == VECTOR_SUCCESS); break;
+		}
+
+		memset(cr, 0, sizeof cr);
+		for (i = 0; i < vector_size(&result); ++i) {
+			++cr[value_at(&result, i, integers)];
+			assert(i == 0 || value_at(&result, i - 1, integers) <= value_at(&result, i, integers));
+		}
+		for (v = 0; v < SET_TEST_RANGE; ++v) {
+			switch (operation) {
+				case 0: expected = MAX(ca[v], cb[v]); break;
+				case 1: expected = MIN(ca[v], cb[v]); break;
+				default: expected = MAX(ca[v] - cb[v], 0); break;
+			}
+			assert(cr[v] == expected);
+		}
+	}
+
+	vector_destroy(&a);
+	vector_destroy(&b);
+	vector_destroy(&result);
+}
+
+/* Walks the first double of every pair, like one column of an array of
+ * { x, y } structs */
+static int column_iter_type(void) { return 2; }
+static void* column_iter_pointer(void* self) { return self; }
+static void* column_iter_next(void* self) { return (double*)self + 2; }
+static void* column_iter_prev(void* self) { return (double*)self - 2; }
+static size_t column_iter_stride(void) { return 2 * sizeof(double); }
+
+static IteratorTC const column_iterator_tc = {
+	._iter_type    = column_iter_type,
+	._iter_pointer = column_iter_pointer,
+	._iter_next    = column_iter_next,
+	._iter_prev    = column_iter_prev,
+	._iter_stride  = column_iter_stride,
+};
+
+/* The same walk without arithmetic hooks, which has to step */
+static IteratorTC const column_stepping_tc = {
+	._iter_type    = column_iter_type,
+	._iter_pointer = column_iter_pointer,
+	._iter_next    = column_iter_next,
+	._iter_prev    = column_iter_prev,
+};
+
+/* A doubles iterator from before the arithmetic hooks, counting its steps */
+static size_t plain_iter_steps;
+static int plain_iter_type(void) { return 1; }
+static void* plain_iter_next(void* self) { ++plain_iter_steps; return (double*)self + 1; }
+static void* plain_iter_prev(void* self) { ++plain_iter_steps; return (double*)self - 1; }
+
+static IteratorTC const plain_iterator_tc = {
+	._iter_type    = plain_iter_type,
+	._iter_pointer = column_iter_pointer,
+	._iter_next    = plain_iter_next,
+	._iter_prev    = plain_iter_prev,
+};
+
+/* Pipeline stages */
+static bool is_multiple(const void* element, void* context)
+{
+	return (int64_t)*(const double*)element % *(int*)context == 0;
+}
+
+static void square(void* result, const void* element, void* context)
+{
+	*(double*)result = *(const double*)element * *(const double*)element;
+}
+
+static void truncate_to_int64(void* result, const void* element, void* context)
+{
+	*(int64_t*)result = (int64_t)*(const double*)element;
+}
+
+static void sum_doubles(void* accumulator, const void* element, void* context)
+{
+	*(double*)accumulator += *(const double*)element;
+}
+
+static void add_doubles(void* accumulator, const void* partial, void* context)
+{
+	*(double*)accumulator += *(const double*)partial;
+}
+
+static bool is_negative(const void* element, void* context)
+{
+	return *(const double*)element < 0;
+}
+
+/* Checks that every view is a prefix of 0, 1, 2, ... no shorter than the
+ * last one, until it sees `RCU_TEST_SIZE` elements */
+#define RCU_TEST_SIZE 200000
+
+static void* rcu_test_reader(void* argument)
+{
+	RcuReader reader;
+	RcuView view;
+	size_t last = 0, i;
+	const double* data;
+
+	assert(rcu_vector_reader_setup(&reader, argument) == VECTOR_SUCCESS);
+
+	do {
+		view = rcu_vector_read_begin(&reader);
+		data = view.data;
+		assert(view.size >= last);
+		for (i = last; i < view.size; ++i) assert(data[i] == (double)i);
+		if (view.size > 0) assert(data[view.size / 2] == (double)(view.size / 2));
+		last = view.size;
+		rcu_vector_read_end(&reader);
+	} while (last < RCU_TEST_SIZE);
+
+	assert(rcu_vector_reader_destroy(&reader) == VECTOR_SUCCESS);
+
+	return NULL;
+}
 
 int main(int argc, const char* argv[]) {
 	int i;
@@ -76,5 +288,1588 @@ int main(int argc, const char* argv[]) {
 
 	assert(vector_destroy(&vector) == 0);
 
+	printf("TESTING SNAPSHOT ...\n");
+	{
+		Vector original = VECTOR_INITIALIZER;
+		Vector snapshot = VECTOR_INITIALIZER;
+
+		doubles_vector_setup(&original, 0);
+		doubles_vector_setup(&snapshot, 0);
+		for (i = 0; i < 100; ++i) {
+			d = (double)i;
+			vector_push_back(&original, &d);
+		}
+
+		assert(vector_snapshot(&snapshot, &original) == VECTOR_SUCCESS);
+		assert(vector_is_shared(&original));
+		assert(vector_size(&snapshot) == 100);
+		assert(vector_const_get(&snapshot, 10) == vector_const_get(&original, 10));
+
+		/* The first write takes a private copy */
+		d = -1;
+		assert(vector_assign(&original, 10, &d) == VECTOR_SUCCESS);
+		assert(!vector_is_shared(&original));
+		assert(!vector_is_shared(&snapshot));
+		assert(*(const double*)vector_const_get(&snapshot, 10) == 10);
+		assert(VECTOR_GET_AS(double, &original, 10) == -1);
+
+		/* The snapshot outlives its source */
+		assert(vector_snapshot(&snapshot, &original) == VECTOR_SUCCESS);
+		assert(vector_destroy(&original) == VECTOR_SUCCESS);
+		assert(!vector_is_shared(&snapshot));
+		assert(VECTOR_GET_AS(double, &snapshot, 10) == -1);
+		assert(vector_push_back(&snapshot, &d) == VECTOR_SUCCESS);
+		assert(vector_size(&snapshot) == 101);
+
+		/* Many live snapshots leave unrelated vectors unshared */
+		{
+			Vector sources[32], copies[32];
+
+			for (i = 0; i < 32; ++i) {
+				doubles_vector_setup(&sources[i], 1);
+				doubles_vector_setup(&copies[i], 0);
+				vector_push_back(&sources[i], &d);
+				assert(vector_snapshot(&copies[i], &sources[i]) == VECTOR_SUCCESS);
+			}
+			for (i = 0; i < 32; ++i) {
+				assert(vector_is_shared(&sources[i]));
+				assert(vector_is_shared(&copies[i]));
+			}
+			assert(!vector_is_shared(&snapshot));
+			for (i = 0; i < 32; ++i) {
+				assert(vector_destroy(&sources[i]) == VECTOR_SUCCESS);
+				assert(!vector_is_shared(&copies[i]));
+				assert(vector_destroy(&copies[i]) == VECTOR_SUCCESS);
+			}
+		}
+
+		assert(vector_destroy(&snapshot) == VECTOR_SUCCESS);
+	}
+
+	printf("TESTING BATCH SETUP ...\n");
+	{
+		DoublesBatch batch;
+		Vector vectors[100], moved = VECTOR_INITIALIZER;
+
+		assert(doubles_batch_setup(&batch, vectors, SIZE_MAX / 8, 4) == VECTOR_ERROR);
+		assert(doubles_batch_setup(&batch, vectors, 2, SIZE_MAX / 4) == VECTOR_ERROR);
+		assert(doubles_batch_setup(&batch, vectors, 100, 4) == VECTOR_SUCCESS);
+		assert((char*)vectors[1].self - (char*)vectors[0].self == batch.stride);
+
+		for (i = 0; i < 100 * 4; ++i) {
+			d = (double)i;
+			assert(vector_push_back(&vectors[i % 100], &d) == VECTOR_SUCCESS);
+		}
+		assert(vector_capacity(&vectors[0]) == 4);
+
+		/* Outgrowing the slot moves a single vector to the heap */
+		for (i = 0; i < 10; ++i) {
+			d = (double)-i;
+			assert(vector_push_back(&vectors[7], &d) == VECTOR_SUCCESS);
+		}
+		assert(vector_size(&vectors[7]) == 14);
+		assert(VECTOR_GET_AS(double, &vectors[7], 1) == 107);
+		assert(VECTOR_GET_AS(double, &vectors[7], 13) == -9);
+		assert(VECTOR_GET_AS(double, &vectors[8], 3) == 308);
+
+		/* Shrinking keeps the slot instead of allocating */
+		assert(vector_erase(&vectors[8], 0) == VECTOR_SUCCESS);
+		assert(vector_erase(&vectors[8], 0) == VECTOR_SUCCESS);
+		assert(vector_erase(&vectors[8], 0) == VECTOR_SUCCESS);
+		assert(vector_capacity(&vectors[8]) == 4);
+		assert(VECTOR_GET_AS(double, &vectors[8], 0) == 308);
+
+		/* A slot cannot change hands, so moving out of it copies */
+		assert(doubles_vector_setup(&moved, 0) == VECTOR_SUCCESS);
+		assert(vector_move_assign(&moved, &vectors[8]) == VECTOR_SUCCESS);
+		assert(vector_size(&moved) == 1);
+		assert(VECTOR_GET_AS(double, &moved, 0) == 308);
+		assert(!vector_is_initialized(&vectors[8]));
+		assert(vector_destroy(&moved) == VECTOR_SUCCESS);
+
+		assert(vector_destroy(&vectors[3]) == VECTOR_SUCCESS);
+		assert(doubles_batch_destroy(&batch) == VECTOR_SUCCESS);
+	}
+
+	printf("TESTING FLAT MAP ...\n");
+	{
+		FlatMap map;
+		FlatSet set;
+		Vector keys = VECTOR_INITIALIZER;
+		Vector values = VECTOR_INITIALIZER;
+		double batch_keys[] = { 9, 3, 7, 3, 1 };
+		double batch_values[] = { 90, 30, 70, 31, 10 };
+		double key, value;
+
+		doubles_vector_setup(&keys, 0);
+		doubles_vector_setup(&values, 0);
+		assert(flat_map_setup(&map, &keys, &values, compare_doubles) == VECTOR_SUCCESS);
+
+		for (i = 10; i > 0; i -= 2) {
+			key = (double)i, value = (double)(i * 100);
+			assert(flat_map_insert(&map, &key, &value) == VECTOR_SUCCESS);
+		}
+		assert(flat_map_size(&map) == 5);
+
+		/* Sorted, deduplicated and merged with the existing keys */
+		assert(flat_map_insert_many(&map, batch_keys, batch_values, 5) == VECTOR_SUCCESS);
+		assert(flat_map_size(&map) == 9);
+		for (i = 1; i < vector_size(&map.keys); ++i) {
+			assert(VECTOR_GET_AS(double, &map.keys, i - 1) <
+						 VECTOR_GET_AS(double, &map.keys, i));
+		}
+		key = 3;
+		assert(*(double*)flat_map_get(&map, &key) == 31);
+		key = 10;
+		assert(*(double*)flat_map_get(&map, &key) == 1000);
+
+		/* The batch overrides existing keys */
+		key = 4, value = -4;
+		assert(flat_map_insert_many(&map, &key, &value, 1) == VECTOR_SUCCESS);
+		assert(flat_map_size(&map) == 9);
+		assert(*(double*)flat_map_get(&map, &key) == -4);
+
+		key = 5;
+		assert(flat_map_get(&map, &key) == NULL);
+		key = 7;
+		assert(flat_map_erase(&map, &key) == VECTOR_SUCCESS);
+		assert(!flat_map_contains(&map, &key));
+
+		/* Buffered inserts are merged on the next lookup */
+		assert(flat_map_set_buffered(&map, true) == VECTOR_SUCCESS);
+		for (i = 0; i < 100; ++i) {
+			key = (double)((i * 37) % 100), value = (double)i;
+			assert(flat_map_insert(&map, &key, &value) == VECTOR_SUCCESS);
+		}
+		assert(map.pending_size == 100);
+		key = 74;
+		assert(*(double*)flat_map_get(&map, &key) == 2);
+		assert(map.pending_size == 0);
+		assert(flat_map_size(&map) == 100);
+
+		assert(flat_map_destroy(&map) == VECTOR_SUCCESS);
+
+		doubles_vector_setup(&keys, 0);
+		assert(flat_set_setup(&set, &keys, compare_doubles) == VECTOR_SUCCESS);
+		assert(flat_set_insert_many(&set, batch_keys, 5) == VECTOR_SUCCESS);
+		assert(flat_set_insert(&set, &batch_keys[0]) == VECTOR_SUCCESS);
+		assert(flat_set_size(&set) == 4);
+		key = 7;
+		assert(flat_set_contains(&set, &key));
+		assert(flat_set_destroy(&set) == VECTOR_SUCCESS);
+	}
+
+	printf("TESTING BIT VECTOR ...\n");
+	{
+		BitVector bits, mask;
+		bool expected[1000];
+		size_t size = 0, count, j;
+
+		assert(bit_vector_setup(&bits, 0) == VECTOR_SUCCESS);
+		assert(bit_vector_find_first(&bits) == BIT_VECTOR_NOT_FOUND);
+
+		/* Random edits checked against a plain bool array */
+		srand(42);
+		for (i = 0; i < 2000; ++i) {
+			bool value = rand() % 3 == 0;
+			int operation = rand() % 4;
+
+			if (operation == 0 || size < 10) {
+				assert(bit_vector_push_back(&bits, value) == VECTOR_SUCCESS);
+				expected[size++] = value;
+			} else if (operation == 1 && size < 1000) {
+				j = (size_t)rand() % (size + 1);
+				assert(bit_vector_insert(&bits, j, value) == VECTOR_SUCCESS);
+				memmove(&expected[j + 1], &expected[j], (size - j) * sizeof(bool));
+				expected[j] = value, ++size;
+			} else if (operation == 2) {
+				j = (size_t)rand() % size;
+				assert(bit_vector_erase(&bits, j) == VECTOR_SUCCESS);
+				memmove(&expected[j], &expected[j + 1], (size - j - 1) * sizeof(bool));
+				--size;
+			} else {
+				j = (size_t)rand() % size;
+				assert(bit_vector_set(&bits, j, value) == VECTOR_SUCCESS);
+				expected[j] = value;
+			}
+		}
+
+		assert(bit_vector_size(&bits) == size);
+		count = 0;
+		for (j = 0; j < size; ++j) {
+			assert(bit_vector_get(&bits, j) == expected[j]);
+			count += expected[j];
+		}
+		assert(bit_vector_count(&bits) == count);
+
+		/* Walking the set bits visits exactly the expected ones */
+		j = bit_vector_find_first(&bits);
+		for (i = 0; j != BIT_VECTOR_NOT_FOUND; ++i) {
+			assert(expected[j]);
+			j = bit_vector_find_next(&bits, j);
+		}
+		assert((size_t)i == count);
+
+		assert(bit_vector_setup(&mask, 0) == VECTOR_SUCCESS);
+		assert(bit_vector_resize(&mask, size) == VECTOR_SUCCESS);
+		assert(bit_vector_count(&mask) == 0);
+		for (j = 0; j < size; j += 2) bit_vector_set(&mask, j, true);
+
+		assert(bit_vector_andnot(&bits, &mask) == VECTOR_SUCCESS);
+		for (j = 0; j < size; j += 2) assert(!bit_vector_get(&bits, j));
+		assert(bit_vector_or(&bits, &mask) == VECTOR_SUCCESS);
+		for (j = 0; j < size; j += 2) assert(bit_vector_get(&bits, j));
+		assert(bit_vector_and(&bits, &mask) == VECTOR_SUCCESS);
+		assert(bit_vector_xor(&bits, &mask) == VECTOR_SUCCESS);
+		assert(bit_vector_count(&bits) == 0);
+
+		/* Growing clears the new bits */
+		assert(bit_vector_resize(&mask, 3) == VECTOR_SUCCESS);
+		assert(bit_vector_resize(&mask, 500) == VECTOR_SUCCESS);
+		assert(bit_vector_count(&mask) == 2);
+		assert(bit_vector_find_next(&mask, 0) == 2);
+
+		bit_vector_destroy(&mask);
+		bit_vector_destroy(&bits);
+	}
+
+	printf("TESTING COMPRESSED VECTOR ...\n");
+	{
+		CompressedVector series;
+		CompressedIterator iterator;
+		Vector source = VECTOR_INITIALIZER;
+		const void* chunk;
+		double value, total = 0, scanned = 0;
+		int64_t integer;
+		size_t count, seen = 0;
+
+		/* A slowly moving series with a few jumps, plus the tail */
+		doubles_vector_setup(&source, 0);
+		d = 100;
+		for (i = 0; i < 5000; ++i) {
+			d += (i % 7 == 0) ? 0.25 : 0;
+			value = (i % 1000 == 999) ? -1e300 : d;
+			vector_push_back(&source, &value);
+			total += value;
+		}
+
+		assert(compressed_vector_setup(&series, COMPRESSED_DOUBLE) == VECTOR_SUCCESS);
+		assert(compressed_vector_append(&series, &source) == VECTOR_SUCCESS);
+		assert(compressed_vector_size(&series) == 5000);
+		assert(compressed_vector_byte_size(&series) < vector_byte_size(&source) / 4);
+
+		for (i = 4999; i >= 0; i -= 3) {
+			assert(compressed_vector_get(&series, i, &value) == VECTOR_SUCCESS);
+			assert(value == VECTOR_GET_AS(double, &source, i));
+		}
+
+		assert(compressed_iterator_begin(&iterator, &series) == VECTOR_SUCCESS);
+		while ((count = compressed_iterator_next(&iterator, &chunk)) > 0) {
+			for (i = 0; i < (int)count; ++i) scanned += ((const double*)chunk)[i];
+			seen += count;
+		}
+		compressed_iterator_destroy(&iterator);
+		assert(seen == 5000);
+		assert(scanned == total);
+
+		compressed_vector_destroy(&series);
+		vector_destroy(&source);
+
+		/* Integers, including deltas that wrap around */
+		assert(compressed_vector_setup(&series, COMPRESSED_INT64) == VECTOR_SUCCESS);
+		for (i = 0; i < 3000; ++i) {
+			integer = i == 1500 ? INT64_MIN : (i == 1501 ? INT64_MAX : i * 1000);
+			assert(compressed_vector_push_back(&series, &integer) == VECTOR_SUCCESS);
+		}
+		for (i = 0; i < 3000; ++i) {
+			assert(compressed_vector_get(&series, i, &integer) == VECTOR_SUCCESS);
+			assert(integer == (i == 1500 ? INT64_MIN : (i == 1501 ? INT64_MAX : i * 1000)));
+		}
+		compressed_vector_destroy(&series);
+	}
+
+	printf("TESTING ITERATOR ARITHMETIC ...\n");
+	{
+		Vector numbers = VECTOR_INITIALIZER;
+		Iterator first, last, column, stepping, column_end;
+
+		doubles_vector_setup(&numbers, 0);
+		for (i = 0; i < 100; ++i) {
+			d = (double)i;
+			vector_push_back(&numbers, &d);
+		}
+
+		first = vector_begin(&numbers);
+		last = vector_end(&numbers);
+		assert(iterator_distance(&first, &last) == 100);
+		assert(iterator_distance(&last, &first) == -100);
+		assert(*(double*)iterator_at(&first, 42) == 42);
+
+		iterator_advance(&first, 60);
+		assert(iterator_index(&numbers, &first) == 60);
+		iterator_advance(&first, -10);
+		assert(ITERATOR_GET_AS(double, &first) == 50);
+		assert(*(double*)iterator_at(&first, -50) == 0);
+
+		/* Strided and stepping iterators agree */
+		column.self = stepping.self = vector_data(&numbers);
+		column.tc = &column_iterator_tc;
+		stepping.tc = &column_stepping_tc;
+		column_end = column;
+		iterator_advance(&column_end, 50);
+		assert(iterator_get(&column_end) == (double*)vector_data(&numbers) + 100);
+		assert(iterator_distance(&column, &column_end) == 50);
+		assert(*(double*)iterator_at(&column, 7) == 14);
+		assert(*(double*)iterator_at(&stepping, 7) == 14);
+
+		last = stepping;
+		iterator_advance(&last, 50);
+		assert(iterator_equals(&last, &column_end));
+		assert(iterator_distance(&stepping, &last) == 50);
+		assert(iterator_distance(&last, &stepping) == -50);
+
+		/* Indices come from the address, without stepping */
+		stepping.self = (double*)vector_data(&numbers) + 60;
+		stepping.tc = &plain_iterator_tc;
+		plain_iter_steps = 0;
+		assert(iterator_index(&numbers, &stepping) == 60);
+		assert(iterator_erase(&numbers, &stepping) == VECTOR_SUCCESS);
+		assert(plain_iter_steps == 0);
+		assert(ITERATOR_GET_AS(double, &stepping) == 61);
+
+		vector_destroy(&numbers);
+	}
+
+	printf("TESTING HEAP ...\n");
+	{
+		Vector heap = VECTOR_INITIALIZER;
+		double previous;
+		int64_t integer, last_integer;
+
+		/* Typed kernel */
+		doubles_vector_setup(&heap, 0);
+		srand(11);
+		for (i = 0; i < 1000; ++i) {
+			d = (double)(rand() % 500);
+			assert(vector_heap_push(&heap, &d, vector_compare_double) == VECTOR_SUCCESS);
+			assert(VECTOR_GET_AS(double, &heap, 0) <= d);
+		}
+		previous = -1;
+		for (i = 0; i < 1000; ++i) {
+			assert(vector_heap_pop(&heap, &d, vector_compare_double) == VECTOR_SUCCESS);
+			assert(d >= previous);
+			previous = d;
+		}
+		assert(vector_is_empty(&heap));
+
+		/* Heapify in place, then change keys */
+		for (i = 0; i < 1000; ++i) {
+			d = (double)((i * 7919) % 1000);
+			vector_push_back(&heap, &d);
+		}
+		assert(vector_heap_make(&heap, vector_compare_double) == VECTOR_SUCCESS);
+		assert(VECTOR_GET_AS(double, &heap, 0) == 0);
+		((double*)vector_data(&heap))[500] = -1;
+		assert(vector_heap_update(&heap, 500, vector_compare_double) == VECTOR_SUCCESS);
+		assert(VECTOR_GET_AS(double, &heap, 0) == -1);
+		((double*)vector_data(&heap))[0] = 5000;
+		assert(vector_heap_update(&heap, 0, vector_compare_double) == VECTOR_SUCCESS);
+		assert(VECTOR_GET_AS(double, &heap, 0) == 0);
+		assert(vector_heap_pop(&heap, NULL, vector_compare_double) == VECTOR_SUCCESS);
+		previous = -1;
+		while (!vector_is_empty(&heap)) {
+			assert(vector_heap_pop(&heap, &d, vector_compare_double) == VECTOR_SUCCESS);
+			assert(d >= previous);
+			previous = d;
+		}
+		assert(previous == 5000);
+
+		/* Generic path with a caller comparator */
+		for (i = 0; i < 1000; ++i) {
+			d = (double)(rand() % 500);
+			assert(vector_heap_push(&heap, &d, compare_doubles) == VECTOR_SUCCESS);
+		}
+		previous = -1;
+		for (i = 0; i < 1000; ++i) {
+			assert(vector_heap_pop(&heap, &d, compare_doubles) == VECTOR_SUCCESS);
+			assert(d >= previous);
+			previous = d;
+		}
+
+		/* Integers stored in the 8-byte slots */
+		for (i = 0; i < 1000; ++i) {
+			integer = (int64_t)(rand() % 2000) - 1000;
+			assert(vector_heap_push(&heap, &integer, vector_compare_int64) == VECTOR_SUCCESS);
+		}
+		last_integer = INT64_MIN;
+		for (i = 0; i < 1000; ++i) {
+			assert(vector_heap_pop(&heap, &integer, vector_compare_int64) == VECTOR_SUCCESS);
+			assert(integer >= last_integer);
+			last_integer = integer;
+		}
+
+		vector_destroy(&heap);
+	}
+
+	printf("TESTING DIRTY TRACKING ...\n");
+	{
+		Vector source = VECTOR_INITIALIZER, replica = VECTOR_INITIALIZER;
+		FILE *log = tmpfile();
+		int fd = fileno(log);
+		off_t before;
+
+		doubles_vector_setup(&source, 0);
+		for (i = 0; i < 10000; ++i) {
+			d = (double)i;
+			vector_push_back(&source, &d);
+		}
+		assert(vector_flush_dirty(&source, fd) == VECTOR_ERROR);
+
+		/* The first flush is a full image */
+		assert(vector_track_dirty(&source, 64) == VECTOR_SUCCESS);
+		assert(vector_dirty_size(&source) == 10000);
+		assert(vector_flush_dirty(&source, fd) == VECTOR_SUCCESS);
+		assert(vector_dirty_size(&source) == 0);
+
+		/* Scattered writes cost the chunks they touch */
+		before = lseek(fd, 0, SEEK_END);
+		d = -1;
+		vector_assign(&source, 5, &d);
+		vector_assign(&source, 5000, &d);
+		vector_assign(&source, 5001, &d);
+		assert(vector_dirty_size(&source) == 128);
+		assert(vector_flush_dirty(&source, fd) == VECTOR_SUCCESS);
+		assert(lseek(fd, 0, SEEK_END) - before ==
+					 3 * 8 + 2 * (2 * 8 + 64 * sizeof(double)));
+
+		/* Shifting dirties the tail, shrinking is carried by the frame size */
+		vector_insert(&source, 9990, &d);
+		assert(vector_dirty_size(&source) == 10001 - 9984);
+		vector_erase(&source, 9000);
+		vector_push_back(&source, &d);
+		assert(vector_flush_dirty(&source, fd) == VECTOR_SUCCESS);
+		vector_resize(&source, 8000);
+		assert(vector_dirty_size(&source) == 0);
+		assert(vector_flush_dirty(&source, fd) == VECTOR_SUCCESS);
+
+		/* Raw writes are reported by hand */
+		((double*)vector_data(&source))[7] = 42;
+		assert(vector_dirty_size(&source) == 0);
+		assert(vector_mark_dirty(&source, 7, 1) == VECTOR_SUCCESS);
+		assert(vector_flush_dirty(&source, fd) == VECTOR_SUCCESS);
+
+		doubles_vector_setup(&replica, 0);
+		lseek(fd, 0, SEEK_SET);
+		assert(vector_replay_dirty(&replica, fd) == VECTOR_SUCCESS);
+		assert(vector_size(&replica) == 8000);
+		assert(memcmp(vector_const_data(&replica),
+									vector_const_data(&source),
+									vector_byte_size(&source)) == 0);
+
+		/* Compaction leaves a single frame with the same contents */
+		assert(vector_compact_dirty(&source, fd) == VECTOR_SUCCESS);
+		assert(lseek(fd, 0, SEEK_END) == 3 * 8 + 2 * 8 + 8000 * sizeof(double));
+		vector_clear(&replica);
+		lseek(fd, 0, SEEK_SET);
+		assert(vector_replay_dirty(&replica, fd) == VECTOR_SUCCESS);
+		assert(vector_size(&replica) == 8000);
+		assert(VECTOR_GET_AS(double, &replica, 7) == 42);
+		assert(VECTOR_GET_AS(double, &replica, 5000) == -1);
+
+		/* A torn frame is refused */
+		assert(write(fd, &d, 4) == 4);
+		lseek(fd, 0, SEEK_SET);
+		assert(vector_replay_dirty(&replica, fd) == VECTOR_ERROR);
+
+		vector_destroy(&replica);
+		vector_destroy(&source);
+		fclose(log);
+	}
+
+	printf("TESTING PIPELINE ...\n");
+	{
+		Vector source = VECTOR_INITIALIZER, survivors = VECTOR_INITIALIZER;
+		Pipeline pipeline;
+		int three = 3, seven = 7;
+		double sum, expected;
+		int64_t raw[5] = {5, 6, 7, 8, 9};
+
+		doubles_vector_setup(&source, 0);
+		for (i = 0; i < 100000; ++i) {
+			d = (double)i;
+			vector_push_back(&source, &d);
+		}
+
+		/* filter -> map -> reduce, serial and parallel agree */
+		expected = 0;
+		for (i = 0; i < 100000; i += 3) expected += (double)i * i;
+
+		assert(pipeline_setup(&pipeline, &source) == VECTOR_SUCCESS);
+		assert(pipeline_filter(&pipeline, is_multiple, &three) == VECTOR_SUCCESS);
+		assert(pipeline_map(&pipeline, square, sizeof(double), NULL) ==
+					 VECTOR_SUCCESS);
+		sum = 0;
+		assert(pipeline_reduce(&pipeline, &sum, sizeof sum, sum_doubles, add_doubles,
+													 NULL) == VECTOR_SUCCESS);
+		assert(sum == expected);
+
+		assert(pipeline_set_threads(&pipeline, 4) == VECTOR_SUCCESS);
+		sum = 0;
+		assert(pipeline_reduce(&pipeline, &sum, sizeof sum, sum_doubles, add_doubles,
+													 NULL) == VECTOR_SUCCESS);
+		assert(sum == expected);
+
+		/* take stops early, even across chunk boundaries */
+		assert(pipeline_setup(&pipeline, &source) == VECTOR_SUCCESS);
+		pipeline_filter(&pipeline, is_multiple, &seven);
+		pipeline_take(&pipeline, 300);
+		pipeline_set_threads(&pipeline, 4);
+		sum = 0;
+		assert(pipeline_reduce(&pipeline, &sum, sizeof sum, sum_doubles, add_doubles,
+													 NULL) == VECTOR_SUCCESS);
+		assert(sum == 7.0 * 299 * 300 / 2);
+
+		/* collect_into is the only stage that materializes */
+		doubles_vector_setup(&survivors, 0);
+		assert(pipeline_setup(&pipeline, &source) == VECTOR_SUCCESS);
+		pipeline_filter(&pipeline, is_multiple, &seven);
+		pipeline_map(&pipeline, truncate_to_int64, sizeof(int64_t), NULL);
+		assert(pipeline_collect_into(&pipeline, &survivors) == VECTOR_SUCCESS);
+		assert(vector_size(&survivors) == (100000 + 6) / 7);
+		for (i = 0; i < (int)vector_size(&survivors); ++i) {
+			assert(*(const int64_t*)vector_const_get(&survivors, i) == 7 * i);
+		}
+
+		/* Views over plain arrays, and an empty take */
+		assert(pipeline_setup_view(&pipeline, raw, 5, sizeof(int64_t)) ==
+					 VECTOR_SUCCESS);
+		assert(pipeline_take(&pipeline, 0) == VECTOR_SUCCESS);
+		vector_clear(&survivors);
+		assert(pipeline_collect_into(&pipeline, &survivors) == VECTOR_SUCCESS);
+		assert(vector_is_empty(&survivors));
+		assert(pipeline_setup_view(&pipeline, raw, 5, sizeof(int64_t)) ==
+					 VECTOR_SUCCESS);
+		assert(pipeline_collect_into(&pipeline, &survivors) == VECTOR_SUCCESS);
+		assert(memcmp(vector_const_data(&survivors), raw, sizeof raw) == 0);
+
+		vector_destroy(&survivors);
+		vector_destroy(&source);
+	}
+
+	printf("TESTING PARSE ...\n");
+	{
+		Vector numbers = VECTOR_INITIALIZER;
+		const char csv[] = "1.5,2\n-3e2,  4.25\r\n\n0.1\n+7.,.5\n";
+		const char *malformed[] = {"1,2,x3\n", "1,,2\n", "1\n2,\n", "4e\n"};
+		const size_t offsets[] = {4, 2, 4, 0};
+		char text[64], path[] = "/tmp/vector-parse-XXXXXX";
+		size_t offset;
+		double expected;
+		int fd;
+
+		doubles_vector_setup(&numbers, 0);
+		assert(vector_parse_doubles(&numbers, csv, strlen(csv), ',', &offset) ==
+					 VECTOR_SUCCESS);
+		assert(offset == VECTOR_PARSE_NO_OFFSET);
+		assert(vector_size(&numbers) == 7);
+		assert(VECTOR_GET_AS(double, &numbers, 0) == 1.5);
+		assert(VECTOR_GET_AS(double, &numbers, 2) == -300);
+		assert(VECTOR_GET_AS(double, &numbers, 3) == 4.25);
+		assert(VECTOR_GET_AS(double, &numbers, 4) == 0.1);
+		assert(VECTOR_GET_AS(double, &numbers, 5) == 7);
+		assert(VECTOR_GET_AS(double, &numbers, 6) == 0.5);
+
+		/* Errors keep what came before and point at the field */
+		for (i = 0; i < 4; ++i) {
+			vector_clear(&numbers);
+			assert(vector_parse_doubles(&numbers,
+																	malformed[i],
+																	strlen(malformed[i]),
+																	',',
+																	&offset) == VECTOR_ERROR);
+			assert(offset == offsets[i]);
+			assert(vector_size(&numbers) == (i == 3 ? 0 : (i == 1 ? 1 : 2)));
+		}
+
+		/* Fast and slow paths both round like strtod */
+		srand(13);
+		for (i = 0; i < 20000; ++i) {
+			expected = (double)rand() / RAND_MAX;
+			for (offset = rand() % 40; offset > 0; --offset) {
+				expected = i % 4 < 2 ? expected * 10 : expected / 10;
+			}
+			snprintf(text, sizeof text, i % 2 ? "%.17g" : "%.6g", expected);
+			vector_clear(&numbers);
+			assert(vector_parse_doubles(&numbers, text, strlen(text), ',', NULL) ==
+						 VECTOR_SUCCESS);
+			expected = strtod(text, NULL);
+			assert(memcmp(vector_const_get(&numbers, 0), &expected, sizeof(double)) == 0);
+		}
+		vector_clear(&numbers);
+		text[0] = '\0';
+		strcat(text, "123456789012345678901234567890 1e400 -inf 4.9e-324");
+		assert(vector_parse_doubles(&numbers, text, strlen(text), ' ', NULL) ==
+					 VECTOR_SUCCESS);
+		assert(VECTOR_GET_AS(double, &numbers, 0) == 123456789012345678901234567890.0);
+		assert(VECTOR_GET_AS(double, &numbers, 1) > 1.7976931348623157e308);
+		assert(VECTOR_GET_AS(double, &numbers, 2) < -1.7976931348623157e308);
+		assert(VECTOR_GET_AS(double, &numbers, 3) == 4.9e-324);
+
+		/* The decimal point stays '.' in any locale */
+		if (setlocale(LC_NUMERIC, "de_DE.UTF-8") != NULL) {
+			vector_clear(&numbers);
+			strcpy(text, "0.1;2.000000000000000000001");
+			assert(vector_parse_doubles(&numbers, text, strlen(text), ';', NULL) ==
+						 VECTOR_SUCCESS);
+			assert(VECTOR_GET_AS(double, &numbers, 1) == 2);
+			setlocale(LC_NUMERIC, "C");
+		}
+
+		/* Mapped files */
+		fd = mkstemp(path);
+		assert(fd >= 0);
+		assert(write(fd, csv, strlen(csv)) == (ssize_t)strlen(csv));
+		close(fd);
+		vector_clear(&numbers);
+		assert(vector_parse_doubles_file(&numbers, path, ',', &offset) ==
+					 VECTOR_SUCCESS);
+		assert(vector_size(&numbers) == 7);
+		unlink(path);
+		assert(vector_parse_doubles_file(&numbers, path, ',', &offset) ==
+					 VECTOR_ERROR);
+		assert(offset == VECTOR_PARSE_NO_OFFSET);
+
+		vector_destroy(&numbers);
+	}
+
+	printf("TESTING PARALLEL BULK ...\n");
+	{
+		Vector big = VECTOR_INITIALIZER, copy = VECTOR_INITIALIZER;
+		const size_t count = 5000000;
+		size_t j;
+
+		/* Large enough for the streaming stores */
+		doubles_vector_setup(&big, 0);
+		vector_resize(&big, count);
+		d = 0.25;
+		assert(vector_fill(&big, 0, count, &d, 4) == VECTOR_SUCCESS);
+		for (j = 0; j < count; ++j) {
+			assert(((const double*)vector_const_data(&big))[j] == 0.25);
+		}
+		d = -1;
+		assert(vector_fill(&big, 3, 1001, &d, 0) == VECTOR_SUCCESS);
+		assert(VECTOR_GET_AS(double, &big, 2) == 0.25);
+		assert(VECTOR_GET_AS(double, &big, 3) == -1);
+		assert(VECTOR_GET_AS(double, &big, 1003) == -1);
+		assert(VECTOR_GET_AS(double, &big, 1004) == 0.25);
+		for (j = 0; j < count; j += 7) {
+			d = (double)j;
+			vector_assign(&big, j, &d);
+		}
+
+		/* vector_copy wants a destination without a buffer */
+		doubles_vector_setup(&copy, 0);
+		free(((Doubles*)copy.self)->data);
+		((Doubles*)copy.self)->data = NULL;
+		assert(vector_copy_parallel(&copy, &big, 4) == VECTOR_SUCCESS);
+		assert(vector_size(&copy) == count);
+		assert(memcmp(vector_const_data(&copy),
+									vector_const_data(&big),
+									vector_byte_size(&big)) == 0);
+
+		assert(vector_reserve_parallel_touch(&copy, 3 * count, 3) == VECTOR_SUCCESS);
+		assert(vector_capacity(&copy) == 3 * count);
+		assert(memcmp(vector_const_data(&copy),
+									vector_const_data(&big),
+									vector_byte_size(&big)) == 0);
+
+		vector_destroy(&copy);
+		vector_destroy(&big);
+	}
+
+	printf("TESTING SEARCH ...\n");
+	{
+		Vector numbers = VECTOR_INITIALIZER, other = VECTOR_INITIALIZER;
+		double zero = 0.0, negative_zero = -0.0;
+		uint64_t hash;
+
+		doubles_vector_setup(&numbers, 0);
+		assert(vector_hash(&numbers) == 0xEF46DB3751D8E999ULL);
+		d = 1;
+		assert(vector_find(&numbers, &d) == VECTOR_NOT_FOUND);
+
+		for (i = 0; i < 1003; ++i) {
+			d = (double)(i % 10);
+			vector_push_back(&numbers, &d);
+		}
+		d = 7;
+		assert(vector_find(&numbers, &d) == 7);
+		assert(vector_count(&numbers, &d) == 100);
+		d = 2;
+		assert(vector_count(&numbers, &d) == 101);
+		d = 1000;
+		assert(vector_find(&numbers, &d) == VECTOR_NOT_FOUND);
+		assert(vector_count(&numbers, &d) == 0);
+
+		/* Matches past the last full SIMD block */
+		vector_assign(&numbers, 1002, &d);
+		assert(vector_find(&numbers, &d) == 1002);
+		assert(vector_find_if(&numbers, is_negative, NULL) == VECTOR_NOT_FOUND);
+		d = -3;
+		vector_assign(&numbers, 500, &d);
+		assert(vector_find_if(&numbers, is_negative, NULL) == 500);
+
+		/* Bytes decide, so the zeros are different elements */
+		vector_assign(&numbers, 0, &negative_zero);
+		assert(vector_find(&numbers, &zero) == 10);
+		assert(vector_find(&numbers, &negative_zero) == 0);
+
+		/* The hash follows the contents */
+		hash = vector_hash(&numbers);
+		assert(vector_hash(&numbers) == hash);
+		d = 4;
+		vector_assign(&numbers, 999, &d);
+		assert(vector_hash(&numbers) != hash);
+
+		/* Dedupe of sorted runs, by bytes and by comparator */
+		vector_clear(&numbers);
+		for (i = 0; i < 1000; ++i) {
+			d = (double)(i / 3);
+			vector_push_back(&numbers, &d);
+		}
+		vector_push_back(&numbers, &negative_zero);
+		vector_push_back(&numbers, &zero);
+		assert(vector_unique(&numbers, NULL) == VECTOR_SUCCESS);
+		assert(vector_size(&numbers) == 336);
+		for (i = 0; i < 334; ++i) assert(VECTOR_GET_AS(double, &numbers, i) == i);
+		assert(vector_unique(&numbers, compare_doubles) == VECTOR_SUCCESS);
+		assert(vector_size(&numbers) == 335);
+
+		/* Already distinct vectors are not unshared */
+		doubles_vector_setup(&other, 0);
+		assert(vector_snapshot(&other, &numbers) == VECTOR_SUCCESS);
+		assert(vector_unique(&other, NULL) == VECTOR_SUCCESS);
+		assert(vector_is_shared(&other));
+		assert(vector_hash(&other) == vector_hash(&numbers));
+
+		vector_destroy(&other);
+		vector_destroy(&numbers);
+	}
+
+	printf("TESTING RELEASE MEMORY ...\n");
+	{
+		Vector vector = VECTOR_INITIALIZER;
+		size_t i, capacity, large = (4 * VECTOR_MADVISE_THRESHOLD) / sizeof(double);
+		double d, *data;
+
+		/* Popping shrinks once a quarter of the capacity is left */
+		assert(doubles_vector_setup(&vector, 64) == VECTOR_SUCCESS);
+		for (d = 0; d < 64; ++d) assert(vector_push_back(&vector, &d) == VECTOR_SUCCESS);
+		while (vector_size(&vector) > 16) assert(vector_pop_back(&vector) == VECTOR_SUCCESS);
+		assert(vector_capacity(&vector) == 32);
+
+		/* Small buffers are reallocated */
+		assert(vector_reserve(&vector, 1000) == VECTOR_SUCCESS);
+		assert(vector_release_memory(&vector, 100) == VECTOR_SUCCESS);
+		assert(vector_capacity(&vector) == 100);
+		assert(vector_release_memory(&vector, 0) == VECTOR_SUCCESS);
+		assert(vector_capacity(&vector) == 16);
+		assert(*(double*)vector_get(&vector, 15) == 15);
+
+		/* Large ones keep their capacity and lose the pages of the tail */
+		assert(vector_reserve(&vector, large) == VECTOR_SUCCESS);
+		data = vector_data(&vector);
+		for (i = 16; i < large; ++i) data[i] = 1;
+		assert(vector_release_memory(&vector, 0) == VECTOR_SUCCESS);
+		capacity = vector_capacity(&vector);
+		assert(capacity == large);
+		assert(vector_data(&vector) == data);
+		for (i = 0; i < 16; ++i) assert(data[i] == (double)i);
+		assert(data[large / 2] == 0);
+
+		assert(vector_destroy(&vector) == VECTOR_SUCCESS);
+	}
+
+	printf("TESTING IDLE TRIMMING ...\n");
+	{
+		Vector cold = VECTOR_INITIALIZER, hot = VECTOR_INITIALIZER;
+		double d = 1;
+
+		assert(doubles_vector_setup(&cold, 1000) == VECTOR_SUCCESS);
+		assert(doubles_vector_setup(&hot, 1000) == VECTOR_SUCCESS);
+		assert(vector_push_back(&cold, &d) == VECTOR_SUCCESS);
+		assert(vector_push_back(&hot, &d) == VECTOR_SUCCESS);
+
+		assert(vector_track_access(&cold) == VECTOR_SUCCESS);
+		assert(vector_track_access(&hot) == VECTOR_SUCCESS);
+		assert(vector_touch(&hot) == VECTOR_SUCCESS);
+
+		/* Within budget nothing is trimmed */
+		assert(vector_trim_all(2 * 999 * sizeof(double)) == 0);
+
+		/* Over budget the coldest goes first */
+		assert(vector_trim_all(999 * sizeof(double)) ==
+					 (1000 - VECTOR_MINIMUM_CAPACITY) * sizeof(double));
+		assert(vector_capacity(&cold) == VECTOR_MINIMUM_CAPACITY);
+		assert(vector_capacity(&hot) == 1000);
+
+		/* Growing is an access, so the other vector is colder now */
+		assert(vector_reserve(&cold, 1000) == VECTOR_SUCCESS);
+		assert(vector_trim_all(999 * sizeof(double)) > 0);
+		assert(vector_capacity(&cold) == 1000);
+		assert(vector_capacity(&hot) == VECTOR_MINIMUM_CAPACITY);
+
+		/* Untracked and destroyed vectors are not trimmed */
+		assert(vector_untrack_access(&cold) == VECTOR_SUCCESS);
+		assert(vector_destroy(&hot) == VECTOR_SUCCESS);
+		assert(vector_trim_all(0) == 0);
+		assert(vector_capacity(&cold) == 1000);
+
+		assert(vector_destroy(&cold) == VECTOR_SUCCESS);
+	}
+
+	printf("TESTING FIXED CAPACITY ...\n");
+	{
+		Vector fixed = VECTOR_INITIALIZER, spilling = VECTOR_INITIALIZER;
+		Vector heap = VECTOR_INITIALIZER, snapshot = VECTOR_INITIALIZER;
+		FixedDoubles fixed_doubles, spilling_doubles;
+		double storage[8], spill_storage[4];
+		double d;
+
+		assert(doubles_fixed_vector_setup(&fixed, &fixed_doubles, storage, 8, false) ==
+					 VECTOR_SUCCESS);
+		for (d = 0; d < 8; ++d) assert(vector_push_back(&fixed, &d) == VECTOR_SUCCESS);
+		assert(vector_data(&fixed) == storage);
+		assert(storage[7] == 7);
+
+		/* Anything that needs a bigger buffer fails and changes nothing */
+		assert(vector_push_back(&fixed, &d) == VECTOR_ERROR);
+		assert(vector_insert(&fixed, 0, &d) == VECTOR_ERROR);
+		assert(vector_reserve(&fixed, 9) == VECTOR_ERROR);
+		assert(vector_resize(&fixed, 9) == VECTOR_ERROR);
+		assert(vector_size(&fixed) == 8 && vector_capacity(&fixed) == 8);
+		assert(vector_data(&fixed) == storage);
+
+		/* Shrinking keeps the storage */
+		while (!vector_is_empty(&fixed)) assert(vector_pop_back(&fixed) == VECTOR_SUCCESS);
+		assert(vector_shrink_to_fit(&fixed) == VECTOR_SUCCESS);
+		assert(vector_data(&fixed) == storage && vector_capacity(&fixed) == 8);
+
+		assert(vector_resize(&fixed, 8) == VECTOR_SUCCESS);
+		assert(vector_fill(&fixed, 0, 8, &d, 1) == VECTOR_SUCCESS);
+		assert(storage[0] == 8 && storage[7] == 8);
+
+		/* Nor can it take a heap buffer that would need copying later */
+		assert(doubles_vector_setup(&heap, 4) == VECTOR_SUCCESS);
+		assert(vector_push_back(&heap, &d) == VECTOR_SUCCESS);
+		assert(vector_snapshot(&fixed, &heap) == VECTOR_ERROR);
+		assert(vector_data(&fixed) == storage);
+
+		/* A spilling vector moves to the heap and leaves the storage alone */
+		assert(doubles_fixed_vector_setup(&spilling,
+																			&spilling_doubles,
+																			spill_storage,
+																			4,
+																			true) == VECTOR_SUCCESS);
+		for (d = 0; d < 100; ++d) {
+			assert(vector_push_back(&spilling, &d) == VECTOR_SUCCESS);
+		}
+		assert(vector_data(&spilling) != spill_storage);
+		assert(*(double*)vector_get(&spilling, 99) == 99);
+		assert(spill_storage[3] == 3);
+
+		assert(doubles_vector_setup(&snapshot, 1) == VECTOR_SUCCESS);
+		assert(vector_snapshot(&snapshot, &spilling) == VECTOR_SUCCESS);
+
+		assert(vector_destroy(&spilling) == VECTOR_SUCCESS);
+		assert(*(double*)vector_get(&snapshot, 99) == 99);
+		assert(vector_destroy(&snapshot) == VECTOR_SUCCESS);
+
+		/* Moving into the storage would need a copy it has no room for, so
+		 * nothing changes; moving out of it copies to the heap */
+		assert(vector_move_assign(&fixed, &heap) == VECTOR_ERROR);
+		assert(vector_size(&heap) == 1 && vector_data(&fixed) == storage);
+		assert(vector_move_assign(&heap, &fixed) == VECTOR_SUCCESS);
+		assert(vector_size(&heap) == 8);
+		assert(VECTOR_GET_AS(double, &heap, 7) == 8);
+		assert(!vector_is_initialized(&fixed));
+		assert(storage[7] == 8);
+
+		assert(vector_destroy(&fixed) == VECTOR_SUCCESS);
+		assert(vector_destroy(&heap) == VECTOR_SUCCESS);
+	}
+
+	printf("TESTING RCU VECTOR ...\n");
+	{
+		RcuVector rv;
+		RcuReader reader, readers[RCU_VECTOR_MAX_READERS + 1];
+		RcuView view;
+		Vector source = VECTOR_INITIALIZER;
+		pthread_t threads[3];
+		double d;
+		size_t i;
+
+		assert(rcu_vector_setup(&rv, 0, sizeof(double)) == VECTOR_SUCCESS);
+		assert(rcu_vector_reader_setup(&reader, &rv) == VECTOR_SUCCESS);
+
+		for (d = 0; d < 10; ++d) assert(rcu_vector_push_back(&rv, &d) == VECTOR_SUCCESS);
+		assert(rcu_vector_size(&rv) == 10);
+		assert(rcu_vector_read_size(&reader) == 10);
+		assert(rcu_vector_read_get(&reader, 9, &d) == VECTOR_SUCCESS && d == 9);
+		assert(rcu_vector_read_get(&reader, 10, &d) == VECTOR_ERROR);
+
+		/* A view outlives growth; the old buffer waits for the reader */
+		view = rcu_vector_read_begin(&reader);
+		for (d = 10; d < 100; ++d) assert(rcu_vector_push_back(&rv, &d) == VECTOR_SUCCESS);
+		assert(view.size == 10 && ((const double*)view.data)[9] == 9);
+		assert(rcu_vector_reclaim(&rv) > 0);
+		rcu_vector_read_end(&reader);
+		assert(rcu_vector_reclaim(&rv) == 0);
+
+		assert(doubles_vector_setup(&source, 10) == VECTOR_SUCCESS);
+		for (d = 100; d < 150; ++d) assert(vector_push_back(&source, &d) == VECTOR_SUCCESS);
+		assert(rcu_vector_append(&rv, &source) == VECTOR_SUCCESS);
+		assert(rcu_vector_size(&rv) == 150);
+		assert(rcu_vector_read_size(&reader) == 150);
+		assert(rcu_vector_read_get(&reader, 149, &d) == VECTOR_SUCCESS && d == 149);
+		assert(vector_destroy(&source) == VECTOR_SUCCESS);
+
+		view = rcu_vector_read_begin(&reader);
+		assert(rcu_vector_clear(&rv) == VECTOR_SUCCESS);
+		assert(rcu_vector_size(&rv) == 0);
+		assert(view.size == 150 && ((const double*)view.data)[149] == 149);
+		rcu_vector_read_end(&reader);
+		assert(rcu_vector_reader_destroy(&reader) == VECTOR_SUCCESS);
+
+		/* Slots run out, and are reused once released */
+		for (i = 0; i < RCU_VECTOR_MAX_READERS; ++i) {
+			assert(rcu_vector_reader_setup(&readers[i], &rv) == VECTOR_SUCCESS);
+		}
+		assert(rcu_vector_reader_setup(&readers[i], &rv) == VECTOR_ERROR);
+		assert(rcu_vector_reader_destroy(&readers[0]) == VECTOR_SUCCESS);
+		assert(rcu_vector_reader_setup(&readers[i], &rv) == VECTOR_SUCCESS);
+		for (i = 1; i <= RCU_VECTOR_MAX_READERS; ++i) {
+			assert(rcu_vector_reader_destroy(&readers[i]) == VECTOR_SUCCESS);
+		}
+
+		/* Readers racing a growing writer */
+		for (i = 0; i < 3; ++i) {
+			assert(pthread_create(&threads[i], NULL, rcu_test_reader, &rv) == 0);
+		}
+		for (d = 0; d < RCU_TEST_SIZE; ++d) {
+			assert(rcu_vector_push_back(&rv, &d) == VECTOR_SUCCESS);
+		}
+		for (i = 0; i < 3; ++i) assert(pthread_join(threads[i], NULL) == 0);
+
+		assert(rcu_vector_reclaim(&rv) == 0);
+		assert(rcu_vector_destroy(&rv) == VECTOR_SUCCESS);
+	}
+
+	printf("TESTING LIFECYCLE ...\n");
+	{
+		Vector texts = VECTOR_INITIALIZER, copy = VECTOR_INITIALIZER;
+		Vector snapshot = VECTOR_INITIALIZER, names = VECTOR_INITIALIZER;
+		Pipeline pipeline;
+		FlatSet set;
+		Text text;
+		char buffer[64], *name;
+		const Text *view;
+		Iterator iterator;
+		size_t i, count;
+
+		/* Growth moves short texts, whose pointers must follow them */
+		assert(texts_vector_setup(&texts, 2) == VECTOR_SUCCESS);
+		for (i = 0; i < 100; ++i) {
+			sprintf(buffer, i % 2 ? "short %zu" : "a long string, not inline %zu", i);
+			assert(text_setup(&text, buffer) == VECTOR_SUCCESS);
+			assert(vector_push_back(&texts, &text) == VECTOR_SUCCESS);
+		}
+		assert(texts_live == 50);
+		for (i = 0; i < 100; ++i) {
+			view = vector_const_get(&texts, i);
+			sprintf(buffer, i % 2 ? "short %zu" : "a long string, not inline %zu", i);
+			assert(strcmp(view->chars, buffer) == 0);
+			assert(i % 2 == 0 || view->chars == view->small);
+		}
+
+		/* Copies are deep */
+		assert(texts_vector_setup(&copy, 0) == VECTOR_SUCCESS);
+		assert(vector_copy_assign(&copy, &texts) == VECTOR_SUCCESS);
+		assert(texts_live == 100);
+		assert(((const Text*)vector_const_get(&copy, 0))->chars !=
+					 ((const Text*)vector_const_get(&texts, 0))->chars);
+
+		/* A snapshot shares until written, then the writer copies */
+		assert(texts_vector_setup(&snapshot, 0) == VECTOR_SUCCESS);
+		assert(vector_snapshot(&snapshot, &texts) == VECTOR_SUCCESS);
+		assert(texts_live == 100);
+		assert(text_setup(&text, "inserted in front of everything") == VECTOR_SUCCESS);
+		assert(vector_insert(&texts, 0, &text) == VECTOR_SUCCESS);
+		assert(texts_live == 151);
+		assert(strcmp(((const Text*)vector_const_get(&texts, 1))->chars,
+									"a long string, not inline 0") == 0);
+		assert(vector_size(&snapshot) == 100);
+		assert(vector_destroy(&snapshot) == VECTOR_SUCCESS);
+		assert(texts_live == 101);
+
+		/* Erasing, assigning and popping destroy */
+		assert(vector_erase(&texts, 0) == VECTOR_SUCCESS);
+		assert(texts_live == 100);
+		assert(text_setup(&text, "tiny") == VECTOR_SUCCESS);
+		assert(vector_assign(&texts, 0, &text) == VECTOR_SUCCESS);
+		assert(texts_live == 99);
+		assert(vector_pop_back(&texts) == VECTOR_SUCCESS);
+		assert(vector_pop_back(&texts) == VECTOR_SUCCESS);
+		assert(texts_live == 98);
+
+		/* Shrinking destroys, growing adds empty texts */
+		assert(vector_resize(&texts, 10) == VECTOR_SUCCESS);
+		assert(texts_live == 54);
+		assert(vector_resize(&texts, 20) == VECTOR_SUCCESS);
+		assert(((const Text*)vector_const_get(&texts, 15))->chars == NULL);
+		assert(text_setup(&text, "a string too long to be inline") == VECTOR_SUCCESS);
+		assert(vector_fill(&texts, 5, 15, &text, 4) == VECTOR_SUCCESS);
+		assert(texts_live == 54 - 2 + 15 + 1);
+		text_destroy(&text);
+
+		/* Runs of equal texts collapse, destroying the duplicates */
+		assert(vector_unique(&texts, compare_texts) == VECTOR_SUCCESS);
+		assert(vector_size(&texts) == 6);
+		assert(texts_live == 50 + 2 + 1);
+		assert(strcmp(((const Text*)vector_const_get(&texts, 5))->chars,
+									"a string too long to be inline") == 0);
+
+		assert(vector_clear(&texts) == VECTOR_SUCCESS);
+		assert(texts_live == 50);
+		assert(vector_destroy(&texts) == VECTOR_SUCCESS);
+		assert(vector_destroy(&copy) == VECTOR_SUCCESS);
+		assert(texts_live == 0);
+
+		/* Owned pointers relocate as bytes and grow through realloc */
+		assert(names_vector_setup(&names, 2) == VECTOR_SUCCESS);
+		for (i = 0; i < 1000; ++i) {
+			sprintf(buffer, "name %zu", i);
+			name = name_new(buffer);
+			assert(vector_push_back(&names, &name) == VECTOR_SUCCESS);
+		}
+		assert(vector_erase(&names, 500) == VECTOR_SUCCESS);
+		assert(strcmp(*(char* const*)vector_const_get(&names, 500), "name 501") == 0);
+		assert(names_vector_setup(&copy, 0) == VECTOR_SUCCESS);
+		assert(vector_copy_assign(&copy, &names) == VECTOR_SUCCESS);
+		assert(texts_live == 1998);
+
+		/* A snapshot that cannot take its private copy hands out no iterator */
+		assert(vector_snapshot(&copy, &names) == VECTOR_SUCCESS);
+		assert(texts_live == 999);
+		texts_failing = 1;
+		iterator = vector_begin(&copy);
+		assert(iterator.tc == NULL && iterator_get(&iterator) == NULL);
+		assert(iterator_erase(&copy, &iterator) == VECTOR_ERROR);
+		count = 0;
+		VECTOR_FOR_EACH(&copy, each) ++count;
+		assert(count == 0);
+		assert(vector_is_shared(&copy));
+		assert(texts_live == 999);
+		texts_failing = 0;
+		iterator = vector_begin(&copy);
+		assert(iterator.tc != NULL && !vector_is_shared(&copy));
+		assert(texts_live == 1998);
+		assert(vector_destroy(&copy) == VECTOR_SUCCESS);
+		assert(vector_destroy(&names) == VECTOR_SUCCESS);
+		assert(texts_live == 0);
+
+		/* A heap of names hands its front over, or destroys it, exactly once */
+		assert(names_vector_setup(&names, 0) == VECTOR_SUCCESS);
+		assert(names_vector_setup(&copy, 0) == VECTOR_SUCCESS);
+		for (i = 0; i < 100; ++i) {
+			sprintf(buffer, "%03zu", (i * 37) % 100);
+			name = name_new(buffer);
+			assert(vector_heap_push(&names, &name, compare_names) == VECTOR_SUCCESS);
+		}
+		assert(vector_heap_pop(&names, &name, compare_names) == VECTOR_SUCCESS);
+		assert(strcmp(name, "000") == 0);
+		assert(vector_push_back(&copy, &name) == VECTOR_SUCCESS);
+		assert(vector_heap_pop(&names, NULL, compare_names) == VECTOR_SUCCESS);
+		assert(texts_live == 99);
+		assert(vector_heap_pop(&names, &name, compare_names) == VECTOR_SUCCESS);
+		assert(strcmp(name, "002") == 0);
+		assert(vector_push_back(&copy, &name) == VECTOR_SUCCESS);
+
+		/* Byte-wise paths refuse the types they would corrupt */
+		assert(pipeline_setup(&pipeline, &names) == VECTOR_SUCCESS);
+		assert(pipeline_collect_into(&pipeline, &copy) == VECTOR_ERROR);
+		assert(vector_destroy(&names) == VECTOR_SUCCESS);
+		assert(vector_destroy(&copy) == VECTOR_SUCCESS);
+		assert(names_vector_setup(&names, 0) == VECTOR_SUCCESS);
+		assert(flat_set_setup(&set, &names, compare_names) == VECTOR_ERROR);
+		assert(vector_destroy(&names) == VECTOR_SUCCESS);
+
+		assert(texts_vector_setup(&texts, 0) == VECTOR_SUCCESS);
+		assert(text_setup(&text, "short") == VECTOR_SUCCESS);
+		assert(vector_heap_push(&texts, &text, compare_texts) == VECTOR_ERROR);
+		assert(vector_heap_make(&texts, compare_texts) == VECTOR_ERROR);
+		text_destroy(&text);
+		assert(vector_destroy(&texts) == VECTOR_SUCCESS);
+		assert(texts_live == 0);
+	}
+
+	printf("TESTING REORDERING ...\n");
+	{
+		Vector values = VECTOR_INITIALIZER, indices = VECTOR_INITIALIZER;
+		Vector gathered = VECTOR_INITIALIZER, names = VECTOR_INITIALIZER;
+		Vector other_names = VECTOR_INITIALIZER, fixed = VECTOR_INITIALIZER, alias;
+		FixedDoubles fixed_doubles;
+		double storage[1000];
+		size_t index;
+
+		doubles_vector_setup(&values, 0);
+		doubles_vector_setup(&indices, 0);
+		doubles_vector_setup(&gathered, 0);
+		for (i = 0; i < 1000; ++i) {
+			d = (double)i * 10;
+			vector_push_back(&values, &d);
+			/* 7 and 1000 are coprime, so this visits every index once */
+			index = (i * 7) % 1000;
+			vector_push_back(&indices, &index);
+		}
+
+		/* gathered[i] = values[indices[i]], odd tails included */
+		assert(vector_resize(&indices, 999) == VECTOR_SUCCESS);
+		assert(vector_gather(&gathered, &values, &indices) == VECTOR_SUCCESS);
+		assert(vector_size(&gathered) == 999);
+		for (i = 0; i < 999; ++i) {
+			assert(VECTOR_GET_AS(double, &gathered, i) == (double)((i * 7) % 1000) * 10);
+		}
+
+		/* Scattering through the same indices undoes the gather */
+		index = 993;
+		assert(vector_push_back(&indices, &index) == VECTOR_SUCCESS);
+		assert(vector_gather(&gathered, &values, &indices) == VECTOR_SUCCESS);
+		d = 0;
+		assert(vector_fill(&values, 0, 1000, &d, 1) == VECTOR_SUCCESS);
+		assert(vector_scatter(&values, &gathered, &indices) == VECTOR_SUCCESS);
+		for (i = 0; i < 1000; ++i) {
+			assert(VECTOR_GET_AS(double, &values, i) == (double)i * 10);
+		}
+
+		/* Permuting in place matches the gather, and leaves perm intact */
+		assert(vector_permute_inplace(&values, &indices) == VECTOR_SUCCESS);
+		for (i = 0; i < 1000; ++i) {
+			assert(VECTOR_GET_AS(double, &values, i) ==
+						 VECTOR_GET_AS(double, &gathered, i));
+			assert(VECTOR_GET_AS(size_t, &indices, i) == (i * 7) % 1000);
+		}
+
+		/* A second handle on an input is refused like the input itself */
+		alias = values;
+		assert(vector_gather(&alias, &values, &indices) == VECTOR_ERROR);
+		assert(vector_scatter(&alias, &values, &indices) == VECTOR_ERROR);
+		alias = indices;
+		assert(vector_gather(&alias, &values, &indices) == VECTOR_ERROR);
+		assert(vector_scatter(&alias, &gathered, &indices) == VECTOR_ERROR);
+		assert(vector_permute_inplace(&alias, &indices) == VECTOR_ERROR);
+		for (i = 0; i < 1000; ++i) {
+			assert(VECTOR_GET_AS(double, &values, i) ==
+						 VECTOR_GET_AS(double, &gathered, i));
+			assert(VECTOR_GET_AS(size_t, &indices, i) == (i * 7) % 1000);
+		}
+
+		/* A vector that must not allocate follows the cycles instead */
+		assert(doubles_fixed_vector_setup(&fixed, &fixed_doubles, storage, 1000, false) ==
+					 VECTOR_SUCCESS);
+		for (i = 0; i < 1000; ++i) {
+			d = (double)i * 10;
+			vector_push_back(&fixed, &d);
+		}
+		assert(vector_permute_inplace(&fixed, &indices) == VECTOR_SUCCESS);
+		for (i = 0; i < 1000; ++i) assert(storage[i] == VECTOR_GET_AS(double, &gathered, i));
+
+		/* Out of range indices and non-permutations are refused untouched */
+		index = 1000;
+		assert(vector_assign(&indices, 3, &index) == VECTOR_SUCCESS);
+		assert(vector_gather(&gathered, &values, &indices) == VECTOR_ERROR);
+		assert(vector_scatter(&values, &gathered, &indices) == VECTOR_ERROR);
+		assert(vector_permute_inplace(&values, &indices) == VECTOR_ERROR);
+		index = 0;
+		assert(vector_assign(&indices, 3, &index) == VECTOR_SUCCESS);
+		assert(vector_permute_inplace(&values, &indices) == VECTOR_ERROR);
+		assert(VECTOR_GET_AS(size_t, &indices, 0) == 0);
+		for (i = 0; i < 1000; ++i) {
+			assert(VECTOR_GET_AS(double, &values, i) ==
+						 VECTOR_GET_AS(double, &gathered, i));
+		}
+
+		/* Elements that own memory cannot be copied as bytes */
+		assert(names_vector_setup(&names, 0) == VECTOR_SUCCESS);
+		assert(names_vector_setup(&other_names, 0) == VECTOR_SUCCESS);
+		assert(vector_gather(&other_names, &names, &indices) == VECTOR_ERROR);
+		assert(vector_destroy(&names) == VECTOR_SUCCESS);
+		assert(vector_destroy(&other_names) == VECTOR_SUCCESS);
+
+		vector_destroy(&fixed);
+		vector_destroy(&values);
+		vector_destroy(&indices);
+		vector_destroy(&gathered);
+	}
+
+	printf("TESTING MERGING ...\n");
+	{
+		static const int sizes[][2] = {
+			{ 200, 300 }, { 20, 2000 }, { 2000, 20 }, { 1, 5000 }, { 0, 50 }, { 50, 0 },
+		};
+		Vector sources[5], merged = VECTOR_INITIALIZER, alias;
+		double fraction;
+		size_t s, j;
+
+		/* Walked linearly, and galloping through either side */
+		for (s = 0; s < sizeof sizes / sizeof sizes[0]; ++s) {
+			check_set_operations(sizes[s][0], sizes[s][1], false, vector_compare_double);
+			check_set_operations(sizes[s][0], sizes[s][1], true, vector_compare_int64);
+			check_set_operations(sizes[s][0], sizes[s][1], false, compare_doubles);
+		}
+
+		/* Ties keep the order of the sources: source s holds n + s / 10 */
+		for (s = 0; s < 5; ++s) {
+			doubles_vector_setup(&sources[s], 0);
+			for (i = 0; i < (int)(s * 40) % 130; ++i) {
+				d = (double)(i / 3) + (double)s / 10;
+				vector_push_back(&sources[s], &d);
+			}
+		}
+		doubles_vector_setup(&merged, 0);
+		assert(vector_merge_k(&merged, sources, 5, compare_floors) == VECTOR_SUCCESS);
+		assert(vector_size(&merged) == 0 + 40 + 80 + 120 + 30);
+		for (j = 1; j < vector_size(&merged); ++j) {
+			d = VECTOR_GET_AS(double, &merged, j - 1);
+			fraction = VECTOR_GET_AS(double, &merged, j);
+			assert((int64_t)d < (int64_t)fraction ||
+						 ((int64_t)d == (int64_t)fraction && d <= fraction));
+		}
+
+		/* The typed kernel, and a single source */
+		assert(vector_merge_k(&merged, sources, 5, vector_compare_double) == VECTOR_SUCCESS);
+		for (j = 1; j < vector_size(&merged); ++j) {
+			assert(VECTOR_GET_AS(double, &merged, j - 1) <= VECTOR_GET_AS(double, &merged, j));
+		}
+		assert(vector_merge_k(&merged, &sources[3], 1, vector_compare_double) == VECTOR_SUCCESS);
+		assert(vector_size(&merged) == 120);
+		assert(vector_merge_k(&merged, sources, 0, vector_compare_double) == VECTOR_SUCCESS);
+		assert(vector_size(&merged) == 0);
+
+		/* The destination cannot be one of the sources */
+		assert(vector_merge_k(&sources[1], sources, 5, vector_compare_double) == VECTOR_ERROR);
+		assert(vector_set_union(&sources[0], &sources[0], &sources[1], vector_compare_double) ==
+					 VECTOR_ERROR);
+		alias = sources[1];
+		assert(vector_set_difference(&alias, &sources[0], &sources[1], vector_compare_double) ==
+					 VECTOR_ERROR);
+		assert(vector_set_intersection(&alias, &sources[1], &sources[2], vector_compare_double) ==
+					 VECTOR_ERROR);
+		assert(vector_size(&sources[1]) == vector_size(&alias));
+
+		for (s = 0; s < 5; ++s) vector_destroy(&sources[s]);
+		vector_destroy(&merged);
+	}
+
+	printf("TESTING CONCAT AND SPLICE ...\n");
+	{
+		Vector a = VECTOR_INITIALIZER, b = VECTOR_INITIALIZER;
+		Vector c = VECTOR_INITIALIZER, texts = VECTOR_INITIALIZER;
+		Vector more_texts = VECTOR_INITIALIZER, snapshot = VECTOR_INITIALIZER;
+		const void *a_data, *b_data;
+		char buffer[64];
+		Text text;
+		size_t j;
+
+		doubles_vector_setup(&a, 0);
+		doubles_vector_setup(&b, 0);
+		doubles_vector_setup(&c, 0);
+		for (i = 0; i < 1000; ++i) {
+			d = (double)i;
+			vector_push_back(i < 10 ? &a : &b, &d);
+		}
+
+		/* a must grow, b has room for both: a takes over b's buffer */
+		a_data = vector_const_data(&a);
+		b_data = vector_const_data(&b);
+		assert(vector_capacity(&a) < 1000 && vector_capacity(&b) >= 1000);
+		assert(vector_concat_move(&a, &b) == VECTOR_SUCCESS);
+		assert(vector_const_data(&a) == b_data && vector_const_data(&b) == a_data);
+		assert(vector_size(&a) == 1000 && vector_size(&b) == 0);
+		for (i = 0; i < 1000; ++i) assert(VECTOR_GET_AS(double, &a, i) == i);
+
+		/* An empty destination just swaps buffers */
+		assert(vector_concat_move(&c, &a) == VECTOR_SUCCESS);
+		assert(vector_const_data(&c) == b_data && vector_size(&a) == 0);
+		assert(vector_size(&c) == 1000);
+
+		/* A destination with room appends in place */
+		d = -1;
+		assert(vector_reserve(&a, 4000) == VECTOR_SUCCESS);
+		assert(vector_push_back(&a, &d) == VECTOR_SUCCESS);
+		a_data = vector_const_data(&a);
+		assert(vector_concat_move(&a, &c) == VECTOR_SUCCESS);
+		assert(vector_const_data(&a) == a_data && vector_size(&a) == 1001);
+		assert(VECTOR_GET_AS(double, &a, 0) == -1 && VECTOR_GET_AS(double, &a, 1000) == 999);
+		assert(vector_concat_move(&a, &c) == VECTOR_SUCCESS && vector_size(&a) == 1001);
+		assert(vector_concat_move(&a, &a) == VECTOR_ERROR);
+
+		/* Splicing [10, 20) of a into the middle of b */
+		for (i = 0; i < 100; ++i) {
+			d = 10000 + i;
+			vector_push_back(&b, &d);
+		}
+		assert(vector_splice(&b, 50, &a, 11, 21) == VECTOR_SUCCESS);
+		assert(vector_size(&b) == 110 && vector_size(&a) == 991);
+		for (i = 0; i < 110; ++i) {
+			d = i < 50 ? 10000 + i : i < 60 ? i - 40 : 10000 + i - 10;
+			assert(VECTOR_GET_AS(double, &b, i) == d);
+		}
+		assert(VECTOR_GET_AS(double, &a, 10) == 9 && VECTOR_GET_AS(double, &a, 11) == 20);
+		assert(vector_splice(&b, 110, &a, 0, 991) == VECTOR_SUCCESS);
+		assert(vector_size(&b) == 1101 && vector_size(&a) == 0);
+		assert(VECTOR_GET_AS(double, &b, 1100) == 999);
+		assert(vector_splice(&b, 0, &b, 0, 1) == VECTOR_ERROR);
+
+		/* Elements with hooks are moved, not copied, and short texts follow
+		 * their inline buffer */
+		assert(texts_vector_setup(&texts, 0) == VECTOR_SUCCESS);
+		assert(texts_vector_setup(&more_texts, 0) == VECTOR_SUCCESS);
+		for (j = 0; j < 40; ++j) {
+			sprintf(buffer, j % 2 ? "t%zu" : "a long string, not inline %zu", j);
+			assert(text_setup(&text, buffer) == VECTOR_SUCCESS);
+			assert(vector_push_back(j < 20 ? &texts : &more_texts, &text) == VECTOR_SUCCESS);
+		}
+		assert(vector_splice(&texts, 0, &more_texts, 5, 15) == VECTOR_SUCCESS);
+		assert(texts_live == 20);
+		assert(strcmp(((const Text*)vector_const_get(&texts, 0))->chars,
+									"t25") == 0);
+		assert(((const Text*)vector_const_get(&texts, 0))->chars ==
+					 ((const Text*)vector_const_get(&texts, 0))->small);
+
+		/* A source shared with a snapshot gives up copies */
+		assert(texts_vector_setup(&snapshot, 0) == VECTOR_SUCCESS);
+		assert(vector_snapshot(&snapshot, &more_texts) == VECTOR_SUCCESS);
+		assert(vector_concat_move(&texts, &more_texts) == VECTOR_SUCCESS);
+		assert(vector_size(&texts) == 40 && vector_size(&more_texts) == 0);
+		assert(texts_live == 25);
+		assert(vector_destroy(&snapshot) == VECTOR_SUCCESS);
+		assert(texts_live == 20);
+		for (j = 0; j < 40; ++j) {
+			assert(((const Text*)vector_const_get(&texts, j))->chars != NULL);
+		}
+
+		vector_destroy(&texts);
+		vector_destroy(&more_texts);
+		assert(texts_live == 0);
+		vector_destroy(&a);
+		vector_destroy(&b);
+		vector_destroy(&c);
+	}
+
+	printf("TESTING SPARSE VECTOR ...\n");
+	{
+		SparseVector s = SPARSE_VECTOR_INITIALIZER, t = SPARSE_VECTOR_INITIALIZER;
+		Vector dense = VECTOR_INITIALIZER, round_trip = VECTOR_INITIALIZER;
+		double result, expected;
+
+		/* Entries stay sorted; zeros are not stored */
+		assert(sparse_vector_setup(&s, 100, 0) == VECTOR_SUCCESS);
+		assert(sparse_vector_set(&s, 40, 4) == VECTOR_SUCCESS);
+		assert(sparse_vector_set(&s, 10, 1) == VECTOR_SUCCESS);
+		assert(sparse_vector_set(&s, 70, 7) == VECTOR_SUCCESS);
+		assert(sparse_vector_set(&s, 20, 0) == VECTOR_SUCCESS);
+		assert(sparse_vector_size(&s) == 3);
+		assert(s.indices[0] == 10 && s.indices[1] == 40 && s.indices[2] == 70);
+		assert(sparse_vector_get(&s, 40) == 4 && sparse_vector_get(&s, 41) == 0);
+		assert(sparse_vector_set(&s, 40, -2) == VECTOR_SUCCESS);
+		assert(sparse_vector_get(&s, 40) == -2 && sparse_vector_size(&s) == 3);
+		assert(sparse_vector_set(&s, 40, 0) == VECTOR_SUCCESS);
+		assert(sparse_vector_size(&s) == 2 && sparse_vector_get(&s, 70) == 7);
+		assert(sparse_vector_set(&s, 100, 1) == VECTOR_ERROR);
+		assert(sparse_vector_byte_size(&s) == 2 * (sizeof(size_t) + sizeof(double)));
+
+		/* Building in order */
+		assert(sparse_vector_clear(&s) == VECTOR_SUCCESS);
+		assert(sparse_vector_push_back(&s, 3, 1) == VECTOR_SUCCESS);
+		assert(sparse_vector_push_back(&s, 5, 0) == VECTOR_SUCCESS);
+		assert(sparse_vector_push_back(&s, 9, 2) == VECTOR_SUCCESS);
+		assert(sparse_vector_size(&s) == 2);
+		sparse_vector_destroy(&s);
+
+		/* Dense vectors of odd lengths exercise the kernel tails */
+		doubles_vector_setup(&dense, 0);
+		doubles_vector_setup(&round_trip, 0);
+		for (i = 0; i < 1003; ++i) {
+			d = i % 3 == 0 ? (double)(i % 7) - 3 : i % 5 == 0 ? 0.25 : 0;
+			vector_push_back(&dense, &d);
+		}
+
+		assert(sparse_vector_setup(&s, 0, 0) == VECTOR_SUCCESS);
+		assert(sparse_vector_from_dense(&s, &dense, 0) == VECTOR_SUCCESS);
+		assert(sparse_vector_dimension(&s) == 1003);
+		for (i = 0; i < 1003; ++i) {
+			assert(sparse_vector_get(&s, i) == VECTOR_GET_AS(double, &dense, i));
+		}
+		assert(sparse_vector_to_dense(&s, &round_trip) == VECTOR_SUCCESS);
+		assert(vector_size(&round_trip) == 1003);
+		assert(memcmp(vector_const_data(&round_trip),
+									vector_const_data(&dense),
+									1003 * sizeof(double)) == 0);
+
+		/* The dot product with itself sums the squares */
+		for (i = 0, expected = 0; i < 1003; ++i) {
+			d = VECTOR_GET_AS(double, &dense, i);
+			expected += d * d;
+		}
+		assert(sparse_vector_dot_dense(&s, &dense, &result) == VECTOR_SUCCESS);
+		assert(result == expected);
+
+		/* The threshold drops small magnitudes */
+		assert(sparse_vector_setup(&t, 1003, 0) == VECTOR_SUCCESS);
+		assert(sparse_vector_from_dense(&t, &dense, 0.5) == VECTOR_SUCCESS);
+		for (i = 0; i < 1003; ++i) {
+			d = VECTOR_GET_AS(double, &dense, i);
+			assert(sparse_vector_get(&t, i) == (d > 0.5 || d < -0.5 ? d : 0));
+		}
+
+		/* The merge visits only the shared indices */
+		for (i = 0, expected = 0; i < 1003; ++i) {
+			d = VECTOR_GET_AS(double, &dense, i);
+			if (d > 0.5 || d < -0.5) expected += d * d;
+		}
+		assert(sparse_vector_dot(&s, &t, &result) == VECTOR_SUCCESS);
+		assert(result == expected);
+		assert(sparse_vector_dot(&t, &s, &result) == VECTOR_SUCCESS);
+		assert(result == expected);
+
+		/* A much shorter operand gallops */
+		sparse_vector_clear(&t);
+		sparse_vector_push_back(&t, 3, 2);
+		sparse_vector_push_back(&t, 5, 2);
+		sparse_vector_push_back(&t, 1002, 2);
+		assert(sparse_vector_dot(&s, &t, &result) == VECTOR_SUCCESS);
+		expected = sparse_vector_get(&s, 3) + sparse_vector_get(&s, 5) +
+               sparse_vector_get(&s, 1002);
+		assert(result == 2 * expected);
+
+		/* axpy touches only the stored entries */
+		assert(sparse_vector_axpy_dense(-1, &s, &dense) == VECTOR_SUCCESS);
+		for (i = 0; i < 1003; ++i) assert(VECTOR_GET_AS(double, &dense, i) == 0);
+
+		/* Dimensions and element sizes must match */
+		vector_pop_back(&dense);
+		assert(sparse_vector_dot_dense(&s, &dense, &result) == VECTOR_ERROR);
+		assert(sparse_vector_axpy_dense(1, &s, &dense) == VECTOR_ERROR);
+		sparse_vector_destroy(&t);
+		sparse_vector_setup(&t, 5, 0);
+		assert(sparse_vector_dot(&s, &t, &result) == VECTOR_ERROR);
+
+		sparse_vector_destroy(&s);
+		sparse_vector_destroy(&t);
+		vector_destroy(&dense);
+		vector_destroy(&round_trip);
+	}
+
+	printf("TESTING STREAM ...\n");
+	{
+		VectorStreamOptions options = VECTOR_STREAM_OPTIONS_DEFAULT;
+		VectorStream stream;
+		Vector batch = VECTOR_INITIALIZER;
+		FILE *file = tmpfile();
+		int fd = fileno(file), read_only;
+		char path[] = "/tmp/vector-stream-XXXXXX";
+		double triple[3], *contents;
+		size_t bytes, j;
+		bool direct;
+
+		/* Two small buffers, so the producer runs into the writer */
+		options.buffer_count = 2;
+		options.buffer_size = 1000;
+		assert(vector_stream_setup(&stream, fd, sizeof(double), &options) == VECTOR_SUCCESS);
+		assert(stream.options.buffer_size == VECTOR_STREAM_ALIGNMENT);
+		for (i = 0; i < 100000; ++i) {
+			d = (double)i;
+			assert(vector_stream_push_back(&stream, &d) == VECTOR_SUCCESS);
+		}
+		assert(vector_stream_flush(&stream) == VECTOR_SUCCESS);
+		assert(lseek(fd, 0, SEEK_END) == 100000 * sizeof(double));
+
+		/* A flush in the middle of a block, then more on top */
+		doubles_vector_setup(&batch, 0);
+		for (i = 100000; i < 100003; ++i) {
+			d = (double)i;
+			vector_push_back(&batch, &d);
+		}
+		assert(vector_stream_append(&stream, &batch) == VECTOR_SUCCESS);
+		assert(vector_stream_flush(&stream) == VECTOR_SUCCESS);
+		assert(vector_stream_flush(&stream) == VECTOR_SUCCESS);
+		assert(vector_stream_append(&stream, &batch) == VECTOR_SUCCESS);
+		assert(vector_stream_size(&stream) == 100006);
+		assert(vector_stream_close(&stream) == VECTOR_SUCCESS);
+
+		bytes = 100006 * sizeof(double);
+		contents = malloc(bytes);
+		assert(pread(fd, contents, bytes, 0) == (ssize_t)bytes);
+		for (i = 0; i < 100006; ++i) {
+			assert(contents[i] == (i < 100003 ? i : i - 3));
+		}
+
+		/* A new stream appends to the unaligned end of the file, and elements
+		 * that do not divide the buffer straddle two of them */
+		assert(vector_stream_setup(&stream, fd, sizeof triple, &options) == VECTOR_SUCCESS);
+		for (j = 0; j < 1000; ++j) {
+			triple[0] = triple[1] = triple[2] = (double)j;
+			assert(vector_stream_push_back(&stream, triple) == VECTOR_SUCCESS);
+		}
+		assert(vector_stream_size(&stream) == 1000);
+		assert(vector_stream_append(&stream, &batch) == VECTOR_ERROR);
+		assert(vector_stream_close(&stream) == VECTOR_SUCCESS);
+
+		assert(lseek(fd, 0, SEEK_END) == (off_t)(bytes + 1000 * sizeof triple));
+		contents = realloc(contents, 3000 * sizeof(double));
+		assert(pread(fd, contents, 3000 * sizeof(double), bytes) ==
+					 3000 * sizeof(double));
+		for (j = 0; j < 3000; ++j) assert(contents[j] == j / 3);
+
+		/* Direct mode, where the file system has it */
+		assert(ftruncate(fd, 0) == 0);
+		options.direct = true;
+		direct = vector_stream_setup(&stream, fd, sizeof(double), &options) ==
+						 VECTOR_SUCCESS;
+		if (direct) {
+			for (i = 0; i < 10000; ++i) {
+				d = (double)i;
+				assert(vector_stream_push_back(&stream, &d) == VECTOR_SUCCESS);
+				if (i % 1001 == 0) assert(vector_stream_flush(&stream) == VECTOR_SUCCESS);
+			}
+			assert(vector_stream_close(&stream) == VECTOR_SUCCESS);
+			assert(lseek(fd, 0, SEEK_END) == 10000 * sizeof(double));
+			assert(pread(fd, contents, 3000 * sizeof(double), 0) == 3000 * sizeof(double));
+			for (j = 0; j < 3000; ++j) assert(contents[j] == j);
+		}
+		options.direct = false;
+
+		/* A failed write is reported by flush and close */
+		close(mkstemp(path));
+		read_only = open(path, O_RDONLY);
+		assert(vector_stream_setup(&stream, read_only, sizeof(double), &options) == VECTOR_SUCCESS);
+		for (i = 0; i < 1000; ++i) {
+			d = (double)i;
+			vector_stream_push_back(&stream, &d);
+		}
+		assert(vector_stream_flush(&stream) == VECTOR_ERROR);
+		assert(vector_stream_close(&stream) == VECTOR_ERROR);
+		close(read_only);
+		unlink(path);
+
+		options.buffer_count = 1;
+		assert(vector_stream_setup(&stream, fd, sizeof(double), &options) == VECTOR_ERROR);
+
+		free(contents);
+		vector_destroy(&batch);
+		fclose(file);
+	}
+
 	printf("\033[92mALL TEST PASSED\033[0m\n");
 }
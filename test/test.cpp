@@ -0,0 +1,193 @@
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <numeric>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "vector.hpp"
+
+extern "C" {
+#include "doubles.h"
+#include "vector_algorithm.h"
+
+int doubles_type(void);
+}
+
+/* Share the type id of Doubles, so the C library combines the two */
+template <>
+struct vec::c_type_id<double>
+{
+	static int value() noexcept { return doubles_type(); }
+};
+
+/* Owns its element, but may be moved with memcpy */
+struct Boxed
+{
+	std::unique_ptr<int> value;
+	explicit Boxed(int v) : value(new int(v)) {}
+};
+
+template <>
+struct vec::is_trivially_relocatable<Boxed> : std::true_type {};
+
+static double sum(std::span<const double> elements)
+{
+	return std::accumulate(elements.begin(), elements.end(), 0.0);
+}
+
+int main(int argc, const char* argv[]) {
+	printf("TESTING C++ LAYOUT ...\n");
+	{
+		static_assert(std::is_standard_layout_v<vec::vector<double>>);
+		static_assert(sizeof(vec::vector<double>) == sizeof(Doubles));
+		static_assert(offsetof(vec::layout<double>, size) == offsetof(Doubles, size));
+		static_assert(offsetof(vec::layout<double>, capacity) ==
+									offsetof(Doubles, capacity));
+		static_assert(offsetof(vec::layout<double>, data) == offsetof(Doubles, data));
+		static_assert(vec::vector<double>::c_compatible);
+		static_assert(!vec::vector<std::string>::c_compatible);
+		static_assert(!vec::vector<Boxed>::c_compatible);
+	}
+
+	printf("TESTING C++ VECTOR ...\n");
+	{
+		vec::vector<double> numbers;
+		assert(numbers.empty());
+		assert(numbers.data() == nullptr);
+
+		for (int i = 0; i < 100; ++i) numbers.push_back(i);
+		assert(numbers.size() == 100);
+		assert(numbers.capacity() >= 100);
+		assert(numbers.front() == 0 && numbers.back() == 99);
+
+		/* Pushing an element of the vector itself while it grows */
+		numbers.shrink_to_fit();
+		numbers.push_back(numbers[10]);
+		assert(numbers.back() == 10);
+		numbers.pop_back();
+
+		double total = 0;
+		for (double d : numbers) total += d;
+		assert(total == 4950);
+		assert(sum(numbers) == 4950);
+
+		vec::vector<double> copy = numbers;
+		assert(copy.size() == 100 && copy.data() != numbers.data());
+		assert(std::equal(copy.begin(), copy.end(), numbers.begin()));
+
+		double* data = copy.data();
+		vec::vector<double> moved = std::move(copy);
+		assert(moved.data() == data);
+		assert(copy.empty() && copy.data() == nullptr);
+
+		moved = numbers;
+		assert(moved.size() == 100 && moved.data() != numbers.data());
+		moved.resize(150, -1.0);
+		assert(moved.size() == 150 && moved[149] == -1.0 && moved[99] == 99);
+		moved.resize(10);
+		assert(moved.size() == 10 && moved.back() == 9);
+
+		bool threw = false;
+		try {
+			moved.at(10);
+		} catch (const std::out_of_range&) {
+			threw = true;
+		}
+		assert(threw);
+
+		moved.clear();
+		moved.shrink_to_fit();
+		assert(moved.capacity() == 0 && moved.data() == nullptr);
+
+		vec::vector<double, vec::policy<vec::grow_half>> slow = {1, 2, 3, 4};
+		slow.push_back(5);
+		assert(slow.capacity() == 6);
+		std::span<const double> view = slow;
+		assert(view.size() == 5 && view[4] == 5);
+	}
+
+	printf("TESTING C++ RELOCATION ...\n");
+	{
+		vec::vector<Boxed> boxes;
+		for (int i = 0; i < 1000; ++i) boxes.emplace_back(i);
+		for (int i = 0; i < 1000; ++i) assert(*boxes[i].value == i);
+
+		vec::vector<std::string> strings;
+		for (int i = 0; i < 100; ++i) strings.push_back(std::to_string(i));
+		strings.push_back(strings[0]);
+		assert(strings.size() == 101 && strings[100] == "0" && strings[99] == "99");
+		strings.resize(2);
+		assert(strings[1] == "1");
+	}
+
+	printf("TESTING C++ INTEROP ...\n");
+	{
+		vec::vector<double> numbers = {1, 2, 3};
+		Vector view = numbers.c_vector();
+
+		/* The C library grows the same buffer */
+		for (double d = 4; d <= 100; ++d) vector_push_back(&view, &d);
+		assert(numbers.size() == 100 && numbers[99] == 100);
+		assert(vector_size(&view) == 100);
+		assert(*(double*)vector_get(&view, 2) == 3);
+
+		double total = 0;
+		VECTOR_FOR_EACH(&view, it) {
+			total += ITERATOR_GET_AS(double, &it);
+		}
+		assert(total == 5050);
+
+		/* Copies into and out of a C typed vector */
+		vec::handle doubles;
+		{
+			Vector c = VECTOR_INITIALIZER;
+			assert(doubles_vector_setup(&c, 10) == VECTOR_SUCCESS);
+			doubles = vec::handle(c);
+		}
+		assert(vector_copy_assign(doubles.get(), &view) == VECTOR_SUCCESS);
+		assert(sum(doubles.span<const double>()) == 5050);
+		doubles.span<double>()[0] = -1;
+
+		vec::vector<double> back;
+		Vector back_view = back.c_vector();
+		assert(vector_copy_assign(&back_view, doubles.get()) == VECTOR_SUCCESS);
+		assert(back.size() == 100 && back[0] == -1 && back[99] == 100);
+
+		vec::handle moved = std::move(doubles);
+		assert(!doubles && moved);
+
+		/* Destroying through C leaves the wrapper empty */
+		vector_destroy(&view);
+		assert(numbers.empty() && numbers.data() == nullptr);
+		numbers.push_back(1);
+		assert(numbers.size() == 1);
+	}
+
+	printf("TESTING C++ GATHER ...\n");
+	{
+		/* 4-byte elements take the other gather kernel */
+		vec::vector<std::uint32_t> values, gathered;
+		vec::vector<std::size_t> indices;
+		for (std::uint32_t i = 0; i < 1001; ++i) {
+			values.push_back(i * 3);
+			indices.push_back((i * 11) % 1001 == 0 ? 0 : 1000 - i);
+		}
+
+		Vector values_view = values.c_vector();
+		Vector gathered_view = gathered.c_vector();
+		Vector indices_view = indices.c_vector();
+		assert(vector_gather(&gathered_view, &values_view, &indices_view) ==
+					 VECTOR_SUCCESS);
+		assert(gathered.size() == 1001);
+		for (std::size_t i = 0; i < 1001; ++i) {
+			assert(gathered[i] == values[indices[i]]);
+		}
+	}
+
+	printf("\033[92mALL TEST PASSED\033[0m\n");
+}
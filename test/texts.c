@@ -0,0 +1,327 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "texts.h"
+
+long texts_live = 0;
+long texts_failing = 0;
+
+char *_texts_strdup(const char *chars)
+{
+	size_t length = strlen(chars) + 1;
+	char *copy;
+
+	if (texts_failing) return NULL;
+
+	copy = malloc(length);
+
+	if (copy == NULL) return NULL;
+	memcpy(copy, chars, length);
+	++texts_live;
+
+	return copy;
+}
+
+void _texts_free(char *chars)
+{
+	if (chars == NULL) return;
+	free(chars);
+	--texts_live;
+}
+
+
+/***** TEXT *****/
+
+int text_setup(Text *text, const char *chars)
+{
+	assert(text != NULL);
+	assert(chars != NULL);
+
+	if (strlen(chars) < sizeof text->small) {
+		strcpy(text->small, chars);
+		text->chars = text->small;
+	} else {
+		text->chars = _texts_strdup(chars);
+		if (text->chars == NULL) return VECTOR_ERROR;
+	}
+
+	return VECTOR_SUCCESS;
+}
+
+void text_destroy(Text *text)
+{
+	assert(text != NULL);
+	if (text->chars != text->small) _texts_free(text->chars);
+}
+
+/* Wrapper functions */
+
+static int text_copy__(void *destination, const void *source)
+{
+	const Text *text = source;
+
+	/* A zeroed element copies as one */
+	if (text->chars == NULL) {
+		memset(destination, 0, sizeof(Text));
+		return VECTOR_SUCCESS;
+	}
+
+	return text_setup(destination, text->chars);
+}
+
+static void text_move__(void *destination, void *source)
+{
+	Text *to = destination, *from = source;
+
+	memcpy(to, from, sizeof(Text));
+	if (from->chars == from->small) to->chars = to->small;
+}
+
+static void text_destroy__(void *element)
+{
+	text_destroy(element);
+}
+
+static size_t text_elem_size__(void)
+{
+  return sizeof(Text);
+}
+
+static int text_type__(void)
+{
+  return 3;
+}
+
+
+/***** NAME *****/
+
+char *name_new(const char *chars)
+{
+	assert(chars != NULL);
+	return _texts_strdup(chars);
+}
+
+/* Wrapper functions */
+
+static int name_copy__(void *destination, const void *source)
+{
+	const char *name = *(char *const *)source;
+
+	*(char **)destination = name == NULL ? NULL : _texts_strdup(name);
+
+	return name != NULL && *(char **)destination == NULL ? VECTOR_ERROR
+                                                       : VECTOR_SUCCESS;
+}
+
+static void name_destroy__(void *element)
+{
+	_texts_free(*(char **)element);
+}
+
+static size_t name_elem_size__(void)
+{
+  return sizeof(char *);
+}
+
+static int name_type__(void)
+{
+  return 4;
+}
+
+
+/***** VECTOR *****/
+
+/* Wrapper functions, shared by both element kinds */
+
+static size_t texts_size__(void *self)
+{
+  return ((Texts *)self)->size;
+}
+
+static size_t texts_capacity__(void *self)
+{
+  return ((Texts *)self)->capacity;
+}
+
+static void *texts_data__(void *self)
+{
+  return ((Texts *)self)->data;
+}
+
+static void texts_set_size__(void *self, size_t size)
+{
+  ((Texts *)self)->size = size;
+}
+
+static void texts_set_capacity__(void *self, size_t capacity)
+{
+  ((Texts *)self)->capacity = capacity;
+}
+
+static void texts_set_data__(void *self, void *data)
+{
+  ((Texts *)self)->data = data;
+}
+
+static void *text_offset__(void *self, size_t index)
+{
+  return (Text *)((Texts *)self)->data + index;
+}
+
+static const void *text_const_offset__(const void *self, size_t index)
+{
+  return (const Text *)((const Texts *)self)->data + index;
+}
+
+static void *text_offset_next__(void *offset)
+{
+  return (Text *)offset + 1;
+}
+
+static void *name_offset__(void *self, size_t index)
+{
+  return (char **)((Texts *)self)->data + index;
+}
+
+static const void *name_const_offset__(const void *self, size_t index)
+{
+  return (char *const *)((const Texts *)self)->data + index;
+}
+
+static void *name_offset_next__(void *offset)
+{
+  return (char **)offset + 1;
+}
+
+static Iterator texts_iterator__(void *self, size_t index)
+{
+  Iterator iterator = { NULL, NULL };
+  (void)self;
+  (void)index;
+  return iterator;
+}
+
+static void *name_iter_pointer__(void *self)
+{
+  return self;
+}
+
+static void *name_iter_next__(void *self)
+{
+  return (char **)self + 1;
+}
+
+static void *name_iter_prev__(void *self)
+{
+  return (char **)self - 1;
+}
+
+static size_t name_iter_stride__(void)
+{
+  return sizeof(char *);
+}
+
+static Iterator names_iterator__(void *self, size_t index)
+{
+  static IteratorTC const iterator_tc = {
+    ._iter_type    = name_type__,
+    ._iter_pointer = name_iter_pointer__,
+    ._iter_next    = name_iter_next__,
+    ._iter_prev    = name_iter_prev__,
+    ._iter_stride  = name_iter_stride__,
+  };
+  Iterator iterator = { NULL, NULL };
+
+  if (index > ((Texts *)self)->size) return iterator;
+
+  iterator.self = name_offset__(self, index);
+  iterator.tc = &iterator_tc;
+
+  return iterator;
+}
+
+/* The library has destroyed the elements already */
+static int texts_destroy__(void *self)
+{
+	free(((Texts *)self)->data);
+	free(self);
+
+	return VECTOR_SUCCESS;
+}
+
+int _texts_setup(Vector *vector,
+                 size_t capacity,
+                 size_t elem_size,
+                 VectorTC const *vector_tc)
+{
+	Texts *texts;
+
+	assert(vector != NULL);
+
+	if (vector == NULL) return VECTOR_ERROR;
+
+	texts = malloc(sizeof(Texts));
+	if (texts == NULL) return VECTOR_ERROR;
+
+	texts->size = 0;
+	texts->capacity = MAX(VECTOR_MINIMUM_CAPACITY, capacity);
+	texts->data = malloc(texts->capacity * elem_size);
+	if (texts->data == NULL) {
+		free(texts);
+		return VECTOR_ERROR;
+	}
+
+	vector->tc = vector_tc;
+	vector->self = texts;
+
+	return VECTOR_SUCCESS;
+}
+
+int texts_vector_setup(Vector *vector, size_t capacity)
+{
+  static VectorTC const vector_tc = {
+    ._vec_elem_size    = text_elem_size__,
+    ._vec_type         = text_type__,
+    ._vec_size         = texts_size__,
+    ._vec_cap          = texts_capacity__,
+    ._vec_data         = texts_data__,
+    ._vec_set_size     = texts_set_size__,
+    ._vec_set_cap      = texts_set_capacity__,
+    ._vec_set_data     = texts_set_data__,
+    ._vec_offset       = text_offset__,
+    ._vec_const_offset = text_const_offset__,
+    ._vec_offset_next  = text_offset_next__,
+    ._vec_iterator     = texts_iterator__,
+    ._vec_destroy      = texts_destroy__,
+    ._vec_elem_copy    = text_copy__,
+    ._vec_elem_move    = text_move__,
+    ._vec_elem_destroy = text_destroy__,
+  };
+
+  return _texts_setup(vector, capacity, sizeof(Text), &vector_tc);
+}
+
+int names_vector_setup(Vector *vector, size_t capacity)
+{
+  static VectorTC const vector_tc = {
+    ._vec_elem_size    = name_elem_size__,
+    ._vec_type         = name_type__,
+    ._vec_size         = texts_size__,
+    ._vec_cap          = texts_capacity__,
+    ._vec_data         = texts_data__,
+    ._vec_set_size     = texts_set_size__,
+    ._vec_set_cap      = texts_set_capacity__,
+    ._vec_set_data     = texts_set_data__,
+    ._vec_offset       = name_offset__,
+    ._vec_const_offset = name_const_offset__,
+    ._vec_offset_next  = name_offset_next__,
+    ._vec_iterator     = names_iterator__,
+    ._vec_destroy      = texts_destroy__,
+    ._vec_elem_copy    = name_copy__,
+    ._vec_elem_destroy = name_destroy__,
+    ._vec_trivially_relocatable = true,
+  };
+
+  return _texts_setup(vector, capacity, sizeof(char *), &vector_tc);
+}
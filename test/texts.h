@@ -0,0 +1,40 @@
+#ifndef TEXTS_H
+#define TEXTS_H
+
+#include <stdlib.h>
+
+#include "vector.h"
+
+/* Strings of up to 15 characters are kept inline, longer ones on the heap.
+ * `chars` points into the element itself for short strings, so moving one
+ * takes a pointer fix-up: the type is not trivially relocatable. */
+typedef struct Text {
+	char *chars;
+	char small[16];
+} Text;
+
+/* Elements with lifecycle hooks. Both kinds share one header; `data` holds
+ * `Text`s or heap-allocated `char *`s. */
+typedef struct Texts {
+	size_t size;
+	size_t capacity;
+	void *data;
+} Texts;
+
+/* Heap strings currently alive, over both kinds, for leak checks */
+extern long texts_live;
+/* While nonzero, every string copy fails as if out of memory */
+extern long texts_failing;
+
+int text_setup(Text *text, const char *chars);
+void text_destroy(Text *text);
+
+/* A vector of `Text` with copy, move and destroy hooks */
+int texts_vector_setup(Vector *vector, size_t capacity);
+
+/* A vector of owned `char *` with copy and destroy hooks; the pointers move
+ * as bytes */
+int names_vector_setup(Vector *vector, size_t capacity);
+char *name_new(const char *chars);
+
+#endif /* TEXTS_H */
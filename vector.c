@@ -19,523 +19,2302 @@
  * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
 	
 #define __STDC_WANT_LIB_EXT1__ 1
+#define _POSIX_C_SOURCE 200809L
+/* For madvise */
+#define _DEFAULT_SOURCE
+
+/* VECTOR_UNCHECKED strips the runtime checks below, so drop the assertions
+ * that mirror them as well */
+#if defined(VECTOR_UNCHECKED) && !defined(NDEBUG)
+#define NDEBUG
+#endif
 
 #include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
+#include "bit_vector.h"
 #include "vector.h"
+#include "vector_private.h"
 
 /***** PRIVATE *****/
 
-bool _vec_should_grow(Vector *v)
+/* Buffers shared between snapshots, with the number of vectors pointing at
+ * each. A buffer owned by a single vector has no entry. */
+typedef struct {
+	void *data;
+	size_t references;
+} _VecShared;
+
+static _VecShared *_vec_shared = NULL;
+static size_t _vec_shared_count = 0;
+static size_t _vec_shared_capacity = 0;
+static pthread_mutex_t _vec_shared_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* The number of shared buffers whose address hashes to each slot. Neither
+ * the Vector handle (copied by value) nor the type's layout has room for a
+ * flag, so this stands in for one: a zero slot proves a buffer unshared
+ * with a single atomic load, and only buffers that are, or collide with,
+ * a shared one go to the registry under the lock. */
+#define _VEC_SHARED_FILTER_BITS 12
+
+static unsigned _vec_shared_filter[1 << _VEC_SHARED_FILTER_BITS];
+
+size_t _vec_shared_slot(const void *data)
 {
-	assert(v->tc->_vec_size(v->self) <= v->tc->_vec_cap(v->self));
+	/* Fibonacci hashing; the low bits of an allocation are always zero */
+	return (size_t)(((uint64_t)(uintptr_t)data >> 4) *
+									UINT64_C(0x9E3779B97F4A7C15) >>
+									(64 - _VEC_SHARED_FILTER_BITS));
+}
 
-	return v->tc->_vec_size(v->self) == v->tc->_vec_cap(v->self);
+/* The registry lock must be held */
+_VecShared* _vec_shared_find(void *data)
+{
+	size_t i;
+
+	for (i = 0; i < _vec_shared_count; ++i) {
+		if (_vec_shared[i].data == data) return &_vec_shared[i];
+	}
+
+	return NULL;
 }
 
-bool _vec_should_shrink(Vector *v)
+bool _vec_is_shared(const void *data)
 {
-	assert(v->tc->_vec_size(v->self) <= v->tc->_vec_cap(v->self));
+	bool shared;
+
+	/* Fast path for every buffer that no snapshot hashes next to */
+	if (__atomic_load_n(&_vec_shared_filter[_vec_shared_slot(data)],
+											__ATOMIC_ACQUIRE) == 0) {
+		return false;
+	}
+
+	pthread_mutex_lock(&_vec_shared_lock);
+	shared = _vec_shared_find((void*)data) != NULL;
+	pthread_mutex_unlock(&_vec_shared_lock);
 
-	return v->tc->_vec_size(v->self) == v->tc->_vec_cap(v->self) *
-    VECTOR_SHRINK_THRESHOLD;
+	return shared;
 }
 
-size_t _vec_free_bytes(const Vector *v)
+int _vec_share(void *data)
 {
-	return vector_free_space(v) * v->tc->_vec_elem_size();
+	_VecShared *entry, *entries;
+	size_t capacity;
+
+	pthread_mutex_lock(&_vec_shared_lock);
+
+	entry = _vec_shared_find(data);
+	if (entry != NULL) {
+		++entry->references;
+		pthread_mutex_unlock(&_vec_shared_lock);
+		return VECTOR_SUCCESS;
+	}
+
+	if (_vec_shared_count == _vec_shared_capacity) {
+		capacity = MAX(VECTOR_MINIMUM_CAPACITY,
+									 _vec_shared_capacity * VECTOR_GROWTH_FACTOR);
+		entries = realloc(_vec_shared, capacity * sizeof(_VecShared));
+		if (entries == NULL) {
+			pthread_mutex_unlock(&_vec_shared_lock);
+			return VECTOR_ERROR;
+		}
+		_vec_shared = entries;
+		_vec_shared_capacity = capacity;
+	}
+
+	_vec_shared[_vec_shared_count].data = data;
+	_vec_shared[_vec_shared_count].references = 2;
+	++_vec_shared_count;
+	__atomic_add_fetch(&_vec_shared_filter[_vec_shared_slot(data)],
+										 1,
+										 __ATOMIC_RELEASE);
+
+	pthread_mutex_unlock(&_vec_shared_lock);
+
+	return VECTOR_SUCCESS;
 }
 
-void* _vec_offset(Vector *v, size_t index)
+/* Drops one reference to a buffer. Returns true if other vectors still
+ * point at it, in which case the caller must not free it. */
+bool _vec_unref(void *data)
 {
-	return v->tc->_vec_offset(v->self, index);
+	_VecShared *entry;
+
+	if (!_vec_is_shared(data)) return false;
+
+	pthread_mutex_lock(&_vec_shared_lock);
+
+	entry = _vec_shared_find(data);
+	if (entry == NULL) {
+		/* The other holders let go in the meantime */
+		pthread_mutex_unlock(&_vec_shared_lock);
+		return false;
+	}
+
+	if (--entry->references == 1) {
+		*entry = _vec_shared[--_vec_shared_count];
+		__atomic_sub_fetch(&_vec_shared_filter[_vec_shared_slot(data)],
+											 1,
+											 __ATOMIC_RELEASE);
+	}
+
+	pthread_mutex_unlock(&_vec_shared_lock);
+
+	return true;
 }
 
-const void* _vec_const_offset(const Vector *v, size_t index)
+bool _vec_owns_data(const Vector *v, const void *data)
 {
-	return v->tc->_vec_const_offset(v->self, index);
+	return v->tc->_vec_owns_data == NULL ||
+    v->tc->_vec_owns_data(v->self, data);
 }
 
-void _vec_assign(Vector *v, size_t index, void* element)
+bool _vec_can_allocate(const Vector *v)
 {
-	/* Insert the element */
-	void* offset = _vec_offset(v, index);
-	memcpy(offset, element, v->tc->_vec_elem_size());
+	return v->tc->_vec_can_allocate == NULL ||
+    v->tc->_vec_can_allocate(v->self);
 }
 
-int _vec_move_right(Vector *v, size_t index)
+/* Element lifecycle */
+
+bool _vec_has_lifecycle(const Vector *v)
 {
-	assert(v->tc->_vec_size(v->self) < v->tc->_vec_cap(v->self));
+	return v->tc->_vec_elem_copy != NULL ||
+    v->tc->_vec_elem_move != NULL ||
+    v->tc->_vec_elem_destroy != NULL;
+}
 
-	/* The location where to start to move from. */
-	void* offset = _vec_offset(v, index);
+bool _vec_relocates_bytes(const Vector *v)
+{
+	return v->tc->_vec_elem_move == NULL || v->tc->_vec_trivially_relocatable;
+}
 
-	/* How many to move to the right. */
-	size_t elements_in_bytes = (v->tc->_vec_size(v->self) - index) *
-    v->tc->_vec_elem_size();
+/* Moves `count` elements to memory that may overlap theirs */
+void _vec_relocate(const Vector *v, void *destination, void *source, size_t count)
+{
+	size_t elem_size = v->tc->_vec_elem_size(), i;
+	char *to = destination, *from = source;
+
+	if (_vec_relocates_bytes(v)) {
+		memmove(destination, source, count * elem_size);
+	} else if (to < from) {
+		for (i = 0; i < count; ++i) {
+			v->tc->_vec_elem_move(to + i * elem_size, from + i * elem_size);
+		}
+	} else {
+		for (i = count; i-- > 0;) {
+			v->tc->_vec_elem_move(to + i * elem_size, from + i * elem_size);
+		}
+	}
+}
 
-#ifdef __STDC_LIB_EXT1__
-	size_t right_capacity_in_bytes = (v->tc->_vec_cap(v->self) - (index + 1)) *
-      v->tc->_vec_elem_size();
+void _vec_destroy_elements(const Vector *v, void *first, size_t count)
+{
+	size_t elem_size, i;
 
-	/* clang-format off */
-  int return_code =  memmove_s(
-      v->tc->_vec_offset_next(offset),
-      right_capacity_in_bytes,
-      offset,
-      elements_in_bytes);
-	/* clang-format on */
+	if (v->tc->_vec_elem_destroy == NULL) return;
 
-	return return_code == 0 ? VECTOR_SUCCESS : VECTOR_ERROR;
+	elem_size = v->tc->_vec_elem_size();
+	for (i = 0; i < count; ++i) {
+		v->tc->_vec_elem_destroy((char *)first + i * elem_size);
+	}
+}
+
+/* Copies `count` elements into uninitialized memory. On failure the copies
+ * made so far are destroyed again. */
+int _vec_copy_elements(const Vector *v,
+                       void *destination,
+                       const void *source,
+                       size_t count)
+{
+	size_t elem_size = v->tc->_vec_elem_size(), i;
+
+	if (v->tc->_vec_elem_copy == NULL) {
+		memcpy(destination, source, count * elem_size);
+		return VECTOR_SUCCESS;
+	}
+
+	for (i = 0; i < count; ++i) {
+		if (v->tc->_vec_elem_copy((char *)destination + i * elem_size,
+															(const char *)source + i * elem_size) ==
+				VECTOR_ERROR) {
+			_vec_destroy_elements(v, destination, i);
+			return VECTOR_ERROR;
+		}
+	}
 
-#else
-	memmove(v->tc->_vec_offset_next(offset), offset, elements_in_bytes);
 	return VECTOR_SUCCESS;
-#endif
 }
 
-void _vec_move_left(Vector *v, size_t index)
+/* Gives up a buffer the vector no longer points at */
+void _vec_release(Vector *v, void *data)
 {
-	size_t right_elements_in_bytes;
-	void* offset;
+	if (data == NULL) return;
+	if (!_vec_unref(data) && _vec_owns_data(v, data)) free(data);
+}
 
-	/* The offset into the memory */
-	offset = _vec_offset(v, index);
+/* Gives up the buffer of the vector together with its elements, unless a
+ * snapshot still uses both */
+void _vec_drop(Vector *v)
+{
+	void *data = v->tc->_vec_data(v->self);
 
-	/* How many to move to the left */
-	right_elements_in_bytes = (v->tc->_vec_size(v->self) - index - 1) *
-    v->tc->_vec_elem_size();
+	if (data == NULL || _vec_unref(data)) return;
 
-	memmove(offset, v->tc->_vec_offset_next(offset), right_elements_in_bytes);
+	_vec_destroy_elements(v, data, v->tc->_vec_size(v->self));
+	if (_vec_owns_data(v, data)) free(data);
 }
 
-int _vec_reallocate(Vector *v, size_t new_capacity)
+/* Gives the vector a private copy of its buffer before it is written to */
+int _vec_unshare(Vector *v)
 {
-	size_t new_capacity_in_bytes;
+	size_t capacity_in_bytes;
 	void *data, *old;
 
-	assert(v != NULL);
-	assert(v->self != NULL);
-
-	if (new_capacity < VECTOR_MINIMUM_CAPACITY) {
-		if (v->tc->_vec_cap(v->self) > VECTOR_MINIMUM_CAPACITY) {
-			new_capacity = VECTOR_MINIMUM_CAPACITY;
-		} else {
-			/* NO-OP */
-			return VECTOR_SUCCESS;
-		}
-	}
-
-	new_capacity_in_bytes = new_capacity * v->tc->_vec_elem_size();
 	old = v->tc->_vec_data(v->self);
+	if (old == NULL || !_vec_is_shared(old)) return VECTOR_SUCCESS;
 
-  data = malloc(new_capacity_in_bytes);
+	if (!_vec_can_allocate(v)) return VECTOR_ERROR;
+
+	capacity_in_bytes = MAX(1, v->tc->_vec_cap(v->self)) *
+    v->tc->_vec_elem_size();
+	data = malloc(capacity_in_bytes);
 	if (data == NULL) return VECTOR_ERROR;
 
-#ifdef __STDC_LIB_EXT1__
-	/* clang-format off */
-	if (memcpy_s(data,
-        new_capacity_in_bytes,
-        old,
-        vector_byte_size(v)) != 0) {
+	if (_vec_copy_elements(v, data, old, v->tc->_vec_size(v->self)) ==
+			VECTOR_ERROR) {
+		free(data);
 		return VECTOR_ERROR;
 	}
-  /* clang-format on */
-#else
-	memcpy(data, old, vector_byte_size(v));
-#endif
-
-  v->tc->_vec_set_data(v->self, data);
-  v->tc->_vec_set_cap(v->self, new_capacity);
+	v->tc->_vec_set_data(v->self, data);
 
-	free(old);
+	_vec_release(v, old);
 
 	return VECTOR_SUCCESS;
 }
 
-int _vec_adjust_capacity(Vector *v)
+/* Vectors with dirty tracking, keyed by their self pointer. `chunks` has a
+ * bit per chunk_size elements written since the last flush; `all` stands
+ * for every chunk at once (after tracking starts, swaps, snapshots, or when
+ * the bitmap could not grow). */
+typedef struct {
+	const void *self;
+	size_t chunk_size;
+	BitVector chunks;
+	bool all;
+} _VecDirty;
+
+static _VecDirty *_vec_dirty = NULL;
+static size_t _vec_dirty_count = 0;
+static size_t _vec_dirty_capacity = 0;
+static pthread_mutex_t _vec_dirty_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* The dirty lock must be held */
+_VecDirty* _vec_dirty_find(const void *self)
 {
-	return _vec_reallocate(v,
-      MAX(1, v->tc->_vec_size(v->self) * VECTOR_GROWTH_FACTOR));
+	size_t i;
+
+	for (i = 0; i < _vec_dirty_count; ++i) {
+		if (_vec_dirty[i].self == self) return &_vec_dirty[i];
+	}
+
+	return NULL;
 }
 
-int _vector_deinitialize(Vector *v)
+/* Records that elements [first, last) were written */
+void _vec_mark_dirty(const Vector *v, size_t first, size_t last)
 {
-	assert(v != NULL);
-	assert(v->self != NULL);
+	_VecDirty *entry;
+	size_t chunk, end;
 
-	if (v == NULL) return VECTOR_ERROR;
-	if (v->self == NULL) return VECTOR_ERROR;
+	/* Fast path when nothing is tracked anywhere */
+	if (__atomic_load_n(&_vec_dirty_count, __ATOMIC_ACQUIRE) == 0) return;
+	if (first >= last) return;
 
-	free(v->tc->_vec_data(v->self));
-  v->tc->_vec_set_data(v->self, NULL);
+	pthread_mutex_lock(&_vec_dirty_lock);
 
-	return VECTOR_SUCCESS;
+	entry = _vec_dirty_find(v->self);
+	if (entry != NULL && !entry->all) {
+		end = (last - 1) / entry->chunk_size + 1;
+		if (end > bit_vector_size(&entry->chunks) &&
+				bit_vector_resize(&entry->chunks, end) == VECTOR_ERROR) {
+			entry->all = true;
+		} else {
+			for (chunk = first / entry->chunk_size; chunk < end; ++chunk) {
+				bit_vector_set(&entry->chunks, chunk, true);
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&_vec_dirty_lock);
 }
 
+void _vec_mark_all_dirty(const Vector *v)
+{
+	_VecDirty *entry;
 
-/***** METHODS *****/
+	if (__atomic_load_n(&_vec_dirty_count, __ATOMIC_ACQUIRE) == 0) return;
 
-int vector_copy(Vector* dest, Vector* src)
-{
-	assert(dest != NULL);
-	assert(src != NULL);
-	assert(vector_is_initialized(src));
-	assert(!vector_is_initialized(dest));
-	assert(dest->tc->_vec_type() == src->tc->_vec_type());
+	pthread_mutex_lock(&_vec_dirty_lock);
+	entry = _vec_dirty_find(v->self);
+	if (entry != NULL) entry->all = true;
+	pthread_mutex_unlock(&_vec_dirty_lock);
+}
 
-	if (dest == NULL) return VECTOR_ERROR;
-	if (src == NULL) return VECTOR_ERROR;
-	if (vector_is_initialized(dest)) return VECTOR_ERROR;
-	if (!vector_is_initialized(src)) return VECTOR_ERROR;
-	if (dest->tc->_vec_type() != src->tc->_vec_type()) {
-    return VECTOR_ERROR;
-  }
+/* Hands the dirty state of a vector to the caller and starts a clean one */
+int _vec_take_dirty(const Vector *v,
+                    BitVector *chunks,
+                    size_t *chunk_size,
+                    bool *all)
+{
+	_VecDirty *entry;
 
-	/* Copy ALL the data */
-  dest->tc->_vec_set_size(dest->self, src->tc->_vec_size(src->self));
-  dest->tc->_vec_set_cap(dest->self, dest->tc->_vec_size(dest->self) * 2);
+	pthread_mutex_lock(&_vec_dirty_lock);
 
-	/* Note that we are not necessarily allocating the same capacity */
-  void *data = malloc(dest->tc->_vec_cap(dest->self) *
-      dest->tc->_vec_elem_size());
-	if (data == NULL) return VECTOR_ERROR;
+	entry = _vec_dirty_find(v->self);
+	if (entry == NULL) {
+		pthread_mutex_unlock(&_vec_dirty_lock);
+		return VECTOR_ERROR;
+	}
 
-	memcpy(data, src->tc->_vec_data(src->self), vector_byte_size(src));
+	*chunks = entry->chunks;
+	*chunk_size = entry->chunk_size;
+	*all = entry->all;
+	entry->chunks = (BitVector)BIT_VECTOR_INITIALIZER;
+	entry->all = false;
 
-  dest->tc->_vec_set_data(dest->self, data);
+	pthread_mutex_unlock(&_vec_dirty_lock);
 
 	return VECTOR_SUCCESS;
 }
 
-int vector_copy_assign(Vector* dest, Vector* src)
+void _vec_untrack(const void *self)
 {
-	assert(dest != NULL);
-	assert(src != NULL);
-	assert(vector_is_initialized(src));
-	assert(vector_is_initialized(dest));
-	assert(dest->tc->_vec_type() == src->tc->_vec_type());
+	_VecDirty *entry;
 
-	if (dest == NULL) return VECTOR_ERROR;
-	if (src == NULL) return VECTOR_ERROR;
-	if (!vector_is_initialized(dest)) return VECTOR_ERROR;
-	if (!vector_is_initialized(src)) return VECTOR_ERROR;
-  if (dest->tc->_vec_type() != src->tc->_vec_type()) {
-    return VECTOR_ERROR;
-  }
+	if (__atomic_load_n(&_vec_dirty_count, __ATOMIC_ACQUIRE) == 0) return;
 
-	_vector_deinitialize(dest);
+	pthread_mutex_lock(&_vec_dirty_lock);
 
-	return vector_copy(dest, src);
+	entry = _vec_dirty_find(self);
+	if (entry != NULL) {
+		bit_vector_destroy(&entry->chunks);
+		*entry = _vec_dirty[_vec_dirty_count - 1];
+		__atomic_store_n(&_vec_dirty_count,
+										 _vec_dirty_count - 1,
+										 __ATOMIC_RELEASE);
+	}
+
+	pthread_mutex_unlock(&_vec_dirty_lock);
 }
 
-int vector_move(Vector* dest, Vector* src)
+/* write() and read() until every byte is through. Reading returns the number
+ * of bytes read, which is short only at the end of the file. */
+int _vec_write_all(int fd, const void *buffer, size_t bytes)
 {
-	assert(dest != NULL);
-	assert(src != NULL);
-
-	if (dest == NULL) return VECTOR_ERROR;
-	if (src == NULL) return VECTOR_ERROR;
+	const char *position = buffer;
+	ssize_t written;
 
-	*dest = *src;
-  src->tc->_vec_set_data(src->self, NULL);
+	while (bytes > 0) {
+		written = write(fd, position, bytes);
+		if (written < 0) {
+			if (errno == EINTR) continue;
+			return VECTOR_ERROR;
+		}
+		position += written;
+		bytes -= (size_t)written;
+	}
 
 	return VECTOR_SUCCESS;
 }
 
-int vector_move_assign(Vector* dest, Vector* src)
+ssize_t _vec_read_all(int fd, void *buffer, size_t bytes)
 {
-	vector_swap(dest, src);
-	return _vector_deinitialize(src);
+	char *position = buffer;
+	size_t total = 0;
+	ssize_t got;
+
+	while (total < bytes) {
+		got = read(fd, position + total, bytes - total);
+		if (got < 0) {
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		if (got == 0) break;
+		total += (size_t)got;
+	}
+
+	return (ssize_t)total;
 }
 
-int vector_swap(Vector* dest, Vector* src)
+int _vec_write_range(const Vector *v, int fd, size_t first, size_t last)
 {
-	assert(dest != NULL);
-	assert(src != NULL);
-	assert(vector_is_initialized(src));
-	assert(vector_is_initialized(dest));
-	assert(dest->tc->_vec_type() == src->tc->_vec_type());
+	uint64_t range[2];
 
-	if (dest == NULL) return VECTOR_ERROR;
-	if (src == NULL) return VECTOR_ERROR;
-	if (!vector_is_initialized(dest)) return VECTOR_ERROR;
-	if (!vector_is_initialized(src)) return VECTOR_ERROR;
-	if (dest->tc->_vec_type() != src->tc->_vec_type()) {
-    return VECTOR_ERROR;
-  }
+	range[0] = first;
+	range[1] = last - first;
 
-  size_t tmp_size = dest->tc->_vec_size(dest->self);
-  dest->tc->_vec_set_size(dest->self, src->tc->_vec_size(src->self));
-  src->tc->_vec_set_size(src->self, tmp_size);
+	if (_vec_write_all(fd, range, sizeof range) == VECTOR_ERROR) {
+		return VECTOR_ERROR;
+	}
 
-  size_t tmp_capacity = dest->tc->_vec_cap(dest->self);
-  dest->tc->_vec_set_cap(dest->self, src->tc->_vec_cap(src->self));
-  src->tc->_vec_set_cap(src->self, tmp_capacity);
+	return _vec_write_all(fd,
+												v->tc->_vec_const_offset(v->self, first),
+												(last - first) * v->tc->_vec_elem_size());
+}
 
-	void *tmp_data = dest->tc->_vec_data(dest->self);
-	dest->tc->_vec_set_data(dest->self, src->tc->_vec_data(src->self));
-	src->tc->_vec_set_data(src->self, tmp_data);
+/* Writes each run of dirty chunks as one element range, clipped to the
+ * vector, and counts them. Pass -1 as fd to only count. */
+int _vec_write_ranges(const Vector *v,
+                      int fd,
+                      const BitVector *chunks,
+                      size_t chunk_size,
+                      bool all,
+                      uint64_t *range_count)
+{
+	size_t size = v->tc->_vec_size(v->self);
+	size_t chunk, end, first, last;
+
+	*range_count = 0;
+
+	if (all) {
+		if (size == 0) return VECTOR_SUCCESS;
+		*range_count = 1;
+		return fd < 0 ? VECTOR_SUCCESS : _vec_write_range(v, fd, 0, size);
+	}
+
+	for (chunk = bit_vector_find_first(chunks);
+			 chunk != BIT_VECTOR_NOT_FOUND;
+			 chunk = bit_vector_find_next(chunks, end - 1)) {
+		for (end = chunk + 1;
+				 end < bit_vector_size(chunks) && bit_vector_get(chunks, end);
+				 ++end);
+
+		first = chunk * chunk_size;
+		if (first >= size) break;
+		last = MIN(end * chunk_size, size);
+
+		++*range_count;
+		if (fd >= 0 && _vec_write_range(v, fd, first, last) == VECTOR_ERROR) {
+			return VECTOR_ERROR;
+		}
+	}
 
 	return VECTOR_SUCCESS;
 }
 
-int vector_destroy(Vector *v)
+/* Appends one frame of the delta log: the element count and size, the number
+ * of ranges, then each range as its first index, its length and its bytes.
+ * A frame that fails half way is cut off again, so the log stays readable. */
+int _vec_write_frame(const Vector *v,
+                     int fd,
+                     const BitVector *chunks,
+                     size_t chunk_size,
+                     bool all)
 {
-	assert(v != NULL);
+	uint64_t header[3], written;
+	off_t start;
 
-	if (v == NULL) return VECTOR_ERROR;
+	start = lseek(fd, 0, SEEK_END);
+	if (start == (off_t)-1) return VECTOR_ERROR;
 
-  if (v->tc->_vec_destroy(v->self) == 0) {
-    v->self = NULL;
-    return VECTOR_SUCCESS;
-  }
+	header[0] = v->tc->_vec_size(v->self);
+	header[1] = v->tc->_vec_elem_size();
+	_vec_write_ranges(v, -1, chunks, chunk_size, all, &header[2]);
+
+	if (_vec_write_all(fd, header, sizeof header) == VECTOR_ERROR ||
+			_vec_write_ranges(v, fd, chunks, chunk_size, all, &written) ==
+					VECTOR_ERROR) {
+		if (ftruncate(fd, start) != 0) {
+			/* Nothing more we can do about the torn frame */
+		}
+		return VECTOR_ERROR;
+	}
+
+	return VECTOR_SUCCESS;
+}
+
+/* A share of a bulk operation: copy `bytes` from source, or fill them with
+ * copies of element, then write one byte per page of the `touch` bytes that
+ * follow so the pages are faulted in by this thread */
+typedef struct {
+	char *destination;
+	const char *source;
+	size_t bytes;
+	const void *element;
+	size_t elem_size;
+	size_t touch;
+	bool stream;
+} _VecBulk;
+
+size_t _vec_bulk_threads(size_t threads, size_t bytes)
+{
+	long online;
+
+	if (threads == 0) {
+		online = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = online > 0 ? (size_t)online : 1;
+	}
+
+	/* Below the threshold a thread costs more than it saves */
+	return MAX(1, MIN(threads, bytes / VECTOR_PARALLEL_THRESHOLD));
+}
+
+/* memcpy, or with stream set, SSE2 non-temporal stores that leave the cache
+ * to the data that is still in use. The caller fences. */
+void _vec_stream_copy(char *destination,
+                      const char *source,
+                      size_t bytes,
+                      bool stream)
+{
+#if defined(__SSE2__)
+	__m128i a, b, c, d;
+	size_t head;
+
+	if (stream && bytes >= 256) {
+		head = (16 - ((uintptr_t)destination & 15)) & 15;
+		memcpy(destination, source, head);
+		destination += head;
+		source += head;
+		bytes -= head;
+
+		for (; bytes >= 64; bytes -= 64, destination += 64, source += 64) {
+			a = _mm_loadu_si128((const __m128i*)source);
+			b = _mm_loadu_si128((const __m128i*)(source + 16));
+			c = _mm_loadu_si128((const __m128i*)(source + 32));
+			d = _mm_loadu_si128((const __m128i*)(source + 48));
+			_mm_stream_si128((__m128i*)destination, a);
+			_mm_stream_si128((__m128i*)(destination + 16), b);
+			_mm_stream_si128((__m128i*)(destination + 32), c);
+			_mm_stream_si128((__m128i*)(destination + 48), d);
+		}
+	}
+#else
+	(void)stream;
+#endif
+
+	memcpy(destination, source, bytes);
+}
+
+/* Pattern doubling: the element is written once and the filled prefix is
+ * copied onto what follows, doubling it each time, up to a block of whole
+ * elements. That block, still in cache, is then repeated to the end. Works
+ * for any element size with nothing but memcpy. */
+void _vec_fill_bytes(char *destination,
+                     size_t bytes,
+                     const void *element,
+                     size_t elem_size,
+                     bool stream)
+{
+	size_t filled, block, n;
+
+	if (bytes == 0) return;
+
+	block = MIN(bytes, MAX(1, VECTOR_FILL_BLOCK / elem_size) * elem_size);
+
+	memcpy(destination, element, elem_size);
+	for (filled = elem_size; filled < block; filled += n) {
+		n = MIN(filled, block - filled);
+		memcpy(destination + filled, destination, n);
+	}
+
+	for (; filled < bytes; filled += n) {
+		n = MIN(block, bytes - filled);
+		_vec_stream_copy(destination + filled, destination, n, stream);
+	}
+}
+
+void* _vec_bulk_run(void *argument)
+{
+	_VecBulk *job = argument;
+	size_t page = (size_t)sysconf(_SC_PAGESIZE), offset;
+
+	if (job->source != NULL) {
+		_vec_stream_copy(job->destination, job->source, job->bytes, job->stream);
+	} else if (job->element != NULL) {
+		_vec_fill_bytes(job->destination,
+										job->bytes,
+										job->element,
+										job->elem_size,
+										job->stream);
+	}
+
+	for (offset = 0; offset < job->touch; offset += page) {
+		job->destination[job->bytes + offset] = 0;
+	}
+
+#if defined(__SSE2__)
+	if (job->stream) _mm_sfence();
+#endif
+
+	return NULL;
+}
+
+/* Runs the jobs on their own threads, the first on the caller's. A thread
+ * that cannot be started has its job run here instead. */
+int _vec_bulk_parallel(_VecBulk *jobs, size_t count)
+{
+	pthread_t *handles;
+	bool *started;
+	size_t t;
+
+	if (count == 1) {
+		_vec_bulk_run(&jobs[0]);
+		return VECTOR_SUCCESS;
+	}
+
+	handles = malloc(count * sizeof(pthread_t));
+	started = calloc(count, sizeof(bool));
+	if (handles == NULL || started == NULL) {
+		free(handles);
+		free(started);
+		return VECTOR_ERROR;
+	}
+
+	for (t = 1; t < count; ++t) {
+		started[t] = pthread_create(&handles[t], NULL, _vec_bulk_run, &jobs[t]) == 0;
+	}
+
+	_vec_bulk_run(&jobs[0]);
+
+	for (t = 1; t < count; ++t) {
+		if (started[t]) {
+			pthread_join(handles[t], NULL);
+		} else {
+			_vec_bulk_run(&jobs[t]);
+		}
+	}
+
+	free(handles);
+	free(started);
+
+	return VECTOR_SUCCESS;
+}
+
+/* Splits elements [0, capacity) of a buffer into one job per thread, on
+ * element boundaries. Each copies or fills its part of [0, size) and touches
+ * the rest of its part. */
+int _vec_bulk(char *destination,
+              const char *source,
+              const void *element,
+              size_t elem_size,
+              size_t size,
+              size_t capacity,
+              size_t threads)
+{
+	_VecBulk single, *jobs;
+	size_t count, t, first, last, end;
+	bool stream;
+	int result;
+
+	count = _vec_bulk_threads(threads, capacity * elem_size);
+	stream = size * elem_size >= VECTOR_STREAM_THRESHOLD;
+
+	/* A single job stays off the heap, for vectors that must not allocate */
+	jobs = count == 1 ? &single : malloc(count * sizeof(_VecBulk));
+	if (jobs == NULL) return VECTOR_ERROR;
+
+	for (t = 0; t < count; ++t) {
+		first = capacity * t / count;
+		last = capacity * (t + 1) / count;
+		end = MAX(first, MIN(last, size));
+
+		jobs[t].destination = destination + first * elem_size;
+		jobs[t].source = source == NULL ? NULL : source + first * elem_size;
+		jobs[t].bytes = (end - first) * elem_size;
+		jobs[t].element = element;
+		jobs[t].elem_size = elem_size;
+		jobs[t].touch = (last - end) * elem_size;
+		jobs[t].stream = stream;
+	}
+
+	result = _vec_bulk_parallel(jobs, count);
+	if (jobs != &single) free(jobs);
+
+	return result;
+}
+
+bool _vec_should_grow(Vector *v)
+{
+	assert(v->tc->_vec_size(v->self) <= v->tc->_vec_cap(v->self));
+
+	return v->tc->_vec_size(v->self) == v->tc->_vec_cap(v->self);
+}
+
+bool _vec_should_shrink(Vector *v)
+{
+	assert(v->tc->_vec_size(v->self) <= v->tc->_vec_cap(v->self));
+
+	return v->tc->_vec_cap(v->self) > VECTOR_MINIMUM_CAPACITY &&
+    v->tc->_vec_size(v->self) <=
+      v->tc->_vec_cap(v->self) / VECTOR_SHRINK_THRESHOLD;
+}
+
+size_t _vec_free_bytes(const Vector *v)
+{
+	return vector_free_space(v) * v->tc->_vec_elem_size();
+}
+
+void* _vec_offset(Vector *v, size_t index)
+{
+	return v->tc->_vec_offset(v->self, index);
+}
+
+const void* _vec_const_offset(const Vector *v, size_t index)
+{
+	return v->tc->_vec_const_offset(v->self, index);
+}
+
+void _vec_assign(Vector *v, size_t index, void* element)
+{
+	/* Insert the element */
+	void* offset = _vec_offset(v, index);
+	_vec_relocate(v, offset, element, 1);
+
+	_vec_mark_dirty(v, index, index + 1);
+}
+
+int _vec_move_right(Vector *v, size_t index)
+{
+	assert(v->tc->_vec_size(v->self) < v->tc->_vec_cap(v->self));
+
+	/* The location where to start to move from. */
+	void* offset = _vec_offset(v, index);
+
+	/* How many to move to the right. */
+	size_t elements_in_bytes = (v->tc->_vec_size(v->self) - index) *
+    v->tc->_vec_elem_size();
+
+	/* Including the slot the caller is about to fill */
+	_vec_mark_dirty(v, index, v->tc->_vec_size(v->self) + 1);
+
+	if (!_vec_relocates_bytes(v)) {
+		_vec_relocate(v,
+									v->tc->_vec_offset_next(offset),
+									offset,
+									v->tc->_vec_size(v->self) - index);
+		return VECTOR_SUCCESS;
+	}
+
+#ifdef __STDC_LIB_EXT1__
+	size_t right_capacity_in_bytes = (v->tc->_vec_cap(v->self) - (index + 1)) *
+      v->tc->_vec_elem_size();
+
+	/* clang-format off */
+  int return_code =  memmove_s(
+      v->tc->_vec_offset_next(offset),
+      right_capacity_in_bytes,
+      offset,
+      elements_in_bytes);
+	/* clang-format on */
+
+	return return_code == 0 ? VECTOR_SUCCESS : VECTOR_ERROR;
+
+#else
+	memmove(v->tc->_vec_offset_next(offset), offset, elements_in_bytes);
+	return VECTOR_SUCCESS;
+#endif
+}
+
+void _vec_move_left(Vector *v, size_t index)
+{
+	size_t right_elements_in_bytes;
+	void* offset;
+
+	/* The offset into the memory */
+	offset = _vec_offset(v, index);
+
+	/* How many to move to the left */
+	right_elements_in_bytes = (v->tc->_vec_size(v->self) - index - 1) *
+    v->tc->_vec_elem_size();
+
+	if (_vec_relocates_bytes(v)) {
+		memmove(offset, v->tc->_vec_offset_next(offset), right_elements_in_bytes);
+	} else {
+		_vec_relocate(v,
+									offset,
+									v->tc->_vec_offset_next(offset),
+									v->tc->_vec_size(v->self) - index - 1);
+	}
+
+	_vec_mark_dirty(v, index, v->tc->_vec_size(v->self) - 1);
+}
+
+int _vec_reallocate(Vector *v, size_t new_capacity)
+{
+	size_t new_capacity_in_bytes;
+	void *data, *old;
+
+	assert(v != NULL);
+	assert(v->self != NULL);
+
+	if (new_capacity < VECTOR_MINIMUM_CAPACITY) {
+		if (v->tc->_vec_cap(v->self) > VECTOR_MINIMUM_CAPACITY) {
+			new_capacity = VECTOR_MINIMUM_CAPACITY;
+		} else {
+			/* NO-OP */
+			return VECTOR_SUCCESS;
+		}
+	}
+
+	new_capacity_in_bytes = new_capacity * v->tc->_vec_elem_size();
+	old = v->tc->_vec_data(v->self);
+
+	/* A buffer we do not own cannot be given back, so keep it */
+	if (new_capacity < v->tc->_vec_cap(v->self) && !_vec_owns_data(v, old)) {
+		return VECTOR_SUCCESS;
+	}
+
+	/* Nor can a vector that must not allocate grow */
+	if (!_vec_can_allocate(v)) return VECTOR_ERROR;
+
+	/* A private heap buffer of elements that move as bytes can be resized in
+	 * place, or moved by the allocator without a copy of ours */
+	if (old != NULL && _vec_owns_data(v, old) && !_vec_is_shared(old) &&
+			_vec_relocates_bytes(v)) {
+		data = realloc(old, new_capacity_in_bytes);
+		if (data == NULL) return VECTOR_ERROR;
+
+		v->tc->_vec_set_data(v->self, data);
+		v->tc->_vec_set_cap(v->self, new_capacity);
+
+		return VECTOR_SUCCESS;
+	}
+
+  data = malloc(new_capacity_in_bytes);
+	if (data == NULL) return VECTOR_ERROR;
+
+	if (_vec_has_lifecycle(v)) {
+		/* Elements still seen by a snapshot stay with it; the vector gets
+		 * copies of its own */
+		if (old != NULL && _vec_is_shared(old)) {
+			if (_vec_copy_elements(v, data, old, v->tc->_vec_size(v->self)) ==
+					VECTOR_ERROR) {
+				free(data);
+				return VECTOR_ERROR;
+			}
+		} else {
+			_vec_relocate(v, data, old, v->tc->_vec_size(v->self));
+		}
+	} else {
+#ifdef __STDC_LIB_EXT1__
+	/* clang-format off */
+	if (memcpy_s(data,
+        new_capacity_in_bytes,
+        old,
+        vector_byte_size(v)) != 0) {
+		return VECTOR_ERROR;
+	}
+  /* clang-format on */
+#else
+	memcpy(data, old, vector_byte_size(v));
+#endif
+	}
+
+  v->tc->_vec_set_data(v->self, data);
+  v->tc->_vec_set_cap(v->self, new_capacity);
+
+	/* Reallocating is also what breaks sharing with snapshots */
+	_vec_release(v, old);
+
+	return VECTOR_SUCCESS;
+}
+
+int _vec_adjust_capacity(Vector *v)
+{
+	return _vec_reallocate(v,
+      MAX(1, v->tc->_vec_size(v->self) * VECTOR_GROWTH_FACTOR));
+}
+
+/* Vectors tracked for idle trimming, keyed by their self pointer. The size,
+ * capacity and buffer seen when the entry was last refreshed tell whether
+ * the vector changed since; `trimmed` means its unused capacity has already
+ * been released. */
+typedef struct {
+	Vector vector;
+	size_t size;
+	size_t capacity;
+	const void *data;
+	uint64_t last_access;
+	bool trimmed;
+} _VecAccess;
+
+static _VecAccess *_vec_access = NULL;
+static size_t _vec_access_count = 0;
+static size_t _vec_access_capacity = 0;
+static pthread_mutex_t _vec_access_lock = PTHREAD_MUTEX_INITIALIZER;
+
+uint64_t _vec_now(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+/* The access lock must be held */
+_VecAccess* _vec_access_find(const void *self)
+{
+	size_t i;
+
+	for (i = 0; i < _vec_access_count; ++i) {
+		if (_vec_access[i].vector.self == self) return &_vec_access[i];
+	}
+
+	return NULL;
+}
+
+bool _vec_access_changed(const _VecAccess *entry)
+{
+	const Vector *v = &entry->vector;
+
+	return entry->size != v->tc->_vec_size(v->self) ||
+    entry->capacity != v->tc->_vec_cap(v->self) ||
+    entry->data != v->tc->_vec_data(v->self);
+}
+
+/* Records the current state of the vector, and with `accessed` the time */
+void _vec_access_refresh(_VecAccess *entry, bool accessed)
+{
+	const Vector *v = &entry->vector;
+
+	entry->size = v->tc->_vec_size(v->self);
+	entry->capacity = v->tc->_vec_cap(v->self);
+	entry->data = v->tc->_vec_data(v->self);
+
+	if (accessed) {
+		entry->last_access = _vec_now();
+		entry->trimmed = false;
+	}
+}
+
+void _vec_forget_access(const void *self)
+{
+	_VecAccess *entry;
+
+	if (__atomic_load_n(&_vec_access_count, __ATOMIC_ACQUIRE) == 0) return;
+
+	pthread_mutex_lock(&_vec_access_lock);
+
+	entry = _vec_access_find(self);
+	if (entry != NULL) {
+		*entry = _vec_access[_vec_access_count - 1];
+		__atomic_store_n(&_vec_access_count,
+										 _vec_access_count - 1,
+										 __ATOMIC_RELEASE);
+	}
+
+	pthread_mutex_unlock(&_vec_access_lock);
+}
+
+/* The unused capacity in bytes that can be given back */
+size_t _vec_slack_bytes(const Vector *v)
+{
+	const void *data = v->tc->_vec_data(v->self);
+
+	if (data == NULL || _vec_is_shared(data) || !_vec_owns_data(v, data)) {
+		return 0;
+	}
+
+	return _vec_free_bytes(v);
+}
+
+/* Gives back the capacity past `keep` elements (at least the size) */
+int _vec_release_tail(Vector *v, size_t keep, size_t *released)
+{
+	size_t capacity, elem_size;
+	uintptr_t first, last, page;
+	char *data;
+
+	*released = 0;
+
+	keep = MAX(keep, v->tc->_vec_size(v->self));
+	capacity = v->tc->_vec_cap(v->self);
+	if (keep >= capacity || _vec_slack_bytes(v) == 0) return VECTOR_SUCCESS;
+
+	elem_size = v->tc->_vec_elem_size();
+	data = v->tc->_vec_data(v->self);
+
+#ifdef MADV_DONTNEED
+	if (capacity * elem_size >= VECTOR_MADVISE_THRESHOLD) {
+		/* Only the pages entirely inside the tail */
+		page = (uintptr_t)sysconf(_SC_PAGESIZE);
+		first = ((uintptr_t)(data + keep * elem_size) + page - 1) & ~(page - 1);
+		last = (uintptr_t)(data + capacity * elem_size) & ~(page - 1);
+		if (first >= last) return VECTOR_SUCCESS;
+
+		if (madvise((void *)first, last - first, MADV_DONTNEED) != 0) {
+			return VECTOR_ERROR;
+		}
+
+		*released = last - first;
+		return VECTOR_SUCCESS;
+	}
+#endif
+
+	if (_vec_reallocate(v, keep) == VECTOR_ERROR) return VECTOR_ERROR;
+
+	*released = (capacity - v->tc->_vec_cap(v->self)) * elem_size;
+
+	return VECTOR_SUCCESS;
+}
+
+int _vector_deinitialize(Vector *v)
+{
+	assert(v != NULL);
+	assert(v->self != NULL);
+
+#ifndef VECTOR_UNCHECKED
+	if (v == NULL) return VECTOR_ERROR;
+	if (v->self == NULL) return VECTOR_ERROR;
+#endif
+
+	_vec_drop(v);
+  v->tc->_vec_set_data(v->self, NULL);
+
+	return VECTOR_SUCCESS;
+}
+
+
+/***** METHODS *****/
+
+int vector_copy(Vector* dest, Vector* src)
+{
+	assert(dest != NULL);
+	assert(src != NULL);
+	assert(vector_is_initialized(src));
+	assert(!vector_is_initialized(dest));
+	assert(dest->tc->_vec_type() == src->tc->_vec_type());
+
+#ifndef VECTOR_UNCHECKED
+	if (dest == NULL) return VECTOR_ERROR;
+	if (src == NULL) return VECTOR_ERROR;
+	if (vector_is_initialized(dest)) return VECTOR_ERROR;
+	if (!vector_is_initialized(src)) return VECTOR_ERROR;
+	if (dest->tc->_vec_type() != src->tc->_vec_type()) {
+    return VECTOR_ERROR;
+  }
+#endif
+
+	if (!_vec_can_allocate(dest)) return VECTOR_ERROR;
+
+	/* Copy ALL the data */
+  dest->tc->_vec_set_size(dest->self, src->tc->_vec_size(src->self));
+  dest->tc->_vec_set_cap(dest->self, dest->tc->_vec_size(dest->self) * 2);
+
+	/* Note that we are not necessarily allocating the same capacity */
+  void *data = malloc(dest->tc->_vec_cap(dest->self) *
+      dest->tc->_vec_elem_size());
+	if (data == NULL) return VECTOR_ERROR;
+
+	if (_vec_copy_elements(src,
+                         data,
+                         src->tc->_vec_data(src->self),
+                         src->tc->_vec_size(src->self)) == VECTOR_ERROR) {
+		free(data);
+		return VECTOR_ERROR;
+	}
+
+  dest->tc->_vec_set_data(dest->self, data);
+	_vec_mark_all_dirty(dest);
+
+	return VECTOR_SUCCESS;
+}
+
+int vector_copy_assign(Vector* dest, Vector* src)
+{
+	assert(dest != NULL);
+	assert(src != NULL);
+	assert(vector_is_initialized(src));
+	assert(vector_is_initialized(dest));
+	assert(dest->tc->_vec_type() == src->tc->_vec_type());
+
+#ifndef VECTOR_UNCHECKED
+	if (dest == NULL) return VECTOR_ERROR;
+	if (src == NULL) return VECTOR_ERROR;
+	if (!vector_is_initialized(dest)) return VECTOR_ERROR;
+	if (!vector_is_initialized(src)) return VECTOR_ERROR;
+  if (dest->tc->_vec_type() != src->tc->_vec_type()) {
+    return VECTOR_ERROR;
+  }
+#endif
+
+	_vector_deinitialize(dest);
+
+	return vector_copy(dest, src);
+}
+
+int vector_snapshot(Vector* dest, Vector* src)
+{
+	assert(dest != NULL);
+	assert(dest->self != NULL);
+	assert(src != NULL);
+	assert(vector_is_initialized(src));
+	assert(dest->tc->_vec_type() == src->tc->_vec_type());
+
+#ifndef VECTOR_UNCHECKED
+	if (dest == NULL) return VECTOR_ERROR;
+	if (dest->self == NULL) return VECTOR_ERROR;
+	if (src == NULL) return VECTOR_ERROR;
+	if (!vector_is_initialized(src)) return VECTOR_ERROR;
+	if (dest->tc->_vec_type() != src->tc->_vec_type()) {
+    return VECTOR_ERROR;
+  }
+#endif
+
+	/* Only a heap buffer can outlive the vector it came from, and only a
+	 * vector that may allocate can take its private copy later */
+	if (!_vec_owns_data(src, src->tc->_vec_data(src->self)) ||
+			!_vec_can_allocate(dest)) {
+		return VECTOR_ERROR;
+	}
+
+	if (dest->tc->_vec_data(dest->self) == src->tc->_vec_data(src->self)) {
+		/* Already a snapshot of this buffer */
+		dest->tc->_vec_set_size(dest->self, src->tc->_vec_size(src->self));
+		_vec_mark_all_dirty(dest);
+		return VECTOR_SUCCESS;
+	}
+
+	if (_vec_share(src->tc->_vec_data(src->self)) == VECTOR_ERROR) {
+		return VECTOR_ERROR;
+	}
+
+	if (vector_is_initialized(dest)) {
+		_vector_deinitialize(dest);
+	}
+
+  dest->tc->_vec_set_size(dest->self, src->tc->_vec_size(src->self));
+  dest->tc->_vec_set_cap(dest->self, src->tc->_vec_cap(src->self));
+  dest->tc->_vec_set_data(dest->self, src->tc->_vec_data(src->self));
+	_vec_mark_all_dirty(dest);
+
+	return VECTOR_SUCCESS;
+}
+
+int vector_move(Vector* dest, Vector* src)
+{
+	assert(dest != NULL);
+	assert(src != NULL);
+
+#ifndef VECTOR_UNCHECKED
+	if (dest == NULL) return VECTOR_ERROR;
+	if (src == NULL) return VECTOR_ERROR;
+#endif
+
+	*dest = *src;
+  src->tc->_vec_set_data(src->self, NULL);
+
+	return VECTOR_SUCCESS;
+}
+
+int vector_move_assign(Vector* dest, Vector* src)
+{
+	if (vector_swap(dest, src) == VECTOR_SUCCESS) {
+		return _vector_deinitialize(src);
+	}
+
+#ifndef VECTOR_UNCHECKED
+	if (dest == NULL) return VECTOR_ERROR;
+	if (src == NULL) return VECTOR_ERROR;
+#endif
+
+	/* A buffer tied to its vector's storage is copied out instead, and `src`
+	 * is only given up once the copy is in place */
+	if (!_vec_can_allocate(dest)) return VECTOR_ERROR;
+	if (vector_copy_assign(dest, src) == VECTOR_ERROR) return VECTOR_ERROR;
+
+	return _vector_deinitialize(src);
+}
+
+int vector_swap(Vector* dest, Vector* src)
+{
+	assert(dest != NULL);
+	assert(src != NULL);
+	assert(vector_is_initialized(src));
+	assert(vector_is_initialized(dest));
+	assert(dest->tc->_vec_type() == src->tc->_vec_type());
+
+#ifndef VECTOR_UNCHECKED
+	if (dest == NULL) return VECTOR_ERROR;
+	if (src == NULL) return VECTOR_ERROR;
+	if (!vector_is_initialized(dest)) return VECTOR_ERROR;
+	if (!vector_is_initialized(src)) return VECTOR_ERROR;
+	if (dest->tc->_vec_type() != src->tc->_vec_type()) {
+    return VECTOR_ERROR;
+  }
+#endif
+
+	/* Buffers tied to their vector's storage cannot change hands */
+	if (!_vec_owns_data(dest, dest->tc->_vec_data(dest->self)) ||
+			!_vec_owns_data(src, src->tc->_vec_data(src->self))) {
+		return VECTOR_ERROR;
+	}
+
+  size_t tmp_size = dest->tc->_vec_size(dest->self);
+  dest->tc->_vec_set_size(dest->self, src->tc->_vec_size(src->self));
+  src->tc->_vec_set_size(src->self, tmp_size);
+
+  size_t tmp_capacity = dest->tc->_vec_cap(dest->self);
+  dest->tc->_vec_set_cap(dest->self, src->tc->_vec_cap(src->self));
+  src->tc->_vec_set_cap(src->self, tmp_capacity);
+
+	void *tmp_data = dest->tc->_vec_data(dest->self);
+	dest->tc->_vec_set_data(dest->self, src->tc->_vec_data(src->self));
+	src->tc->_vec_set_data(src->self, tmp_data);
+
+	_vec_mark_all_dirty(dest);
+	_vec_mark_all_dirty(src);
+
+	return VECTOR_SUCCESS;
+}
+
+int vector_concat_move(Vector* dest, Vector* src)
+{
+	size_t dest_size, src_size, dest_capacity, src_capacity, total;
+	void *dest_data, *src_data;
+	bool adopt;
+
+	assert(dest != NULL);
+	assert(src != NULL);
+	assert(vector_is_initialized(dest));
+	assert(vector_is_initialized(src));
+	assert(dest->tc->_vec_type() == src->tc->_vec_type());
+
+#ifndef VECTOR_UNCHECKED
+	if (dest == NULL) return VECTOR_ERROR;
+	if (src == NULL) return VECTOR_ERROR;
+	if (!vector_is_initialized(dest)) return VECTOR_ERROR;
+	if (!vector_is_initialized(src)) return VECTOR_ERROR;
+	if (dest->tc->_vec_type() != src->tc->_vec_type()) {
+    return VECTOR_ERROR;
+  }
+#endif
+
+	if (dest->self == src->self) return VECTOR_ERROR;
+
+	dest_size = dest->tc->_vec_size(dest->self);
+	src_size = src->tc->_vec_size(src->self);
+	dest_capacity = dest->tc->_vec_cap(dest->self);
+	src_capacity = src->tc->_vec_cap(src->self);
+	dest_data = dest->tc->_vec_data(dest->self);
+	src_data = src->tc->_vec_data(src->self);
+	total = dest_size + src_size;
+
+	if (src_size == 0) return VECTOR_SUCCESS;
+
+	/* The source buffer is taken over when the destination has nothing to
+	 * keep, or would have to grow while the source has room for both (then
+	 * the destination's elements are moved in front of the source's).
+	 * Buffers tied to their vector's storage cannot change hands. */
+	adopt = _vec_owns_data(dest, dest_data) && _vec_owns_data(src, src_data);
+	if (adopt && dest_size > 0) {
+		adopt = total > dest_capacity && total <= src_capacity &&
+      !_vec_is_shared(dest_data) && !_vec_is_shared(src_data);
+	}
+
+	if (adopt) {
+		if (dest_size > 0) {
+			_vec_relocate(src, _vec_offset(src, dest_size), src_data, src_size);
+			_vec_relocate(src, src_data, dest_data, dest_size);
+		}
+
+		dest->tc->_vec_set_data(dest->self, src_data);
+		dest->tc->_vec_set_cap(dest->self, src_capacity);
+		dest->tc->_vec_set_size(dest->self, total);
+		src->tc->_vec_set_data(src->self, dest_data);
+		src->tc->_vec_set_cap(src->self, dest_capacity);
+		src->tc->_vec_set_size(src->self, 0);
+
+		_vec_mark_all_dirty(dest);
+		_vec_mark_all_dirty(src);
+
+		return VECTOR_SUCCESS;
+	}
+
+	/* Elements a snapshot still owns are not ours to move */
+	if (_vec_has_lifecycle(src) && _vec_unshare(src) == VECTOR_ERROR) {
+		return VECTOR_ERROR;
+	}
+	if (_vec_unshare(dest) == VECTOR_ERROR) return VECTOR_ERROR;
+
+	if (total > dest_capacity) {
+		if (_vec_reallocate(dest,
+												MAX(total, dest_capacity * VECTOR_GROWTH_FACTOR)) ==
+				VECTOR_ERROR) {
+			return VECTOR_ERROR;
+		}
+	}
+
+	_vec_relocate(dest,
+								_vec_offset(dest, dest_size),
+								src->tc->_vec_data(src->self),
+								src_size);
+  dest->tc->_vec_set_size(dest->self, total);
+  src->tc->_vec_set_size(src->self, 0);
+
+	_vec_mark_dirty(dest, dest_size, total);
+	_vec_mark_all_dirty(src);
+
+	return VECTOR_SUCCESS;
+}
+
+int vector_splice(Vector* dest,
+                  size_t index,
+                  Vector* src,
+                  size_t first,
+                  size_t last)
+{
+	size_t dest_size, src_size, count;
+
+	assert(dest != NULL);
+	assert(src != NULL);
+	assert(vector_is_initialized(dest));
+	assert(vector_is_initialized(src));
+	assert(dest->tc->_vec_type() == src->tc->_vec_type());
+	assert(index <= dest->tc->_vec_size(dest->self));
+	assert(first <= last && last <= src->tc->_vec_size(src->self));
+
+#ifndef VECTOR_UNCHECKED
+	if (dest == NULL) return VECTOR_ERROR;
+	if (src == NULL) return VECTOR_ERROR;
+	if (!vector_is_initialized(dest)) return VECTOR_ERROR;
+	if (!vector_is_initialized(src)) return VECTOR_ERROR;
+	if (dest->tc->_vec_type() != src->tc->_vec_type()) {
+    return VECTOR_ERROR;
+  }
+	if (index > dest->tc->_vec_size(dest->self)) return VECTOR_ERROR;
+	if (first > last) return VECTOR_ERROR;
+	if (last > src->tc->_vec_size(src->self)) return VECTOR_ERROR;
+#endif
+
+	if (dest->self == src->self) return VECTOR_ERROR;
+
+	count = last - first;
+	if (count == 0) return VECTOR_SUCCESS;
+
+	if (_vec_unshare(dest) == VECTOR_ERROR) return VECTOR_ERROR;
+	if (_vec_unshare(src) == VECTOR_ERROR) return VECTOR_ERROR;
+
+	dest_size = dest->tc->_vec_size(dest->self);
+	src_size = src->tc->_vec_size(src->self);
+
+	if (dest_size + count > dest->tc->_vec_cap(dest->self)) {
+		if (_vec_reallocate(dest,
+												MAX(dest_size + count,
+														dest->tc->_vec_cap(dest->self) *
+                            VECTOR_GROWTH_FACTOR)) == VECTOR_ERROR) {
+			return VECTOR_ERROR;
+		}
+	}
+
+	/* Open the gap, fill it, and close the one left behind */
+	_vec_relocate(dest,
+								_vec_offset(dest, index + count),
+								_vec_offset(dest, index),
+								dest_size - index);
+	_vec_relocate(dest, _vec_offset(dest, index), _vec_offset(src, first), count);
+	_vec_relocate(src,
+								_vec_offset(src, first),
+								_vec_offset(src, last),
+								src_size - last);
+
+  dest->tc->_vec_set_size(dest->self, dest_size + count);
+  src->tc->_vec_set_size(src->self, src_size - count);
+
+	_vec_mark_dirty(dest, index, dest_size + count);
+	_vec_mark_dirty(src, first, src_size);
+
+	return VECTOR_SUCCESS;
+}
+
+int vector_destroy(Vector *v)
+{
+	assert(v != NULL);
+
+#ifndef VECTOR_UNCHECKED
+	if (v == NULL) return VECTOR_ERROR;
+#endif
+
+	_vec_untrack(v->self);
+	_vec_forget_access(v->self);
+
+	/* A buffer still used by a snapshot must survive the destructor */
+	if (_vec_unref(v->tc->_vec_data(v->self))) {
+		v->tc->_vec_set_data(v->self, NULL);
+	} else if (v->tc->_vec_data(v->self) != NULL) {
+		_vec_destroy_elements(v,
+                          v->tc->_vec_data(v->self),
+                          v->tc->_vec_size(v->self));
+	}
+
+  if (v->tc->_vec_destroy(v->self) == 0) {
+    v->self = NULL;
+    return VECTOR_SUCCESS;
+  }
+
+  return VECTOR_ERROR;
+}
+
+/* Insertion */
+
+int vector_push_back(Vector *v, void* element)
+{
+	assert(v != NULL);
+	assert(v->self != NULL);
+	assert(element != NULL);
+
+	if (_vec_should_grow(v)) {
+		if (_vec_adjust_capacity(v) == VECTOR_ERROR) {
+			return VECTOR_ERROR;
+		}
+	}
+
+	if (_vec_unshare(v) == VECTOR_ERROR) return VECTOR_ERROR;
+
+	_vec_assign(v, v->tc->_vec_size(v->self), element);
+
+  v->tc->_vec_set_size(v->self, v->tc->_vec_size(v->self) + 1);
+
+	return VECTOR_SUCCESS;
+}
+
+int vector_push_front(Vector *v, void* element)
+{
+	return vector_insert(v, 0, element);
+}
+
+int vector_insert(Vector *v, size_t index, void* element)
+{
+	void* offset;
+
+	assert(v != NULL);
+	assert(v->self != NULL);
+	assert(element != NULL);
+	assert(index <= v->tc->_vec_size(v->self));
+
+#ifndef VECTOR_UNCHECKED
+	if (v == NULL) return VECTOR_ERROR;
+	if (v->self == NULL) return VECTOR_ERROR;
+	if (element == NULL) return VECTOR_ERROR;
+	if (index > v->tc->_vec_size(v->self)) return VECTOR_ERROR;
+#endif
+
+  if (_vec_should_grow(v)) {
+    if (_vec_adjust_capacity(v) == VECTOR_ERROR) {
+      return VECTOR_ERROR;
+    }
+  }
+
+	if (_vec_unshare(v) == VECTOR_ERROR) return VECTOR_ERROR;
+
+	/* Move other elements to the right */
+	if (_vec_move_right(v, index) == VECTOR_ERROR) {
+		return VECTOR_ERROR;
+	}
+
+	/* Insert the element */
+	offset = _vec_offset(v, index);
+	_vec_relocate(v, offset, element, 1);
+  v->tc->_vec_set_size(v->self, v->tc->_vec_size(v->self) + 1);
+
+	return VECTOR_SUCCESS;
+}
+
+int vector_assign(Vector *v, size_t index, void* element)
+{
+	assert(v != NULL);
+	assert(v->self != NULL);
+	assert(element != NULL);
+	assert(index < v->tc->_vec_size(v->self));
+
+#ifndef VECTOR_UNCHECKED
+	if (v == NULL) return VECTOR_ERROR;
+	if (v->self == NULL) return VECTOR_ERROR;
+	if (element == NULL) return VECTOR_ERROR;
+	if (index >= v->tc->_vec_size(v->self)) return VECTOR_ERROR;
+#endif
+
+	if (_vec_unshare(v) == VECTOR_ERROR) return VECTOR_ERROR;
+
+	_vec_destroy_elements(v, _vec_offset(v, index), 1);
+	_vec_assign(v, index, element);
+
+	return VECTOR_SUCCESS;
+}
+
+/* Deletion */
+
+int vector_pop_back(Vector *v)
+{
+	assert(v != NULL);
+	assert(v->self != NULL);
+	assert(v->tc->_vec_size(v->self) > 0);
+
+#ifndef VECTOR_UNCHECKED
+	if (v == NULL) return VECTOR_ERROR;
+	if (v->self == NULL) return VECTOR_ERROR;
+#endif
+
+	if (v->tc->_vec_elem_destroy != NULL) {
+		if (_vec_unshare(v) == VECTOR_ERROR) return VECTOR_ERROR;
+		_vec_destroy_elements(v, _vec_offset(v, v->tc->_vec_size(v->self) - 1), 1);
+	}
+
+  v->tc->_vec_set_size(v->self, v->tc->_vec_size(v->self) - 1);
+
+#ifndef VECTOR_NO_SHRINK
+	if (_vec_should_shrink(v)) {
+		_vec_adjust_capacity(v);
+	}
+#endif
+
+	return VECTOR_SUCCESS;
+}
+
+int vector_pop_front(Vector *v)
+{
+	return vector_erase(v, 0);
+}
+
+int vector_erase(Vector *v, size_t index)
+{
+	assert(v != NULL);
+	assert(v->self != NULL);
+	assert(index < v->tc->_vec_size(v->self));
+
+#ifndef VECTOR_UNCHECKED
+	if (v == NULL) return VECTOR_ERROR;
+	if (v->self == NULL) return VECTOR_ERROR;
+	if (index >= v->tc->_vec_size(v->self)) return VECTOR_ERROR;
+#endif
+
+	if (_vec_unshare(v) == VECTOR_ERROR) return VECTOR_ERROR;
+
+	/* Just overwrite */
+	_vec_destroy_elements(v, _vec_offset(v, index), 1);
+	_vec_move_left(v, index);
+
+#ifndef VECTOR_NO_SHRINK
+  v->tc->_vec_set_size(v->self, v->tc->_vec_size(v->self) - 1);
+	if (_vec_should_shrink(v)) {
+		_vec_adjust_capacity(v);
+	}
+#endif
+
+	return VECTOR_SUCCESS;
+}
+
+int vector_clear(Vector *v)
+{
+	return vector_resize(v, 0);
+}
+
+/* Lookup */
+
+void* vector_get(Vector *v, size_t index)
+{
+	assert(v != NULL);
+	assert(v->self != NULL);
+	assert(index < v->tc->_vec_size(v->self));
+
+#ifndef VECTOR_UNCHECKED
+	if (v == NULL) return NULL;
+	if (v->self == NULL) return NULL;
+	if (index >= v->tc->_vec_size(v->self)) return NULL;
+#endif
+
+	/* The element may be written through the returned pointer */
+	if (_vec_unshare(v) == VECTOR_ERROR) return NULL;
+
+	return _vec_offset(v, index);
+}
+
+const void* vector_const_get(const Vector *v, size_t index)
+{
+  assert(v != NULL);
+	assert(v->self != NULL);
+  assert(index < v->tc->_vec_size(v->self));
+
+#ifndef VECTOR_UNCHECKED
+  if (v == NULL) return NULL;
+	if (v->self == NULL) return NULL;
+  if (index >= v->tc->_vec_size(v->self)) return NULL;
+#endif
+
+  return _vec_const_offset(v, index);
+}
+
+void* vector_front(Vector *v)
+{
+	return vector_get(v, 0);
+}
+
+void* vector_back(Vector *v)
+{
+	return vector_get(v, v->tc->_vec_size(v->self) - 1);
+}
+
+void* vector_data(Vector *v)
+{
+	assert(v != NULL);
+	assert(v->self != NULL);
+
+#ifndef VECTOR_UNCHECKED
+	if (v == NULL) return NULL;
+	if (v->self == NULL) return NULL;
+#endif
+
+	if (_vec_unshare(v) == VECTOR_ERROR) return NULL;
+
+	return v->tc->_vec_data(v->self);
+}
+
+const void* vector_const_data(const Vector *v)
+{
+	assert(v != NULL);
+	assert(v->self != NULL);
+
+#ifndef VECTOR_UNCHECKED
+	if (v == NULL) return NULL;
+	if (v->self == NULL) return NULL;
+#endif
+
+	return v->tc->_vec_data(v->self);
+}
+
+/* Information */
+
+bool vector_is_initialized(const Vector *v)
+{
+	return v->self != NULL && v->tc->_vec_data(v->self) != NULL;
+}
+
+bool vector_is_shared(const Vector *v)
+{
+	assert(v->self != NULL);
+	return _vec_is_shared(v->tc->_vec_data(v->self));
+}
+
+size_t vector_byte_size(const Vector *v)
+{
+	assert(v->self != NULL);
+	return v->tc->_vec_size(v->self) * v->tc->_vec_elem_size();
+}
+
+size_t vector_size(const Vector *v)
+{
+	assert(v->self != NULL);
+	return v->tc->_vec_size(v->self);
+}
+
+size_t vector_capacity(const Vector *v)
+{
+	assert(v->self != NULL);
+	return v->tc->_vec_cap(v->self);
+}
+
+size_t vector_free_space(const Vector *v)
+{
+	assert(v->self != NULL);
+	return v->tc->_vec_cap(v->self) - v->tc->_vec_size(v->self);
+}
+
+bool vector_is_empty(const Vector *v)
+{
+	assert(v->self != NULL);
+	return v->tc->_vec_size(v->self) == 0;
+}
+
+/* Memory management */
+
+int vector_resize(Vector *v, size_t new_size)
+{
+	size_t old_size = v->tc->_vec_size(v->self);
+
+	/* Elements cut off are destroyed in the vector's own copy of the buffer */
+	if (new_size < old_size && v->tc->_vec_elem_destroy != NULL) {
+		if (_vec_unshare(v) == VECTOR_ERROR) return VECTOR_ERROR;
+		_vec_destroy_elements(v, _vec_offset(v, new_size), old_size - new_size);
+	}
+
+	if (new_size <= v->tc->_vec_cap(v->self) / VECTOR_SHRINK_THRESHOLD) {
+    v->tc->_vec_set_size(v->self, new_size);
+		if (_vec_reallocate(v, new_size * VECTOR_GROWTH_FACTOR) == -1) {
+			return VECTOR_ERROR;
+		}
+	} else if (new_size > v->tc->_vec_cap(v->self)) {
+		if (_vec_reallocate(v, new_size * VECTOR_GROWTH_FACTOR) == -1) {
+			return VECTOR_ERROR;
+		}
+	}
+
+  v->tc->_vec_set_size(v->self, new_size);
+
+	/* Elements with hooks are never left as garbage: new ones start zeroed */
+	if (new_size > old_size && _vec_has_lifecycle(v)) {
+		if (_vec_unshare(v) == VECTOR_ERROR) return VECTOR_ERROR;
+		memset(_vec_offset(v, old_size),
+           0,
+           (new_size - old_size) * v->tc->_vec_elem_size());
+	}
+
+	/* Shrinking is recorded by the size in the next frame */
+	_vec_mark_dirty(v, old_size, new_size);
+
+	return VECTOR_SUCCESS;
+}
+
+int vector_reserve(Vector *v, size_t minimum_capacity)
+{
+	if (minimum_capacity > v->tc->_vec_cap(v->self)) {
+		if (_vec_reallocate(v, minimum_capacity) == VECTOR_ERROR) {
+			return VECTOR_ERROR;
+		}
+	}
+
+	return VECTOR_SUCCESS;
+}
+
+int vector_shrink_to_fit(Vector *v)
+{
+	return _vec_reallocate(v, v->tc->_vec_size(v->self));
+}
+
+int vector_release_memory(Vector *v, size_t keep_capacity)
+{
+	size_t released;
+
+	assert(v != NULL);
+	assert(v->self != NULL);
+
+#ifndef VECTOR_UNCHECKED
+	if (v == NULL) return VECTOR_ERROR;
+	if (v->self == NULL) return VECTOR_ERROR;
+#endif
+
+	return _vec_release_tail(v, keep_capacity, &released);
+}
+
+/* Idle trimming */
+
+int vector_track_access(Vector *v)
+{
+	_VecAccess *entry, *entries;
+	size_t capacity;
+
+	assert(v != NULL);
+	assert(v->self != NULL);
+
+#ifndef VECTOR_UNCHECKED
+	if (v == NULL) return VECTOR_ERROR;
+	if (v->self == NULL) return VECTOR_ERROR;
+#endif
+
+	pthread_mutex_lock(&_vec_access_lock);
+
+	entry = _vec_access_find(v->self);
+	if (entry == NULL) {
+		if (_vec_access_count == _vec_access_capacity) {
+			capacity = MAX(VECTOR_MINIMUM_CAPACITY,
+										 _vec_access_capacity * VECTOR_GROWTH_FACTOR);
+			entries = realloc(_vec_access, capacity * sizeof(_VecAccess));
+			if (entries == NULL) {
+				pthread_mutex_unlock(&_vec_access_lock);
+				return VECTOR_ERROR;
+			}
+			_vec_access = entries;
+			_vec_access_capacity = capacity;
+		}
+
+		entry = &_vec_access[_vec_access_count];
+		__atomic_store_n(&_vec_access_count,
+										 _vec_access_count + 1,
+										 __ATOMIC_RELEASE);
+	}
+
+	entry->vector = *v;
+	_vec_access_refresh(entry, true);
+
+	pthread_mutex_unlock(&_vec_access_lock);
+
+	return VECTOR_SUCCESS;
+}
+
+int vector_untrack_access(Vector *v)
+{
+	assert(v != NULL);
+	assert(v->self != NULL);
+
+#ifndef VECTOR_UNCHECKED
+	if (v == NULL) return VECTOR_ERROR;
+	if (v->self == NULL) return VECTOR_ERROR;
+#endif
+
+	_vec_forget_access(v->self);
+
+	return VECTOR_SUCCESS;
+}
+
+int vector_touch(Vector *v)
+{
+	_VecAccess *entry;
+
+	assert(v != NULL);
+	assert(v->self != NULL);
+
+#ifndef VECTOR_UNCHECKED
+	if (v == NULL) return VECTOR_ERROR;
+	if (v->self == NULL) return VECTOR_ERROR;
+#endif
+
+	if (__atomic_load_n(&_vec_access_count, __ATOMIC_ACQUIRE) == 0) {
+		return VECTOR_SUCCESS;
+	}
+
+	pthread_mutex_lock(&_vec_access_lock);
+	entry = _vec_access_find(v->self);
+	if (entry != NULL) _vec_access_refresh(entry, true);
+	pthread_mutex_unlock(&_vec_access_lock);
+
+	return VECTOR_SUCCESS;
+}
+
+size_t vector_trim_all(size_t budget_bytes)
+{
+	_VecAccess *entry, *coldest;
+	size_t i, total = 0, released = 0, bytes;
+
+	pthread_mutex_lock(&_vec_access_lock);
+
+	/* A vector that changed since the last look was used in between */
+	for (i = 0; i < _vec_access_count; ++i) {
+		entry = &_vec_access[i];
+		if (_vec_access_changed(entry)) _vec_access_refresh(entry, true);
+		if (!entry->trimmed) total += _vec_slack_bytes(&entry->vector);
+	}
+
+	while (total > budget_bytes) {
+		coldest = NULL;
+		for (i = 0; i < _vec_access_count; ++i) {
+			entry = &_vec_access[i];
+			if (entry->trimmed || _vec_slack_bytes(&entry->vector) == 0) continue;
+			if (coldest == NULL || entry->last_access < coldest->last_access) {
+				coldest = entry;
+			}
+		}
+		if (coldest == NULL) break;
+
+		total -= _vec_slack_bytes(&coldest->vector);
+		if (_vec_release_tail(&coldest->vector, 0, &bytes) == VECTOR_SUCCESS) {
+			released += bytes;
+		}
+
+		/* Trimming is not an access */
+		_vec_access_refresh(coldest, false);
+		coldest->trimmed = true;
+	}
+
+	pthread_mutex_unlock(&_vec_access_lock);
 
-  return VECTOR_ERROR;
+	return released;
 }
 
-/* Insertion */
+/* Persistence */
 
-int vector_push_back(Vector *v, void* element)
+int vector_track_dirty(Vector *v, size_t chunk_size)
 {
+	_VecDirty *entry, *entries;
+	size_t capacity;
+
 	assert(v != NULL);
 	assert(v->self != NULL);
-	assert(element != NULL);
 
-	if (_vec_should_grow(v)) {
-		if (_vec_adjust_capacity(v) == VECTOR_ERROR) {
-			return VECTOR_ERROR;
+#ifndef VECTOR_UNCHECKED
+	if (v == NULL) return VECTOR_ERROR;
+	if (v->self == NULL) return VECTOR_ERROR;
+#endif
+
+	if (chunk_size == 0) {
+		chunk_size = MAX(1, VECTOR_DIRTY_CHUNK_BYTES / v->tc->_vec_elem_size());
+	}
+
+	pthread_mutex_lock(&_vec_dirty_lock);
+
+	entry = _vec_dirty_find(v->self);
+	if (entry == NULL) {
+		if (_vec_dirty_count == _vec_dirty_capacity) {
+			capacity = MAX(VECTOR_MINIMUM_CAPACITY,
+										 _vec_dirty_capacity * VECTOR_GROWTH_FACTOR);
+			entries = realloc(_vec_dirty, capacity * sizeof(_VecDirty));
+			if (entries == NULL) {
+				pthread_mutex_unlock(&_vec_dirty_lock);
+				return VECTOR_ERROR;
+			}
+			_vec_dirty = entries;
+			_vec_dirty_capacity = capacity;
 		}
+
+		entry = &_vec_dirty[_vec_dirty_count];
+		entry->self = v->self;
+		entry->chunks = (BitVector)BIT_VECTOR_INITIALIZER;
+		__atomic_store_n(&_vec_dirty_count,
+										 _vec_dirty_count + 1,
+										 __ATOMIC_RELEASE);
+	} else {
+		bit_vector_clear(&entry->chunks);
 	}
 
-	_vec_assign(v, v->tc->_vec_size(v->self), element);
+	/* The first flush writes the vector in full */
+	entry->chunk_size = chunk_size;
+	entry->all = true;
 
-  v->tc->_vec_set_size(v->self, v->tc->_vec_size(v->self) + 1);
+	pthread_mutex_unlock(&_vec_dirty_lock);
 
 	return VECTOR_SUCCESS;
 }
 
-int vector_push_front(Vector *v, void* element)
-{
-	return vector_insert(v, 0, element);
-}
-
-int vector_insert(Vector *v, size_t index, void* element)
+int vector_untrack_dirty(Vector *v)
 {
-	void* offset;
-
 	assert(v != NULL);
 	assert(v->self != NULL);
-	assert(element != NULL);
-	assert(index <= v->tc->_vec_size(v->self));
 
+#ifndef VECTOR_UNCHECKED
 	if (v == NULL) return VECTOR_ERROR;
 	if (v->self == NULL) return VECTOR_ERROR;
-	if (element == NULL) return VECTOR_ERROR;
-	if (index > v->tc->_vec_size(v->self)) return VECTOR_ERROR;
-
-  if (_vec_should_grow(v)) {
-    if (_vec_adjust_capacity(v) == VECTOR_ERROR) {
-      return VECTOR_ERROR;
-    }
-  }
-
-	/* Move other elements to the right */
-	if (_vec_move_right(v, index) == VECTOR_ERROR) {
-		return VECTOR_ERROR;
-	}
+#endif
 
-	/* Insert the element */
-	offset = _vec_offset(v, index);
-	memcpy(offset, element, v->tc->_vec_elem_size());
-  v->tc->_vec_set_size(v->self, v->tc->_vec_size(v->self) + 1);
+	_vec_untrack(v->self);
 
 	return VECTOR_SUCCESS;
 }
 
-int vector_assign(Vector *v, size_t index, void* element)
+int vector_mark_dirty(Vector *v, size_t index, size_t count)
 {
 	assert(v != NULL);
 	assert(v->self != NULL);
-	assert(element != NULL);
-	assert(index < v->tc->_vec_size(v->self));
+	assert(index + count <= v->tc->_vec_size(v->self));
 
+#ifndef VECTOR_UNCHECKED
 	if (v == NULL) return VECTOR_ERROR;
 	if (v->self == NULL) return VECTOR_ERROR;
-	if (element == NULL) return VECTOR_ERROR;
-	if (index >= v->tc->_vec_size(v->self)) return VECTOR_ERROR;
+	if (index + count > v->tc->_vec_size(v->self)) return VECTOR_ERROR;
+#endif
 
-	_vec_assign(v, index, element);
+	_vec_mark_dirty(v, index, index + count);
 
 	return VECTOR_SUCCESS;
 }
 
-/* Deletion */
+size_t vector_dirty_size(const Vector *v)
+{
+	size_t size = v->tc->_vec_size(v->self);
+	size_t dirty = 0, chunk, first;
+	_VecDirty *entry;
 
-int vector_pop_back(Vector *v)
+	assert(v->self != NULL);
+
+	pthread_mutex_lock(&_vec_dirty_lock);
+
+	entry = _vec_dirty_find(v->self);
+	if (entry != NULL && entry->all) {
+		dirty = size;
+	} else if (entry != NULL) {
+		for (chunk = bit_vector_find_first(&entry->chunks);
+				 chunk != BIT_VECTOR_NOT_FOUND;
+				 chunk = bit_vector_find_next(&entry->chunks, chunk)) {
+			first = chunk * entry->chunk_size;
+			if (first >= size) break;
+			dirty += MIN(entry->chunk_size, size - first);
+		}
+	}
+
+	pthread_mutex_unlock(&_vec_dirty_lock);
+
+	return dirty;
+}
+
+int vector_flush_dirty(Vector *v, int fd)
 {
+	BitVector chunks;
+	size_t chunk_size;
+	bool all;
+	int result;
+
 	assert(v != NULL);
 	assert(v->self != NULL);
-	assert(v->tc->_vec_size(v->self) > 0);
+	assert(fd >= 0);
 
+#ifndef VECTOR_UNCHECKED
 	if (v == NULL) return VECTOR_ERROR;
 	if (v->self == NULL) return VECTOR_ERROR;
+	if (fd < 0) return VECTOR_ERROR;
+#endif
 
-  v->tc->_vec_set_size(v->self, v->tc->_vec_size(v->self) - 1);
-
-#ifndef VECTOR_NO_SHRINK
-	if (_vec_should_shrink(v)) {
-		_vec_adjust_capacity(v);
+	if (_vec_take_dirty(v, &chunks, &chunk_size, &all) == VECTOR_ERROR) {
+		return VECTOR_ERROR;
 	}
-#endif
 
-	return VECTOR_SUCCESS;
-}
+	result = _vec_write_frame(v, fd, &chunks, chunk_size, all);
+	bit_vector_destroy(&chunks);
 
-int vector_pop_front(Vector *v)
-{
-	return vector_erase(v, 0);
+	/* Whatever did not reach the log goes out with the next flush */
+	if (result == VECTOR_ERROR) _vec_mark_all_dirty(v);
+
+	return result;
 }
 
-int vector_erase(Vector *v, size_t index)
+int vector_compact_dirty(Vector *v, int fd)
 {
+	BitVector chunks;
+	size_t chunk_size;
+	bool all;
+
 	assert(v != NULL);
 	assert(v->self != NULL);
-	assert(index < v->tc->_vec_size(v->self));
+	assert(fd >= 0);
 
+#ifndef VECTOR_UNCHECKED
 	if (v == NULL) return VECTOR_ERROR;
 	if (v->self == NULL) return VECTOR_ERROR;
-	if (index >= v->tc->_vec_size(v->self)) return VECTOR_ERROR;
+	if (fd < 0) return VECTOR_ERROR;
+#endif
 
-	/* Just overwrite */
-	_vec_move_left(v, index);
+	if (_vec_take_dirty(v, &chunks, &chunk_size, &all) == VECTOR_ERROR) {
+		return VECTOR_ERROR;
+	}
+	bit_vector_destroy(&chunks);
 
-#ifndef VECTOR_NO_SHRINK
-  v->tc->_vec_set_size(v->self, v->tc->_vec_size(v->self) - 1);
-	if (v->tc->_vec_size(v->self) == v->tc->_vec_cap(v->self) / 4) {
-		_vec_adjust_capacity(v);
+	if (ftruncate(fd, 0) != 0 ||
+			_vec_write_frame(v, fd, NULL, chunk_size, true) == VECTOR_ERROR) {
+		_vec_mark_all_dirty(v);
+		return VECTOR_ERROR;
 	}
-#endif
 
 	return VECTOR_SUCCESS;
 }
 
-int vector_clear(Vector *v)
+int vector_replay_dirty(Vector *v, int fd)
 {
-	return vector_resize(v, 0);
-}
-
-/* Lookup */
+	BitVector chunks;
+	size_t elem_size, chunk_size;
+	uint64_t header[3], range[2], r;
+	ssize_t got;
+	char *data;
+	bool all;
 
-void* vector_get(Vector *v, size_t index)
-{
 	assert(v != NULL);
 	assert(v->self != NULL);
-	assert(index < v->tc->_vec_size(v->self));
+	assert(fd >= 0);
 
-	if (v == NULL) return NULL;
-	if (v->self == NULL) return NULL;
-	if (index >= v->tc->_vec_size(v->self)) return NULL;
+#ifndef VECTOR_UNCHECKED
+	if (v == NULL) return VECTOR_ERROR;
+	if (v->self == NULL) return VECTOR_ERROR;
+	if (fd < 0) return VECTOR_ERROR;
+#endif
 
-	return _vec_offset(v, index);
-}
+	elem_size = v->tc->_vec_elem_size();
+
+	while ((got = _vec_read_all(fd, header, sizeof header)) ==
+				 (ssize_t)sizeof header) {
+		if (header[1] != elem_size) return VECTOR_ERROR;
+		if (vector_resize(v, header[0]) == VECTOR_ERROR) return VECTOR_ERROR;
+
+		data = vector_data(v);
+		if (data == NULL) return VECTOR_ERROR;
+
+		for (r = 0; r < header[2]; ++r) {
+			if (_vec_read_all(fd, range, sizeof range) != (ssize_t)sizeof range) {
+				return VECTOR_ERROR;
+			}
+			if (range[0] > header[0] || range[1] > header[0] - range[0]) {
+				return VECTOR_ERROR;
+			}
+			if (_vec_read_all(fd, data + range[0] * elem_size, range[1] * elem_size)
+					!= (ssize_t)(range[1] * elem_size)) {
+				return VECTOR_ERROR;
+			}
+		}
+	}
 
-const void* vector_const_get(const Vector *v, size_t index)
-{
-  assert(v != NULL);
-	assert(v->self != NULL);
-  assert(index < v->tc->_vec_size(v->self));
+	/* A header cut short is a frame that never finished */
+	if (got != 0) return VECTOR_ERROR;
 
-  if (v == NULL) return NULL;
-	if (v->self == NULL) return NULL;
-  if (index >= v->tc->_vec_size(v->self)) return NULL;
+	/* What was just read back is in the log already */
+	if (_vec_take_dirty(v, &chunks, &chunk_size, &all) == VECTOR_SUCCESS) {
+		bit_vector_destroy(&chunks);
+	}
 
-  return _vec_const_offset(v, index);
+	return VECTOR_SUCCESS;
 }
 
-void* vector_front(Vector *v)
-{
-	return vector_get(v, 0);
-}
+/* Parallel bulk operations */
 
-void* vector_back(Vector *v)
+int vector_copy_parallel(Vector* dest, Vector* src, size_t threads)
 {
-	return vector_get(v, v->tc->_vec_size(v->self) - 1);
-}
+	size_t size, capacity, elem_size;
+	void *data;
 
-/* Information */
+	assert(dest != NULL);
+	assert(src != NULL);
+	assert(vector_is_initialized(src));
+	assert(!vector_is_initialized(dest));
+	assert(dest->tc->_vec_type() == src->tc->_vec_type());
 
-bool vector_is_initialized(const Vector *v)
-{
-	return v->self != NULL && v->tc->_vec_data(v->self) != NULL;
-}
+#ifndef VECTOR_UNCHECKED
+	if (dest == NULL) return VECTOR_ERROR;
+	if (src == NULL) return VECTOR_ERROR;
+	if (vector_is_initialized(dest)) return VECTOR_ERROR;
+	if (!vector_is_initialized(src)) return VECTOR_ERROR;
+	if (dest->tc->_vec_type() != src->tc->_vec_type()) {
+    return VECTOR_ERROR;
+  }
+#endif
 
-size_t vector_byte_size(const Vector *v)
-{
-	assert(v->self != NULL);
-	return v->tc->_vec_size(v->self) * v->tc->_vec_elem_size();
-}
+	/* Copy hooks are not known to be thread-safe */
+	if (src->tc->_vec_elem_copy != NULL) return vector_copy(dest, src);
 
-size_t vector_size(const Vector *v)
-{
-	assert(v->self != NULL);
-	return v->tc->_vec_size(v->self);
-}
+	size = src->tc->_vec_size(src->self);
+	capacity = MAX(VECTOR_MINIMUM_CAPACITY, size * VECTOR_GROWTH_FACTOR);
+	elem_size = src->tc->_vec_elem_size();
 
-size_t vector_capacity(const Vector *v)
-{
-	assert(v->self != NULL);
-	return v->tc->_vec_cap(v->self);
-}
+	if (!_vec_can_allocate(dest)) return VECTOR_ERROR;
 
-size_t vector_free_space(const Vector *v)
-{
-	assert(v->self != NULL);
-	return v->tc->_vec_cap(v->self) - v->tc->_vec_size(v->self);
+	data = malloc(capacity * elem_size);
+	if (data == NULL) return VECTOR_ERROR;
+
+	/* Spare capacity is left to whoever appends, as with vector_copy;
+	 * vector_reserve_parallel_touch faults it in up front */
+	if (_vec_bulk(data,
+								src->tc->_vec_data(src->self),
+								NULL,
+								elem_size,
+								size,
+								size,
+								threads) == VECTOR_ERROR) {
+		free(data);
+		return VECTOR_ERROR;
+	}
+
+  dest->tc->_vec_set_size(dest->self, size);
+  dest->tc->_vec_set_cap(dest->self, capacity);
+  dest->tc->_vec_set_data(dest->self, data);
+	_vec_mark_all_dirty(dest);
+
+	return VECTOR_SUCCESS;
 }
 
-bool vector_is_empty(const Vector *v)
+int vector_fill(Vector* v,
+                size_t index,
+                size_t count,
+                const void* element,
+                size_t threads)
 {
+	size_t elem_size, i;
+	void *offset;
+
+	assert(v != NULL);
 	assert(v->self != NULL);
-	return v->tc->_vec_size(v->self) == 0;
-}
+	assert(element != NULL);
+	assert(index + count <= v->tc->_vec_size(v->self));
 
-/* Memory management */
+#ifndef VECTOR_UNCHECKED
+	if (v == NULL) return VECTOR_ERROR;
+	if (v->self == NULL) return VECTOR_ERROR;
+	if (element == NULL) return VECTOR_ERROR;
+	if (index + count > v->tc->_vec_size(v->self)) return VECTOR_ERROR;
+#endif
 
-int vector_resize(Vector *v, size_t new_size)
-{
-	if (new_size <= v->tc->_vec_cap(v->self) * VECTOR_SHRINK_THRESHOLD) {
-    v->tc->_vec_set_size(v->self, new_size);
-		if (_vec_reallocate(v, new_size * VECTOR_GROWTH_FACTOR) == -1) {
-			return VECTOR_ERROR;
-		}
-	} else if (new_size > v->tc->_vec_cap(v->self)) {
-		if (_vec_reallocate(v, new_size * VECTOR_GROWTH_FACTOR) == -1) {
-			return VECTOR_ERROR;
+	if (_vec_unshare(v) == VECTOR_ERROR) return VECTOR_ERROR;
+
+	elem_size = v->tc->_vec_elem_size();
+
+	/* Each slot gets its own copy, one after the other */
+	if (_vec_has_lifecycle(v)) {
+		for (i = index; i < index + count; ++i) {
+			offset = _vec_offset(v, i);
+			_vec_destroy_elements(v, offset, 1);
+			if (_vec_copy_elements(v, offset, element, 1) == VECTOR_ERROR) {
+				/* The slot is left empty rather than destroyed twice */
+				memset(offset, 0, elem_size);
+				_vec_mark_dirty(v, index, i + 1);
+				return VECTOR_ERROR;
+			}
 		}
+		_vec_mark_dirty(v, index, index + count);
+		return VECTOR_SUCCESS;
 	}
 
-  v->tc->_vec_set_size(v->self, new_size);
+	if (_vec_bulk(_vec_offset(v, index),
+								NULL,
+								element,
+								elem_size,
+								count,
+								count,
+								threads) == VECTOR_ERROR) {
+		return VECTOR_ERROR;
+	}
+
+	_vec_mark_dirty(v, index, index + count);
 
 	return VECTOR_SUCCESS;
 }
 
-int vector_reserve(Vector *v, size_t minimum_capacity)
+int vector_reserve_parallel_touch(Vector* v,
+                                  size_t minimum_capacity,
+                                  size_t threads)
 {
-	if (minimum_capacity > v->tc->_vec_cap(v->self)) {
-		if (_vec_reallocate(v, minimum_capacity) == VECTOR_ERROR) {
-			return VECTOR_ERROR;
-		}
+	size_t elem_size;
+	void *data, *old;
+
+	assert(v != NULL);
+	assert(v->self != NULL);
+
+#ifndef VECTOR_UNCHECKED
+	if (v == NULL) return VECTOR_ERROR;
+	if (v->self == NULL) return VECTOR_ERROR;
+#endif
+
+	if (minimum_capacity <= v->tc->_vec_cap(v->self)) return VECTOR_SUCCESS;
+	if (!_vec_can_allocate(v)) return VECTOR_ERROR;
+
+	/* Elements with hooks are moved by them, on this thread */
+	if (_vec_has_lifecycle(v)) return vector_reserve(v, minimum_capacity);
+
+	elem_size = v->tc->_vec_elem_size();
+	old = v->tc->_vec_data(v->self);
+
+	data = malloc(minimum_capacity * elem_size);
+	if (data == NULL) return VECTOR_ERROR;
+
+	if (_vec_bulk(data,
+								old,
+								NULL,
+								elem_size,
+								v->tc->_vec_size(v->self),
+								minimum_capacity,
+								threads) == VECTOR_ERROR) {
+		free(data);
+		return VECTOR_ERROR;
 	}
 
-	return VECTOR_SUCCESS;
-}
+  v->tc->_vec_set_data(v->self, data);
+  v->tc->_vec_set_cap(v->self, minimum_capacity);
+	_vec_release(v, old);
 
-int vector_shrink_to_fit(Vector *v)
-{
-	return _vec_reallocate(v, v->tc->_vec_size(v->self));
+	return VECTOR_SUCCESS;
 }
 
 /* Iterators */
@@ -552,17 +2331,29 @@ Iterator vector_end(Vector *v)
 
 Iterator vector_iterator(Vector *v, size_t index)
 {
+	Iterator iterator = { NULL, NULL };
+
+	/* Iterators hand out mutable pointers, just like vector_get */
+	if (_vec_unshare(v) == VECTOR_ERROR) return iterator;
+
 	return v->tc->_vec_iterator(v->self, index);
 }
 
 void* iterator_get(Iterator* iter)
 {
+	/* vector_iterator failed to unshare: it points at nothing */
+	if (iter->tc == NULL) return NULL;
+
 	return iter->tc->_iter_pointer(iter->self);
 }
 
 int iterator_erase(Vector *v, Iterator *iter)
 {
-	size_t index = iterator_index(v, iter);
+	size_t index;
+
+	if (iter->tc == NULL) return VECTOR_ERROR;
+
+	index = iterator_index(v, iter);
 
 	if (vector_erase(v, index) == VECTOR_ERROR) {
 		return VECTOR_ERROR;
@@ -601,9 +2392,69 @@ void* iterator_previous(Iterator* iter)
 	return current;
 }
 
+void iterator_advance(Iterator* iter, ptrdiff_t n)
+{
+	assert(iter != NULL);
+
+	if (iter->tc->_iter_stride != NULL) {
+		assert(iter->tc->_iter_pointer(iter->self) == iter->self);
+		iter->self = (char*)iter->self + n * (ptrdiff_t)iter->tc->_iter_stride();
+	} else if (iter->tc->_iter_advance != NULL) {
+		iter->self = iter->tc->_iter_advance(iter->self, n);
+	} else {
+		for (; n > 0; --n) iterator_increment(iter);
+		for (; n < 0; ++n) iterator_decrement(iter);
+	}
+}
+
+void* iterator_at(Iterator* iter, ptrdiff_t n)
+{
+	Iterator moved = *iter;
+
+	iterator_advance(&moved, n);
+
+	return iterator_get(&moved);
+}
+
+ptrdiff_t iterator_distance(Iterator* first, Iterator* last)
+{
+	Iterator walker;
+	ptrdiff_t distance = 0;
+
+	assert(first != NULL);
+	assert(last != NULL);
+	assert(first->tc->_iter_type() == last->tc->_iter_type());
+
+	if (first->tc->_iter_stride != NULL) {
+		assert(iterator_get(first) == first->self);
+		assert(iterator_get(last) == last->self);
+		return ((char*)last->self - (char*)first->self) /
+      (ptrdiff_t)first->tc->_iter_stride();
+	}
+
+	if (first->tc->_iter_distance != NULL) {
+		return first->tc->_iter_distance(first->self, last->self);
+	}
+
+	/* Step towards `last`, which iterators order by address */
+	walker = *first;
+	if (iterator_is_before(first, last)) {
+		for (; !iterator_equals(&walker, last); ++distance) {
+			iterator_increment(&walker);
+		}
+	} else {
+		for (; !iterator_equals(&walker, last); --distance) {
+			iterator_decrement(&walker);
+		}
+	}
+
+	return distance;
+}
+
 bool iterator_equals(Iterator* first, Iterator* second)
 {
-	assert(first->tc->_iter_type() ==  second->tc->_iter_type());
+	assert(first->tc == NULL || second->tc == NULL ||
+				 first->tc->_iter_type() == second->tc->_iter_type());
 
 	return iterator_get(first) == iterator_get(second);
 }
@@ -629,6 +2480,16 @@ size_t iterator_index(Vector *v, Iterator* iter)
 	assert(iter != NULL);
 	assert(v->tc->_vec_type() == iter->tc->_iter_type());
 
-	return (iter->tc->_iter_pointer(iter->self) - v->tc->_vec_data(v->self)) /
-    v->tc->_vec_elem_size();
+	/* Layouts with their own arithmetic measure from the first element; not
+	 * vector_begin, which would break copy-on-write sharing */
+	if (iter->tc->_iter_stride == NULL && iter->tc->_iter_distance != NULL) {
+		Iterator begin = v->tc->_vec_iterator(v->self, 0);
+		return (size_t)iterator_distance(&begin, iter);
+	}
+
+	size_t step = iter->tc->_iter_stride != NULL ? iter->tc->_iter_stride()
+                                               : v->tc->_vec_elem_size();
+
+	return (size_t)((char*)iter->tc->_iter_pointer(iter->self) -
+									(char*)v->tc->_vec_data(v->self)) / step;
 }
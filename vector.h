@@ -23,12 +23,28 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <string.h>
 
 /***** DEFINITIONS *****/
 
 #define VECTOR_MINIMUM_CAPACITY 2
 #define VECTOR_GROWTH_FACTOR 2
-#define VECTOR_SHRINK_THRESHOLD (1 / 4)
+/* Capacity shrinks once the size drops to 1 / VECTOR_SHRINK_THRESHOLD of it */
+#define VECTOR_SHRINK_THRESHOLD 4
+
+/* vector_release_memory drops the pages of buffers from this size on instead
+ * of reallocating them */
+#define VECTOR_MADVISE_THRESHOLD (128 << 10)
+
+/* Default granularity of dirty tracking */
+#define VECTOR_DIRTY_CHUNK_BYTES 4096
+
+/* Bulk operations give each thread at least this many bytes, use
+ * non-temporal stores from VECTOR_STREAM_THRESHOLD bytes on, and fill by
+ * repeating a block of this size */
+#define VECTOR_PARALLEL_THRESHOLD (1 << 20)
+#define VECTOR_STREAM_THRESHOLD (32 << 20)
+#define VECTOR_FILL_BLOCK 4096
 
 #define VECTOR_ERROR -1
 #define VECTOR_SUCCESS 0
@@ -44,6 +60,17 @@ typedef struct
   void *(*const _iter_pointer)(void *self);
   void *(*const _iter_next)(void *self);
   void *(*const _iter_prev)(void *self);
+  /* Optional: the distance in bytes between consecutive elements, for
+   * iterators that step through memory at a fixed stride (contiguous
+   * arrays, struct-of-arrays columns, strided views). Makes arithmetic O(1).
+   * Such an iterator's `self` must be the element's address, the same
+   * pointer _iter_pointer returns, since arithmetic moves and measures
+   * `self` directly. */
+  size_t (*const _iter_stride)(void);
+  /* Optional: O(1) arithmetic for layouts that are not strided. Without
+   * either hook, iterators fall back to repeated _iter_next/_iter_prev. */
+  void *(*const _iter_advance)(void *self, ptrdiff_t n);
+  ptrdiff_t (*const _iter_distance)(const void *first, const void *last);
 } IteratorTC;
 
 typedef struct {
@@ -66,6 +93,33 @@ typedef struct
   void *(*const _vec_offset_next)(void *offset);
   Iterator  (*const _vec_iterator)(void* self, size_t index);
   int (*const _vec_destroy)(void* self);
+  /* Optional: whether a buffer may be passed to free(). Types whose data can
+   * live in storage they did not malloc (slabs, caller buffers) provide it;
+   * NULL means every buffer is owned. */
+  bool (*const _vec_owns_data)(const void *self, const void *data);
+  /* Optional: whether the library may allocate a buffer for the vector at
+   * all. Types over fixed storage that must never touch the heap return
+   * false, so that growing past their capacity fails with VECTOR_ERROR.
+   * NULL means allocating is allowed. */
+  bool (*const _vec_can_allocate)(const void *self);
+  /* Optional: element lifecycle, for elements that own resources. Without
+   * these hooks elements are plain bytes.
+   * _vec_elem_copy deep-copies an element into uninitialized memory.
+   * _vec_elem_move moves one into uninitialized memory, leaving nothing
+   * behind to destroy. _vec_elem_destroy releases one.
+   * Insertion moves the caller's element into the vector; copies, snapshots
+   * that are written to and vector_fill copy; erasing, popping, clearing,
+   * shrinking and destroying destroy. Elements added by resizing are zeroed,
+   * so _vec_elem_destroy must accept an all-zero element. Paths that only
+   * move bytes (heaps, flat maps, pipeline collection, gathers and set
+   * operations) refuse the types they cannot handle. */
+  int (*const _vec_elem_copy)(void *destination, const void *source);
+  void (*const _vec_elem_move)(void *destination, void *source);
+  void (*const _vec_elem_destroy)(void *element);
+  /* Whether elements can be moved with memcpy even though _vec_elem_move is
+   * set, so that growth, insertion and erasure keep the realloc and memmove
+   * paths instead of moving element by element */
+  bool const _vec_trivially_relocatable;
 } VectorTC;
 
 typedef struct
@@ -74,6 +128,9 @@ typedef struct
   VectorTC const *tc;
 } Vector;
 
+/* Three-way comparison of two elements, as for qsort */
+typedef int (*VectorCompare)(const void *first, const void *second);
+
 
 /***** METHODS *****/
 
@@ -83,6 +140,13 @@ int vector_copy(Vector* destination, Vector* source);
 /* Copy Assignment */
 int vector_copy_assign(Vector* destination, Vector* source);
 
+/* Copy-on-write Snapshot
+ * Makes destination share the buffer of source instead of copying it. Any
+ * buffer destination already holds is released. Whichever side is mutated
+ * first (or handed out a mutable pointer by vector_get or an iterator) takes
+ * a private copy at that point; const access never copies. */
+int vector_snapshot(Vector* destination, Vector* source);
+
 /* Move Constructor */
 int vector_move(Vector* destination, Vector* source);
 
@@ -91,6 +155,25 @@ int vector_move_assign(Vector* destination, Vector* source);
 
 int vector_swap(Vector* destination, Vector* source);
 
+/* Moving between vectors
+ * vector_concat_move appends every element of source to destination and
+ * leaves source empty. When destination is empty, or would have to grow
+ * while source has room for both, it takes over the buffer of source and
+ * source gets the old one; otherwise the elements are appended in one go,
+ * with at most one reallocation.
+ *
+ * vector_splice moves elements [first, last) of source into destination
+ * before index: one move on each side and at most one reallocation of
+ * destination. Source keeps its capacity.
+ *
+ * Both need two distinct vectors of the same type. */
+int vector_concat_move(Vector* destination, Vector* source);
+int vector_splice(Vector* destination,
+                  size_t index,
+                  Vector* source,
+                  size_t first,
+                  size_t last);
+
 /* Destructor */
 int vector_destroy(Vector* vector);
 
@@ -111,23 +194,126 @@ void* vector_get(Vector* vector, size_t index);
 const void* vector_const_get(const Vector* vector, size_t index);
 void* vector_front(Vector* vector);
 void* vector_back(Vector* vector);
+void* vector_data(Vector* vector);
+const void* vector_const_data(const Vector* vector);
 #define VECTOR_GET_AS(type, vector_pointer, index) \
 	*((type*)vector_get((vector_pointer), (index)))
 
 /* Information */
 bool vector_is_initialized(const Vector* vector);
+bool vector_is_shared(const Vector* vector);
 size_t vector_byte_size(const Vector* vector);
 size_t vector_size(const Vector* vector);
 size_t vector_capacity(const Vector* vector);
 size_t vector_free_space(const Vector* vector);
 bool vector_is_empty(const Vector* vector);
 
+/* Unchecked access
+ * Inline counterparts of the lookup/insertion methods that skip every
+ * assertion and runtime check. The caller guarantees that the vector is
+ * initialized, that indices are in range and, for
+ * vector_push_back_unchecked, that capacity has been reserved beforehand.
+ * They do not break copy-on-write sharing either, so a snapshotted vector must
+ * go through vector_get or an insertion first. vector_push_back_unchecked
+ * moves the element as bytes, bypassing a non-trivial _vec_elem_move. */
+static inline size_t vector_size_fast(const Vector* vector)
+{
+	return vector->tc->_vec_size(vector->self);
+}
+
+static inline void* vector_get_unchecked(Vector* vector, size_t index)
+{
+	return vector->tc->_vec_offset(vector->self, index);
+}
+
+static inline void vector_push_back_unchecked(Vector* vector, void* element)
+{
+	size_t size = vector->tc->_vec_size(vector->self);
+
+	memcpy(vector->tc->_vec_offset(vector->self, size),
+				 element,
+				 vector->tc->_vec_elem_size());
+	vector->tc->_vec_set_size(vector->self, size + 1);
+}
+
 /* Memory management */
 int vector_resize(Vector* vector, size_t new_size);
 int vector_reserve(Vector* vector, size_t minimum_capacity);
 int vector_shrink_to_fit(Vector* vector);
 
+/* Returns the unused capacity past MAX(size, keep_capacity) to the system.
+ * Buffers of VECTOR_MADVISE_THRESHOLD bytes or more keep their capacity and
+ * have the pages of that tail dropped with madvise, to be faulted back in,
+ * zeroed, when the vector grows into them. Smaller buffers are reallocated.
+ * Shared buffers and buffers the vector does not own are left alone. */
+int vector_release_memory(Vector* vector, size_t keep_capacity);
+
+/* Idle trimming
+ * Tracked vectors carry a last-access time, refreshed by vector_touch and
+ * whenever vector_trim_all finds their size, capacity or buffer changed since
+ * it last looked. vector_trim_all releases the unused capacity of the coldest
+ * vectors until the total left is within budget_bytes and returns the bytes
+ * it released. It must not run concurrently with other operations on tracked
+ * vectors. */
+int vector_track_access(Vector* vector);
+int vector_untrack_access(Vector* vector);
+int vector_touch(Vector* vector);
+size_t vector_trim_all(size_t budget_bytes);
+
+/* Incremental persistence
+ * Once tracked, a vector records which chunks of `chunk_size` elements
+ * (0 picks VECTOR_DIRTY_CHUNK_BYTES worth) are written by assignment,
+ * insertion, erasure and resizing. vector_flush_dirty appends only those
+ * chunks to `fd` as a frame of a delta log: the element count and size, the
+ * number of ranges, then each range as its first index, its length and its
+ * bytes. The first flush after tracking starts (and after a swap, snapshot
+ * or copy) writes everything.
+ *
+ * Writes through vector_get, vector_data, iterators or the unchecked
+ * accessors are not seen; report them with vector_mark_dirty.
+ *
+ * vector_compact_dirty truncates `fd` and writes the whole vector as a
+ * single frame. For a log that is never left empty by a crash, compact into
+ * a new file and rename it over the old one.
+ *
+ * vector_replay_dirty applies every frame from the current position of `fd`
+ * to the vector, which fails on a frame that was cut short.
+ *
+ * Elements are logged and replayed as bytes, so types with lifecycle hooks
+ * cannot be persisted this way. */
+int vector_track_dirty(Vector* vector, size_t chunk_size);
+int vector_untrack_dirty(Vector* vector);
+int vector_mark_dirty(Vector* vector, size_t index, size_t count);
+size_t vector_dirty_size(const Vector* vector);
+int vector_flush_dirty(Vector* vector, int fd);
+int vector_compact_dirty(Vector* vector, int fd);
+int vector_replay_dirty(Vector* vector, int fd);
+
+/* Parallel bulk operations
+ * Split across `threads` threads (0 for one per online CPU), each taking a
+ * contiguous part of the buffer. A thread writes (and so first-touches) the
+ * pages of its own part, which on NUMA systems spreads a large vector
+ * across the nodes of the threads that made it.
+ *
+ * vector_copy_parallel is vector_copy with the copy split up.
+ * vector_fill writes `count` copies of element from `index` on, for any
+ * element size. vector_reserve_parallel_touch reallocates to at least
+ * minimum_capacity, copying the elements and faulting in the rest. */
+int vector_copy_parallel(Vector* destination, Vector* source, size_t threads);
+int vector_fill(Vector* vector,
+                size_t index,
+                size_t count,
+                const void* element,
+                size_t threads);
+int vector_reserve_parallel_touch(Vector* vector,
+                                  size_t minimum_capacity,
+                                  size_t threads);
+
 /* Iterators */
+/* Iterators hand out mutable pointers, so a snapshot takes its private copy
+ * here. If that copy fails, the iterator is { NULL, NULL }: iterator_get
+ * returns NULL, it equals any other such iterator (so VECTOR_FOR_EACH visits
+ * nothing), and iterator_erase returns VECTOR_ERROR. */
 Iterator vector_begin(Vector* vector);
 Iterator vector_end(Vector* vector);
 Iterator vector_iterator(Vector* vector, size_t index);
@@ -143,6 +329,11 @@ void iterator_decrement(Iterator* iterator);
 void* iterator_next(Iterator* iterator);
 void* iterator_previous(Iterator* iterator);
 
+/* Random access */
+void iterator_advance(Iterator* iterator, ptrdiff_t n);
+void* iterator_at(Iterator* iterator, ptrdiff_t n);
+ptrdiff_t iterator_distance(Iterator* first, Iterator* last);
+
 bool iterator_equals(Iterator* first, Iterator* second);
 bool iterator_is_before(Iterator* first, Iterator* second);
 bool iterator_is_after(Iterator* first, Iterator* second);
@@ -156,5 +347,6 @@ size_t iterator_index(Vector* vector, Iterator* iterator);
 			 iterator_increment(&(iterator_name)))
 
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
 
 #endif /* VECTOR_H */
@@ -0,0 +1,653 @@
+/* The MIT License (MIT)
+ * Copyright (c) 2016 Peter Goldsborough
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#ifndef VECTOR_HPP
+#define VECTOR_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdlib>
+#include <initializer_list>
+#include <memory>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+extern "C" {
+#include "vector.h"
+}
+
+namespace vec {
+
+/***** POLICIES *****/
+
+/* Growth policies return the capacity to move to when `needed` elements do
+ * not fit into `capacity`. The default grows like the C library. */
+struct grow_double
+{
+  static constexpr std::size_t next(std::size_t capacity,
+                                    std::size_t needed) noexcept
+  {
+    return std::max({needed,
+                     capacity * VECTOR_GROWTH_FACTOR,
+                     std::size_t{VECTOR_MINIMUM_CAPACITY}});
+  }
+};
+
+/* Grows by half, so blocks freed by earlier growth can be reused */
+struct grow_half
+{
+  static constexpr std::size_t next(std::size_t capacity,
+                                    std::size_t needed) noexcept
+  {
+    return std::max({needed,
+                     capacity + capacity / 2,
+                     std::size_t{VECTOR_MINIMUM_CAPACITY}});
+  }
+};
+
+/* Allocators hand out raw bytes. reallocate is only used for trivially
+ * relocatable elements and must accept a null pointer. Buffers of an
+ * allocator with `c_compatible` set come from malloc, so the C library may
+ * grow and free them. */
+struct malloc_allocator
+{
+  static constexpr bool c_compatible = true;
+
+  static void *allocate(std::size_t bytes) noexcept
+  {
+    return std::malloc(bytes);
+  }
+
+  static void *reallocate(void *data, std::size_t, std::size_t bytes) noexcept
+  {
+    return std::realloc(data, bytes);
+  }
+
+  static void deallocate(void *data, std::size_t) noexcept
+  {
+    std::free(data);
+  }
+};
+
+template <class Growth = grow_double, class Allocator = malloc_allocator>
+struct policy
+{
+  using growth = Growth;
+  using allocator = Allocator;
+};
+
+
+/***** TRAITS *****/
+
+/* Whether a T can be moved to a new address with memcpy, leaving nothing
+ * behind to destroy. Specialize it for types that are relocatable without
+ * being trivially copyable, such as most owning handles. */
+template <class T>
+struct is_trivially_relocatable : std::is_trivially_copyable<T> {};
+
+template <class T>
+inline constexpr bool is_trivially_relocatable_v =
+    is_trivially_relocatable<T>::value;
+
+namespace detail {
+
+inline int next_type_id() noexcept
+{
+  static std::atomic<int> id{1 << 16};
+  return id.fetch_add(1, std::memory_order_relaxed);
+}
+
+template <class Allocator, class = void>
+struct is_c_allocator : std::false_type {};
+
+template <class Allocator>
+struct is_c_allocator<Allocator, std::void_t<decltype(Allocator::c_compatible)>>
+    : std::bool_constant<Allocator::c_compatible> {};
+
+} // namespace detail
+
+/* The id `_vec_type` reports for vectors of T. The C library only copies,
+ * moves and swaps between vectors of the same type, so specialize this to
+ * share an id with a C type of the same layout. */
+template <class T>
+struct c_type_id
+{
+  static int value() noexcept
+  {
+    static int const id = detail::next_type_id();
+    return id;
+  }
+};
+
+
+/***** STRUCTURES *****/
+
+/* The layout of the typed structs the C library is used with */
+template <class T>
+struct layout
+{
+  std::size_t size;
+  std::size_t capacity;
+  T *data;
+};
+
+
+/***** PRIVATE *****/
+
+namespace detail {
+
+template <class T>
+layout<T> *raw(void *self) noexcept
+{
+  return static_cast<layout<T> *>(self);
+}
+
+template <class T>
+std::size_t elem_size() noexcept
+{
+  return sizeof(T);
+}
+
+template <class T>
+int type() noexcept
+{
+  return c_type_id<T>::value();
+}
+
+template <class T>
+std::size_t size(void *self) noexcept
+{
+  return raw<T>(self)->size;
+}
+
+template <class T>
+std::size_t capacity(void *self) noexcept
+{
+  return raw<T>(self)->capacity;
+}
+
+template <class T>
+void *data(void *self) noexcept
+{
+  return raw<T>(self)->data;
+}
+
+template <class T>
+void set_size(void *self, std::size_t size) noexcept
+{
+  raw<T>(self)->size = size;
+}
+
+template <class T>
+void set_capacity(void *self, std::size_t capacity) noexcept
+{
+  raw<T>(self)->capacity = capacity;
+}
+
+template <class T>
+void set_data(void *self, void *data) noexcept
+{
+  raw<T>(self)->data = static_cast<T *>(data);
+}
+
+template <class T>
+void *offset(void *self, std::size_t index) noexcept
+{
+  return raw<T>(self)->data + index;
+}
+
+template <class T>
+const void *const_offset(const void *self, std::size_t index) noexcept
+{
+  return static_cast<const layout<T> *>(self)->data + index;
+}
+
+template <class T>
+void *offset_next(void *offset) noexcept
+{
+  return static_cast<T *>(offset) + 1;
+}
+
+template <class T>
+void *iter_pointer(void *self) noexcept
+{
+  return self;
+}
+
+template <class T>
+void *iter_prev(void *self) noexcept
+{
+  return static_cast<T *>(self) - 1;
+}
+
+template <class T>
+inline constexpr IteratorTC iterator_tc = {
+  &type<T>,
+  &iter_pointer<T>,
+  &offset_next<T>,
+  &iter_prev<T>,
+  &elem_size<T>,
+  nullptr,
+  nullptr,
+};
+
+template <class T>
+Iterator iterator(void *self, std::size_t index) noexcept
+{
+  return Iterator{raw<T>(self)->data + index, &iterator_tc<T>};
+}
+
+/* The struct is embedded in a vec::vector, so only the buffer is freed */
+template <class T>
+int destroy(void *self) noexcept
+{
+  layout<T> *vector = raw<T>(self);
+
+  std::free(vector->data);
+  *vector = layout<T>{0, 0, nullptr};
+
+  return VECTOR_SUCCESS;
+}
+
+template <class T>
+inline constexpr VectorTC vector_tc = {
+  &elem_size<T>,
+  &type<T>,
+  &size<T>,
+  &capacity<T>,
+  &data<T>,
+  &set_size<T>,
+  &set_capacity<T>,
+  &set_data<T>,
+  &offset<T>,
+  &const_offset<T>,
+  &offset_next<T>,
+  &iterator<T>,
+  &destroy<T>,
+  nullptr, /* owns_data: the buffer is always malloc'ed */
+  nullptr, /* can_allocate */
+  /* Elements are handed to the C library as bytes, like the C types
+   * without hooks */
+  nullptr, /* elem_copy */
+  nullptr, /* elem_move */
+  nullptr, /* elem_destroy */
+  is_trivially_relocatable_v<T>,
+};
+
+} // namespace detail
+
+
+/***** CLASSES *****/
+
+/* A typed vector with the layout of the C structs (size, capacity, data), so
+ * the same object can be handed to the C library through c_vector().
+ * Iterators are raw pointers. Growth and allocation are fixed at compile
+ * time by the policy; trivially relocatable elements grow with a single
+ * reallocate instead of moving one by one. */
+template <class T, class Policy = policy<>>
+class vector
+{
+ public:
+  using value_type = T;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+  using reference = T &;
+  using const_reference = const T &;
+  using pointer = T *;
+  using const_pointer = const T *;
+  using iterator = T *;
+  using const_iterator = const T *;
+  using growth = typename Policy::growth;
+  using allocator = typename Policy::allocator;
+
+  /* Whether c_vector() is available. The C library copies elements with
+   * memcpy and frees buffers with free(). */
+  static constexpr bool c_compatible =
+      std::is_trivially_copyable_v<T> && detail::is_c_allocator<allocator>::value;
+
+  /* Constructors */
+  vector() noexcept : raw_{0, 0, nullptr} {}
+
+  explicit vector(size_type capacity) : vector()
+  {
+    reserve(capacity);
+  }
+
+  vector(std::initializer_list<T> elements) : vector()
+  {
+    _append(elements.begin(), elements.size());
+  }
+
+  vector(const vector &other) : vector()
+  {
+    _append(other.begin(), other.size());
+  }
+
+  vector(vector &&other) noexcept : raw_(other.raw_)
+  {
+    other.raw_ = layout<T>{0, 0, nullptr};
+  }
+
+  /* Copy and move assignment */
+  vector &operator=(vector other) noexcept
+  {
+    swap(other);
+    return *this;
+  }
+
+  /* Destructor
+   * C compatible vectors go through vector_destroy, which also releases any
+   * snapshot or dirty tracking the C library registered for them. */
+  ~vector()
+  {
+    if constexpr (c_compatible) {
+      Vector c = {&raw_, &detail::vector_tc<T>};
+      vector_destroy(&c);
+    } else {
+      if (raw_.data == nullptr) return;
+      std::destroy_n(raw_.data, raw_.size);
+      allocator::deallocate(raw_.data, raw_.capacity * sizeof(T));
+    }
+  }
+
+  void swap(vector &other) noexcept
+  {
+    std::swap(raw_, other.raw_);
+  }
+
+  /* Insertion */
+  template <class... Args>
+  T &emplace_back(Args &&...args)
+  {
+    if (raw_.size == raw_.capacity) {
+      return _emplace_back_grow(std::forward<Args>(args)...);
+    }
+
+    T *element = ::new (raw_.data + raw_.size) T(std::forward<Args>(args)...);
+    ++raw_.size;
+
+    return *element;
+  }
+
+  void push_back(const T &element)
+  {
+    emplace_back(element);
+  }
+
+  void push_back(T &&element)
+  {
+    emplace_back(std::move(element));
+  }
+
+  /* Deletion */
+  void pop_back() noexcept
+  {
+    assert(!empty());
+    std::destroy_at(raw_.data + --raw_.size);
+  }
+
+  void clear() noexcept
+  {
+    std::destroy_n(raw_.data, raw_.size);
+    raw_.size = 0;
+  }
+
+  /* Lookup */
+  T &operator[](size_type index) noexcept
+  {
+    assert(index < raw_.size);
+    return raw_.data[index];
+  }
+
+  const T &operator[](size_type index) const noexcept
+  {
+    assert(index < raw_.size);
+    return raw_.data[index];
+  }
+
+  T &at(size_type index)
+  {
+    if (index >= raw_.size) throw std::out_of_range("vec::vector::at");
+    return raw_.data[index];
+  }
+
+  const T &at(size_type index) const
+  {
+    if (index >= raw_.size) throw std::out_of_range("vec::vector::at");
+    return raw_.data[index];
+  }
+
+  T &front() noexcept { return (*this)[0]; }
+  const T &front() const noexcept { return (*this)[0]; }
+  T &back() noexcept { return (*this)[raw_.size - 1]; }
+  const T &back() const noexcept { return (*this)[raw_.size - 1]; }
+
+  T *data() noexcept { return raw_.data; }
+  const T *data() const noexcept { return raw_.data; }
+
+  /* Information */
+  size_type size() const noexcept { return raw_.size; }
+  size_type capacity() const noexcept { return raw_.capacity; }
+  bool empty() const noexcept { return raw_.size == 0; }
+
+  /* Memory management */
+  void reserve(size_type minimum_capacity)
+  {
+    if (minimum_capacity > raw_.capacity) _reallocate(minimum_capacity);
+  }
+
+  void resize(size_type new_size)
+  {
+    _resize(new_size, [](T *element) { ::new (element) T(); });
+  }
+
+  void resize(size_type new_size, const T &value)
+  {
+    _resize(new_size, [&value](T *element) { ::new (element) T(value); });
+  }
+
+  void shrink_to_fit()
+  {
+    if (raw_.size == raw_.capacity) return;
+
+    if (raw_.size == 0) {
+      allocator::deallocate(raw_.data, raw_.capacity * sizeof(T));
+      raw_ = layout<T>{0, 0, nullptr};
+    } else {
+      _reallocate(raw_.size);
+    }
+  }
+
+  /* Iterators */
+  T *begin() noexcept { return raw_.data; }
+  T *end() noexcept { return raw_.data + raw_.size; }
+  const T *begin() const noexcept { return raw_.data; }
+  const T *end() const noexcept { return raw_.data + raw_.size; }
+  const T *cbegin() const noexcept { return begin(); }
+  const T *cend() const noexcept { return end(); }
+
+  /* Views */
+  std::span<T> span() noexcept { return {raw_.data, raw_.size}; }
+  std::span<const T> span() const noexcept { return {raw_.data, raw_.size}; }
+
+  operator std::span<T>() noexcept { return span(); }
+  operator std::span<const T>() const noexcept { return span(); }
+
+  /* Interop
+   * The vector as a C `Vector` over the same fields, so changes made by
+   * either side are seen by the other. Writes through the wrapper bypass
+   * copy-on-write and dirty tracking; use the C functions for vectors that
+   * take part in either. The view must not outlive the wrapper. Like the
+   * C constructors, this makes sure there is a buffer. */
+  Vector c_vector() requires c_compatible
+  {
+    if (raw_.data == nullptr) reserve(VECTOR_MINIMUM_CAPACITY);
+    return Vector{&raw_, &detail::vector_tc<T>};
+  }
+
+ private:
+  template <class... Args>
+  __attribute__((noinline)) T &_emplace_back_grow(Args &&...args)
+  {
+    /* The arguments may refer into the buffer that is about to move */
+    T element(std::forward<Args>(args)...);
+
+    _reallocate(growth::next(raw_.capacity, raw_.size + 1));
+
+    T *slot = ::new (raw_.data + raw_.size) T(std::move(element));
+    ++raw_.size;
+
+    return *slot;
+  }
+
+  void _append(const T *first, size_type count)
+  {
+    reserve(raw_.size + count);
+    std::uninitialized_copy_n(first, count, raw_.data + raw_.size);
+    raw_.size += count;
+  }
+
+  template <class Construct>
+  void _resize(size_type new_size, Construct construct)
+  {
+    if (new_size > raw_.capacity) {
+      _reallocate(growth::next(raw_.capacity, new_size));
+    }
+
+    for (; raw_.size < new_size; ++raw_.size) construct(raw_.data + raw_.size);
+
+    if (new_size < raw_.size) {
+      std::destroy(raw_.data + new_size, raw_.data + raw_.size);
+      raw_.size = new_size;
+    }
+  }
+
+  void _reallocate(size_type capacity)
+  {
+    T *data;
+
+    if constexpr (is_trivially_relocatable_v<T>) {
+      data = static_cast<T *>(allocator::reallocate(raw_.data,
+                                                    raw_.capacity * sizeof(T),
+                                                    capacity * sizeof(T)));
+      if (data == nullptr) throw std::bad_alloc();
+    } else {
+      data = static_cast<T *>(allocator::allocate(capacity * sizeof(T)));
+      if (data == nullptr) throw std::bad_alloc();
+
+      size_type moved = 0;
+      try {
+        for (; moved < raw_.size; ++moved) {
+          ::new (data + moved) T(std::move_if_noexcept(raw_.data[moved]));
+        }
+      } catch (...) {
+        std::destroy_n(data, moved);
+        allocator::deallocate(data, capacity * sizeof(T));
+        throw;
+      }
+
+      std::destroy_n(raw_.data, raw_.size);
+      allocator::deallocate(raw_.data, raw_.capacity * sizeof(T));
+    }
+
+    raw_.data = data;
+    raw_.capacity = capacity;
+  }
+
+  layout<T> raw_;
+};
+
+template <class T, class Policy>
+void swap(vector<T, Policy> &first, vector<T, Policy> &second) noexcept
+{
+  first.swap(second);
+}
+
+/* Owns a `Vector` built by a C constructor such as doubles_vector_setup and
+ * destroys it with vector_destroy */
+class handle
+{
+ public:
+  handle() noexcept : vector_{nullptr, nullptr} {}
+  explicit handle(Vector vector) noexcept : vector_(vector) {}
+
+  handle(handle &&other) noexcept : vector_(other.release()) {}
+
+  handle &operator=(handle &&other) noexcept
+  {
+    if (this != &other) reset(other.release());
+    return *this;
+  }
+
+  handle(const handle &) = delete;
+  handle &operator=(const handle &) = delete;
+
+  ~handle()
+  {
+    reset();
+  }
+
+  void reset(Vector vector = Vector{nullptr, nullptr}) noexcept
+  {
+    if (vector_.self != nullptr) vector_destroy(&vector_);
+    vector_ = vector;
+  }
+
+  Vector release() noexcept
+  {
+    Vector vector = vector_;
+    vector_ = Vector{nullptr, nullptr};
+    return vector;
+  }
+
+  Vector *get() noexcept { return &vector_; }
+  const Vector *get() const noexcept { return &vector_; }
+
+  explicit operator bool() const noexcept { return vector_.self != nullptr; }
+
+  /* The elements viewed as T, which must match the element type. A mutable
+   * view takes a private copy of a shared buffer first. */
+  template <class T>
+  std::span<T> span() noexcept
+  {
+    assert(vector_.tc->_vec_elem_size() == sizeof(T));
+    return {static_cast<T *>(vector_data(&vector_)), vector_size(&vector_)};
+  }
+
+  template <class T>
+  std::span<const T> span() const noexcept
+  {
+    assert(vector_.tc->_vec_elem_size() == sizeof(T));
+    return {static_cast<const T *>(vector_const_data(&vector_)),
+            vector_size(&vector_)};
+  }
+
+ private:
+  Vector vector_;
+};
+
+} // namespace vec
+
+#endif /* VECTOR_HPP */
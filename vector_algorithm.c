@@ -0,0 +1,1639 @@
+/* The MIT License (MIT)
+ * Copyright (c) 2016 Peter Goldsborough
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* x86 builds carry AVX2 search kernels that are picked at runtime */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define VECTOR_ALGORITHM_X86
+#include <immintrin.h>
+#endif
+
+#include "vector_algorithm.h"
+#include "vector_private.h"
+
+/***** DEFINITIONS *****/
+
+#define VECTOR_HEAP_ARITY 4
+
+/* Elements up to this size are held on the stack while sifting */
+#define VECTOR_SCRATCH_SIZE 64
+
+/* Gathers and scatters over a source of at least this many bytes, which
+ * will not stay in cache, prefetch the element VECTOR_PREFETCH_DISTANCE
+ * indices ahead */
+#define VECTOR_PREFETCH_BYTES (1 << 20)
+#define VECTOR_PREFETCH_DISTANCE 16
+
+/* Marks an index of a permutation as visited while it is being applied */
+#define VECTOR_PERMUTE_SEEN ((size_t)1 << (sizeof(size_t) * 8 - 1))
+
+/* Set operations gallop through the larger input once it has this many
+ * times the elements of the smaller one */
+#define VECTOR_GALLOP_RATIO 16
+
+/* xxHash64 primes */
+#define VECTOR_HASH_PRIME_1 0x9E3779B185EBCA87ULL
+#define VECTOR_HASH_PRIME_2 0xC2B2AE3D27D4EB4FULL
+#define VECTOR_HASH_PRIME_3 0x165667B19E3779F9ULL
+#define VECTOR_HASH_PRIME_4 0x85EBCA77C2B2AE63ULL
+#define VECTOR_HASH_PRIME_5 0x27D4EB2F165667C5ULL
+
+
+/***** PRIVATE *****/
+
+/* Suitably aligned room for one element, so comparators may cast it */
+typedef union {
+	long double alignment_long_double;
+	long long alignment_long_long;
+	void *alignment_pointer;
+	unsigned char bytes[VECTOR_SCRATCH_SIZE];
+} _VecScratch;
+
+typedef enum {
+	_VEC_KERNEL_GENERIC,
+	_VEC_KERNEL_DOUBLE,
+	_VEC_KERNEL_INT64
+} _VecKernel;
+
+/* Picks a typed kernel when the comparator is one of ours */
+_VecKernel _vec_kernel(const Vector *v, VectorCompare compare)
+{
+	size_t elem_size = v->tc->_vec_elem_size();
+
+	if (compare == vector_compare_double && elem_size == sizeof(double)) {
+		return _VEC_KERNEL_DOUBLE;
+	}
+	if (compare == vector_compare_int64 && elem_size == sizeof(int64_t)) {
+		return _VEC_KERNEL_INT64;
+	}
+
+	return _VEC_KERNEL_GENERIC;
+}
+
+void* _vec_scratch_acquire(_VecScratch *local, size_t elem_size)
+{
+	return elem_size <= sizeof(local->bytes) ? local->bytes : malloc(elem_size);
+}
+
+void _vec_scratch_release(_VecScratch *local, void *scratch)
+{
+	if (scratch != local->bytes) free(scratch);
+}
+
+/* Heap kernels */
+
+#define VECTOR_HEAP_KERNELS(suffix, type)                                 \
+	static void _vec_heap_sift_up_##suffix(type *data, size_t index)        \
+	{                                                                       \
+		type value = data[index];                                             \
+		size_t parent;                                                        \
+                                                                          \
+		while (index > 0) {                                                   \
+			parent = (index - 1) / VECTOR_HEAP_ARITY;                           \
+			if (!(value < data[parent])) break;                                 \
+			data[index] = data[parent];                                         \
+			index = parent;                                                     \
+		}                                                                     \
+                                                                          \
+		data[index] = value;                                                  \
+	}                                                                       \
+                                                                          \
+	static void _vec_heap_sift_down_##suffix(type *data,                    \
+	                                         size_t size,                   \
+	                                         size_t index)                  \
+	{                                                                       \
+		type value = data[index];                                             \
+		size_t child, best, c;                                                \
+                                                                          \
+		while ((child = index * VECTOR_HEAP_ARITY + 1) < size) {              \
+			if (child + VECTOR_HEAP_ARITY <= size) {                            \
+				/* Pairwise, so the compiler can select without branching */      \
+				best = child + (data[child + 1] < data[child]);                   \
+				c = child + 2 + (data[child + 3] < data[child + 2]);               \
+				best = data[c] < data[best] ? c : best;                           \
+			} else {                                                            \
+				best = child;                                                     \
+				for (c = child + 1; c < size; ++c) {                              \
+					if (data[c] < data[best]) best = c;                             \
+				}                                                                 \
+			}                                                                   \
+			if (!(data[best] < value)) break;                                   \
+			data[index] = data[best];                                           \
+			index = best;                                                       \
+		}                                                                     \
+                                                                          \
+		data[index] = value;                                                  \
+	}
+
+VECTOR_HEAP_KERNELS(double, double)
+VECTOR_HEAP_KERNELS(int64, int64_t)
+
+#undef VECTOR_HEAP_KERNELS
+
+void _vec_heap_sift_up(char *data,
+                       size_t elem_size,
+                       size_t index,
+                       VectorCompare compare,
+                       void *value)
+{
+	size_t parent;
+
+	memcpy(value, data + index * elem_size, elem_size);
+
+	while (index > 0) {
+		parent = (index - 1) / VECTOR_HEAP_ARITY;
+		if (compare(value, data + parent * elem_size) >= 0) break;
+		memcpy(data + index * elem_size, data + parent * elem_size, elem_size);
+		index = parent;
+	}
+
+	memcpy(data + index * elem_size, value, elem_size);
+}
+
+void _vec_heap_sift_down(char *data,
+                         size_t elem_size,
+                         size_t size,
+                         size_t index,
+                         VectorCompare compare,
+                         void *value)
+{
+	size_t child, best, last, c;
+
+	memcpy(value, data + index * elem_size, elem_size);
+
+	while ((child = index * VECTOR_HEAP_ARITY + 1) < size) {
+		best = child;
+		last = MIN(child + VECTOR_HEAP_ARITY, size);
+		for (c = child + 1; c < last; ++c) {
+			if (compare(data + c * elem_size, data + best * elem_size) < 0) {
+				best = c;
+			}
+		}
+		if (compare(data + best * elem_size, value) >= 0) break;
+		memcpy(data + index * elem_size, data + best * elem_size, elem_size);
+		index = best;
+	}
+
+	memcpy(data + index * elem_size, value, elem_size);
+}
+
+/* Dispatches a sift to the kernel for the element type */
+int _vec_heap_sift(Vector *v,
+                   size_t size,
+                   size_t index,
+                   bool up,
+                   VectorCompare compare)
+{
+	size_t elem_size = v->tc->_vec_elem_size();
+	_VecScratch local;
+	void *data, *scratch;
+
+	data = vector_data(v);
+	if (data == NULL) return VECTOR_ERROR;
+
+	switch (_vec_kernel(v, compare)) {
+		case _VEC_KERNEL_DOUBLE:
+			if (up) {
+				_vec_heap_sift_up_double(data, index);
+			} else {
+				_vec_heap_sift_down_double(data, size, index);
+			}
+			return VECTOR_SUCCESS;
+		case _VEC_KERNEL_INT64:
+			if (up) {
+				_vec_heap_sift_up_int64(data, index);
+			} else {
+				_vec_heap_sift_down_int64(data, size, index);
+			}
+			return VECTOR_SUCCESS;
+		case _VEC_KERNEL_GENERIC:
+			break;
+	}
+
+	scratch = _vec_scratch_acquire(&local, elem_size);
+	if (scratch == NULL) return VECTOR_ERROR;
+
+	if (up) {
+		_vec_heap_sift_up(data, elem_size, index, compare, scratch);
+	} else {
+		_vec_heap_sift_down(data, elem_size, size, index, compare, scratch);
+	}
+
+	_vec_scratch_release(&local, scratch);
+
+	return VECTOR_SUCCESS;
+}
+
+/* Search kernels
+ * For each element width: a scalar loop (which compilers vectorize with
+ * whatever the baseline ISA offers), an AVX2 loop comparing 32 bytes at a
+ * time, and a dispatcher. find returns `count` when nothing matches. */
+
+#ifdef VECTOR_ALGORITHM_X86
+#define VECTOR_SEARCH_AVX2(bits, type, set1, cmpeq)                         \
+	__attribute__((target("avx2")))                                         \
+	static size_t _vec_find_avx2_##bits(const type *data,                   \
+	                                    size_t count,                       \
+	                                    type value)                         \
+	{                                                                       \
+		const __m256i needle = set1(value);                                   \
+		const size_t lanes = sizeof(__m256i) / sizeof(type);                  \
+		size_t i;                                                             \
+		int mask;                                                             \
+                                                                          \
+		for (i = 0; i + lanes <= count; i += lanes) {                         \
+			mask = _mm256_movemask_epi8(                                        \
+          cmpeq(_mm256_loadu_si256((const __m256i*)(data + i)), needle)); \
+			if (mask != 0) {                                                    \
+				return i + (size_t)__builtin_ctz((unsigned)mask) / sizeof(type);  \
+			}                                                                   \
+		}                                                                     \
+                                                                          \
+		for (; i < count; ++i) {                                              \
+			if (data[i] == value) return i;                                     \
+		}                                                                     \
+                                                                          \
+		return count;                                                         \
+	}                                                                       \
+                                                                          \
+	__attribute__((target("avx2,popcnt")))                                  \
+	static size_t _vec_count_avx2_##bits(const type *data,                  \
+	                                     size_t count,                      \
+	                                     type value)                        \
+	{                                                                       \
+		const __m256i needle = set1(value);                                   \
+		const size_t lanes = sizeof(__m256i) / sizeof(type);                  \
+		size_t i, total = 0;                                                  \
+		int mask;                                                             \
+                                                                          \
+		for (i = 0; i + lanes <= count; i += lanes) {                         \
+			mask = _mm256_movemask_epi8(                                        \
+          cmpeq(_mm256_loadu_si256((const __m256i*)(data + i)), needle)); \
+			total += (size_t)__builtin_popcount((unsigned)mask);                \
+		}                                                                     \
+		total /= sizeof(type);                                                \
+                                                                          \
+		for (; i < count; ++i) total += data[i] == value;                     \
+                                                                          \
+		return total;                                                         \
+	}
+#else
+#define VECTOR_SEARCH_AVX2(bits, type, set1, cmpeq)
+#endif
+
+#ifdef VECTOR_ALGORITHM_X86
+#define VECTOR_SEARCH_DISPATCH(bits, kind, data, count, value)              \
+	if (__builtin_cpu_supports("avx2")) {                                   \
+		return _vec_##kind##_avx2_##bits(data, count, value);                 \
+	}
+#else
+#define VECTOR_SEARCH_DISPATCH(bits, kind, data, count, value)
+#endif
+
+#define VECTOR_SEARCH_KERNELS(bits, type, set1, cmpeq)                      \
+	VECTOR_SEARCH_AVX2(bits, type, set1, cmpeq)                             \
+                                                                          \
+	static size_t _vec_find_##bits(const void *elements,                    \
+	                               size_t count,                            \
+	                               const void *element)                     \
+	{                                                                       \
+		const type *data = elements;                                          \
+		type value;                                                           \
+		size_t i;                                                             \
+                                                                          \
+		memcpy(&value, element, sizeof(type));                                \
+		VECTOR_SEARCH_DISPATCH(bits, find, data, count, value)                \
+                                                                          \
+		for (i = 0; i < count; ++i) {                                         \
+			if (data[i] == value) return i;                                     \
+		}                                                                     \
+                                                                          \
+		return count;                                                         \
+	}                                                                       \
+                                                                          \
+	static size_t _vec_count_##bits(const void *elements,                   \
+	                                size_t count,                           \
+	                                const void *element)                    \
+	{                                                                       \
+		const type *data = elements;                                          \
+		size_t i, total = 0;                                                  \
+		type value;                                                           \
+                                                                          \
+		memcpy(&value, element, sizeof(type));                                \
+		VECTOR_SEARCH_DISPATCH(bits, count, data, count, value)               \
+                                                                          \
+		for (i = 0; i < count; ++i) total += data[i] == value;                \
+                                                                          \
+		return total;                                                         \
+	}
+
+VECTOR_SEARCH_KERNELS(8, uint8_t, _mm256_set1_epi8, _mm256_cmpeq_epi8)
+VECTOR_SEARCH_KERNELS(16, uint16_t, _mm256_set1_epi16, _mm256_cmpeq_epi16)
+VECTOR_SEARCH_KERNELS(32, uint32_t, _mm256_set1_epi32, _mm256_cmpeq_epi32)
+VECTOR_SEARCH_KERNELS(64, uint64_t, _mm256_set1_epi64x, _mm256_cmpeq_epi64)
+
+#undef VECTOR_SEARCH_KERNELS
+#undef VECTOR_SEARCH_DISPATCH
+#undef VECTOR_SEARCH_AVX2
+
+size_t _vec_find_bytes(const void *elements,
+                       size_t count,
+                       size_t elem_size,
+                       const void *element)
+{
+	const char *data = elements;
+	size_t i;
+
+	switch (elem_size) {
+		case 1: return _vec_find_8(elements, count, element);
+		case 2: return _vec_find_16(elements, count, element);
+		case 4: return _vec_find_32(elements, count, element);
+		case 8: return _vec_find_64(elements, count, element);
+	}
+
+	for (i = 0; i < count; ++i, data += elem_size) {
+		if (memcmp(data, element, elem_size) == 0) return i;
+	}
+
+	return count;
+}
+
+size_t _vec_count_bytes(const void *elements,
+                        size_t count,
+                        size_t elem_size,
+                        const void *element)
+{
+	const char *data = elements;
+	size_t i, total = 0;
+
+	switch (elem_size) {
+		case 1: return _vec_count_8(elements, count, element);
+		case 2: return _vec_count_16(elements, count, element);
+		case 4: return _vec_count_32(elements, count, element);
+		case 8: return _vec_count_64(elements, count, element);
+	}
+
+	for (i = 0; i < count; ++i, data += elem_size) {
+		total += memcmp(data, element, elem_size) == 0;
+	}
+
+	return total;
+}
+
+/* Equality for unique: the comparator, else bytes, with 8-byte elements
+ * compared as one word */
+bool _vec_equal(const void *first,
+                const void *second,
+                size_t elem_size,
+                VectorCompare compare)
+{
+	uint64_t a, b;
+
+	if (compare != NULL) return compare(first, second) == 0;
+
+	if (elem_size == sizeof(uint64_t)) {
+		memcpy(&a, first, sizeof a);
+		memcpy(&b, second, sizeof b);
+		return a == b;
+	}
+
+	return memcmp(first, second, elem_size) == 0;
+}
+
+/* Hashing */
+
+static inline uint64_t _vec_rotate_left(uint64_t value, int bits)
+{
+	return (value << bits) | (value >> (64 - bits));
+}
+
+static inline uint64_t _vec_read_64(const unsigned char *bytes)
+{
+	uint64_t value;
+	memcpy(&value, bytes, sizeof value);
+	return value;
+}
+
+static inline uint64_t _vec_hash_round(uint64_t accumulator, uint64_t input)
+{
+	accumulator += input * VECTOR_HASH_PRIME_2;
+	accumulator = _vec_rotate_left(accumulator, 31);
+	return accumulator * VECTOR_HASH_PRIME_1;
+}
+
+static inline uint64_t _vec_hash_merge(uint64_t hash, uint64_t lane)
+{
+	hash ^= _vec_hash_round(0, lane);
+	return hash * VECTOR_HASH_PRIME_1 + VECTOR_HASH_PRIME_4;
+}
+
+/* xxHash64 with seed 0: four independent lanes over 32-byte stripes, then
+ * the tail and a final avalanche */
+uint64_t _vec_hash_bytes(const unsigned char *bytes, size_t length)
+{
+	const unsigned char *end = bytes + length;
+	uint64_t hash, lanes[4];
+	uint32_t word;
+
+	if (length >= 32) {
+		lanes[0] = VECTOR_HASH_PRIME_1 + VECTOR_HASH_PRIME_2;
+		lanes[1] = VECTOR_HASH_PRIME_2;
+		lanes[2] = 0;
+		lanes[3] = 0 - VECTOR_HASH_PRIME_1;
+
+		for (; end - bytes >= 32; bytes += 32) {
+			lanes[0] = _vec_hash_round(lanes[0], _vec_read_64(bytes));
+			lanes[1] = _vec_hash_round(lanes[1], _vec_read_64(bytes + 8));
+			lanes[2] = _vec_hash_round(lanes[2], _vec_read_64(bytes + 16));
+			lanes[3] = _vec_hash_round(lanes[3], _vec_read_64(bytes + 24));
+		}
+
+		hash = _vec_rotate_left(lanes[0], 1) + _vec_rotate_left(lanes[1], 7) +
+			_vec_rotate_left(lanes[2], 12) + _vec_rotate_left(lanes[3], 18);
+		hash = _vec_hash_merge(hash, lanes[0]);
+		hash = _vec_hash_merge(hash, lanes[1]);
+		hash = _vec_hash_merge(hash, lanes[2]);
+		hash = _vec_hash_merge(hash, lanes[3]);
+	} else {
+		hash = VECTOR_HASH_PRIME_5;
+	}
+
+	hash += length;
+
+	for (; end - bytes >= 8; bytes += 8) {
+		hash ^= _vec_hash_round(0, _vec_read_64(bytes));
+		hash = _vec_rotate_left(hash, 27) * VECTOR_HASH_PRIME_1 +
+			VECTOR_HASH_PRIME_4;
+	}
+
+	if (end - bytes >= 4) {
+		memcpy(&word, bytes, sizeof word);
+		hash ^= (uint64_t)word * VECTOR_HASH_PRIME_1;
+		hash = _vec_rotate_left(hash, 23) * VECTOR_HASH_PRIME_2 +
+			VECTOR_HASH_PRIME_3;
+		bytes += 4;
+	}
+
+	for (; bytes < end; ++bytes) {
+		hash ^= *bytes * VECTOR_HASH_PRIME_5;
+		hash = _vec_rotate_left(hash, 11) * VECTOR_HASH_PRIME_1;
+	}
+
+	hash ^= hash >> 33;
+	hash *= VECTOR_HASH_PRIME_2;
+	hash ^= hash >> 29;
+	hash *= VECTOR_HASH_PRIME_3;
+	hash ^= hash >> 32;
+
+	return hash;
+}
+
+
+/* Reordering kernels
+ * For each element width: a scalar loop that prefetches when asked to, and
+ * for 4 and 8-byte elements an AVX2 gather of four indices at a time. Other
+ * widths are moved with memcpy. */
+
+#ifdef VECTOR_ALGORITHM_X86
+__attribute__((target("avx2")))
+static void _vec_gather_avx2_32(uint32_t *destination,
+                                const uint32_t *source,
+                                const size_t *indices,
+                                size_t count)
+{
+	__m256i index;
+	size_t i;
+
+	for (i = 0; i + 4 <= count; i += 4) {
+		index = _mm256_loadu_si256((const __m256i*)(indices + i));
+		_mm_storeu_si128((__m128i*)(destination + i),
+										 _mm256_i64gather_epi32((const int*)source, index, 4));
+	}
+
+	for (; i < count; ++i) destination[i] = source[indices[i]];
+}
+
+__attribute__((target("avx2")))
+static void _vec_gather_avx2_64(uint64_t *destination,
+                                const uint64_t *source,
+                                const size_t *indices,
+                                size_t count)
+{
+	__m256i index;
+	size_t i;
+
+	for (i = 0; i + 4 <= count; i += 4) {
+		index = _mm256_loadu_si256((const __m256i*)(indices + i));
+		_mm256_storeu_si256(
+        (__m256i*)(destination + i),
+        _mm256_i64gather_epi64((const long long*)source, index, 8));
+	}
+
+	for (; i < count; ++i) destination[i] = source[indices[i]];
+}
+#endif
+
+#define VECTOR_REORDER_KERNELS(bits, type)                                  \
+	static void _vec_gather_##bits(type *destination,                       \
+	                               const type *source,                      \
+	                               const size_t *indices,                   \
+	                               size_t count,                            \
+	                               bool prefetch)                           \
+	{                                                                       \
+		size_t i = 0;                                                         \
+                                                                          \
+		if (prefetch) {                                                       \
+			for (; i + VECTOR_PREFETCH_DISTANCE < count; ++i) {                 \
+				__builtin_prefetch(source + indices[i + VECTOR_PREFETCH_DISTANCE]); \
+				destination[i] = source[indices[i]];                              \
+			}                                                                   \
+		}                                                                     \
+                                                                          \
+		for (; i < count; ++i) destination[i] = source[indices[i]];           \
+	}                                                                       \
+                                                                          \
+	static void _vec_scatter_##bits(type *destination,                      \
+	                                const type *source,                     \
+	                                const size_t *indices,                  \
+	                                size_t count,                           \
+	                                bool prefetch)                          \
+	{                                                                       \
+		size_t i = 0;                                                         \
+                                                                          \
+		if (prefetch) {                                                       \
+			for (; i + VECTOR_PREFETCH_DISTANCE < count; ++i) {                 \
+				__builtin_prefetch(                                               \
+            destination + indices[i + VECTOR_PREFETCH_DISTANCE], 1);      \
+				destination[indices[i]] = source[i];                              \
+			}                                                                   \
+		}                                                                     \
+                                                                          \
+		for (; i < count; ++i) destination[indices[i]] = source[i];           \
+	}
+
+VECTOR_REORDER_KERNELS(8, uint8_t)
+VECTOR_REORDER_KERNELS(16, uint16_t)
+VECTOR_REORDER_KERNELS(32, uint32_t)
+VECTOR_REORDER_KERNELS(64, uint64_t)
+
+#undef VECTOR_REORDER_KERNELS
+
+void _vec_gather_bytes(void *destination,
+                       const void *source,
+                       const size_t *indices,
+                       size_t count,
+                       size_t elem_size,
+                       bool prefetch)
+{
+	const char *from = source;
+	char *to = destination;
+	size_t i;
+
+	switch (elem_size) {
+		case 1:
+			_vec_gather_8(destination, source, indices, count, prefetch);
+			return;
+		case 2:
+			_vec_gather_16(destination, source, indices, count, prefetch);
+			return;
+		case 4:
+#ifdef VECTOR_ALGORITHM_X86
+			/* The hardware gather waits on each cache miss in turn, so sources
+			 * too large for the cache are left to the prefetching loop */
+			if (!prefetch && __builtin_cpu_supports("avx2")) {
+				_vec_gather_avx2_32(destination, source, indices, count);
+				return;
+			}
+#endif
+			_vec_gather_32(destination, source, indices, count, prefetch);
+			return;
+		case 8:
+#ifdef VECTOR_ALGORITHM_X86
+			if (!prefetch && __builtin_cpu_supports("avx2")) {
+				_vec_gather_avx2_64(destination, source, indices, count);
+				return;
+			}
+#endif
+			_vec_gather_64(destination, source, indices, count, prefetch);
+			return;
+	}
+
+	for (i = 0; i < count; ++i, to += elem_size) {
+		if (prefetch && i + VECTOR_PREFETCH_DISTANCE < count) {
+			__builtin_prefetch(from +
+                         indices[i + VECTOR_PREFETCH_DISTANCE] * elem_size);
+		}
+		memcpy(to, from + indices[i] * elem_size, elem_size);
+	}
+}
+
+void _vec_scatter_bytes(void *destination,
+                        const void *source,
+                        const size_t *indices,
+                        size_t count,
+                        size_t elem_size,
+                        bool prefetch)
+{
+	const char *from = source;
+	char *to = destination;
+	size_t i;
+
+	switch (elem_size) {
+		case 1:
+			_vec_scatter_8(destination, source, indices, count, prefetch);
+			return;
+		case 2:
+			_vec_scatter_16(destination, source, indices, count, prefetch);
+			return;
+		case 4:
+			_vec_scatter_32(destination, source, indices, count, prefetch);
+			return;
+		case 8:
+			_vec_scatter_64(destination, source, indices, count, prefetch);
+			return;
+	}
+
+	for (i = 0; i < count; ++i, from += elem_size) {
+		if (prefetch && i + VECTOR_PREFETCH_DISTANCE < count) {
+			__builtin_prefetch(
+          to + indices[i + VECTOR_PREFETCH_DISTANCE] * elem_size, 1);
+		}
+		memcpy(to + indices[i] * elem_size, from, elem_size);
+	}
+}
+
+/* Whether every index is below `bound` */
+bool _vec_indices_below(const size_t *indices, size_t count, size_t bound)
+{
+	size_t i, largest = 0;
+
+	for (i = 0; i < count; ++i) largest = MAX(largest, indices[i]);
+
+	return count == 0 || largest < bound;
+}
+
+/* Whether `perm` holds every index below `count` exactly once. The check
+ * borrows the top bit of each entry to mark its index as taken, so it needs
+ * no memory of its own; the entries are left as they were. */
+bool _vec_is_permutation(size_t *perm, size_t count)
+{
+	size_t i, index;
+	bool valid = true;
+
+	for (i = 0; i < count; ++i) {
+		index = perm[i] & ~VECTOR_PERMUTE_SEEN;
+		if (index >= count || (perm[index] & VECTOR_PERMUTE_SEEN)) {
+			valid = false;
+			break;
+		}
+		perm[index] |= VECTOR_PERMUTE_SEEN;
+	}
+
+	for (i = 0; i < count; ++i) perm[i] &= ~VECTOR_PERMUTE_SEEN;
+
+	return valid;
+}
+
+/* Applies data[i] = data[perm[i]] one cycle at a time, holding a single
+ * element aside. Entries of `perm` are marked as their slot is filled and
+ * restored at the end. */
+void _vec_permute_cycles(char *data,
+                         size_t *perm,
+                         size_t count,
+                         size_t elem_size,
+                         void *held)
+{
+	size_t start, slot, next;
+
+	for (start = 0; start < count; ++start) {
+		if (perm[start] & VECTOR_PERMUTE_SEEN) continue;
+
+		memcpy(held, data + start * elem_size, elem_size);
+		for (slot = start;; slot = next) {
+			next = perm[slot];
+			perm[slot] |= VECTOR_PERMUTE_SEEN;
+			if (next == start) {
+				memcpy(data + slot * elem_size, held, elem_size);
+				break;
+			}
+			memcpy(data + slot * elem_size, data + next * elem_size, elem_size);
+		}
+	}
+
+	for (start = 0; start < count; ++start) perm[start] &= ~VECTOR_PERMUTE_SEEN;
+}
+
+/* Whether elements of the vector may be duplicated or moved as bytes */
+bool _vec_copies_bytes(const Vector *v)
+{
+	return v->tc->_vec_elem_copy == NULL && v->tc->_vec_elem_destroy == NULL &&
+    _vec_relocates_bytes(v);
+}
+
+
+/* Merge kernels
+ * Set operations and k-way merges for sorted inputs, instantiated for
+ * doubles, int64_t and any element type with a comparator. Inputs are
+ * walked linearly, or for skewed sizes by galloping: an exponential then
+ * binary search of the larger input for each element of the smaller one,
+ * with the runs in between copied in bulk. Elements of the first input
+ * win ties, as with the C++ standard library. */
+
+static inline bool _vec_less_double(const char *x,
+                                    const char *y,
+                                    VectorCompare compare)
+{
+	(void)compare;
+	return *(const double*)x < *(const double*)y;
+}
+
+static inline bool _vec_less_int64(const char *x,
+                                   const char *y,
+                                   VectorCompare compare)
+{
+	(void)compare;
+	return *(const int64_t*)x < *(const int64_t*)y;
+}
+
+static inline bool _vec_less_generic(const char *x,
+                                     const char *y,
+                                     VectorCompare compare)
+{
+	return compare(x, y) < 0;
+}
+
+#define VECTOR_MERGE_KERNELS(suffix, es)                                    \
+	/* First index in [from, count) not less than x */                      \
+	static size_t _vec_gallop_##suffix(const char *base,                    \
+	                                   size_t from,                         \
+	                                   size_t count,                        \
+	                                   const char *x,                       \
+	                                   size_t elem_size,                    \
+	                                   VectorCompare compare)               \
+	{                                                                       \
+		size_t low = from, high = from, step = 1, middle;                     \
+                                                                          \
+		(void)elem_size;                                                      \
+		while (high < count && _vec_less_##suffix(base + high * (es), x, compare)) { \
+			low = high + 1;                                                     \
+			high += step;                                                       \
+			step <<= 1;                                                         \
+		}                                                                     \
+		high = MIN(high, count);                                              \
+                                                                          \
+		while (low < high) {                                                  \
+			middle = low + (high - low) / 2;                                    \
+			if (_vec_less_##suffix(base + middle * (es), x, compare)) {         \
+				low = middle + 1;                                                 \
+			} else {                                                            \
+				high = middle;                                                    \
+			}                                                                   \
+		}                                                                     \
+                                                                          \
+		return low;                                                           \
+	}                                                                       \
+                                                                          \
+	static size_t _vec_union_##suffix(char *out,                            \
+	                                  const char *a,                        \
+	                                  size_t na,                            \
+	                                  const char *b,                        \
+	                                  size_t nb,                            \
+	                                  size_t elem_size,                     \
+	                                  VectorCompare compare)                \
+	{                                                                       \
+		char *start = out;                                                    \
+		size_t i = 0, j = 0, p;                                               \
+                                                                          \
+		(void)elem_size;                                                      \
+		if (nb >= na * VECTOR_GALLOP_RATIO) {                                 \
+			for (; i < na; ++i) {                                               \
+				p = _vec_gallop_##suffix(b, j, nb, a + i * (es), elem_size, compare); \
+				memcpy(out, b + j * (es), (p - j) * (es));                        \
+				out += (p - j) * (es);                                            \
+				j = p;                                                            \
+				if (j < nb && !_vec_less_##suffix(a + i * (es), b + j * (es), compare)) { \
+					++j;                                                            \
+				}                                                                 \
+				memcpy(out, a + i * (es), (es));                                  \
+				out += (es);                                                      \
+			}                                                                   \
+		} else if (na >= nb * VECTOR_GALLOP_RATIO) {                          \
+			for (; j < nb; ++j) {                                               \
+				p = _vec_gallop_##suffix(a, i, na, b + j * (es), elem_size, compare); \
+				memcpy(out, a + i * (es), (p - i) * (es));                        \
+				out += (p - i) * (es);                                            \
+				i = p;                                                            \
+				if (i < na && !_vec_less_##suffix(b + j * (es), a + i * (es), compare)) { \
+					memcpy(out, a + i++ * (es), (es));                              \
+				} else {                                                          \
+					memcpy(out, b + j * (es), (es));                                \
+				}                                                                 \
+				out += (es);                                                      \
+			}                                                                   \
+		} else {                                                              \
+			while (i < na && j < nb) {                                          \
+				if (_vec_less_##suffix(b + j * (es), a + i * (es), compare)) {    \
+					memcpy(out, b + j++ * (es), (es));                              \
+				} else {                                                          \
+					if (!_vec_less_##suffix(a + i * (es), b + j * (es), compare)) ++j; \
+					memcpy(out, a + i++ * (es), (es));                              \
+				}                                                                 \
+				out += (es);                                                      \
+			}                                                                   \
+		}                                                                     \
+                                                                          \
+		memcpy(out, a + i * (es), (na - i) * (es));                           \
+		out += (na - i) * (es);                                               \
+		memcpy(out, b + j * (es), (nb - j) * (es));                           \
+		out += (nb - j) * (es);                                               \
+                                                                          \
+		return (size_t)(out - start) / (es);                                  \
+	}                                                                       \
+                                                                          \
+	static size_t _vec_intersection_##suffix(char *out,                     \
+	                                         const char *a,                 \
+	                                         size_t na,                     \
+	                                         const char *b,                 \
+	                                         size_t nb,                     \
+	                                         size_t elem_size,              \
+	                                         VectorCompare compare)         \
+	{                                                                       \
+		char *start = out;                                                    \
+		size_t i = 0, j = 0;                                                  \
+                                                                          \
+		(void)elem_size;                                                      \
+		if (nb >= na * VECTOR_GALLOP_RATIO) {                                 \
+			for (; i < na; ++i) {                                               \
+				j = _vec_gallop_##suffix(b, j, nb, a + i * (es), elem_size, compare); \
+				if (j == nb) break;                                               \
+				if (!_vec_less_##suffix(a + i * (es), b + j * (es), compare)) {   \
+					memcpy(out, a + i * (es), (es));                                \
+					out += (es);                                                    \
+					++j;                                                            \
+				}                                                                 \
+			}                                                                   \
+		} else if (na >= nb * VECTOR_GALLOP_RATIO) {                          \
+			for (; j < nb; ++j) {                                               \
+				i = _vec_gallop_##suffix(a, i, na, b + j * (es), elem_size, compare); \
+				if (i == na) break;                                               \
+				if (!_vec_less_##suffix(b + j * (es), a + i * (es), compare)) {   \
+					memcpy(out, a + i++ * (es), (es));                              \
+					out += (es);                                                    \
+				}                                                                 \
+			}                                                                   \
+		} else {                                                              \
+			while (i < na && j < nb) {                                          \
+				if (_vec_less_##suffix(a + i * (es), b + j * (es), compare)) {    \
+					++i;                                                            \
+				} else if (_vec_less_##suffix(b + j * (es), a + i * (es), compare)) { \
+					++j;                                                            \
+				} else {                                                          \
+					memcpy(out, a + i++ * (es), (es));                              \
+					out += (es);                                                    \
+					++j;                                                            \
+				}                                                                 \
+			}                                                                   \
+		}                                                                     \
+                                                                          \
+		return (size_t)(out - start) / (es);                                  \
+	}                                                                       \
+                                                                          \
+	static size_t _vec_difference_##suffix(char *out,                       \
+	                                       const char *a,                   \
+	                                       size_t na,                       \
+	                                       const char *b,                   \
+	                                       size_t nb,                       \
+	                                       size_t elem_size,                \
+	                                       VectorCompare compare)           \
+	{                                                                       \
+		char *start = out;                                                    \
+		size_t i = 0, j = 0, p;                                               \
+                                                                          \
+		(void)elem_size;                                                      \
+		if (nb >= na * VECTOR_GALLOP_RATIO) {                                 \
+			for (; i < na; ++i) {                                               \
+				j = _vec_gallop_##suffix(b, j, nb, a + i * (es), elem_size, compare); \
+				if (j < nb && !_vec_less_##suffix(a + i * (es), b + j * (es), compare)) { \
+					++j;                                                            \
+				} else {                                                          \
+					memcpy(out, a + i * (es), (es));                                \
+					out += (es);                                                    \
+				}                                                                 \
+			}                                                                   \
+		} else if (na >= nb * VECTOR_GALLOP_RATIO) {                          \
+			for (; j < nb; ++j) {                                               \
+				p = _vec_gallop_##suffix(a, i, na, b + j * (es), elem_size, compare); \
+				memcpy(out, a + i * (es), (p - i) * (es));                        \
+				out += (p - i) * (es);                                            \
+				i = p;                                                            \
+				if (i < na && !_vec_less_##suffix(b + j * (es), a + i * (es), compare)) { \
+					++i;                                                            \
+				}                                                                 \
+			}                                                                   \
+		} else {                                                              \
+			while (i < na && j < nb) {                                          \
+				if (_vec_less_##suffix(a + i * (es), b + j * (es), compare)) {    \
+					memcpy(out, a + i++ * (es), (es));                              \
+					out += (es);                                                    \
+				} else if (_vec_less_##suffix(b + j * (es), a + i * (es), compare)) { \
+					++j;                                                            \
+				} else {                                                          \
+					++i;                                                            \
+					++j;                                                            \
+				}                                                                 \
+			}                                                                   \
+		}                                                                     \
+                                                                          \
+		memcpy(out, a + i * (es), (na - i) * (es));                           \
+		out += (na - i) * (es);                                               \
+                                                                          \
+		return (size_t)(out - start) / (es);                                  \
+	}                                                                       \
+                                                                          \
+	/* Whether source x goes before source y: exhausted sources last, ties  \
+	 * to the earlier source */                                             \
+	static inline bool _vec_merge_before_##suffix(const char **cursor,     \
+	                                              const char **end,        \
+	                                              size_t x,                \
+	                                              size_t y,                \
+	                                              VectorCompare compare)   \
+	{                                                                       \
+		if (cursor[x] == end[x]) return cursor[y] == end[y] && x < y;         \
+		if (cursor[y] == end[y]) return true;                                 \
+		if (_vec_less_##suffix(cursor[x], cursor[y], compare)) return true;   \
+		return x < y && !_vec_less_##suffix(cursor[y], cursor[x], compare);   \
+	}                                                                       \
+                                                                          \
+	/* Tournament tree of losers: node n of 1..k-1 holds the source that    \
+	 * lost the match played there, leaves k..2k-1 stand for the sources,   \
+	 * and only the path of the last winner is replayed per element */      \
+	static void _vec_merge_k_##suffix(char *out,                            \
+	                                  size_t total,                         \
+	                                  const char **cursor,                  \
+	                                  const char **end,                     \
+	                                  size_t k,                             \
+	                                  size_t *loser,                        \
+	                                  size_t *winner,                       \
+	                                  size_t elem_size,                     \
+	                                  VectorCompare compare)                \
+	{                                                                       \
+		size_t n, left, right, w, swap, t;                                    \
+                                                                          \
+		(void)elem_size;                                                      \
+		for (n = 0; n < k; ++n) winner[k + n] = n;                            \
+		for (n = k - 1; n > 0; --n) {                                         \
+			left = winner[2 * n];                                               \
+			right = winner[2 * n + 1];                                          \
+			if (_vec_merge_before_##suffix(cursor, end, right, left, compare)) { \
+				winner[n] = right;                                                \
+				loser[n] = left;                                                  \
+			} else {                                                            \
+				winner[n] = left;                                                 \
+				loser[n] = right;                                                 \
+			}                                                                   \
+		}                                                                     \
+		w = winner[1];                                                        \
+                                                                          \
+		for (t = 0; t < total; ++t) {                                         \
+			memcpy(out, cursor[w], (es));                                       \
+			out += (es);                                                        \
+			cursor[w] += (es);                                                  \
+			for (n = (k + w) / 2; n > 0; n /= 2) {                              \
+				if (_vec_merge_before_##suffix(cursor, end, loser[n], w, compare)) { \
+					swap = loser[n];                                                \
+					loser[n] = w;                                                   \
+					w = swap;                                                       \
+				}                                                                 \
+			}                                                                   \
+		}                                                                     \
+	}
+
+VECTOR_MERGE_KERNELS(double, sizeof(double))
+VECTOR_MERGE_KERNELS(int64, sizeof(int64_t))
+VECTOR_MERGE_KERNELS(generic, elem_size)
+
+#undef VECTOR_MERGE_KERNELS
+
+typedef size_t (*_VecSetKernel)(char *out,
+                                const char *a,
+                                size_t na,
+                                const char *b,
+                                size_t nb,
+                                size_t elem_size,
+                                VectorCompare compare);
+
+typedef enum {
+	_VEC_SET_UNION,
+	_VEC_SET_INTERSECTION,
+	_VEC_SET_DIFFERENCE
+} _VecSetOperation;
+
+/* Writes a set operation of two sorted vectors into `dest`, sized once for
+ * the largest possible result */
+int _vec_set_operation(Vector *dest,
+                       const Vector *a,
+                       const Vector *b,
+                       VectorCompare compare,
+                       _VecSetOperation operation)
+{
+	static const _VecSetKernel kernels[][3] = {
+		{ _vec_union_generic, _vec_union_double, _vec_union_int64 },
+		{ _vec_intersection_generic,
+			_vec_intersection_double,
+			_vec_intersection_int64 },
+		{ _vec_difference_generic,
+			_vec_difference_double,
+			_vec_difference_int64 },
+	};
+	size_t na, nb, bound, count;
+	char *out;
+
+	assert(dest != NULL);
+	assert(a != NULL);
+	assert(b != NULL);
+	assert(compare != NULL);
+
+	if (dest == NULL || a == NULL || b == NULL) return VECTOR_ERROR;
+	if (compare == NULL) return VECTOR_ERROR;
+	/* Resizing dest could free the buffer an input is read from, even through
+	 * another handle to the same vector */
+	if (dest == a || dest == b) return VECTOR_ERROR;
+	if (dest->self == a->self || dest->self == b->self) return VECTOR_ERROR;
+	if (dest->tc->_vec_type() != a->tc->_vec_type()) return VECTOR_ERROR;
+	if (dest->tc->_vec_type() != b->tc->_vec_type()) return VECTOR_ERROR;
+	if (!_vec_copies_bytes(dest)) return VECTOR_ERROR;
+
+	na = vector_size(a);
+	nb = vector_size(b);
+	switch (operation) {
+		case _VEC_SET_UNION: bound = na + nb; break;
+		case _VEC_SET_INTERSECTION: bound = MIN(na, nb); break;
+		default: bound = na; break;
+	}
+
+	if (vector_resize(dest, bound) == VECTOR_ERROR) return VECTOR_ERROR;
+	if (bound == 0) return VECTOR_SUCCESS;
+
+	out = vector_data(dest);
+	if (out == NULL) return VECTOR_ERROR;
+
+	/* An empty input may have no buffer at all */
+	count = kernels[operation][_vec_kernel(dest, compare)](
+      out,
+      na == 0 ? "" : vector_const_data(a),
+      na,
+      nb == 0 ? "" : vector_const_data(b),
+      nb,
+      dest->tc->_vec_elem_size(),
+      compare);
+
+	vector_mark_dirty(dest, 0, count);
+
+	return vector_resize(dest, count);
+}
+
+
+/***** COMPARATORS *****/
+
+int vector_compare_double(const void* first, const void* second)
+{
+	double a = *(const double*)first, b = *(const double*)second;
+	return (a > b) - (a < b);
+}
+
+int vector_compare_int64(const void* first, const void* second)
+{
+	int64_t a = *(const int64_t*)first, b = *(const int64_t*)second;
+	return (a > b) - (a < b);
+}
+
+
+/***** HEAPS *****/
+
+int vector_heap_make(Vector* v, VectorCompare compare)
+{
+	size_t size, index;
+
+	assert(v != NULL);
+	assert(v->self != NULL);
+	assert(compare != NULL);
+
+	if (v == NULL) return VECTOR_ERROR;
+	if (v->self == NULL) return VECTOR_ERROR;
+	if (compare == NULL) return VECTOR_ERROR;
+	if (!_vec_relocates_bytes(v)) return VECTOR_ERROR;
+
+	size = vector_size(v);
+	if (size < 2) return VECTOR_SUCCESS;
+
+	/* Floyd: sift down every inner node, last one first */
+	for (index = (size - 2) / VECTOR_HEAP_ARITY + 1; index-- > 0;) {
+		if (_vec_heap_sift(v, size, index, false, compare) == VECTOR_ERROR) {
+			return VECTOR_ERROR;
+		}
+	}
+
+	return VECTOR_SUCCESS;
+}
+
+int vector_heap_push(Vector* v, void* element, VectorCompare compare)
+{
+	assert(v != NULL);
+	assert(element != NULL);
+	assert(compare != NULL);
+
+	if (v == NULL) return VECTOR_ERROR;
+	if (element == NULL) return VECTOR_ERROR;
+	if (compare == NULL) return VECTOR_ERROR;
+	if (!_vec_relocates_bytes(v)) return VECTOR_ERROR;
+
+	if (vector_push_back(v, element) == VECTOR_ERROR) return VECTOR_ERROR;
+
+	return _vec_heap_sift(v, vector_size(v), vector_size(v) - 1, true, compare);
+}
+
+int vector_heap_pop(Vector* v, void* element, VectorCompare compare)
+{
+	size_t elem_size, size;
+	char *data, *last;
+
+	assert(v != NULL);
+	assert(v->self != NULL);
+	assert(compare != NULL);
+	assert(!vector_is_empty(v));
+
+	if (v == NULL) return VECTOR_ERROR;
+	if (v->self == NULL) return VECTOR_ERROR;
+	if (compare == NULL) return VECTOR_ERROR;
+	if (vector_is_empty(v)) return VECTOR_ERROR;
+	if (!_vec_relocates_bytes(v)) return VECTOR_ERROR;
+
+	elem_size = v->tc->_vec_elem_size();
+	size = vector_size(v);
+
+	data = vector_data(v);
+	if (data == NULL) return VECTOR_ERROR;
+
+	last = data + (size - 1) * elem_size;
+
+	if (element != NULL) {
+		memcpy(element, data, elem_size);
+	} else if (v->tc->_vec_elem_destroy != NULL) {
+		v->tc->_vec_elem_destroy(data);
+	}
+
+	/* Move the last leaf to the root and let it sink. Its old slot is left
+	 * all-zero, which pop_back's destroy hook accepts, so nothing is released
+	 * twice. */
+	if (size > 1) {
+		memcpy(data, last, elem_size);
+		if (_vec_heap_sift(v, size - 1, 0, false, compare) == VECTOR_ERROR) {
+			return VECTOR_ERROR;
+		}
+	}
+	if (v->tc->_vec_elem_destroy != NULL) memset(last, 0, elem_size);
+
+	return vector_pop_back(v);
+}
+
+int vector_heap_update(Vector* v, size_t index, VectorCompare compare)
+{
+	size_t elem_size;
+	const char *data;
+	bool up;
+
+	assert(v != NULL);
+	assert(v->self != NULL);
+	assert(compare != NULL);
+	assert(index < vector_size(v));
+
+	if (v == NULL) return VECTOR_ERROR;
+	if (v->self == NULL) return VECTOR_ERROR;
+	if (compare == NULL) return VECTOR_ERROR;
+	if (index >= vector_size(v)) return VECTOR_ERROR;
+	if (!_vec_relocates_bytes(v)) return VECTOR_ERROR;
+
+	elem_size = v->tc->_vec_elem_size();
+	data = vector_const_data(v);
+
+	/* A key that became smaller than its parent rises, otherwise it sinks */
+	up = index > 0 &&
+    compare(data + index * elem_size,
+            data + (index - 1) / VECTOR_HEAP_ARITY * elem_size) < 0;
+
+	return _vec_heap_sift(v, vector_size(v), index, up, compare);
+}
+
+
+/***** SEARCH *****/
+
+size_t vector_find(const Vector* v, const void* element)
+{
+	size_t size, index;
+
+	assert(v != NULL);
+	assert(v->self != NULL);
+	assert(element != NULL);
+
+	if (v == NULL) return VECTOR_NOT_FOUND;
+	if (v->self == NULL) return VECTOR_NOT_FOUND;
+	if (element == NULL) return VECTOR_NOT_FOUND;
+
+	size = vector_size(v);
+	if (size == 0) return VECTOR_NOT_FOUND;
+
+	index = _vec_find_bytes(vector_const_data(v),
+													size,
+													v->tc->_vec_elem_size(),
+													element);
+
+	return index == size ? VECTOR_NOT_FOUND : index;
+}
+
+size_t vector_count(const Vector* v, const void* element)
+{
+	assert(v != NULL);
+	assert(v->self != NULL);
+	assert(element != NULL);
+
+	if (v == NULL) return 0;
+	if (v->self == NULL) return 0;
+	if (element == NULL) return 0;
+	if (vector_is_empty(v)) return 0;
+
+	return _vec_count_bytes(vector_const_data(v),
+													vector_size(v),
+													v->tc->_vec_elem_size(),
+													element);
+}
+
+size_t vector_find_if(const Vector* v, VectorPredicate predicate, void* context)
+{
+	size_t elem_size, size, i;
+	const char *data;
+
+	assert(v != NULL);
+	assert(v->self != NULL);
+	assert(predicate != NULL);
+
+	if (v == NULL) return VECTOR_NOT_FOUND;
+	if (v->self == NULL) return VECTOR_NOT_FOUND;
+	if (predicate == NULL) return VECTOR_NOT_FOUND;
+
+	elem_size = v->tc->_vec_elem_size();
+	size = vector_size(v);
+	data = vector_const_data(v);
+
+	for (i = 0; i < size; ++i, data += elem_size) {
+		if (predicate(data, context)) return i;
+	}
+
+	return VECTOR_NOT_FOUND;
+}
+
+int vector_unique(Vector* v, VectorCompare compare)
+{
+	size_t elem_size, size, kept, first_moved, i;
+	const char *view;
+	char *data;
+
+	assert(v != NULL);
+	assert(v->self != NULL);
+
+	if (v == NULL) return VECTOR_ERROR;
+	if (v->self == NULL) return VECTOR_ERROR;
+
+	size = vector_size(v);
+	if (size < 2) return VECTOR_SUCCESS;
+
+	elem_size = v->tc->_vec_elem_size();
+
+	/* Find the first duplicate without writing, so that a vector which is
+	 * already unique is neither unshared nor marked dirty */
+	view = vector_const_data(v);
+	for (i = 1; i < size; ++i, view += elem_size) {
+		if (_vec_equal(view, view + elem_size, elem_size, compare)) break;
+	}
+	if (i == size) return VECTOR_SUCCESS;
+
+	data = vector_data(v);
+	if (data == NULL) return VECTOR_ERROR;
+
+	/* Elements [0, kept) are the distinct ones so far. With lifecycle hooks
+	 * duplicates are destroyed as they are dropped and the slots past `kept`
+	 * hold nothing, so the size is cut without destroying them again. */
+	kept = first_moved = i;
+	if (v->tc->_vec_elem_destroy != NULL) {
+		v->tc->_vec_elem_destroy(data + i * elem_size);
+	}
+	for (++i; i < size; ++i) {
+		if (!_vec_equal(data + (kept - 1) * elem_size,
+										data + i * elem_size,
+										elem_size,
+										compare)) {
+			if (v->tc->_vec_elem_move != NULL &&
+					!v->tc->_vec_trivially_relocatable) {
+				v->tc->_vec_elem_move(data + kept * elem_size, data + i * elem_size);
+			} else {
+				memcpy(data + kept * elem_size, data + i * elem_size, elem_size);
+			}
+			++kept;
+		} else if (v->tc->_vec_elem_destroy != NULL) {
+			v->tc->_vec_elem_destroy(data + i * elem_size);
+		}
+	}
+
+	vector_mark_dirty(v, first_moved, kept - first_moved);
+
+	if (v->tc->_vec_elem_destroy != NULL) {
+		v->tc->_vec_set_size(v->self, kept);
+		return VECTOR_SUCCESS;
+	}
+
+	return vector_resize(v, kept);
+}
+
+uint64_t vector_hash(const Vector* v)
+{
+	assert(v != NULL);
+	assert(v->self != NULL);
+
+	return _vec_hash_bytes(vector_const_data(v), vector_byte_size(v));
+}
+
+
+/***** REORDERING *****/
+
+int vector_gather(Vector* dest, const Vector* src, const Vector* indices)
+{
+	size_t count, elem_size;
+	const size_t *index;
+	void *data;
+
+	assert(dest != NULL);
+	assert(src != NULL);
+	assert(indices != NULL);
+	assert(dest != src);
+
+	if (dest == NULL) return VECTOR_ERROR;
+	if (src == NULL) return VECTOR_ERROR;
+	if (indices == NULL) return VECTOR_ERROR;
+	if (dest == src || dest == indices) return VECTOR_ERROR;
+	if (dest->self == src->self || dest->self == indices->self) {
+		return VECTOR_ERROR;
+	}
+	if (dest->tc->_vec_type() != src->tc->_vec_type()) return VECTOR_ERROR;
+	if (indices->tc->_vec_elem_size() != sizeof(size_t)) return VECTOR_ERROR;
+	if (!_vec_copies_bytes(src)) return VECTOR_ERROR;
+
+	count = vector_size(indices);
+	index = vector_const_data(indices);
+	if (!_vec_indices_below(index, count, vector_size(src))) {
+		return VECTOR_ERROR;
+	}
+
+	if (vector_resize(dest, count) == VECTOR_ERROR) return VECTOR_ERROR;
+	if (count == 0) return VECTOR_SUCCESS;
+
+	data = vector_data(dest);
+	if (data == NULL) return VECTOR_ERROR;
+
+	elem_size = src->tc->_vec_elem_size();
+	_vec_gather_bytes(data,
+										vector_const_data(src),
+										index,
+										count,
+										elem_size,
+										vector_byte_size(src) >= VECTOR_PREFETCH_BYTES);
+
+	vector_mark_dirty(dest, 0, count);
+
+	return VECTOR_SUCCESS;
+}
+
+int vector_scatter(Vector* dest, const Vector* src, const Vector* indices)
+{
+	size_t count, elem_size;
+	const size_t *index;
+	void *data;
+
+	assert(dest != NULL);
+	assert(src != NULL);
+	assert(indices != NULL);
+	assert(dest != src);
+
+	if (dest == NULL) return VECTOR_ERROR;
+	if (src == NULL) return VECTOR_ERROR;
+	if (indices == NULL) return VECTOR_ERROR;
+	if (dest == src || dest == indices) return VECTOR_ERROR;
+	if (dest->self == src->self || dest->self == indices->self) {
+		return VECTOR_ERROR;
+	}
+	if (dest->tc->_vec_type() != src->tc->_vec_type()) return VECTOR_ERROR;
+	if (indices->tc->_vec_elem_size() != sizeof(size_t)) return VECTOR_ERROR;
+	if (!_vec_copies_bytes(src)) return VECTOR_ERROR;
+
+	count = vector_size(indices);
+	if (count != vector_size(src)) return VECTOR_ERROR;
+	if (count == 0) return VECTOR_SUCCESS;
+
+	index = vector_const_data(indices);
+	if (!_vec_indices_below(index, count, vector_size(dest))) {
+		return VECTOR_ERROR;
+	}
+
+	data = vector_data(dest);
+	if (data == NULL) return VECTOR_ERROR;
+
+	elem_size = src->tc->_vec_elem_size();
+	_vec_scatter_bytes(data,
+										 vector_const_data(src),
+										 index,
+										 count,
+										 elem_size,
+										 vector_byte_size(dest) >= VECTOR_PREFETCH_BYTES);
+
+	vector_mark_dirty(dest, 0, vector_size(dest));
+
+	return VECTOR_SUCCESS;
+}
+
+int vector_permute_inplace(Vector* v, Vector* perm)
+{
+	size_t count, elem_size;
+	_VecScratch local;
+	size_t *index;
+	void *held, *buffer;
+	char *data;
+
+	assert(v != NULL);
+	assert(perm != NULL);
+	assert(v != perm);
+
+	if (v == NULL) return VECTOR_ERROR;
+	if (perm == NULL) return VECTOR_ERROR;
+	if (v == perm || v->self == perm->self) return VECTOR_ERROR;
+	if (perm->tc->_vec_elem_size() != sizeof(size_t)) return VECTOR_ERROR;
+	if (!_vec_relocates_bytes(v)) return VECTOR_ERROR;
+
+	count = vector_size(v);
+	if (vector_size(perm) != count) return VECTOR_ERROR;
+	if (count < 2) return VECTOR_SUCCESS;
+
+	index = vector_data(perm);
+	data = vector_data(v);
+	if (index == NULL || data == NULL) return VECTOR_ERROR;
+
+	if (!_vec_is_permutation(index, count)) return VECTOR_ERROR;
+
+	elem_size = v->tc->_vec_elem_size();
+
+	/* A gather into a buffer streams through memory; following cycles jumps
+	 * from element to element, but needs room for one element only */
+	buffer = NULL;
+	if (vector_byte_size(v) <= VECTOR_PERMUTE_BUFFER_BYTES &&
+			_vec_can_allocate(v)) {
+		buffer = malloc(vector_byte_size(v));
+	}
+
+	if (buffer != NULL) {
+		_vec_gather_bytes(buffer,
+											data,
+											index,
+											count,
+											elem_size,
+											vector_byte_size(v) >= VECTOR_PREFETCH_BYTES);
+		memcpy(data, buffer, vector_byte_size(v));
+		free(buffer);
+	} else {
+		held = _vec_scratch_acquire(&local, elem_size);
+		if (held == NULL) return VECTOR_ERROR;
+		_vec_permute_cycles(data, index, count, elem_size, held);
+		_vec_scratch_release(&local, held);
+	}
+
+	vector_mark_dirty(v, 0, count);
+
+	return VECTOR_SUCCESS;
+}
+
+
+/***** MERGING *****/
+
+int vector_merge_k(Vector* dest,
+                   const Vector* sources,
+                   size_t k,
+                   VectorCompare compare)
+{
+	size_t elem_size, total = 0, n;
+	const char **cursor, **end;
+	size_t *loser, *winner;
+	void *scratch;
+	char *out;
+
+	assert(dest != NULL);
+	assert(sources != NULL || k == 0);
+	assert(compare != NULL);
+
+	if (dest == NULL) return VECTOR_ERROR;
+	if (sources == NULL && k > 0) return VECTOR_ERROR;
+	if (compare == NULL) return VECTOR_ERROR;
+	if (!_vec_copies_bytes(dest)) return VECTOR_ERROR;
+
+	for (n = 0; n < k; ++n) {
+		if (&sources[n] == dest || sources[n].self == dest->self) {
+			return VECTOR_ERROR;
+		}
+		if (sources[n].tc->_vec_type() != dest->tc->_vec_type()) {
+			return VECTOR_ERROR;
+		}
+		total += vector_size(&sources[n]);
+	}
+
+	if (vector_resize(dest, total) == VECTOR_ERROR) return VECTOR_ERROR;
+	if (total == 0) return VECTOR_SUCCESS;
+
+	out = vector_data(dest);
+	if (out == NULL) return VECTOR_ERROR;
+
+	elem_size = dest->tc->_vec_elem_size();
+
+	/* Cursors and the tree in one allocation */
+	scratch = malloc(k * (2 * sizeof(char*) + 3 * sizeof(size_t)));
+	if (scratch == NULL) return VECTOR_ERROR;
+	cursor = scratch;
+	end = cursor + k;
+	loser = (size_t*)(end + k);
+	winner = loser + k;
+
+	for (n = 0; n < k; ++n) {
+		cursor[n] = vector_const_data(&sources[n]);
+		end[n] = cursor[n] + vector_size(&sources[n]) * elem_size;
+	}
+
+	switch (_vec_kernel(dest, compare)) {
+		case _VEC_KERNEL_DOUBLE:
+			_vec_merge_k_double(out, total, cursor, end, k, loser, winner,
+													elem_size, compare);
+			break;
+		case _VEC_KERNEL_INT64:
+			_vec_merge_k_int64(out, total, cursor, end, k, loser, winner,
+												 elem_size, compare);
+			break;
+		case _VEC_KERNEL_GENERIC:
+			_vec_merge_k_generic(out, total, cursor, end, k, loser, winner,
+													 elem_size, compare);
+			break;
+	}
+
+	free(scratch);
+
+	vector_mark_dirty(dest, 0, total);
+
+	return VECTOR_SUCCESS;
+}
+
+int vector_set_union(Vector* dest,
+                     const Vector* a,
+                     const Vector* b,
+                     VectorCompare compare)
+{
+	return _vec_set_operation(dest, a, b, compare, _VEC_SET_UNION);
+}
+
+int vector_set_intersection(Vector* dest,
+                            const Vector* a,
+                            const Vector* b,
+                            VectorCompare compare)
+{
+	return _vec_set_operation(dest, a, b, compare, _VEC_SET_INTERSECTION);
+}
+
+int vector_set_difference(Vector* dest,
+                          const Vector* a,
+                          const Vector* b,
+                          VectorCompare compare)
+{
+	return _vec_set_operation(dest, a, b, compare, _VEC_SET_DIFFERENCE);
+}
@@ -0,0 +1,151 @@
+/* The MIT License (MIT)
+ * Copyright (c) 2016 Peter Goldsborough
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#ifndef VECTOR_ALGORITHM_H
+#define VECTOR_ALGORITHM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vector.h"
+
+/***** DEFINITIONS *****/
+
+/* Returned by the search methods when no element matches */
+#define VECTOR_NOT_FOUND ((size_t)-1)
+
+/* Permutations of up to this many bytes go through a temporary buffer;
+ * larger ones follow cycles in place */
+#define VECTOR_PERMUTE_BUFFER_BYTES ((size_t)256 << 20)
+
+typedef bool (*VectorPredicate)(const void *element, void *context);
+
+
+/***** COMPARATORS *****/
+
+/* Ascending order of doubles and int64_t. Algorithms recognise these two
+ * and switch to kernels specialized for the key type. */
+int vector_compare_double(const void* first, const void* second);
+int vector_compare_int64(const void* first, const void* second);
+
+
+/***** HEAPS *****/
+
+/* A 4-ary min-heap laid out in the vector: the children of element i are
+ * 4i + 1 to 4i + 4, so all siblings are adjacent and a sift-down compares
+ * them within one or two cache lines. The smallest element according to
+ * `compare` is at the front. Elements are swapped as bytes, so types whose
+ * move hook is not trivially relocatable are refused; vector_heap_pop hands
+ * the front element over to the caller, or destroys it without `element`. */
+int vector_heap_make(Vector* vector, VectorCompare compare);
+int vector_heap_push(Vector* vector, void* element, VectorCompare compare);
+
+/* Removes the front element, moving it to `element` unless that is NULL */
+int vector_heap_pop(Vector* vector, void* element, VectorCompare compare);
+
+/* Restores the heap after the element at `index` was changed in place */
+int vector_heap_update(Vector* vector, size_t index, VectorCompare compare);
+
+
+
+/***** SEARCH *****/
+
+/* Elements are equal when their bytes are, so 0.0 and -0.0 differ and a NaN
+ * matches the same NaN. Vectors of 1, 2, 4 and 8-byte elements are scanned
+ * with SIMD compares (AVX2 where the CPU has it), other sizes with memcmp. */
+size_t vector_find(const Vector* vector, const void* element);
+size_t vector_count(const Vector* vector, const void* element);
+size_t vector_find_if(const Vector* vector,
+                      VectorPredicate predicate,
+                      void* context);
+
+/* Removes all but the first of each run of equal elements, so a sorted
+ * vector ends up with distinct elements. Equality is by `compare`, or by
+ * bytes when it is NULL. */
+int vector_unique(Vector* vector, VectorCompare compare);
+
+/* 64-bit xxHash of the buffer contents, for change detection and cache
+ * keys. Depends on the byte order of the machine. */
+uint64_t vector_hash(const Vector* vector);
+
+
+/***** REORDERING *****/
+
+/* `indices` and `perm` are vectors of size_t (any type with 8-byte elements
+ * on 64-bit targets), and every index must be in range.
+ *
+ * vector_gather resizes `destination` to the number of indices and sets
+ * destination[i] = source[indices[i]]. vector_scatter sets
+ * destination[indices[i]] = source[i] for every element of `source`; with
+ * repeated indices the last one wins. Both copy elements as bytes, so
+ * types with copy or destroy hooks are refused.
+ *
+ * vector_permute_inplace reorders the vector so that element i becomes the
+ * one previously at perm[i], failing unless `perm` is a permutation of
+ * 0..size-1. Vectors of up to VECTOR_PERMUTE_BUFFER_BYTES are gathered into
+ * a temporary buffer; larger ones, vectors that must not allocate, or
+ * when that buffer cannot be had, follow the cycles of `perm` in place with
+ * one element of extra memory.
+ * `perm` is marked in place while it is applied and restored afterwards. */
+int vector_gather(Vector* destination,
+                  const Vector* source,
+                  const Vector* indices);
+int vector_scatter(Vector* destination,
+                   const Vector* source,
+                   const Vector* indices);
+int vector_permute_inplace(Vector* vector, Vector* perm);
+
+
+/***** MERGING *****/
+
+/* Inputs are sorted by `compare`, and `destination` is overwritten with a
+ * sorted result. Its capacity is reserved once for the largest possible
+ * result. Elements are copied as bytes, as for vector_gather.
+ *
+ * vector_merge_k merges `k` vectors through a tournament tree, so each
+ * element costs about log2(k) comparisons. Equal elements keep the order of
+ * their sources. */
+int vector_merge_k(Vector* destination,
+                   const Vector* sources,
+                   size_t k,
+                   VectorCompare compare);
+
+/* Set operations on sorted vectors, with the multiset semantics of the C++
+ * standard library: an element present m times in `a` and n times in `b`
+ * appears max(m, n), min(m, n) and max(m - n, 0) times respectively, and
+ * ties are taken from `a`. When one input is much larger than the other,
+ * it is searched by galloping rather than walked, so intersecting a short
+ * list with a long one costs about the short length times the log of the
+ * gap between matches. */
+int vector_set_union(Vector* destination,
+                     const Vector* a,
+                     const Vector* b,
+                     VectorCompare compare);
+int vector_set_intersection(Vector* destination,
+                            const Vector* a,
+                            const Vector* b,
+                            VectorCompare compare);
+int vector_set_difference(Vector* destination,
+                          const Vector* a,
+                          const Vector* b,
+                          VectorCompare compare);
+
+#endif /* VECTOR_ALGORITHM_H */
@@ -0,0 +1,297 @@
+/* The MIT License (MIT)
+ * Copyright (c) 2016 Peter Goldsborough
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <fcntl.h>
+#include <locale.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "vector_parse.h"
+
+/***** DEFINITIONS *****/
+
+/* Fields up to this length are copied on the stack for strtod */
+#define VECTOR_PARSE_FIELD_SIZE 128
+
+/* Digits that fit a uint64_t without overflow */
+#define VECTOR_PARSE_MAX_DIGITS 19
+
+
+/***** PRIVATE *****/
+
+/* Every power of ten that a double holds exactly */
+static const double _vec_powers_of_ten[] = {
+	1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+	1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+	1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+bool _vec_is_digit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+bool _vec_is_padding(char c, char delimiter)
+{
+	return (c == ' ' || c == '\t') && c != delimiter;
+}
+
+/* strtod for what the fast path turned down. The field is copied so it can
+ * be terminated, and its '.' translated to the locale's decimal point. */
+int _vec_parse_slow(const char *begin, const char *end, double *value)
+{
+	char local[VECTOR_PARSE_FIELD_SIZE], *copy, *stop;
+	size_t length = (size_t)(end - begin), i;
+	const char *point = localeconv()->decimal_point;
+	bool valid = true;
+
+	copy = length < sizeof local ? local : malloc(length + 1);
+	if (copy == NULL) return VECTOR_ERROR;
+
+	for (i = 0; i < length; ++i) {
+		copy[i] = begin[i];
+		if (point[0] != '.' && point[1] == '\0') {
+			/* The locale's own decimal point is not ours to accept */
+			if (begin[i] == point[0]) valid = false;
+			if (begin[i] == '.') copy[i] = point[0];
+		}
+	}
+	copy[length] = '\0';
+
+	*value = strtod(copy, &stop);
+	valid = valid && length > 0 && stop == copy + length;
+
+	if (copy != local) free(copy);
+
+	return valid ? VECTOR_SUCCESS : VECTOR_ERROR;
+}
+
+/* Reads [+-]digits[.digits][(e|E)[+-]digits]. When the significand fits in
+ * 53 bits and the decimal exponent is within 22, both are exact doubles and
+ * one multiplication or division rounds correctly (Clinger's fast path).
+ * Anything else, including inf and nan, goes to strtod. */
+int _vec_parse_double(const char *begin, const char *end, double *value)
+{
+	const char *p = begin;
+	uint64_t mantissa = 0;
+	int digits = 0, exponent = 0, exponent_value = 0;
+	bool negative = false, any = false, truncated = false, exponent_negative;
+
+	if (p < end && (*p == '+' || *p == '-')) negative = *p++ == '-';
+
+	for (; p < end && _vec_is_digit(*p); ++p) {
+		any = true;
+		if (digits < VECTOR_PARSE_MAX_DIGITS) {
+			mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+			digits += mantissa != 0;
+		} else {
+			++exponent;
+			truncated = truncated || *p != '0';
+		}
+	}
+
+	if (p < end && *p == '.') {
+		for (++p; p < end && _vec_is_digit(*p); ++p) {
+			any = true;
+			if (digits < VECTOR_PARSE_MAX_DIGITS) {
+				mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+				digits += mantissa != 0;
+				--exponent;
+			} else {
+				truncated = truncated || *p != '0';
+			}
+		}
+	}
+
+	if (!any) return _vec_parse_slow(begin, end, value);
+
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		++p;
+		exponent_negative = p < end && *p == '-';
+		if (p < end && (*p == '+' || *p == '-')) ++p;
+		if (p == end || !_vec_is_digit(*p)) return VECTOR_ERROR;
+		for (; p < end && _vec_is_digit(*p); ++p) {
+			/* Far past any finite double, so clamp instead of overflowing */
+			if (exponent_value < 100000) {
+				exponent_value = exponent_value * 10 + (*p - '0');
+			}
+		}
+		exponent += exponent_negative ? -exponent_value : exponent_value;
+	}
+
+	if (p != end) return _vec_parse_slow(begin, end, value);
+
+	if (truncated || mantissa > ((uint64_t)1 << 53) ||
+			exponent < -22 || exponent > 22) {
+		return _vec_parse_slow(begin, end, value);
+	}
+
+	*value = (double)mantissa;
+	if (exponent < 0) {
+		*value /= _vec_powers_of_ten[-exponent];
+	} else {
+		*value *= _vec_powers_of_ten[exponent];
+	}
+	if (negative) *value = -*value;
+
+	return VECTOR_SUCCESS;
+}
+
+/* Every field ends at a delimiter, a newline or the end of the buffer */
+size_t _vec_count_fields(const char *buffer, size_t length, char delimiter)
+{
+	size_t count = 1, i;
+
+	for (i = 0; i < length; ++i) {
+		count += buffer[i] == delimiter || buffer[i] == '\n';
+	}
+
+	return count;
+}
+
+
+/***** METHODS *****/
+
+int vector_parse_doubles(Vector* v,
+                         const char* buffer,
+                         size_t length,
+                         char delimiter,
+                         size_t* error_offset)
+{
+	const char *position, *end, *field, *field_end;
+	size_t old_size, count = 0;
+	double *data;
+	bool line_start, at_newline;
+	int result = VECTOR_SUCCESS;
+
+	assert(v != NULL);
+	assert(v->self != NULL);
+	assert(buffer != NULL || length == 0);
+	assert(v->tc->_vec_elem_size() == sizeof(double));
+
+	if (error_offset != NULL) *error_offset = VECTOR_PARSE_NO_OFFSET;
+
+	if (v == NULL) return VECTOR_ERROR;
+	if (v->self == NULL) return VECTOR_ERROR;
+	if (buffer == NULL && length > 0) return VECTOR_ERROR;
+	if (v->tc->_vec_elem_size() != sizeof(double)) return VECTOR_ERROR;
+
+	old_size = vector_size(v);
+	if (vector_reserve(v, old_size + _vec_count_fields(buffer, length, delimiter))
+			== VECTOR_ERROR) {
+		return VECTOR_ERROR;
+	}
+
+	data = vector_data(v);
+	if (data == NULL) return VECTOR_ERROR;
+	data += old_size;
+
+	end = buffer + length;
+	line_start = true;
+
+	for (position = buffer; position < end; position = field_end + 1) {
+		for (field_end = position;
+				 field_end < end && *field_end != delimiter && *field_end != '\n';
+				 ++field_end);
+		at_newline = field_end == end || *field_end == '\n';
+
+		field = position;
+		while (field < field_end && _vec_is_padding(*field, delimiter)) ++field;
+		position = field_end;
+		while (position > field &&
+					 (_vec_is_padding(position[-1], delimiter) || position[-1] == '\r')) {
+			--position;
+		}
+
+		if (field == position) {
+			/* A blank line is fine, a missing value between delimiters is not */
+			if (line_start && at_newline) continue;
+			result = VECTOR_ERROR;
+		} else {
+			result = _vec_parse_double(field, position, &data[count]);
+		}
+
+		if (result == VECTOR_ERROR) {
+			if (error_offset != NULL) *error_offset = (size_t)(field - buffer);
+			break;
+		}
+
+		++count;
+		line_start = at_newline;
+	}
+
+	/* Only publishes what was written, and marks it for dirty tracking */
+	vector_resize(v, old_size + count);
+
+	return result;
+}
+
+int vector_parse_doubles_file(Vector* v,
+                              const char* path,
+                              char delimiter,
+                              size_t* error_offset)
+{
+	struct stat status;
+	void *mapping;
+	int fd, result;
+
+	assert(path != NULL);
+
+	if (error_offset != NULL) *error_offset = VECTOR_PARSE_NO_OFFSET;
+	if (path == NULL) return VECTOR_ERROR;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) return VECTOR_ERROR;
+
+	if (fstat(fd, &status) != 0) {
+		close(fd);
+		return VECTOR_ERROR;
+	}
+
+	if (status.st_size == 0) {
+		close(fd);
+		return vector_parse_doubles(v, "", 0, delimiter, error_offset);
+	}
+
+	mapping = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapping == MAP_FAILED) return VECTOR_ERROR;
+
+	/* One front-to-back pass to count, one to parse */
+	posix_madvise(mapping, (size_t)status.st_size, POSIX_MADV_SEQUENTIAL);
+
+	result = vector_parse_doubles(v,
+																mapping,
+																(size_t)status.st_size,
+																delimiter,
+																error_offset);
+
+	munmap(mapping, (size_t)status.st_size);
+
+	return result;
+}
@@ -0,0 +1,62 @@
+/* The MIT License (MIT)
+ * Copyright (c) 2016 Peter Goldsborough
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#ifndef VECTOR_PARSE_H
+#define VECTOR_PARSE_H
+
+#include <stddef.h>
+
+#include "vector.h"
+
+/***** DEFINITIONS *****/
+
+/* Reported as the error offset when a failure is not in the text itself */
+#define VECTOR_PARSE_NO_OFFSET ((size_t)-1)
+
+
+/***** METHODS *****/
+
+/* Appends the numbers in `buffer` to a vector of doubles. Fields are split
+ * by `delimiter` and by newlines (\n or \r\n), may be padded with spaces or
+ * tabs (unless one of those is the delimiter) and are read in the C locale
+ * whatever the current one is. Blank lines are skipped, empty fields are
+ * errors.
+ *
+ * Capacity is reserved once from a count of separators and values are
+ * written straight into the vector's buffer. Most values take an exact
+ * fast path; the rest are handed to strtod, so every result is correctly
+ * rounded.
+ *
+ * On a malformed field the values before it are kept, `error_offset` (if
+ * not NULL) receives the byte offset of the field and VECTOR_ERROR is
+ * returned. */
+int vector_parse_doubles(Vector* vector,
+                         const char* buffer,
+                         size_t length,
+                         char delimiter,
+                         size_t* error_offset);
+
+/* The same for a whole file, which is mapped rather than read */
+int vector_parse_doubles_file(Vector* vector,
+                              const char* path,
+                              char delimiter,
+                              size_t* error_offset);
+
+#endif /* VECTOR_PARSE_H */
@@ -0,0 +1,42 @@
+/* The MIT License (MIT)
+ * Copyright (c) 2016 Peter Goldsborough
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#ifndef VECTOR_PRIVATE_H
+#define VECTOR_PRIVATE_H
+
+#include <stdbool.h>
+
+#include "vector.h"
+
+/* Helpers defined in vector.c that the other parts of the library share.
+ * They are not part of the public interface. */
+
+/***** METHODS *****/
+
+/* Whether the vector's type allows the library to allocate for it */
+bool _vec_can_allocate(const Vector* vector);
+
+/* Element lifecycle
+ * _vec_has_lifecycle: the type sets any of the copy, move or destroy hooks.
+ * _vec_relocates_bytes: elements may be moved with memcpy/memmove. */
+bool _vec_has_lifecycle(const Vector* vector);
+bool _vec_relocates_bytes(const Vector* vector);
+
+#endif /* VECTOR_PRIVATE_H */
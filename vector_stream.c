@@ -0,0 +1,422 @@
+/* The MIT License (MIT)
+ * Copyright (c) 2016 Peter Goldsborough
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+/* For O_DIRECT */
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "vector_stream.h"
+
+/***** PRIVATE *****/
+
+size_t _vector_stream_align_up(size_t bytes)
+{
+	return (bytes + VECTOR_STREAM_ALIGNMENT - 1) &
+				 ~(size_t)(VECTOR_STREAM_ALIGNMENT - 1);
+}
+
+void _vector_stream_free(VectorStream *s)
+{
+	size_t i;
+
+	if (s->buffers != NULL) {
+		for (i = 0; i < s->options.buffer_count; ++i) free(s->buffers[i].data);
+	}
+	free(s->buffers);
+	free(s->queue);
+	free(s->free_buffers);
+	s->buffers = NULL;
+	s->queue = NULL;
+	s->free_buffers = NULL;
+	s->active = NULL;
+}
+
+/* Returns 0 or the errno of the failed write */
+int _vector_stream_write_buffer(VectorStream *s, VectorStreamBuffer *buffer)
+{
+	const unsigned char *position;
+	size_t from, to;
+	ssize_t written;
+
+	/* Direct writes cover whole aligned blocks; the padding past the end is
+	 * overwritten by the next buffer or truncated by flush */
+	if (s->options.direct) {
+		from = 0;
+		to = _vector_stream_align_up(buffer->bytes);
+	} else {
+		from = buffer->start;
+		to = buffer->bytes;
+	}
+
+	position = buffer->data + from;
+	while (from < to) {
+		written = pwrite(s->fd, position, to - from, (off_t)(buffer->offset + from));
+		if (written < 0) {
+			if (errno == EINTR) continue;
+			return errno;
+		}
+		if (written == 0) return EIO;
+		position += written;
+		from += (size_t)written;
+	}
+
+	return 0;
+}
+
+void* _vector_stream_run(void *argument)
+{
+	VectorStream *s = argument;
+	VectorStreamBuffer *buffer;
+	int error;
+
+	pthread_mutex_lock(&s->lock);
+	for (;;) {
+		while (s->queue_count == 0 && !s->closing) {
+			pthread_cond_wait(&s->filled, &s->lock);
+		}
+		if (s->queue_count == 0) break;
+
+		buffer = s->queue[s->queue_head];
+		s->queue_head = (s->queue_head + 1) % s->options.buffer_count;
+		--s->queue_count;
+		s->writing = true;
+		error = s->error;
+		pthread_mutex_unlock(&s->lock);
+
+		if (error == 0) error = _vector_stream_write_buffer(s, buffer);
+
+		pthread_mutex_lock(&s->lock);
+		s->error = error;
+		s->writing = false;
+		s->free_buffers[s->free_count++] = buffer;
+		pthread_cond_broadcast(&s->recycled);
+	}
+	pthread_mutex_unlock(&s->lock);
+
+	return NULL;
+}
+
+/* Queues the active buffer and takes a free one in its place, waiting for
+ * the writer if there is none. The part of the last block that a direct
+ * write would cut off is carried over, so the next buffer starts at an
+ * aligned offset too. */
+int _vector_stream_hand_off(VectorStream *s)
+{
+	VectorStreamBuffer *full = s->active, *next;
+	size_t carried, tail;
+	int error;
+
+	pthread_mutex_lock(&s->lock);
+	if (s->free_count == 0) {
+		++s->stalls;
+		while (s->free_count == 0) pthread_cond_wait(&s->recycled, &s->lock);
+	}
+	next = s->free_buffers[--s->free_count];
+	pthread_mutex_unlock(&s->lock);
+
+	carried = full->bytes % VECTOR_STREAM_ALIGNMENT;
+	memcpy(next->data, full->data + full->bytes - carried, carried);
+	next->start = carried;
+	next->bytes = carried;
+	next->offset = full->offset + full->bytes - carried;
+
+	pthread_mutex_lock(&s->lock);
+	tail = (s->queue_head + s->queue_count) % s->options.buffer_count;
+	s->queue[tail] = full;
+	++s->queue_count;
+	error = s->error;
+	pthread_cond_signal(&s->filled);
+	pthread_mutex_unlock(&s->lock);
+
+	s->active = next;
+
+	return error == 0 ? VECTOR_SUCCESS : VECTOR_ERROR;
+}
+
+/* Reads the unaligned end of the file into the first buffer, so that the
+ * stream starts at an aligned offset */
+int _vector_stream_load_tail(VectorStream *s, uint64_t end)
+{
+	VectorStreamBuffer *buffer = s->active;
+	ssize_t bytes;
+
+	buffer->start = buffer->bytes = end % VECTOR_STREAM_ALIGNMENT;
+	buffer->offset = end - buffer->start;
+
+	while (buffer->bytes > 0) {
+		bytes = pread(s->fd, buffer->data, buffer->bytes, (off_t)buffer->offset);
+		if (bytes < 0 && errno == EINTR) continue;
+		return bytes == (ssize_t)buffer->bytes ? VECTOR_SUCCESS : VECTOR_ERROR;
+	}
+
+	return VECTOR_SUCCESS;
+}
+
+int _vector_stream_set_direct(VectorStream *s)
+{
+#ifdef O_DIRECT
+	if (!s->options.direct) return VECTOR_SUCCESS;
+	return fcntl(s->fd, F_SETFL, s->fd_flags | O_DIRECT) == 0 ? VECTOR_SUCCESS
+																														 : VECTOR_ERROR;
+#else
+	return s->options.direct ? VECTOR_ERROR : VECTOR_SUCCESS;
+#endif
+}
+
+
+/***** METHODS *****/
+
+int vector_stream_setup(VectorStream* stream,
+                        int fd,
+                        size_t elem_size,
+                        const VectorStreamOptions* options)
+{
+	const VectorStreamOptions defaults = VECTOR_STREAM_OPTIONS_DEFAULT;
+	VectorStream *s = stream;
+	off_t end;
+	size_t i;
+
+	assert(s != NULL);
+	assert(fd >= 0);
+	assert(elem_size > 0);
+
+	if (s == NULL) return VECTOR_ERROR;
+	if (fd < 0) return VECTOR_ERROR;
+	if (elem_size == 0) return VECTOR_ERROR;
+
+	memset(s, 0, sizeof *s);
+	s->fd = fd;
+	s->elem_size = elem_size;
+	s->options = options != NULL ? *options : defaults;
+	s->options.buffer_size = _vector_stream_align_up(s->options.buffer_size);
+
+	if (s->options.buffer_count < 2) return VECTOR_ERROR;
+	if (s->options.buffer_size == 0) return VECTOR_ERROR;
+
+	s->fd_flags = fcntl(fd, F_GETFL);
+	end = lseek(fd, 0, SEEK_END);
+	if (s->fd_flags < 0 || end < 0) return VECTOR_ERROR;
+	s->origin = (uint64_t)end;
+
+	s->buffers = calloc(s->options.buffer_count, sizeof(VectorStreamBuffer));
+	s->queue = malloc(s->options.buffer_count * sizeof(VectorStreamBuffer*));
+	s->free_buffers = malloc(s->options.buffer_count * sizeof(VectorStreamBuffer*));
+	if (s->buffers == NULL || s->queue == NULL || s->free_buffers == NULL) {
+		_vector_stream_free(s);
+		return VECTOR_ERROR;
+	}
+
+	for (i = 0; i < s->options.buffer_count; ++i) {
+		if (posix_memalign((void**)&s->buffers[i].data,
+											 VECTOR_STREAM_ALIGNMENT,
+											 s->options.buffer_size) != 0) {
+			s->buffers[i].data = NULL;
+			_vector_stream_free(s);
+			return VECTOR_ERROR;
+		}
+		if (i > 0) s->free_buffers[s->free_count++] = &s->buffers[i];
+	}
+	s->active = &s->buffers[0];
+
+	/* The tail is read before O_DIRECT would require an aligned read */
+	if (_vector_stream_load_tail(s, s->origin) == VECTOR_ERROR ||
+			_vector_stream_set_direct(s) == VECTOR_ERROR) {
+		_vector_stream_free(s);
+		return VECTOR_ERROR;
+	}
+
+	pthread_mutex_init(&s->lock, NULL);
+	pthread_cond_init(&s->filled, NULL);
+	pthread_cond_init(&s->recycled, NULL);
+
+	if (pthread_create(&s->writer, NULL, _vector_stream_run, s) != 0) {
+		pthread_mutex_destroy(&s->lock);
+		pthread_cond_destroy(&s->filled);
+		pthread_cond_destroy(&s->recycled);
+		if (s->options.direct) fcntl(fd, F_SETFL, s->fd_flags);
+		_vector_stream_free(s);
+		return VECTOR_ERROR;
+	}
+
+	return VECTOR_SUCCESS;
+}
+
+int vector_stream_close(VectorStream* stream)
+{
+	int result;
+
+	assert(stream != NULL);
+	assert(stream->active != NULL);
+
+	if (stream == NULL) return VECTOR_ERROR;
+	if (stream->active == NULL) return VECTOR_ERROR;
+
+	result = vector_stream_flush(stream);
+
+	pthread_mutex_lock(&stream->lock);
+	stream->closing = true;
+	pthread_cond_signal(&stream->filled);
+	pthread_mutex_unlock(&stream->lock);
+	pthread_join(stream->writer, NULL);
+
+	pthread_mutex_destroy(&stream->lock);
+	pthread_cond_destroy(&stream->filled);
+	pthread_cond_destroy(&stream->recycled);
+
+	if (stream->options.direct) fcntl(stream->fd, F_SETFL, stream->fd_flags);
+	_vector_stream_free(stream);
+
+	return result;
+}
+
+/* Insertion */
+
+int vector_stream_push_back(VectorStream* stream, const void* element)
+{
+	VectorStreamBuffer *active;
+
+	assert(stream != NULL);
+	assert(element != NULL);
+
+	if (stream == NULL) return VECTOR_ERROR;
+	if (element == NULL) return VECTOR_ERROR;
+
+	/* Fast path: room in the active buffer with some to spare */
+	active = stream->active;
+	if (active->bytes + stream->elem_size < stream->options.buffer_size) {
+		/* A constant size lets the common 8-byte copy be a single move */
+		if (stream->elem_size == sizeof(uint64_t)) {
+			memcpy(active->data + active->bytes, element, sizeof(uint64_t));
+		} else {
+			memcpy(active->data + active->bytes, element, stream->elem_size);
+		}
+		active->bytes += stream->elem_size;
+		return VECTOR_SUCCESS;
+	}
+
+	return vector_stream_write(stream, element, 1);
+}
+
+int vector_stream_write(VectorStream* stream,
+                        const void* elements,
+                        size_t count)
+{
+	const unsigned char *position = elements;
+	VectorStreamBuffer *active;
+	size_t bytes, room;
+
+	assert(stream != NULL);
+	assert(elements != NULL || count == 0);
+
+	if (stream == NULL) return VECTOR_ERROR;
+	if (elements == NULL && count > 0) return VECTOR_ERROR;
+
+	/* Elements may straddle two buffers; the file is a byte stream */
+	bytes = count * stream->elem_size;
+	while (bytes > 0) {
+		active = stream->active;
+		room = MIN(bytes, stream->options.buffer_size - active->bytes);
+		memcpy(active->data + active->bytes, position, room);
+		active->bytes += room;
+		position += room;
+		bytes -= room;
+
+		if (active->bytes == stream->options.buffer_size &&
+				_vector_stream_hand_off(stream) == VECTOR_ERROR) {
+			return VECTOR_ERROR;
+		}
+	}
+
+	return VECTOR_SUCCESS;
+}
+
+int vector_stream_append(VectorStream* stream, const Vector* source)
+{
+	assert(stream != NULL);
+	assert(source != NULL);
+
+	if (stream == NULL) return VECTOR_ERROR;
+	if (source == NULL) return VECTOR_ERROR;
+	if (source->tc->_vec_elem_size() != stream->elem_size) return VECTOR_ERROR;
+
+	return vector_stream_write(stream,
+														 vector_const_data(source),
+														 vector_size(source));
+}
+
+int vector_stream_flush(VectorStream* stream)
+{
+	uint64_t end;
+	int error;
+
+	assert(stream != NULL);
+
+	if (stream == NULL) return VECTOR_ERROR;
+
+	if (stream->active->bytes > stream->active->start &&
+			_vector_stream_hand_off(stream) == VECTOR_ERROR) {
+		return VECTOR_ERROR;
+	}
+
+	pthread_mutex_lock(&stream->lock);
+	while (stream->queue_count > 0 || stream->writing) {
+		pthread_cond_wait(&stream->recycled, &stream->lock);
+	}
+	error = stream->error;
+	pthread_mutex_unlock(&stream->lock);
+
+	if (error != 0) return VECTOR_ERROR;
+
+	/* Cut off the padding of the last direct write */
+	end = stream->active->offset + stream->active->bytes;
+	if (stream->options.direct && ftruncate(stream->fd, (off_t)end) != 0) {
+		return VECTOR_ERROR;
+	}
+
+	return VECTOR_SUCCESS;
+}
+
+/* Information */
+
+size_t vector_stream_size(const VectorStream* stream)
+{
+	assert(stream != NULL);
+	return (size_t)(stream->active->offset + stream->active->bytes -
+									stream->origin) / stream->elem_size;
+}
+
+size_t vector_stream_stalls(VectorStream* stream)
+{
+	size_t stalls;
+
+	assert(stream != NULL);
+
+	pthread_mutex_lock(&stream->lock);
+	stalls = stream->stalls;
+	pthread_mutex_unlock(&stream->lock);
+
+	return stalls;
+}
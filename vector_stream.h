@@ -0,0 +1,150 @@
+/* The MIT License (MIT)
+ * Copyright (c) 2016 Peter Goldsborough
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#ifndef VECTOR_STREAM_H
+#define VECTOR_STREAM_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vector.h"
+
+/***** DEFINITIONS *****/
+
+/* Buffers, their sizes and every file offset written at are multiples of
+ * this, as O_DIRECT requires */
+#define VECTOR_STREAM_ALIGNMENT 4096
+
+#define VECTOR_STREAM_DEFAULT_BUFFERS 4
+#define VECTOR_STREAM_DEFAULT_BUFFER_SIZE ((size_t)1 << 20)
+
+#define VECTOR_STREAM_OPTIONS_DEFAULT \
+  { VECTOR_STREAM_DEFAULT_BUFFERS, VECTOR_STREAM_DEFAULT_BUFFER_SIZE, false }
+
+
+/***** STRUCTURES *****/
+
+typedef struct
+{
+  /* At least two: one being filled while the others are written */
+  size_t buffer_count;
+
+  /* Rounded up to a multiple of VECTOR_STREAM_ALIGNMENT */
+  size_t buffer_size;
+
+  /* Writes bypass the page cache */
+  bool direct;
+} VectorStreamOptions;
+
+/* Bytes [start, bytes) of `data` go to the file at `offset` + start. The
+ * bytes before `start` are already in the file; they are only kept so that
+ * direct writes can start at an aligned offset. */
+typedef struct
+{
+  unsigned char *data;
+  size_t start;
+  size_t bytes;
+  uint64_t offset;
+} VectorStreamBuffer;
+
+/* An append-only sink that streams elements to a file. The producer copies
+ * elements into the active buffer; a full buffer is queued for a writer
+ * thread, which writes it with a single pwrite and hands it back for reuse,
+ * while a free buffer takes its place. When every buffer is queued or being
+ * written, the producer waits for one to come back. */
+typedef struct
+{
+  int fd;
+  int fd_flags;
+  size_t elem_size;
+  VectorStreamOptions options;
+
+  /* Where the file ended at setup */
+  uint64_t origin;
+
+  VectorStreamBuffer *buffers;
+
+  /* Only touched by the producer */
+  VectorStreamBuffer *active;
+
+  /* Shared with the writer under `lock`. `filled` is signalled when a buffer
+   * is queued or the stream closes, `recycled` when a buffer is written. */
+  pthread_mutex_t lock;
+  pthread_cond_t filled;
+  pthread_cond_t recycled;
+
+  VectorStreamBuffer **queue;
+  size_t queue_head;
+  size_t queue_count;
+
+  VectorStreamBuffer **free_buffers;
+  size_t free_count;
+
+  bool writing;
+  bool closing;
+
+  /* The errno of the first failed write; later buffers are dropped */
+  int error;
+
+  /* Times the producer had to wait for a buffer */
+  size_t stalls;
+
+  pthread_t writer;
+} VectorStream;
+
+
+/***** METHODS *****/
+
+/* Constructor
+ * Appends to the end of `fd`, which must be open for reading and writing and
+ * stays owned by the caller. `options` may be NULL for the defaults. In
+ * direct mode O_DIRECT is set on `fd` until the stream is closed, and setup
+ * fails where the file system does not support it. */
+int vector_stream_setup(VectorStream* stream,
+                        int fd,
+                        size_t elem_size,
+                        const VectorStreamOptions* options);
+
+/* Destructor
+ * Flushes, stops the writer thread and frees the buffers. Returns
+ * VECTOR_ERROR if any write failed. */
+int vector_stream_close(VectorStream* stream);
+
+/* Insertion
+ * Only one thread may append to a stream at a time. These fail once a write
+ * has failed. */
+int vector_stream_push_back(VectorStream* stream, const void* element);
+int vector_stream_write(VectorStream* stream,
+                        const void* elements,
+                        size_t count);
+int vector_stream_append(VectorStream* stream, const Vector* source);
+
+/* Hands the active buffer to the writer and waits until everything appended
+ * so far is in the file. This does not fsync. */
+int vector_stream_flush(VectorStream* stream);
+
+/* Information
+ * vector_stream_size is the number of elements appended since setup. */
+size_t vector_stream_size(const VectorStream* stream);
+size_t vector_stream_stalls(VectorStream* stream);
+
+#endif /* VECTOR_STREAM_H */